@@ -0,0 +1,73 @@
+#!/usr/bin/ruby
+
+# turns the PROF lines printed by prof.exe (found in the debug console
+# log, output.log by default) into a profile symbolized against
+# geekos/kernel.syms: the hottest functions, and with -g the hottest
+# functions including callees and the hottest call stacks.
+
+$symbol = Hash.new
+$cache = Hash.new
+File.open("geekos/kernel.syms").each { |ln|
+  # 0006085c T Main
+  if ln =~ /^([0-9a-f]{8}) [tTwW] (\S+)/ then
+    $symbol[$1.hex] = $2
+  end
+}
+$addresses = $symbol.keys.sort.reverse
+
+def function(addr)
+  return $cache[addr] if $cache.has_key?(addr)
+  $cache[addr] = if found = $addresses.bsearch { |x| x <= addr } then
+                   $symbol[found]
+                 else
+                   "%x" % [ addr ]
+                 end
+end
+
+self_counts = Hash.new {|h,k| h[k] = 0 }
+inclusive = Hash.new {|h,k| h[k] = 0 }
+stacks = Hash.new {|h,k| h[k] = 0 }
+total = 0
+summary = nil
+
+File.open(ARGV.length > 0 ? ARGV[0] : "output.log").each { |ln|
+  if ln =~ /^PROF total/ then
+    summary = ln.sub(/^PROF /, "")
+  elsif ln =~ /^PROF (\d+) ([ku]) ([0-9a-f]+)((?: [0-9a-f]+)*)/ then
+    count = $1.to_i
+    frames = if $2 == "u" then
+               [ "[user]" ]
+             else
+               # a return address may be just past the end of its caller
+               [ function($3.hex) ] + $4.split.map { |a| function(a.hex - 1) }
+             end
+    total += count
+    self_counts[frames[0]] += count
+    frames.uniq.each { |f| inclusive[f] += count }
+    stacks[frames.join(" <- ")] += count if frames.length > 1
+  end
+}
+
+if total == 0 then
+  puts "no PROF samples found"
+  exit 1
+end
+
+puts "%d samples (%s)" % [ total, summary ? summary.strip : "no summary line" ]
+
+puts "\nself"
+self_counts.sort_by{ |k,v| v}.reverse[0..24].each { |k,v|
+  puts "%6d %5.1f%% %s" % [ v, 100.0 * v / total, k ]
+}
+
+unless stacks.empty?
+  puts "\nself + callees"
+  inclusive.sort_by{ |k,v| v}.reverse[0..24].each { |k,v|
+    puts "%6d %5.1f%% %s" % [ v, 100.0 * v / total, k ]
+  }
+
+  puts "\nstacks"
+  stacks.sort_by{ |k,v| v}.reverse[0..24].each { |k,v|
+    puts "%6d %s" % [ v, k ]
+  }
+end
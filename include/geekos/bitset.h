@@ -28,6 +28,41 @@ int Find_First_Free_Bit(void *bitSet, ulong_t totalBits);       /* -1 if not fou
 int Find_First_N_Free(void *bitSet, uint_t runLength, ulong_t totalBits);       /* -1 if not found */
 void Destroy_Bit_Set(void *bitSet);
 
+/*
+ * Search index for a bit set used as a free map (set = in use).
+ * hint is a position below which no bit is clear.  Each group of
+ * BITSET_GROUP_BITS bits keeps a free-extent summary: its number of
+ * clear bits, the clear runs touching its first and last bit, and
+ * its longest clear run, so a search for a run can step from group
+ * to group and only scan the words of a group that can hold it.
+ */
+#define BITSET_GROUP_WORDS 128
+#define BITSET_GROUP_BITS (BITSET_GROUP_WORDS * 32)
+
+struct Bit_Set_Group {
+    ushort_t free;
+    ushort_t head;
+    ushort_t tail;
+    ushort_t longest;
+};
+
+struct Bit_Set_Index {
+    void *bitSet;
+    ulong_t totalBits;
+    ulong_t hint;
+    ulong_t numGroups;
+    struct Bit_Set_Group *group;
+};
+
+struct Bit_Set_Index *Create_Bit_Set_Index(void *bitSet, ulong_t totalBits);
+void Destroy_Bit_Set_Index(struct Bit_Set_Index *index);
+void Index_Set_Bits(struct Bit_Set_Index *index, uint_t first, uint_t count);
+void Index_Clear_Bits(struct Bit_Set_Index *index, uint_t first,
+                      uint_t count);
+int Index_Find_First_Free(struct Bit_Set_Index *index); /* -1 if not found */
+int Index_Find_First_N_Free(struct Bit_Set_Index *index, uint_t runLength);     /* -1 if not found */
+ulong_t Index_Count_Free(struct Bit_Set_Index *index);
+
 #if 0
 struct Bit_Set {
     int size;
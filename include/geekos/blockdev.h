@@ -54,6 +54,7 @@ struct Block_Request {
     struct Block_Device *dev;
     enum Request_Type type;
     int blockNum;
+    int numBlocks;              /* contiguous blocks starting at blockNum */
     void *buf;
     volatile enum Request_State state;
     volatile int errorCode;
@@ -118,6 +119,10 @@ void Notify_Request_Completion(struct Block_Request *request,
  */
 int Block_Read(struct Block_Device *dev, int blockNum, void *buf);
 int Block_Write(struct Block_Device *dev, int blockNum, void *buf);
+int Block_Read_Multi(struct Block_Device *dev, int blockNum, int numBlocks,
+                     void *buf);
+int Block_Write_Multi(struct Block_Device *dev, int blockNum, int numBlocks,
+                      void *buf);
 int Get_Num_Blocks(struct Block_Device *dev);
 
 /*
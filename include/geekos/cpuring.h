@@ -0,0 +1,67 @@
+/*
+ * Per-CPU rings of fixed-size records, drained to user space
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#ifndef GEEKOS_CPURING_H
+#define GEEKOS_CPURING_H
+
+#include <geekos/ktypes.h>
+#include <geekos/smp.h>
+
+/*
+ * Each CPU's ring has one writer, code running on that CPU with
+ * interrupts disabled, which alone moves head; readers, serialized
+ * by the caller, alone move tail.  So neither side takes a lock, and
+ * a full ring drops new records and counts them rather than
+ * overwriting what has not been read.
+ *
+ * Rings are allocated by the first CPU_Rings_Start() and kept, since
+ * a CPU may be writing to its ring at any moment.
+ */
+struct CPU_Ring {
+    char *records;
+    volatile ulong_t head;      /* next slot to fill */
+    volatile ulong_t tail;      /* next slot to read */
+    ulong_t dropped;            /* records lost to a full ring, ever */
+    ulong_t droppedBase;        /* dropped as of the last start */
+};
+
+struct CPU_Rings {
+    struct CPU_Ring ring[MAX_CPUS];
+    volatile int count;         /* CPUs with a ring allocated */
+    ulong_t recordSize;
+    ulong_t size;               /* records per ring */
+};
+
+#define CPU_RINGS_INITIALIZER(type, size) { { { 0 } }, 0, sizeof(type), (size) }
+
+/*
+ * The slot the next record from cpu goes in, or NULL if it has no
+ * ring or its ring is full.  Finish the record with CPU_Ring_Commit().
+ */
+static __inline__ void *CPU_Ring_Reserve(struct CPU_Rings *rings, int cpu) {
+    struct CPU_Ring *ring = &rings->ring[cpu];
+
+    if(cpu >= rings->count)
+        return 0;
+    if(ring->head - ring->tail >= rings->size) {
+        ++ring->dropped;
+        return 0;
+    }
+    return ring->records + (ring->head % rings->size) * rings->recordSize;
+}
+
+static __inline__ void CPU_Ring_Commit(struct CPU_Rings *rings, int cpu) {
+    /* publish the record before the reader can see it */
+    __sync_synchronize();
+    ++rings->ring[cpu].head;
+}
+
+int CPU_Rings_Start(struct CPU_Rings *rings);
+int CPU_Rings_Dropped(struct CPU_Rings *rings);
+int CPU_Rings_Read(struct CPU_Rings *rings, ulong_t userBuffer, int max);
+
+#endif /* GEEKOS_CPURING_H */
@@ -0,0 +1,61 @@
+/*
+ * Epoch counting for lock-free readers of linked structures
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#ifndef GEEKOS_EPOCH_H
+#define GEEKOS_EPOCH_H
+
+#include <geekos/ktypes.h>
+
+/*
+ * Readers count themselves, for as long as they may hold a pointer
+ * into the structure, in one of two counters picked by the epoch.  A
+ * writer that has unlinked something flips the epoch; once the
+ * counter of the epoch before the flip drains, no reader can still
+ * see what was unlinked, and it may be freed or reused.  Readers
+ * must not block between Epoch_Read_Begin() and Epoch_Read_End().
+ */
+struct Epoch {
+    volatile int epoch;
+    volatile int readers[2];
+};
+
+#define EPOCH_INITIALIZER { 0, { 0, 0 } }
+
+/* returns the counter to pass to Epoch_Read_End() */
+static __inline__ int Epoch_Read_Begin(struct Epoch *e) {
+    int epoch;
+
+    for(;;) {
+        epoch = e->epoch & 1;
+        __sync_fetch_and_add(&e->readers[epoch], 1);
+        if((e->epoch & 1) == epoch)
+            return epoch;
+        __sync_fetch_and_sub(&e->readers[epoch], 1);
+    }
+}
+
+static __inline__ void Epoch_Read_End(struct Epoch *e, int epoch) {
+    __sync_fetch_and_sub(&e->readers[epoch], 1);
+}
+
+/*
+ * Start a new epoch; returns the old one, whose readers may still see
+ * anything unlinked before the call.  Writers serialize their flips.
+ */
+static __inline__ int Epoch_Flip(struct Epoch *e) {
+    int epoch = e->epoch & 1;
+
+    __sync_fetch_and_add(&e->epoch, 1);
+    return epoch;
+}
+
+/* true once no reader of an epoch returned by Epoch_Flip() is left */
+static __inline__ bool Epoch_Drained(struct Epoch *e, int epoch) {
+    return e->readers[epoch] == 0;
+}
+
+#endif /* GEEKOS_EPOCH_H */
@@ -0,0 +1,23 @@
+/*
+ * Futexes: sleeping and waking keyed by a user address
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#ifndef GEEKOS_FUTEX_H
+#define GEEKOS_FUTEX_H
+
+/* Sys_Futex operations */
+#define FUTEX_WAIT 0            /* sleep if the word still holds the value */
+#define FUTEX_WAKE 1            /* wake up to count threads sleeping on the word */
+
+#ifdef GEEKOS
+
+struct Interrupt_State;
+
+int Sys_Futex(struct Interrupt_State *state);
+
+#endif /* GEEKOS */
+
+#endif /* GEEKOS_FUTEX_H */
@@ -126,12 +126,15 @@ typedef ushort_t Keycode;
 
 #ifdef GEEKOS
 
+struct Poll_Entry;
+
 /*
  * Public functions
  */
 void Init_Keyboard(void);
 bool Read_Key(Keycode * keycode);
 Keycode Wait_For_Key(void);
+int Keyboard_Poll(struct Poll_Entry *entry);
 
 #endif /* GEEKOS */
 
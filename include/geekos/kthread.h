@@ -42,6 +42,23 @@ DEFINE_LIST(All_Thread_List, Kernel_Thread);
 
 #define AFFINITY_ANY_CORE	-1
 
+/*
+ * Per-thread accounting reported by Sys_PS.  Only the CPU running
+ * the thread updates these, so they need no lock.
+ */
+struct Thread_Stats {
+    ulong_t userTicks;          /* timer ticks that interrupted user mode */
+    ulong_t kernelTicks;        /* ... and kernel mode */
+    ulong_t switches;           /* times another thread took the CPU */
+    ulong_t voluntarySwitches;  /* ... of which because this one blocked or yielded */
+    ulong_t syscalls;
+    ulong_t pageFaults;
+    ulong_t blockReads;         /* blocks read through block requests */
+    ulong_t blockWrites;        /* ... and written */
+    int lastCore;               /* CPU it last ran on */
+    bool inSyscall;
+};
+
 /*
  * Kernel thread context data structure.
  * NOTE: there is assembly code in lowlevel.asm that depends
@@ -79,6 +96,10 @@ struct Kernel_Thread {
 
     char threadName[20];
 
+    struct Thread_Stats stats;
+
+    /* Next thread in the same pid hash chain. */
+    struct Kernel_Thread *pidHashNext;
 };
 
 #ifdef GEEKOS
@@ -131,15 +152,22 @@ struct Kernel_Thread *Start_Kernel_Thread(Thread_Start_Func startFunc,
                                           const char *name);
 struct Kernel_Thread *Start_User_Thread(struct User_Context *userContext,
                                         bool detached);
+struct Kernel_Thread *Clone_User_Thread(ulong_t entryAddr,
+                                        ulong_t stackPointer);
 void Make_Runnable(struct Kernel_Thread *kthread);
 void Make_Runnable_Atomic(struct Kernel_Thread *kthread);
 int Is_Thread_On_Run_Queue(const struct Kernel_Thread *thread);
 struct Kernel_Thread *Get_Current(void);
 struct Kernel_Thread *Get_Next_Runnable(void);
 void Schedule(void);
+bool Can_Switch_To_Woken(const struct Kernel_Thread *kthread);
+void Switch_To_Woken_And_Unlock(struct Kernel_Thread *kthread,
+                                Spin_Lock_t * unlock_me);
+void Finish_Switch(void);
 void Yield(void);
 void Exit(int exitCode) __attribute__ ((noreturn));
 int Join(struct Kernel_Thread *kthread);
+void Detach_Thread(struct Kernel_Thread *kthread);
 struct Kernel_Thread *Lookup_Thread(int pid,
                                     int
                                     return_a_thread_even_if_not_my_child);
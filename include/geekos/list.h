@@ -181,6 +181,17 @@ static __inline__ void Locked_Remove_From_##LType(struct LType *listPtr, struct
 	listPtr->tail = nodePtr->prev##LType;							\
     nodePtr->in##LType = (void *)0;                                  \
 }												\
+static __inline__ void Locked_Unchecked_Remove_From_##LType(struct LType *listPtr, struct NType *nodePtr) {	\
+    if (nodePtr->prev##LType != 0)								\
+	nodePtr->prev##LType->next##LType = nodePtr->next##LType;				\
+    else											\
+	listPtr->head = nodePtr->next##LType;							\
+    if (nodePtr->next##LType != 0)								\
+	nodePtr->next##LType->prev##LType = nodePtr->prev##LType;				\
+    else											\
+	listPtr->tail = nodePtr->prev##LType;							\
+    nodePtr->in##LType = (void *)0;                                  \
+}												\
 static __inline__ void Remove_From_##LType(struct LType *listPtr, struct NType *nodePtr) {	\
     Lock_List(&listPtr->lock);										\
     Locked_Remove_From_##LType(listPtr, nodePtr);        \
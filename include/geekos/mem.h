@@ -36,6 +36,7 @@ struct Boot_Info;
 #define PAGE_HEAP      0x0010   /* page is in kernel heap */
 #define PAGE_PAGEABLE  0x0020   /* page can be paged out */
 #define PAGE_LOCKED    0x0040   /* page is taken should not be freed */
+#define PAGE_ZEROED    0x0080   /* free page is known to contain only zeroes */
 
 /*
  * PC memory map
@@ -79,8 +80,11 @@ IMPLEMENT_LIST(Page_List, Page);
 void Init_Mem(struct Boot_Info *bootInfo);
 void Init_BSS(void);
 void *Alloc_Page(void);
+void *Alloc_Pages(unsigned int numPages);
 void *Alloc_Pageable_Page(pte_t * entry, ulong_t vaddr);
 void Free_Page(void *pageAddr);
+void Free_Pages(void *pageAddr, unsigned int numPages);
+bool Idle_Zero_Free_Page(void);
 
 /* debugging support */
 void Print_Struct_Page(const struct Page *p);
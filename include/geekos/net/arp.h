@@ -36,6 +36,17 @@
 typedef uchar_t ARP_Protocol_Address[ARP_PROT_ADDR_SIZE];
 typedef uchar_t ARP_Hardware_Address[ARP_HWARE_ADDR_SIZE];
 
+/* number of hash chains in the ARP cache */
+#define ARP_HASH_BUCKETS 64
+
+/* frames held per address while its request is outstanding */
+#define ARP_MAX_QUEUED 8
+
+/* states of an ARP cache entry */
+#define ARP_ENTRY_PENDING 0     /* request sent, no reply yet */
+#define ARP_ENTRY_RESOLVED 1
+#define ARP_ENTRY_FAILED 2      /* timed out; being torn down */
+
 struct ARP_Table_Element;
 
 DEFINE_LIST(ARP_Table, ARP_Table_Element);
@@ -45,7 +56,19 @@ struct ARP_Table_Element {
     ushort_t ptype;
     uchar_t hardwareAddress[ARP_HWARE_ADDR_SIZE];
     uchar_t protocolAddress[ARP_PROT_ADDR_SIZE];
-    ulong_t insertTime;
+    ulong_t insertTime;         /* ticks at resolution, or first request */
+    ulong_t requestTime;        /* ticks at the latest request */
+
+    int state;
+    struct Net_Device *device;  /* where requests for it go out */
+
+    /* frames waiting for the address, sent when it resolves */
+    struct Packet_Queue queued;
+    ulong_t queuedCount;
+
+    /* threads blocked in ARP_Resolve_Address for this entry */
+    struct Condition resolved;
+    int waiters;
 
      DEFINE_LINK(ARP_Table, ARP_Table_Element);
 };
@@ -91,6 +114,11 @@ extern int ARP_Resolve_Address(struct Net_Device *,
                                ARP_Protocol_Address protocolAddress,
                                ARP_Hardware_Address hardwareAddress);
 
+/* Send nBuf to protocolAddress once it resolves; takes ownership */
+extern int ARP_Output(struct Net_Device *, ushort_t ptype,
+                      ARP_Protocol_Address protocolAddress,
+                      struct Net_Buf *nBuf);
+
 extern void Init_ARP_Protocol(void);
 
 #endif
@@ -0,0 +1,25 @@
+/*
+ * Internet checksum (RFC 1071)
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#ifndef GEEKOS_NET_CHECKSUM_H
+#define GEEKOS_NET_CHECKSUM_H
+
+#include <geekos/ktypes.h>
+
+/*
+ * A partial sum is the one's complement sum of big-endian 16 bit
+ * words, not yet folded; chain them by passing one call's result to
+ * the next, starting from 0.  A piece of odd length is padded with a
+ * zero byte, so only the last piece may be odd; Net_Buf_Checksum()
+ * handles chains of odd pieces itself.
+ */
+ulong_t Checksum_Partial(ulong_t sum, const void *data, ulong_t length);
+
+/* the checksum of a partial sum, in host order; 0 over data that checks out */
+ushort_t Checksum_Fold(ulong_t sum);
+
+#endif /* GEEKOS_NET_CHECKSUM_H */
@@ -19,6 +19,24 @@
 
 #define IP_UDP_PROTOCOL 17
 
+#define IP_VERSION 4
+#define IP_HEADER_SIZE 20U     /* without options */
+#define IP_MAX_HEADER_SIZE 60U
+#define IP_MAX_LENGTH 65535U   /* largest datagram, header included */
+#define IP_MTU 1500U           /* the ethernet payload */
+#define IP_DEFAULT_TTL 64
+
+/* frag_off, in host order */
+#define IP_FLAG_DF 0x4000       /* don't fragment */
+#define IP_FLAG_MF 0x2000       /* more fragments follow */
+#define IP_OFFSET_MASK 0x1fff   /* offset of the fragment, in 8-byte units */
+
+/* reassembly */
+#define IP_REASSEMBLY_HASH_BITS 6
+#define IP_MAX_REASSEMBLIES 64  /* datagrams being put back together at once */
+#define IP_REASSEMBLY_TIMEOUT_MS 15000
+#define IP_REASSEMBLY_SWEEP_MS 1000
+
 // extern IP_Address * INADDR_ANY;
 // extern IP_Address * INADDR_BROADCAST;
 
@@ -62,6 +80,7 @@ struct IP_Device {
 IMPLEMENT_LIST(IP_Device_List, IP_Device);
 
 extern int IP_Dispatch(struct Net_Device *, struct Net_Buf *);
+/* send nBuf, fragmenting it to fit the MTU; takes ownership of nBuf */
 extern int IP_Transmit(IP_Address * src, IP_Address * destination,
                        struct Net_Buf *, uchar_t tos, ushort_t protocol);
 
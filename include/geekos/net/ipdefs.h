@@ -51,7 +51,9 @@ struct IP_Device_Info {
     ulong_t txPacketErrors;
     ulong_t rxBytes;
     ulong_t txBytes;
-
+    ulong_t rxDropped;
+    ulong_t rxPacketRate;       /* per second */
+    ulong_t rxInterruptRate;
 
     ulong_t ioport;
     uchar_t interrupt;
@@ -203,6 +203,11 @@
 #define NE2K_TB_START      0x40
 #define NE2K_TB_STOP       0x52
 #define NE2K_RB_START      0x52
+
+/* the transmit area is split into two slots of a full frame each */
+#define NE2K_TX_SLOTS      2
+#define NE2K_TX_SLOT_PAGES 6
+#define NE2K_TX_SLOT_PAGE(slot) (NE2K_TB_START + (slot) * NE2K_TX_SLOT_PAGES)
 #define NE2K_RB_STOP       0x92
 
 #define NE2K_IO_PORT       NE2K_OFFSET_ADDR(0x10)
@@ -212,8 +217,8 @@ extern struct Net_Device_Capabilities g_ne2000Capabilities;
 
 /* Public Functions*/
 extern int Init_NE2000(struct Net_Device *device);
-extern void NE2000_Transmit(struct Net_Device *device, void *buffer,
-                            ulong_t length);
+extern int NE2000_Transmit(struct Net_Device *device, void *buffer,
+                           ulong_t length);
 extern void NE2000_Receive(struct Net_Device *device, void *buffer,
                            ulong_t length, ulong_t pageOffset);
 extern void NE2000_Reset(struct Net_Device *device);
@@ -226,5 +231,8 @@ extern void NE2000_Transmit_Thread(struct Net_Device *device);
 extern void NE2000_Complete_Receive(struct Net_Device *device,
                                     struct Net_Device_Header *hdr);
 void NE2000_Handle_Ring_Buffer_Overflow(struct Net_Device *device);
+extern int NE2000_Poll(struct Net_Device *device, int budget);
+extern void NE2000_Receive_Interrupt(struct Net_Device *device,
+                                     bool enable);
 
 #endif
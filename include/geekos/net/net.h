@@ -13,6 +13,18 @@
 #define NET_NAME_SIZE              32
 #define MAX_DEV_ADDR               32
 
+/* receive buffers kept ready per device, and the size of each: a
+   full ethernet frame (1514) plus CRC, rounded up */
+#define NET_RX_POOL_SIZE           32
+#define NET_RX_BUF_SIZE            1536
+
+/* most frames a receive thread takes off the ring per pass */
+#define NET_RX_BUDGET              16
+
+/* frames held for transmit while the device is busy, before senders
+   block */
+#define NET_TX_QUEUE_MAX           64
+
 #include <geekos/synch.h>
 #include <geekos/list.h>
 #include <geekos/defs.h>
@@ -26,6 +38,9 @@ struct Net_Device_Receive_State;
 
 #define ntohs(x) ((((x) >> 8) & 0xff) | (((x) & 0xff) << 8))
 #define htons(x) ((((x) >> 8) & 0xff) | (((x) & 0xff) << 8))
+#define ntohl(x) ((((x) >> 24) & 0xff) | (((x) >> 8) & 0xff00) | \
+                  (((x) & 0xff00) << 8) | (((x) & 0xff) << 24))
+#define htonl(x) ntohl(x)
 
 #ifdef GEEKOS
 
@@ -34,22 +49,6 @@ struct Net_Device_Receive_State;
  */
 DEFINE_LIST(Net_Device_List, Net_Device);
 
-/*
- * Queue of device receive states
- */
-DEFINE_LIST(Net_Device_Receive_Packet_Queue, Net_Device_Packet);
-
-DEFINE_LIST(Net_Device_Packet_Queue, Net_Device_Packet);
-
-struct Net_Device_Packet {
-    void *buffer;
-    unsigned int bufferLen;
-    struct Net_Device *device;
-
-     DEFINE_LINK(Net_Device_Receive_Packet_Queue, Net_Device_Packet);
-     DEFINE_LINK(Net_Device_Packet_Queue, Net_Device_Packet);
-};
-
 struct Net_Device_Header {
     uchar_t status;
     uchar_t next;
@@ -78,6 +77,13 @@ struct Net_Device {
     ulong_t status;
     ulong_t flags;
 
+    /*
+     * Guards the card's registers, the queues and scheduling flags
+     * below, and the driver's own state, against the interrupt handler
+     * on another CPU.  Only taken with interrupts disabled.
+     */
+    Spin_Lock_t lock;
+
     /* Error tracking */
     ulong_t rxPacketErrors;
     ulong_t txPacketErrors;
@@ -85,16 +91,63 @@ struct Net_Device {
     ulong_t txPackets;
     ulong_t rxBytes;
     ulong_t txBytes;
+    ulong_t rxDropped;          /* frames lost to an empty receive pool */
+    ulong_t rxInterrupts;
+
+    /* packets and receive interrupts per second, over the last second
+       or so the receive thread ran */
+    ulong_t rxPacketRate;
+    ulong_t rxInterruptRate;
+    ulong_t rateStart;
+    ulong_t rateRxPackets;
+    ulong_t rateRxInterrupts;
+
+    /*
+     * Receive buffers.  The interrupt handler takes a linear Net_Buf
+     * from rxPool, reads the frame into it and queues it on rxQueue;
+     * the receive thread dispatches it and tops the pool back up, so
+     * nothing is allocated in interrupt context.  Both queues are
+     * protected by lock.
+     */
+    struct Packet_Queue rxPool;
+    ulong_t rxPoolCount;
+    struct Packet_Queue rxQueue;
+
+    /*
+     * Polled receive.  On a receive interrupt the driver masks it and
+     * calls Net_Device_Schedule_Receive; the device's thread
+     * then polls up to NET_RX_BUDGET frames per pass, and unmasks the
+     * interrupt once the ring is empty.
+     */
+    bool rxScheduled;
+    struct Thread_Queue workWaitQueue;  /* the device thread sleeps here */
+
+    /*
+     * Transmit queue.  Frames go straight to the device while it has
+     * room; otherwise a copy waits here.  The driver calls
+     * Net_Device_Transmit_Complete as frames finish, and the device
+     * thread (or the next sender) feeds it from the queue.  Senders
+     * block on txWaitQueue while NET_TX_QUEUE_MAX frames are waiting.
+     * All of it is protected by lock.
+     */
+    struct Packet_Queue txQueue;
+    ulong_t txQueueLength;
+    bool txScheduled;
+    struct Thread_Queue txWaitQueue;
+
+    void *driverData;           /* the driver's private state */
 
     /* Device function pointers */
     int (*init) (struct Net_Device *);
-    void (*transmit) (struct Net_Device *, void *, ulong_t);
+    int (*transmit) (struct Net_Device *, void *, ulong_t);
     void (*receive) (struct Net_Device *, void *, ulong_t, ulong_t);
     void (*reset) (struct Net_Device *);
     void (*getHeader) (struct Net_Device *, struct Net_Device_Header *,
                        ulong_t);
     void (*completeReceive) (struct Net_Device *,
                              struct Net_Device_Header *);
+    int (*poll) (struct Net_Device *, int budget);
+    void (*receiveInterrupt) (struct Net_Device *, bool enable);
 
     /* Links for management in lists */
      DEFINE_LINK(Net_Device_List, Net_Device);
@@ -104,13 +157,15 @@ struct Net_Device {
 struct Net_Device_Capabilities {
     const char *name;
     int (*init) (struct Net_Device *);
-    void (*transmit) (struct Net_Device *, void *, ulong_t);
+    int (*transmit) (struct Net_Device *, void *, ulong_t);
     void (*receive) (struct Net_Device *, void *, ulong_t, ulong_t);
     void (*reset) (struct Net_Device *);
     void (*getHeader) (struct Net_Device *, struct Net_Device_Header *,
                        ulong_t);
     void (*completeReceive) (struct Net_Device *,
                              struct Net_Device_Header *);
+    int (*poll) (struct Net_Device *, int budget);
+    void (*receiveInterrupt) (struct Net_Device *, bool enable);
 };
 
 /*
@@ -118,13 +173,6 @@ struct Net_Device_Capabilities {
  */
 IMPLEMENT_LIST(Net_Device_List, Net_Device);
 
-/*
- * Network device receive packet queue
- */
-IMPLEMENT_LIST(Net_Device_Receive_Packet_Queue, Net_Device_Packet);
-
-IMPLEMENT_LIST(Net_Device_Packet_Queue, Net_Device_Packet);
-
 /* Public functions */
 int Register_Net_Device(struct Net_Device_Capabilities *, ulong_t,
                         ulong_t, const char *nameBase);
@@ -135,6 +183,9 @@ struct Net_Device_List *Get_Net_Device_List(void);
 int Get_Net_Device_By_IRQ(unsigned int irq, /*@out@ */
                           struct Net_Device **device);
 int Net_Device_Receive(struct Net_Device *, ushort_t ringBufferPage);
+void Net_Device_Schedule_Receive(struct Net_Device *);
+int Net_Device_Transmit(struct Net_Device *, void *buffer, ulong_t length);
+void Net_Device_Transmit_Complete(struct Net_Device *);
 int Get_Free_Net_Device(struct Net_Device **device);
 void Init_Network_Devices();
 
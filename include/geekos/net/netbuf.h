@@ -18,7 +18,12 @@
 #define NET_BUF_ALLOC_LEND 0x1
 #define NET_BUF_ALLOC_COPY 0x2
 
+/* room reserved in front of a linear buffer for the headers pushed on
+   the way down the stack (ethernet 14, IP 60, TCP 60, rounded up) */
+#define NET_BUF_HEADROOM 160
+
 struct Message_Buffer;
+struct Net_Buf;
 
 DEFINE_LIST(Message_Buffer_List, Message_Buffer);
 
@@ -26,17 +31,27 @@ struct Message_Buffer {
     unsigned int length;
     void *buffer;
      DEFINE_LINK(Message_Buffer_List, Message_Buffer);
+    struct Net_Buf *owner;      /* destroyed along with this entry, if set */
     uchar_t mustFree:1;
     uchar_t valid:1;
 };
 
-struct Net_Buf;
-
 DEFINE_LIST(Packet_Queue, Net_Buf);
 
 struct Net_Buf {
     ulong_t length;             /* sum of the length of the buffers */
     struct Message_Buffer_List buffers;
+
+    /*
+     * Linear storage, allocated along with the Net_Buf by
+     * Net_Buf_Create_Linear.  While the buffer list is empty the
+     * packet is the length bytes at data; head..data is headroom and
+     * data+length..end is tailroom.  Once an operation needs the
+     * buffer list, the linear bytes become its first (lent) entry.
+     */
+    uchar_t *head;
+    uchar_t *data;
+    uchar_t *end;
      DEFINE_LINK(Packet_Queue, Net_Buf);
 
 #ifndef NDEBUG
@@ -53,8 +68,21 @@ IMPLEMENT_LIST(Packet_Queue, Net_Buf);
 
 #define NET_BUF_SIZE(net_buf) (net_buf->length)
 
+/* true while all of the data is contiguous at (net_buf)->data */
+#define NET_BUF_IS_LINEAR(net_buf) \
+    ((net_buf)->head != 0 && Is_Message_Buffer_List_Empty(&(net_buf)->buffers))
+
 /* Creation */
 int Net_Buf_Create(struct Net_Buf **);
+int Net_Buf_Create_Linear(struct Net_Buf **, ulong_t headroom,
+                          ulong_t size);
+
+/* grow a linear buffer in place; NULL if it has no room or isn't linear */
+void *Net_Buf_Push(struct Net_Buf *, ulong_t);
+void *Net_Buf_Put(struct Net_Buf *, ulong_t);
+
+/* the contiguous data of a linear buffer, NULL otherwise */
+void *Net_Buf_Data(struct Net_Buf *);
 
 /* Deletion */
 int Net_Buf_Destroy(struct Net_Buf *);
@@ -63,10 +91,18 @@ int Net_Buf_Destroy(struct Net_Buf *);
 int Net_Buf_Prepend(struct Net_Buf *, void *, ulong_t, uchar_t);
 int Net_Buf_Append(struct Net_Buf *, void *, ulong_t, uchar_t);
 
+/* move all of the second buffer's data onto the end of the first,
+   without copying; takes ownership of the second */
+int Net_Buf_Concatenate(struct Net_Buf *, struct Net_Buf *);
+
 /* Extract data from the net buffer */
 int Net_Buf_Extract(struct Net_Buf *, ulong_t start, void *dest, ulong_t);
 int Net_Buf_Extract_All(struct Net_Buf *, void *dest);
 
+/* add a range to a partial internet checksum (see checksum.h) in place */
+int Net_Buf_Checksum(struct Net_Buf *, ulong_t start, ulong_t size,
+                     ulong_t * sum);
+
 /* Remove data from the net buffer */
 int Net_Buf_Remove(struct Net_Buf *, ulong_t start, ulong_t length);
 int Net_Buf_Remove_All(struct Net_Buf *);
@@ -17,6 +17,7 @@
 #include <geekos/kthread.h>
 #include <geekos/synch.h>
 #include <geekos/list.h>
+#include <geekos/poll.h>
 
 #define SOCK_DGRAM 0
 #define SOCK_STREAM 1
@@ -26,7 +27,20 @@
 // U for unsigned
 #define SOCK_BUFFER_SIZE 4096U
 
-#define MSS 1024U
+/*
+ * TCP send and receive buffer sizes, chosen per socket at creation.
+ * Sizes are rounded up to a power of two; the receive side can't
+ * usefully exceed the largest unscaled window.
+ */
+#define SOCK_DEFAULT_BUFFER_SIZE 16384U
+#define SOCK_MIN_BUFFER_SIZE 2048U
+#define SOCK_MAX_BUFFER_SIZE 65536U
+
+/* largest segment payload on ethernet: 1500 less the IP and TCP headers */
+#define MSS 1460U
+
+/* out-of-order ranges a receiver holds on to */
+#define TCP_MAX_OOO_RANGES 4
 
 // Socket States
 enum {
@@ -59,6 +73,10 @@ struct Socket {
     bool multihomed;
     bool bound;
     bool initialzed;
+    struct Socket *hashNext;    // demultiplexing chain
+    struct Socket *retiredNext; // waiting to be freed
+    int hashed;                 // which demultiplexing table, if any
+    volatile int refCount;      // system calls using it; see Get_Socket
 };
 
 struct TCP_Connection {
@@ -67,6 +85,13 @@ struct TCP_Connection {
     ulong_t sequenceNumber;
     ushort_t targetPort;
     IP_Address targetAddress;
+    ulong_t mss;
+};
+
+/* a run of received sequence space past a hole */
+struct TCP_Range {
+    ulong_t start;
+    ulong_t end;
 };
 
 struct TCP_Socket {
@@ -81,43 +106,70 @@ struct TCP_Socket {
     bool multihomed;
     bool bound;
     bool initialzed;
+    struct Socket *hashNext;    // demultiplexing chain
+    struct Socket *retiredNext; // waiting to be freed
+    int hashed;                 // which demultiplexing table, if any
+
+    /*
+     * Everything below is protected by lock.  The send and receive
+     * buffers are rings indexed by sequence number modulo their size.
+     */
+    struct Mutex lock;
+    bool closed;                /* the user is done with it */
+    int error;                  /* why the connection failed */
+    ulong_t mss;                /* largest segment the peer takes */
+
+    // Transmit: sequence numbers of the first unacknowledged byte,
+    // the next byte to send, the highest byte ever sent and the end
+    // of the data written so far
+    ulong_t initialSendSeq;
+    ulong_t sendUnacked;
+    ulong_t sendNext;
+    ulong_t sendMax;
+    ulong_t sendWritten;
+    ulong_t advertisedWindow;   // peer's window
+    ulong_t congestionWindow;
+    ulong_t slowStartThreshold;
+    ulong_t recoverySeq;        // fast recovery ends once this is acked
+    bool fastRecovery;
+    int dupAcks;
+    bool finQueued;
+    bool finSent;
+
+    ulong_t sendTimer;          // retransmit deadline in ticks, 0 if idle
+    int retries;
+    int rto;                    // retransmit timeout, ms
+    int smoothedRtt;            // ms, scaled by 8
+    int rttVariance;            // ms, scaled by 4
+    bool timingRtt;
+    ulong_t rttSeq;
+    ulong_t rttStart;
 
-    ulong_t advertisedWindow;
-
-    // Transmit
-    ulong_t lastByteAckedPtr;   // Buffer ptr
-    ulong_t lastByteSentPtr;    // Buffer ptr
-    ulong_t lastByteWrittenPtr; // Buffer ptr
-
-    ulong_t lastByteAcked;      // Sequence number
-    ulong_t lastByteSent;       // Sequence number
-    ulong_t lastByteWritten;    // Sequence number
-
-    int sendTimer;
     ulong_t maxSendBuffer;
-    uchar_t sendBuffer[SOCK_BUFFER_SIZE];
-    struct Mutex sendMutex;
+    uchar_t *sendBuffer;
     struct Condition sendCond;
 
-    // Close mutex and semaphore
-    struct Mutex closeMutex;
+    // Close
+    ulong_t closeTimer;         // TIME_WAIT deadline in ticks
     struct Condition closeCond;
 
-    // Receive Buffer
-    ulong_t lastByteReadPtr;    // Buffer ptr
-    ulong_t nextByteExpectedPtr;        // Buffer ptr
-    ulong_t lastByteRcvdPtr;    // Buffer ptr
+    // Receive: the next byte the user reads and the next byte expected
+    ulong_t initialReceiveSeq;
+    ulong_t receiveRead;
+    ulong_t receiveNext;
+    ulong_t receiveAdvertised;  // right edge of the window we last sent
+    bool finReceived;
+    struct TCP_Range outOfOrder[TCP_MAX_OOO_RANGES];
+    int outOfOrderCount;
+
+    int ackPending;             // segments received but not acknowledged
+    ulong_t ackTimer;           // delayed ACK deadline in ticks
 
-    ulong_t lastByteRead;       // Sequence number
-    ulong_t nextByteExpected;   // Sequence number
-    ulong_t lastByteRcvd;       // Sequence number
     ulong_t maxReceiveBuffer;
-    uchar_t receiveBuffer[SOCK_BUFFER_SIZE];
-    struct Mutex receiveMutex;
+    uchar_t *receiveBuffer;
     struct Condition receiveCond;
 
     // Support for listening
-    struct Mutex listenMutex;
     struct Condition listenCond;
     ulong_t backlogMaxSize;
     ulong_t backlogIndex;
@@ -126,7 +178,7 @@ struct TCP_Socket {
     bool listening;
     bool backlogOverflow;
 
-
+    struct Poll_Queue pollQueue;        // threads in Poll() on this socket
 };
 
 struct UDP_Packet_Data;
@@ -145,6 +197,9 @@ struct UDP_Socket {
     bool multihomed;
     bool bound;
     bool initialzed;
+    struct Socket *hashNext;    // demultiplexing chain
+    struct Socket *retiredNext; // waiting to be freed
+    int hashed;                 // which demultiplexing table, if any
 
     ulong_t bufferSize;
     uchar_t receiveBuffer[SOCK_BUFFER_SIZE];
@@ -157,14 +212,19 @@ struct UDP_Socket {
 /*
  * Socket Interface
  * Create - Create a socket with the specified type and return the socket id
+ * 	TCP sockets get send and receive buffers of the given sizes (0 for
+ * 	the default).
  * Get - Get's the id of a socket that uses the associated bindings.
  * Bind - Bind a socket to a local interface (specified by IP) and port. If
  * 	the interface is NULL, listen on all interfaces.
  * Send - Send data out on a socket
  * Receive - Receive data from a socket
+ * Poll - Report whether Receive/Accept or Send would block, registering
+ * 	a Poll_Entry so the next change wakes the poller.
  */
 
-int Socket_Create(uchar_t type, int flags);
+int Socket_Create(uchar_t type, int flags, ulong_t sendBufferSize,
+                  ulong_t receiveBufferSize);
 int Socket_Connect(ulong_t id, ushort_t port, IP_Address * ipAddress);
 int Socket_Accept(ulong_t id, IP_Address * clientIpAddress,
                   ushort_t * clientPort);
@@ -178,6 +238,7 @@ int Socket_Receive_From(ulong_t id, uchar_t * buffer, ulong_t bufferSize,
                         ushort_t * port, IP_Address * ipAddress);
 int Socket_Close(ulong_t id);
 int Socket_Destroy(ulong_t id);
+int Socket_Poll(ulong_t id, struct Poll_Entry *entry);
 
 int Socket_Dispatch(struct IP_Device *device, uchar_t type,
                     ushort_t destPort, ushort_t srcPort,
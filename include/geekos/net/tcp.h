@@ -17,14 +17,29 @@
 
 #define IP_TCP_PROTOCOL 6
 
-#define TCP_CWR 		1
-#define TCP_ECE			2
-#define TCP_URG			4
-#define TCP_ACK			8
-#define TCP_PSH			16
-#define TCP_RST			32
-#define TCP_SYN			64
-#define TCP_FIN			128
+/* flag bits as they appear in byte 13 of the header */
+#define TCP_CWR 		128
+#define TCP_ECE			64
+#define TCP_URG			32
+#define TCP_ACK			16
+#define TCP_PSH			8
+#define TCP_RST			4
+#define TCP_SYN			2
+#define TCP_FIN			1
+
+#define TCP_HEADER_SIZE 20
+#define TCP_OPTION_MSS 2
+#define TCP_MAX_WINDOW 65535U
+
+/* all times in milliseconds */
+#define TCP_TIMER_MS 20         /* how often socket timers are checked */
+#define TCP_DELAYED_ACK_MS 100  /* longest an ACK is held back */
+#define TCP_RTO_INITIAL_MS 1000
+#define TCP_RTO_MIN_MS 200
+#define TCP_RTO_MAX_MS 60000
+#define TCP_TIME_WAIT_MS 2000
+#define TCP_MAX_RETRIES 8
+#define TCP_DUP_ACK_THRESHOLD 3
 
 struct TCP_Header {
     ulong_t srcPort:16;
@@ -46,6 +61,22 @@ struct TCP_Header {
     ulong_t urgentPointer:16;
 };
 
+/* a received segment; the payload is the whole of nBuf */
+struct TCP_Segment {
+    ushort_t srcPort;
+    ushort_t destPort;
+    ulong_t seqNum;
+    ulong_t ackNum;
+    uchar_t flags;
+    ulong_t window;
+    ulong_t mss;                /* from the MSS option, 0 without one */
+    ulong_t length;
+    struct Net_Buf *nBuf;
+};
+
+struct TCP_Socket;
+struct TCP_Connection;
+
 // Types of TCP Transmissions
 extern int TCP_Transmit(IP_Address * srcAddress, IP_Address * destAddress,
                         ushort_t srcPort, ushort_t destPort,
@@ -56,5 +87,27 @@ extern int TCP_Dispatch(struct IP_Device *device,
                         IP_Address * destAddress, IP_Address * srcAddress,
                         struct Net_Buf *nBuf);
 
+/*
+ * Connection side of the sockets; all of these expect the socket's
+ * lock to be held, and may wait on it.
+ */
+extern int TCP_Socket_Init(struct TCP_Socket *sock, ulong_t sendBufferSize,
+                           ulong_t receiveBufferSize);
+extern void TCP_Socket_Free(struct TCP_Socket *sock);
+extern int TCP_Connect(struct TCP_Socket *sock);
+extern int TCP_Accept(struct TCP_Socket *sock,
+                      struct TCP_Connection *connection);
+extern int TCP_Send(struct TCP_Socket *sock, uchar_t * buffer,
+                    ulong_t bufferSize);
+extern int TCP_Receive(struct TCP_Socket *sock, uchar_t * buffer,
+                       ulong_t bufferSize);
+extern int TCP_Close(struct TCP_Socket *sock);
+extern void TCP_Input(struct TCP_Socket *sock, IP_Address * destAddress,
+                      IP_Address * srcAddress, struct TCP_Segment *segment);
+extern bool TCP_Timer(struct TCP_Socket *sock);
+extern int TCP_Poll(struct TCP_Socket *sock);
+extern int TCP_Send_Reset(IP_Address * srcAddress, IP_Address * destAddress,
+                          ushort_t srcPort, ushort_t destPort,
+                          struct TCP_Segment *segment);
 
 #endif /* TCP_H_ */
@@ -19,3 +19,4 @@ int Pipe_Create(struct File **read_file, struct File **write_file);
 int Pipe_Read(struct File *f, void *buf, ulong_t numBytes);
 int Pipe_Write(struct File *f, void *buf, ulong_t numBytes);
 int Pipe_Close(struct File *f);
+int Pipe_Poll(struct File *f, struct Poll_Entry *entry);
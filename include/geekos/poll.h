@@ -0,0 +1,87 @@
+/*
+ * Readiness multiplexing over files, sockets and the keyboard
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#ifndef GEEKOS_POLL_H
+#define GEEKOS_POLL_H
+
+/* what a Poll_Descriptor's fd names */
+#define POLL_FILE      0        /* an entry in the file descriptor table */
+#define POLL_SOCKET    1        /* a socket id */
+#define POLL_KEYBOARD  2        /* the console keyboard; fd is ignored */
+
+/* events and revents bits */
+#define POLLIN   0x01           /* reading will not block */
+#define POLLOUT  0x02           /* writing will not block */
+#define POLLHUP  0x04           /* the other end has gone away */
+#define POLLERR  0x08           /* an error is pending */
+#define POLLNVAL 0x10           /* fd does not name an open object */
+
+/* most descriptors one Poll() will take */
+#define POLL_MAX_DESCRIPTORS 1024
+
+/* no timeout: wait until something is ready */
+#define POLL_INFINITE (-1)
+
+struct Poll_Descriptor {
+    int fd;
+    short kind;                 /* POLL_FILE, POLL_SOCKET or POLL_KEYBOARD */
+    short events;               /* what to wait for; POLLHUP, POLLERR and POLLNVAL are always reported */
+    short revents;              /* what is ready, filled in by Poll() */
+    short pad;
+};
+
+#ifdef GEEKOS
+
+#include <geekos/ktypes.h>
+#include <geekos/list.h>
+#include <geekos/kthread.h>
+
+struct Poll_Entry;
+struct Poll_Waiter;
+struct Interrupt_State;
+
+DEFINE_LIST(Poll_Entry_List, Poll_Entry);
+
+/*
+ * Anything Poll() can wait on embeds a poll queue and calls
+ * Poll_Wake() on it whenever it may have become readable or
+ * writable, or has been closed.
+ */
+struct Poll_Queue {
+    struct Poll_Entry_List entries;
+};
+
+/* one per polled object per Poll() call; links its waiter onto the object */
+struct Poll_Entry {
+    struct Poll_Waiter *waiter;
+    struct Poll_Queue *queue;   /* NULL once unregistered or the object is gone */
+     DEFINE_LINK(Poll_Entry_List, Poll_Entry);
+};
+
+/* the thread sleeping in Poll() */
+struct Poll_Waiter {
+    struct Thread_Queue waitQueue;
+    volatile int woken;
+    volatile int timedOut;
+    int timerId;                /* timeout timer, 0 when none is pending */
+    struct Poll_Waiter *timerNext;
+};
+
+IMPLEMENT_LIST(Poll_Entry_List, Poll_Entry);
+
+void Poll_Queue_Init(struct Poll_Queue *queue);
+void Poll_Queue_Destroy(struct Poll_Queue *queue);
+void Poll_Register(struct Poll_Queue *queue, struct Poll_Entry *entry);
+void Poll_Wake(struct Poll_Queue *queue);
+
+int Poll(struct Poll_Descriptor *fds, int count, int timeout);
+
+int Sys_Poll(struct Interrupt_State *state);
+
+#endif /* GEEKOS */
+
+#endif /* GEEKOS_POLL_H */
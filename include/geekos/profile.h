@@ -0,0 +1,47 @@
+/*
+ * Sampling profiler driven by the timer interrupt
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#ifndef GEEKOS_PROFILE_H
+#define GEEKOS_PROFILE_H
+
+/* Sys_Profile operations */
+#define PROFILE_START  0        /* arg: period in ticks, flags */
+#define PROFILE_STOP   1        /* returns the number of samples dropped */
+#define PROFILE_READ   2        /* drain samples into a user buffer */
+
+/* PROFILE_START flags */
+#define PROFILE_STACKS 0x1      /* also walk the kernel frame pointer chain */
+
+/* Profile_Sample flags */
+#define PROFILE_USER   0x1      /* eip is a user-mode address */
+
+/* return addresses kept per sample when walking stacks */
+#define PROFILE_MAX_DEPTH 8
+
+/* samples each CPU buffers between reads */
+#define PROFILE_RING_SIZE 2048
+
+struct Profile_Sample {
+    unsigned long eip;          /* where the timer interrupted */
+    int pid;
+    unsigned char cpu;
+    unsigned char flags;        /* PROFILE_USER */
+    unsigned short depth;       /* valid entries in stack */
+    unsigned long stack[PROFILE_MAX_DEPTH];     /* return addresses, innermost first */
+};
+
+#ifdef GEEKOS
+
+struct Interrupt_State;
+
+void Profile_Tick(struct Interrupt_State *state, int cpu);
+
+int Sys_Profile(struct Interrupt_State *state);
+
+#endif /* GEEKOS */
+
+#endif /* GEEKOS_PROFILE_H */
@@ -57,6 +57,9 @@ void Set_Current_Attr(uchar_t attrib);
 void Put_Char(int c);
 void Put_String(const char *s);
 void Put_Buf(const char *buf, ulong_t length);
+void Put_Buf_Async(const char *buf, ulong_t length);
+void Init_Console_Thread(void);
+void Flush_Console(void);
 void Print(const char *fmt, ...) __attribute__ ((format(printf, 1, 2)));
 
 #endif /* GEEKOS */
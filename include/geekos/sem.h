@@ -12,10 +12,18 @@
  */
 #ifndef _INCLUDED_SEM_H
 #define _INCLUDED_SEM_H
+
+/* size of the kernel's semaphore table */
+#define MAX_SEMAPHORES 128
+
 #ifdef GEEKOS
+struct Interrupt_State;
+struct User_Context;
+
 int Sys_Open_Semaphore(struct Interrupt_State *state);
 int Sys_P(struct Interrupt_State *state);
 int Sys_V(struct Interrupt_State *state);
 int Sys_Close_Semaphore(struct Interrupt_State *state);
+void Release_Semaphores(struct User_Context *context);
 #endif
 #endif
@@ -1,2 +1,11 @@
+#ifndef GEEKOS_SERIAL_H
+#define GEEKOS_SERIAL_H
+
+#include <geekos/ktypes.h>
 
 void Init_Serial(void);
+void Serial_Put_Buf(const char *buf, ulong_t length);
+void Serial_Wait_Room(ulong_t length);
+void Serial_Flush(void);
+
+#endif /* GEEKOS_SERIAL_H */
@@ -25,9 +25,19 @@ typedef struct CPU_Info {
     int ticks;
     struct Kernel_Thread *idleThread;
     struct User_Context *s_currentUserContext;
+
+    /* accounting reported by Sys_PS; ticks above counts every tick */
+    int idleTicks;              /* ticks spent in the idle thread */
+    int userTicks;              /* ... in user mode */
+    int syscallTicks;           /* ... in the kernel on behalf of a syscall */
+    int switches;               /* context switches */
+    int irqs;                   /* hardware interrupts handled */
+    unsigned long long irqCycles;       /* TSC cycles spent in IRQ handlers */
+    unsigned long long irqStart;        /* TSC at entry to the current IRQ */
 } CPU_Info;
 
 extern volatile CPU_Info CPUs[];
+extern int CPU_Count;
 
 int Get_CPU_ID(void);
 
@@ -35,6 +45,7 @@ void Map_IO_APIC_IRQ(int irq, void *handler);
 void Init_SMP();
 int Init_Local_APIC(int cpu);
 void Release_SMP();
+void Init_String_Features(int cpu);
 int send_IPI(int APIC_Id, int mask);
 
 struct Kernel_Thread *get_current_thread(int atomic);
@@ -4,6 +4,7 @@ extern int Sys_Arp(struct Interrupt_State *state);
 extern int Sys_RouteAdd(struct Interrupt_State *state);
 extern int Sys_RouteDel(struct Interrupt_State *state);
 extern int Sys_RouteGet(struct Interrupt_State *state);
+extern int Sys_RouteLookup(struct Interrupt_State *state);
 extern int Sys_IPConfigure(struct Interrupt_State *state);
 extern int Sys_IPGet(struct Interrupt_State *state);
 extern int Sys_IPSend(struct Interrupt_State *state);
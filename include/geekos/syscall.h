@@ -123,6 +123,11 @@ enum {
     SYS_LINK,                   /* hard link two files */
     SYS_SYMLINK,                /* Symbolic link two files */
     SYS_SBRK,                   /* sbrk */
+    SYS_ROUTELOOKUP,            /* longest-prefix route lookup */
+    SYS_POLL,                   /* wait for readiness on many descriptors */
+    SYS_PROFILE,                /* control the sampling profiler */
+    SYS_TRACE,                  /* control the tracepoints */
+    SYS_FUTEX,                  /* sleep on or wake a user word */
 };
 
 /*
@@ -48,4 +48,11 @@ int Cancel_Timer(int id);
 
 void Micro_Delay(int us);
 
+/* this CPU's time stamp counter */
+static __inline__ unsigned long long Read_TSC(void) {
+    unsigned long long tsc;
+    __asm__ __volatile__("rdtsc":"=A"(tsc));
+    return tsc;
+}
+
 #endif /* GEEKOS_TIMER_H */
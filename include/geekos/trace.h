@@ -0,0 +1,71 @@
+/*
+ * Static tracepoints recorded into per-CPU binary trace buffers
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#ifndef GEEKOS_TRACE_H
+#define GEEKOS_TRACE_H
+
+/* trace events and what their arguments hold */
+#define TRACE_SCHED_SWITCH    1 /* pid switched away from, pid switched to */
+#define TRACE_SYSCALL_ENTER   2 /* syscall number, ebx, ecx */
+#define TRACE_SYSCALL_EXIT    3 /* syscall number, return value */
+#define TRACE_BLOCK_POST      4 /* request, type, first block, block count */
+#define TRACE_BLOCK_COMPLETE  5 /* request, state, error code */
+#define TRACE_IRQ_ENTER       6 /* interrupt number */
+#define TRACE_IRQ_EXIT        7 /* interrupt number */
+#define TRACE_MUTEX_CONTEND   8 /* mutex, pid of its owner */
+#define TRACE_MUTEX_ACQUIRE   9 /* mutex; only after contending */
+#define TRACE_NUM_EVENTS     10
+
+#define TRACE_EVENT_BIT(event) (1U << (event))
+#define TRACE_ALL_EVENTS (TRACE_EVENT_BIT(TRACE_NUM_EVENTS) - 2)
+
+/* Sys_Trace operations */
+#define TRACE_START 0           /* arg: mask of TRACE_EVENT_BITs */
+#define TRACE_STOP  1           /* returns the number of records dropped */
+#define TRACE_READ  2           /* drain records into a user buffer */
+
+/* records each CPU buffers between reads */
+#define TRACE_RING_SIZE 4096
+
+#define TRACE_MAX_ARGS 4
+
+/* one fixed-size record; 32 bytes so a ring slot never straddles a cache line */
+struct Trace_Record {
+    unsigned long long tsc;     /* time stamp counter of the CPU that wrote it */
+    unsigned short event;
+    unsigned char cpu;
+    unsigned char pad;
+    int pid;                    /* thread running when the event happened */
+    unsigned long args[TRACE_MAX_ARGS];
+};
+
+#ifdef GEEKOS
+
+struct Interrupt_State;
+
+extern volatile unsigned int g_traceMask;
+
+void Trace_Record(int event, unsigned long arg0, unsigned long arg1,
+                  unsigned long arg2, unsigned long arg3);
+
+/*
+ * A trace site.  While its event is not being traced it costs one
+ * load and branch, so sites can stay compiled in on hot paths.
+ */
+#define TRACE(event, arg0, arg1, arg2, arg3)                            \
+    do {                                                                \
+        if(g_traceMask & TRACE_EVENT_BIT(event))                        \
+            Trace_Record((event), (unsigned long) (arg0),               \
+                         (unsigned long) (arg1), (unsigned long) (arg2), \
+                         (unsigned long) (arg3));                       \
+    } while (0)
+
+int Sys_Trace(struct Interrupt_State *state);
+
+#endif /* GEEKOS */
+
+#endif /* GEEKOS_TRACE_H */
@@ -30,8 +30,30 @@ struct Process_Info {
 #define STATUS_ZOMBIE   2
     int status;
     int affinity;
-    int currCore;
+    int currCore;               /* CPU running it now, or -1 */
     int totalTime;
+    /* accounting since the thread started */
+    int lastCore;               /* CPU it last ran on */
+    int userTicks;
+    int kernelTicks;
+    int voluntarySwitches;      /* gave up the CPU by blocking or yielding */
+    int involuntarySwitches;    /* was preempted */
+    int syscalls;
+    int pageFaults;
+    int blockReads;             /* blocks read */
+    int blockWrites;            /* blocks written */
+};
+
+/* Per-CPU accounting communicated by the PS system call */
+struct PS_CPU_Info {
+    int cpu;                    /* -1 for entries beyond the last CPU */
+    int ticks;                  /* all timer ticks on this CPU */
+    int idleTicks;
+    int userTicks;
+    int syscallTicks;           /* in the kernel for a syscall */
+    int switches;               /* context switches */
+    int irqs;                   /* hardware interrupts handled */
+    unsigned long long irqCycles;       /* TSC cycles spent handling them */
 };
 
 #ifdef GEEKOS
@@ -41,6 +63,7 @@ struct Process_Info {
 #include <geekos/elf.h>
 #include <geekos/signal.h>
 #include <geekos/paging.h>
+#include <geekos/sem.h>
 
 struct File;
 
@@ -86,6 +109,9 @@ struct User_Context {
     /*! Open files. */
     struct File *file_descriptor_table[USER_MAX_FILES];
 
+    /* Opens not yet closed of each semaphore, by id */
+    int semaphoreOpens[MAX_SEMAPHORES];
+
     /* Code entry point */
     ulong_t entryAddr;
 
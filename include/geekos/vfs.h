@@ -35,6 +35,7 @@ struct Mount_Point;
 struct File;
 struct Mount_Point_Ops;
 struct File_Ops;
+struct Poll_Entry;
 
 /*
  * Operations providing support for formatting and mounting
@@ -109,6 +110,7 @@ struct File_Ops {
     int (*Seek) (struct File * file, ulong_t pos);
     int (*Close) (struct File * file);
     int (*Read_Entry) (struct File * dir, struct VFS_Dir_Entry * entry);        /* Read next directory entry. */
+    int (*Poll) (struct File * file, struct Poll_Entry * entry);        /* Readiness for Poll(); NULL if never blocking. */
 };
 
 /*
@@ -149,6 +151,7 @@ int FStat(struct File *file, struct VFS_File_Stat *stat);
 int Read(struct File *file, void *buf, ulong_t len);
 int Write(struct File *file, void *buf, ulong_t len);
 int Seek(struct File *file, ulong_t len);
+int Poll_File(struct File *file, struct Poll_Entry *entry);
 int Read_Fully(const char *path, void **pBuffer, ulong_t * pLen);
 int Delete(const char *path, bool recursive);
 int Rename(const char *oldpath, const char *newpath);
@@ -0,0 +1,55 @@
+/*
+ * Futexes, and the user-mode locks built on them
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#ifndef FUTEX_H
+#define FUTEX_H
+
+#include <geekos/futex.h>
+
+/*
+ * Sleep while *word == value, until woken; returns 0 once woken, or
+ * EWOULDBLOCK at once if *word has already changed.
+ */
+int Futex_Wait(volatile int *word, int value);
+
+/* Wake up to count threads sleeping on word; returns how many woke. */
+int Futex_Wake(volatile int *word, int count);
+
+/*
+ * Locks for threads sharing memory through Clone().  Each keeps its
+ * state in user memory, and only enters the kernel to sleep when it
+ * must wait, or to wake a thread that is asleep.
+ */
+typedef struct {
+    volatile int state;         /* 0 free, 1 held, 2 held with sleepers */
+} User_Mutex_t;
+
+typedef struct {
+    volatile int sequence;      /* bumped by every signal */
+    volatile int waiters;
+} User_Cond_t;
+
+typedef struct {
+    volatile int count;
+    volatile int waiters;
+} User_Sema_t;
+
+void User_Mutex_Init(User_Mutex_t * mutex);
+void User_Mutex_Lock(User_Mutex_t * mutex);
+int User_Mutex_Try_Lock(User_Mutex_t * mutex);
+void User_Mutex_Unlock(User_Mutex_t * mutex);
+
+void User_Cond_Init(User_Cond_t * cond);
+void User_Cond_Wait(User_Cond_t * cond, User_Mutex_t * mutex);
+void User_Cond_Signal(User_Cond_t * cond);
+void User_Cond_Broadcast(User_Cond_t * cond);
+
+void User_Sema_Init(User_Sema_t * sema, int count);
+void User_Sema_P(User_Sema_t * sema);
+void User_Sema_V(User_Sema_t * sema);
+
+#endif /* FUTEX_H */
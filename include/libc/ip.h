@@ -23,6 +23,7 @@ int Route_Add(uchar_t *, uchar_t *, uchar_t *, char *, ulong_t);
 int Route_Delete(uchar_t *, uchar_t *);
 int IP_Configure(char *, ulong_t, uchar_t *, uchar_t *);
 int Get_Routes(struct IP_Route *buffer, ulong_t numRoutes);
+int Route_Lookup(uchar_t * ipAddress, ulong_t count, struct IP_Route *route);
 int Get_IP_Info(struct IP_Device_Info *buffer, ulong_t count,
                 char *interface, ulong_t ifaceNameLength);
 bool Parse_IP(const char *ip, uchar_t * ipBuffer);
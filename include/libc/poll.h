@@ -0,0 +1,20 @@
+/*
+ * Readiness multiplexing
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#ifndef POLL_H
+#define POLL_H
+
+#include <geekos/poll.h>
+
+/*
+ * Wait until one of count descriptors is ready, or timeout
+ * milliseconds pass (POLL_INFINITE to wait forever, 0 to just check).
+ * Returns the number of ready descriptors, with revents filled in.
+ */
+int Poll(struct Poll_Descriptor *fds, int count, int timeout);
+
+#endif /* POLL_H */
@@ -30,6 +30,8 @@ int Spawn_With_Path(const char *program, const char *command,
 int Wait(int pid);
 int Get_PID(void);
 int PS(struct Process_Info *ptable, int len);
+int PS_With_CPUs(struct Process_Info *ptable, int len,
+                 struct PS_CPU_Info *cpus, int numCPUs);
 int WaitNoPID(int *status);
 
 int Fork(void);
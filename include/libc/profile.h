@@ -0,0 +1,26 @@
+/*
+ * Sampling profiler
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <geekos/profile.h>
+
+/*
+ * Start sampling every period ticks on each CPU, discarding any
+ * samples not yet read.  PROFILE_STACKS also records kernel call
+ * stacks.
+ */
+int Profile_Start(int period, int flags);
+
+/* Stop sampling; returns how many samples were dropped since the start. */
+int Profile_Stop(void);
+
+/* Take up to max buffered samples; returns how many were copied. */
+int Profile_Read(struct Profile_Sample *samples, int max);
+
+#endif /* PROFILE_H */
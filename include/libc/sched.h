@@ -18,9 +18,16 @@
 #ifndef SCHED_H
 #define SCHED_H
 
+#include <geekos/timer.h>
+
 int Set_Scheduling_Policy(int policy, int quantum);
+
+/* timer ticks since boot; there are TICKS_PER_SEC of them a second */
 int Get_Time_Of_Day(void);
 
+/* pid 0 names the calling thread; this core value allows any CPU */
+#define AFFINITY_ANY_CORE (-1)
+
 int Set_Affinity(int pid, int core);
 int Get_Affinity(int pid);
 
@@ -29,6 +29,9 @@ extern uchar_t INADDR_ANY[4];
 extern uchar_t INADDR_BROADCAST[4];
 
 int Socket(uchar_t type, int flags);
+/* a stream socket with its own buffer sizes; 0 picks the default */
+int Socket_With_Buffers(uchar_t type, int flags, ulong_t sendBufferSize,
+                        ulong_t receiveBufferSize);
 int Connect(ulong_t id, ushort_t port, uchar_t ipAddress[4]);
 int Accept(ulong_t id, ushort_t * clientPort, uchar_t clientIpAddress[4]);
 int Listen(ulong_t id, ulong_t backlog);
@@ -24,6 +24,13 @@ void *memset(void *s, int c, size_t n);
 void *memcpy(void *dst, const void *src, size_t n);
 void *memmove(void *dst, const void *src, size_t n);
 int memcmp(const void *s1, const void *s2, size_t n);
+
+/* CPU features the block routines can use */
+#define STRING_ERMS 0x1         /* fast rep movsb/stosb */
+#define STRING_SSE2 0x2         /* non-temporal stores; kernel only */
+unsigned int Detect_String_Features(void);
+void Set_String_Features(unsigned int features);
+
 size_t strlen(const char *s);
 size_t strnlen(const char *s, size_t maxlen);
 int strcmp(const char *s1, const char *s2);
@@ -0,0 +1,25 @@
+/*
+ * Tracepoints
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <geekos/trace.h>
+
+/*
+ * Start recording the events in mask (TRACE_EVENT_BITs), discarding
+ * any records not yet read.
+ */
+int Trace_Start(unsigned int mask);
+
+/* Stop recording; returns how many records were dropped since the start. */
+int Trace_Stop(void);
+
+/* Take up to max buffered records; returns how many were copied. */
+int Trace_Read(struct Trace_Record *records, int max);
+
+#endif /* TRACE_H */
@@ -7,18 +7,29 @@
 
 #include <string.h>
 
+/*
+ * A copy to a lower address, or between blocks that do not overlap,
+ * is a memcpy, since the string instructions copy forwards.  Otherwise
+ * copy backwards with the direction flag set: the odd bytes at the
+ * end first, then the dwords.
+ */
 void *memmove(void *dest1, const void *source1, size_t length) {
-    char *dest = dest1;
-    const char *source = source1;
-    char *d0 = dest;
-    if(source < dest)
-        /* Moving from low mem to hi mem; start at end.  */
-        for(source += length, dest += length; length; --length)
-            *--dest = *--source;
-    else if(source != dest) {
-        /* Moving from hi mem to low mem; start at beginning.  */
-        for(; length; --length)
-            *dest++ = *source++;
-    }
-    return (void *)d0;
+    unsigned char *dest = (unsigned char *)dest1 + length - 1;
+    const unsigned char *source =
+        (const unsigned char *)source1 + length - 1;
+    size_t tail = length & 3;
+
+    if((unsigned long)dest1 - (unsigned long)source1 >= length)
+        return memcpy(dest1, source1, length);
+
+    __asm__ __volatile__("std\n\t"
+                         "rep movsb\n\t"
+                         "subl $3, %%edi\n\t"
+                         "subl $3, %%esi\n\t"
+                         "movl %3, %%ecx\n\t"
+                         "rep movsl\n\t"
+                         "cld":"+D"(dest), "+S"(source), "+c"(tail)
+                         :"r"(length >> 2)
+                         :"memory");
+    return dest1;
 }
@@ -9,8 +9,9 @@
 
 /*
  * NOTE:
- * These are slow and simple implementations of a subset of
- * the standard C library string functions.
+ * Apart from the block routines, these are slow and simple
+ * implementations of a subset of the standard C library string
+ * functions.
  * We also have an implementation of snprintf().
  */
 
@@ -19,51 +20,158 @@
 
 extern void *Malloc(size_t size);
 
-void *memset(void *s, int c, size_t n) {
-    if((((unsigned long)s) & 0x3) == 0 && ((unsigned long)n & 0x3) == 0) {
-        /* marginally optimized common case version -ns */
-        /* memset was implicated by poor man's profiling as being the top single function */
-        /* consult, e.g., https://github.com/ryanmcgrath/svgalib-1/blob/master/demos/memset.c */
-        /* for an assembly variant that uses i386 instructions if more performance is needed. */
-        unsigned int *pi = s;
-        n /= 4;
-        c |= c << 8;
-        c |= c << 16;
-        for(pi = s; n > 0; n--, pi++) {
-            *pi = c;
-        }
-        return s;
-    } else {
-        unsigned char *p = (unsigned char *)s;
+/*
+ * memset, memcpy and memmove use the string instructions.  Which
+ * variants they use is chosen once by Set_String_Features(); until
+ * then they use rep stosl/movsl, which any CPU runs well.
+ *
+ * With STRING_ERMS ("enhanced rep movsb") the CPU moves whole cache
+ * lines for rep movsb/stosb, so the byte forms are used throughout.
+ * With STRING_SSE2, which only the kernel sets, blocks of at least a
+ * page are written with non-temporal stores that bypass the cache:
+ * pages being zeroed or copied are rarely read straight away, and
+ * would otherwise push everything else out.
+ */
+static unsigned int s_stringFeatures;
 
-        while (n > 0) {
-            *p++ = (unsigned char)c;
-            --n;
-        }
+#define NT_MIN_SIZE 4096
+#define NT_CHUNK 64
+
+static __inline__ void Cpuid(unsigned int leaf, unsigned int *a,
+                             unsigned int *b, unsigned int *d) {
+    unsigned int c = 0;
+
+    __asm__ __volatile__("cpuid":"=a"(*a), "=b"(*b), "+c"(c), "=d"(*d)
+                         :"a"(leaf));
+}
+
+/* the string features this CPU has; cpuid runs in user mode too */
+unsigned int Detect_String_Features(void) {
+    unsigned int maxLeaf, a, b, d, features = 0;
+
+    Cpuid(0, &maxLeaf, &b, &d);
+    if(maxLeaf >= 1) {
+        Cpuid(1, &a, &b, &d);
+        if(d & (1 << 26))
+            features |= STRING_SSE2;
+    }
+    if(maxLeaf >= 7) {
+        Cpuid(7, &a, &b, &d);
+        if(b & (1 << 9))
+            features |= STRING_ERMS;
+    }
+    return features;
+}
+
+void Set_String_Features(unsigned int features) {
+    s_stringFeatures = features;
+}
+
+#ifdef GEEKOS
+/*
+ * The kernel does not save SSE registers when it switches threads,
+ * so the non-temporal routines save the ones they use on the stack
+ * and put them back, which makes them safe to preempt or to run from
+ * an interrupt handler.
+ */
+#define SAVE_XMM(save) \
+    __asm__ __volatile__("movdqu %%xmm0, 0(%0)\n\t" \
+                         "movdqu %%xmm1, 16(%0)\n\t" \
+                         "movdqu %%xmm2, 32(%0)\n\t" \
+                         "movdqu %%xmm3, 48(%0)"::"r"(save):"memory")
+#define RESTORE_XMM(save) \
+    __asm__ __volatile__("movdqu 0(%0), %%xmm0\n\t" \
+                         "movdqu 16(%0), %%xmm1\n\t" \
+                         "movdqu 32(%0), %%xmm2\n\t" \
+                         "movdqu 48(%0), %%xmm3"::"r"(save):"memory")
+
+/* n is a multiple of NT_CHUNK and d is 16-byte aligned */
+static void NT_Set(unsigned char *d, int c, size_t n) {
+    unsigned char save[64];
+    unsigned int pattern[4];
+
+    pattern[0] = pattern[1] = pattern[2] = pattern[3] =
+        (unsigned char)c * 0x01010101U;
+    SAVE_XMM(save);
+    __asm__ __volatile__("movdqu (%0), %%xmm0"::"r"(pattern):"memory");
+    for(; n > 0; n -= NT_CHUNK, d += NT_CHUNK)
+        __asm__ __volatile__("movntdq %%xmm0, 0(%0)\n\t"
+                             "movntdq %%xmm0, 16(%0)\n\t"
+                             "movntdq %%xmm0, 32(%0)\n\t"
+                             "movntdq %%xmm0, 48(%0)"::"r"(d):"memory");
+    __asm__ __volatile__("sfence":::"memory");
+    RESTORE_XMM(save);
+}
+
+/* n is a multiple of NT_CHUNK and d is 16-byte aligned */
+static void NT_Copy(unsigned char *d, const unsigned char *s, size_t n) {
+    unsigned char save[64];
+
+    SAVE_XMM(save);
+    for(; n > 0; n -= NT_CHUNK, d += NT_CHUNK, s += NT_CHUNK)
+        __asm__ __volatile__("movdqu 0(%1), %%xmm0\n\t"
+                             "movdqu 16(%1), %%xmm1\n\t"
+                             "movdqu 32(%1), %%xmm2\n\t"
+                             "movdqu 48(%1), %%xmm3\n\t"
+                             "movntdq %%xmm0, 0(%0)\n\t"
+                             "movntdq %%xmm1, 16(%0)\n\t"
+                             "movntdq %%xmm2, 32(%0)\n\t"
+                             "movntdq %%xmm3, 48(%0)"::"r"(d), "r"(s)
+                             :"memory");
+    __asm__ __volatile__("sfence":::"memory");
+    RESTORE_XMM(save);
+}
 
-        return s;
+static __inline__ int Use_NT(const void *d, size_t n) {
+    return (s_stringFeatures & STRING_SSE2) && n >= NT_MIN_SIZE &&
+        ((unsigned long)d & 15) == 0;
+}
+#endif /* GEEKOS */
+
+void *memset(void *s, int c, size_t n) {
+    unsigned char *d = s;
+    size_t words;
+
+#ifdef GEEKOS
+    if(Use_NT(d, n)) {
+        NT_Set(d, c, n & ~(NT_CHUNK - 1));
+        d += n & ~(NT_CHUNK - 1);
+        n &= NT_CHUNK - 1;
     }
+#endif
+
+    if(!(s_stringFeatures & STRING_ERMS)) {
+        words = n >> 2;
+        n &= 3;
+        __asm__ __volatile__("rep stosl":"+D"(d), "+c"(words)
+                             :"a"((unsigned char)c * 0x01010101U)
+                             :"memory");
+    }
+    __asm__ __volatile__("rep stosb":"+D"(d), "+c"(n):"a"(c):"memory");
+    return s;
 }
 
 void *memcpy(void *dst, const void *src, size_t n) {
-    unsigned char *d = (unsigned char *)dst;
-    const unsigned char *s = (const unsigned char *)src;
-
-    if((((unsigned long)d | (unsigned long)s | n) & 0x3) == 0) {
-        unsigned int *di = (unsigned int *)dst;
-        const unsigned int *si = (const unsigned int *)src;
-        n /= 4;
-        while (n > 0) {
-            *di++ = *si++;
-            --n;
-        }
-    } else {
-        while (n > 0) {
-            *d++ = *s++;
-            --n;
-        }
+    unsigned char *d = dst;
+    const unsigned char *s = src;
+    size_t words;
+
+#ifdef GEEKOS
+    if(Use_NT(d, n)) {
+        NT_Copy(d, s, n & ~(NT_CHUNK - 1));
+        d += n & ~(NT_CHUNK - 1);
+        s += n & ~(NT_CHUNK - 1);
+        n &= NT_CHUNK - 1;
     }
+#endif
 
+    if(!(s_stringFeatures & STRING_ERMS)) {
+        words = n >> 2;
+        n &= 3;
+        __asm__ __volatile__("rep movsl":"+D"(d), "+S"(s), "+c"(words)
+                             ::"memory");
+    }
+    __asm__ __volatile__("rep movsb":"+D"(d), "+S"(s), "+c"(n)::"memory");
     return dst;
 }
 
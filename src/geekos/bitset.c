@@ -63,50 +63,310 @@ bool Is_Bit_Set(void *bitSet, uint_t bitPos) {
     return (((uchar_t *) bitSet)[offset] & (1 << bit)) != 0;
 }
 
-int Find_First_Free_Bit(void *bitSet, ulong_t totalBits) {
-    uint_t numBytes = FIND_NUM_BYTES(totalBits);
-    ulong_t offset;
-    uchar_t *bits = (uchar_t *) bitSet;
-
-    for(offset = 0; offset < numBytes; ++offset) {
-        if(bits[offset] != 0xff) {
-            uint_t bit;
-            for(bit = 0; bit < 8; ++bit) {
-                if((bits[offset] & (1 << bit)) == 0)
-                    return (offset * 8) + bit;
+/*
+ * Word-at-a-time helpers.  Bit n lives in byte n/8 at position n%8,
+ * which on little-endian x86 is the same as word n/32 at position
+ * n%32, so the byte-oriented bit sets above can be scanned 32 bits
+ * at a time.  Only whole words below totalBits are loaded; the tail
+ * is examined bit by bit so callers need not round allocations.
+ */
+#define WORD_BITS 32
+
+static __inline__ uint_t Get_Word(void *bitSet, ulong_t word) {
+    return ((uint_t *) bitSet)[word];
+}
+
+/*
+ * Find the first clear bit at or after start, or totalBits if none.
+ * Whole groups with no clear bit are skipped when index is given.
+ */
+static ulong_t Scan_For_Clear(void *bitSet, ulong_t start, ulong_t totalBits,
+                              struct Bit_Set_Index *index) {
+    ulong_t fullWords = totalBits / WORD_BITS;
+    ulong_t word = start / WORD_BITS;
+
+    if(start >= totalBits)
+        return totalBits;
+
+    if(word < fullWords) {
+        /* treat the bits below start in the first word as set */
+        uint_t w = Get_Word(bitSet, word) | ((1U << (start % WORD_BITS)) - 1);
+
+        for(;;) {
+            if(w != 0xffffffffU)
+                return word * WORD_BITS + __builtin_ctz(~w);
+            if(++word >= fullWords)
+                break;
+            if(index != 0 && word % BITSET_GROUP_WORDS == 0) {
+                while (word < fullWords
+                       && index->group[word / BITSET_GROUP_WORDS].free == 0)
+                    word += BITSET_GROUP_WORDS;
+                if(word >= fullWords)
+                    break;
             }
-#ifdef GEEKOS
-            /* kassert only defined properly when running in geekos. */
-            KASSERT(false);
-#endif
+            w = Get_Word(bitSet, word);
         }
+        start = fullWords * WORD_BITS;
     }
 
-    return -1;
+    for(; start < totalBits; ++start) {
+        if(!Is_Bit_Set(bitSet, start))
+            return start;
+    }
+    return totalBits;
 }
 
 /*
- * This is slow!!
+ * Find the first set bit in [start, limit), or limit if none.
+ * Whole groups with every bit clear are skipped when index is given.
  */
-int Find_First_N_Free(void *bitSet, uint_t runLength, ulong_t totalBits) {
-    uint_t i, j;
+static ulong_t Scan_For_Set(void *bitSet, ulong_t start, ulong_t limit,
+                            struct Bit_Set_Index *index) {
+    ulong_t fullWords = limit / WORD_BITS;
+    ulong_t word = start / WORD_BITS;
+
+    if(start >= limit)
+        return limit;
+
+    if(word < fullWords) {
+        /* treat the bits below start in the first word as clear */
+        uint_t w = Get_Word(bitSet, word) & ~((1U << (start % WORD_BITS)) - 1);
 
-    for(i = 0; i < totalBits - runLength; i++) {
-        if(!Is_Bit_Set(bitSet, i)) {
-            for(j = 1; j < runLength; j++) {
-                if(Is_Bit_Set(bitSet, i + j)) {
-                    i += j;     /* Mr. Hunt's contribution */
+        for(;;) {
+            if(w != 0)
+                return word * WORD_BITS + __builtin_ctz(w);
+            if(++word >= fullWords)
+                break;
+            if(index != 0 && word % BITSET_GROUP_WORDS == 0) {
+                while (word + BITSET_GROUP_WORDS <= fullWords
+                       && index->group[word / BITSET_GROUP_WORDS].free ==
+                       BITSET_GROUP_BITS)
+                    word += BITSET_GROUP_WORDS;
+                if(word >= fullWords)
                     break;
-                }
-            }
-            if(j == runLength) {
-                return i;
             }
+            w = Get_Word(bitSet, word);
         }
+        start = fullWords * WORD_BITS;
+    }
+
+    for(; start < limit; ++start) {
+        if(Is_Bit_Set(bitSet, start))
+            return start;
+    }
+    return limit;
+}
+
+/*
+ * Find the first run of runLength clear bits at or after start.
+ * Each probe jumps from a clear bit to the next set bit and back,
+ * so the cost is proportional to words scanned, not bits.
+ */
+static int Scan_For_Run(void *bitSet, ulong_t start, uint_t runLength,
+                        ulong_t totalBits, struct Bit_Set_Index *index) {
+    ulong_t pos = Scan_For_Clear(bitSet, start, totalBits, index);
+
+    if(runLength == 0)
+        runLength = 1;
+
+    while (pos + runLength <= totalBits) {
+        ulong_t end = Scan_For_Set(bitSet, pos, pos + runLength, index);
+        if(end == pos + runLength)
+            return (int)pos;
+        pos = Scan_For_Clear(bitSet, end, totalBits, index);
     }
     return -1;
 }
 
+int Find_First_Free_Bit(void *bitSet, ulong_t totalBits) {
+    ulong_t pos = Scan_For_Clear(bitSet, 0, totalBits, 0);
+
+    return pos < totalBits ? (int)pos : -1;
+}
+
+int Find_First_N_Free(void *bitSet, uint_t runLength, ulong_t totalBits) {
+    return Scan_For_Run(bitSet, 0, runLength, totalBits, 0);
+}
+
+/*
+ * Recompute the free-extent summary of one group from its words.
+ */
+static void Summarize_Group(struct Bit_Set_Index *index, ulong_t g) {
+    struct Bit_Set_Group *group = &index->group[g];
+    ulong_t first = g * BITSET_GROUP_BITS;
+    ulong_t last = first + BITSET_GROUP_BITS;
+    ulong_t pos, start, end;
+
+    if(last > index->totalBits)
+        last = index->totalBits;
+
+    group->free = group->head = group->tail = group->longest = 0;
+    for(pos = first; pos < last; pos = end) {
+        start = Scan_For_Clear(index->bitSet, pos, last, 0);
+        if(start >= last)
+            break;
+        end = Scan_For_Set(index->bitSet, start, last, 0);
+        group->free += end - start;
+        if(start == first)
+            group->head = end - start;
+        if(end == last)
+            group->tail = end - start;
+        if(end - start > group->longest)
+            group->longest = end - start;
+    }
+}
+
+/*
+ * Create a search index over an existing bit set used as a free map.
+ * The bit set must not be modified except through the Index functions
+ * while the index exists.
+ */
+struct Bit_Set_Index *Create_Bit_Set_Index(void *bitSet, ulong_t totalBits) {
+    struct Bit_Set_Index *index;
+    ulong_t g;
+
+    index = (struct Bit_Set_Index *)Malloc(sizeof(*index));
+    if(index == 0)
+        return 0;
+
+    index->bitSet = bitSet;
+    index->totalBits = totalBits;
+    index->numGroups =
+        (totalBits + BITSET_GROUP_BITS - 1) / BITSET_GROUP_BITS;
+    index->group = (struct Bit_Set_Group *)
+        Malloc(index->numGroups * sizeof(struct Bit_Set_Group));
+    if(index->group == 0) {
+        Free(index);
+        return 0;
+    }
+
+    for(g = 0; g < index->numGroups; ++g)
+        Summarize_Group(index, g);
+
+    index->hint = Scan_For_Clear(bitSet, 0, totalBits, index);
+    return index;
+}
+
+void Destroy_Bit_Set_Index(struct Bit_Set_Index *index) {
+    Free(index->group);
+    Free(index);
+}
+
+/*
+ * Mark count bits starting at first as in use.
+ */
+void Index_Set_Bits(struct Bit_Set_Index *index, uint_t first, uint_t count) {
+    uint_t bit;
+    ulong_t g;
+
+    if(count == 0)
+        return;
+#ifdef GEEKOS
+    KASSERT(first + count <= index->totalBits);
+#endif
+    for(bit = first; bit < first + count; ++bit)
+        Set_Bit(index->bitSet, bit);
+    for(g = first / BITSET_GROUP_BITS;
+        g <= (first + count - 1) / BITSET_GROUP_BITS; ++g)
+        Summarize_Group(index, g);
+
+    if(first <= index->hint && index->hint < first + count)
+        index->hint = Scan_For_Clear(index->bitSet, first + count,
+                                     index->totalBits, index);
+}
+
+/*
+ * Mark count bits starting at first as free.
+ */
+void Index_Clear_Bits(struct Bit_Set_Index *index, uint_t first,
+                      uint_t count) {
+    uint_t bit;
+    ulong_t g;
+
+    if(count == 0)
+        return;
+#ifdef GEEKOS
+    KASSERT(first + count <= index->totalBits);
+#endif
+    for(bit = first; bit < first + count; ++bit)
+        Clear_Bit(index->bitSet, bit);
+    for(g = first / BITSET_GROUP_BITS;
+        g <= (first + count - 1) / BITSET_GROUP_BITS; ++g)
+        Summarize_Group(index, g);
+
+    if(first < index->hint)
+        index->hint = first;
+}
+
+/*
+ * Find the first free bit, starting from the hint.
+ * Returns -1 if there is none.
+ */
+int Index_Find_First_Free(struct Bit_Set_Index *index) {
+    return index->hint < index->totalBits ? (int)index->hint : -1;
+}
+
+/*
+ * Find the first run of runLength free bits.  Walks the group
+ * summaries from the hint, carrying the free run that ends at each
+ * group boundary, and only scans the words of a group whose longest
+ * interior run is long enough.  Returns -1 if there is none.
+ */
+int Index_Find_First_N_Free(struct Bit_Set_Index *index, uint_t runLength) {
+    ulong_t g, run = 0, runStart = 0;
+
+    if(runLength == 0)
+        runLength = 1;
+
+    for(g = index->hint / BITSET_GROUP_BITS; g < index->numGroups; ++g) {
+        struct Bit_Set_Group *group = &index->group[g];
+        ulong_t first = g * BITSET_GROUP_BITS;
+        ulong_t last = first + BITSET_GROUP_BITS;
+
+        if(last > index->totalBits)
+            last = index->totalBits;
+
+        if(group->free == last - first) {
+            /* wholly free: extend the carried run */
+            if(run == 0)
+                runStart = first;
+            run += last - first;
+            if(run >= runLength)
+                return (int)runStart;
+            continue;
+        }
+
+        /* a run carried in from earlier groups, ending in our head */
+        if(run + group->head >= runLength)
+            return (int)(run > 0 ? runStart : first);
+
+        /* a run inside this group (possibly its tail) */
+        if(group->longest >= runLength) {
+            int pos = Scan_For_Run(index->bitSet, first, runLength, last, 0);
+#ifdef GEEKOS
+            KASSERT(pos >= 0);
+#endif
+            return pos;
+        }
+
+        run = group->tail;
+        runStart = last - run;
+    }
+
+    return -1;
+}
+
+/*
+ * Number of free bits in the whole set.
+ */
+ulong_t Index_Count_Free(struct Bit_Set_Index *index) {
+    ulong_t g, total = 0;
+
+    for(g = 0; g < index->numGroups; ++g)
+        total += index->group[g].free;
+    return total;
+}
+
 void Destroy_Bit_Set(void *bitSet) {
     Free(bitSet);
 }
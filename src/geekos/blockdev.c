@@ -15,6 +15,7 @@
 #include <geekos/kthread.h>
 #include <geekos/synch.h>
 #include <geekos/blockdev.h>
+#include <geekos/trace.h>
 #include <geekos/kassert.h>
 
 /* #define BLOCKDEV_DEBUG  */
@@ -59,7 +60,7 @@ static struct Block_Device_List s_deviceList;
  * Returns 0 if successful, error code on failure.
  */
 static int Do_Request(struct Block_Device *dev, enum Request_Type type,
-                      int blockNum, void *buf) {
+                      int blockNum, int numBlocks, void *buf) {
     struct Block_Request *request;
     int rc;
 
@@ -72,6 +73,7 @@ static int Do_Request(struct Block_Device *dev, enum Request_Type type,
         Mutex_Unlock(&s_blockdevLock);
         return ENOMEM;
     }
+    request->numBlocks = numBlocks;
     // Print("about to post\n");
     Post_Request_And_Wait(request);
     rc = request->errorCode;
@@ -188,6 +190,7 @@ struct Block_Request *Create_Request(struct Block_Device *dev,
         request->dev = dev;
         request->type = type;
         request->blockNum = blockNum;
+        request->numBlocks = 1;
         request->buf = buf;
         request->state = PENDING;
         //      Clear_Thread_Queue(&request->waitQueue);
@@ -213,6 +216,13 @@ void Post_Request_And_Wait(struct Block_Request *request) {
     /* Send request to the driver */
     Debug("Posting block device request [@%p]...\n", request);
 
+    TRACE(TRACE_BLOCK_POST, request, request->type, request->blockNum,
+          request->numBlocks);
+    if(request->type == BLOCK_READ)
+        CURRENT_THREAD->stats.blockReads += request->numBlocks;
+    else
+        CURRENT_THREAD->stats.blockWrites += request->numBlocks;
+
     Mutex_Lock(&s_blockdevRequestLock);
     Add_To_Back_Of_Block_Request_List(dev->requestQueue, request);
     Cond_Broadcast(&s_blockdevRequestCond);     /* awakens Dequeue_Request below */
@@ -255,6 +265,7 @@ struct Block_Request *Dequeue_Request(struct Block_Request_List
  */
 void Notify_Request_Completion(struct Block_Request *request,
                                enum Request_State state, int errorCode) {
+    TRACE(TRACE_BLOCK_COMPLETE, request, state, errorCode, 0);
     request->state = state;
     request->errorCode = errorCode;
     Cond_Signal(&request->satisfied);
@@ -275,7 +286,7 @@ int Block_Read(struct Block_Device *dev, int blockNum, void *buf) {
     KASSERT(dev);
     KASSERT(buf);
     dev->reads++;
-    return Do_Request(dev, BLOCK_READ, blockNum, buf);
+    return Do_Request(dev, BLOCK_READ, blockNum, 1, buf);
 }
 
 /*
@@ -286,7 +297,36 @@ int Block_Write(struct Block_Device *dev, int blockNum, void *buf) {
     KASSERT(dev);
     KASSERT(buf);
     dev->writes++;
-    return Do_Request(dev, BLOCK_WRITE, blockNum, buf);
+    return Do_Request(dev, BLOCK_WRITE, blockNum, 1, buf);
+}
+
+/*
+ * Read numBlocks contiguous blocks starting at blockNum into buf
+ * with a single request, so the driver can transfer the whole run
+ * at once.
+ * Return 0 if successful, error code on error.
+ */
+int Block_Read_Multi(struct Block_Device *dev, int blockNum, int numBlocks,
+                     void *buf) {
+    KASSERT(dev);
+    KASSERT(buf);
+    KASSERT(numBlocks > 0);
+    dev->reads += numBlocks;
+    return Do_Request(dev, BLOCK_READ, blockNum, numBlocks, buf);
+}
+
+/*
+ * Write numBlocks contiguous blocks starting at blockNum from buf
+ * with a single request.
+ * Return 0 if successful, error code on error.
+ */
+int Block_Write_Multi(struct Block_Device *dev, int blockNum, int numBlocks,
+                      void *buf) {
+    KASSERT(dev);
+    KASSERT(buf);
+    KASSERT(numBlocks > 0);
+    dev->writes += numBlocks;
+    return Do_Request(dev, BLOCK_WRITE, blockNum, numBlocks, buf);
 }
 
 /*
@@ -0,0 +1,81 @@
+/*
+ * Per-CPU rings of fixed-size records, drained to user space
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#include <geekos/cpuring.h>
+#include <geekos/errno.h>
+#include <geekos/defs.h>
+#include <geekos/malloc.h>
+#include <geekos/user.h>
+
+/*
+ * Allocate a ring for each CPU that lacks one, and discard what the
+ * rings hold.  The caller stops writers first.
+ */
+int CPU_Rings_Start(struct CPU_Rings *rings) {
+    int i, count = CPU_Count > 0 ? CPU_Count : 1;
+    struct CPU_Ring *ring;
+
+    for(i = rings->count; i < count; ++i) {
+        ring = &rings->ring[i];
+        ring->records = Malloc(rings->recordSize * rings->size);
+        if(ring->records == NULL)
+            return ENOMEM;
+        ring->head = ring->tail = 0;
+        __sync_synchronize();
+        rings->count = i + 1;
+    }
+
+    for(i = 0; i < rings->count; ++i) {
+        ring = &rings->ring[i];
+        ring->tail = ring->head;
+        ring->droppedBase = ring->dropped;
+    }
+    __sync_synchronize();
+    return 0;
+}
+
+/* records dropped since the last start */
+int CPU_Rings_Dropped(struct CPU_Rings *rings) {
+    int i, dropped = 0;
+
+    for(i = 0; i < rings->count; ++i)
+        dropped += rings->ring[i].dropped - rings->ring[i].droppedBase;
+    return dropped;
+}
+
+/*
+ * Copy up to max records into a user buffer, each CPU's in the order
+ * written.  Returns the number copied, or EINVALID for a bad buffer.
+ */
+int CPU_Rings_Read(struct CPU_Rings *rings, ulong_t userBuffer, int max) {
+    struct CPU_Ring *ring;
+    ulong_t head, run;
+    int i, copied = 0;
+
+    for(i = 0; i < rings->count && copied < max; ++i) {
+        ring = &rings->ring[i];
+        head = ring->head;
+        __sync_synchronize();
+
+        while (ring->tail != head && copied < max) {
+            /* the records up to the end of the ring or the head */
+            run = MIN(head - ring->tail,
+                      rings->size - ring->tail % rings->size);
+            run = MIN(run, (ulong_t) (max - copied));
+            if(!Copy_To_User(userBuffer + copied * rings->recordSize,
+                             ring->records +
+                             (ring->tail % rings->size) * rings->recordSize,
+                             run * rings->recordSize))
+                return EINVALID;
+
+            __sync_synchronize();
+            ring->tail += run;
+            copied += run;
+        }
+    }
+    return copied;
+}
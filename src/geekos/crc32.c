@@ -10,7 +10,16 @@
 #include <geekos/kassert.h>
 
 #define POLYNOMIAL (ulong_t)0xedb88320
-static ulong_t crc_table[256];
+
+/*
+ * Slicing-by-8: crc_table[0] is the classic byte-at-a-time table;
+ * crc_table[k][i] is the CRC of byte i followed by k zero bytes, so
+ * eight table lookups fold in eight bytes at once.
+ */
+static uint_t crc_table[8][256];
+
+/* 32-bit loads from a byte buffer */
+typedef uint_t __attribute__ ((__may_alias__)) crc_word_t;
 
 /*
  * This routine writes each crc_table entry exactly once,
@@ -18,15 +27,19 @@ static ulong_t crc_table[256];
  * even on a table that someone else is using concurrently.
  */
 void Init_CRC32(void) {
-    unsigned int i, j;
+    unsigned int i, j, k;
     ulong_t h = 1;
-    crc_table[0] = 0;
+    crc_table[0][0] = 0;
     for(i = 128; i; i >>= 1) {
         h = (h >> 1) ^ ((h & 1) ? POLYNOMIAL : 0);
-        /* h is now crc_table[i] */
+        /* h is now crc_table[0][i] */
         for(j = 0; j < 256; j += 2 * i)
-            crc_table[i + j] = crc_table[j] ^ h;
+            crc_table[0][i + j] = crc_table[0][j] ^ h;
     }
+    for(k = 1; k < 8; ++k)
+        for(i = 0; i < 256; ++i)
+            crc_table[k][i] = (crc_table[k - 1][i] >> 8) ^
+                crc_table[0][crc_table[k - 1][i] & 0xff];
 }
 
 /*
@@ -40,11 +53,35 @@ void Init_CRC32(void) {
  * property of detecting all burst errors of length 32 bits or less.
  */
 ulong_t crc32(ulong_t crc, char const *buf, size_t len) {
-    KASSERT(crc_table[255] != 0);
-    crc ^= 0xffffffff;
+    const uchar_t *p = (const uchar_t *)buf;
+    uint_t c = crc ^ 0xffffffff, one, two;
+
+    KASSERT(crc_table[0][255] != 0);
+
+    /* a byte at a time up to a word boundary */
+    while (len > 0 && ((ulong_t) p & 3) != 0) {
+        c = (c >> 8) ^ crc_table[0][(c ^ *p++) & 0xff];
+        --len;
+    }
+
+    /* eight bytes per iteration; x86 is little-endian */
+    while (len >= 8) {
+        one = ((const crc_word_t *)p)[0] ^ c;
+        two = ((const crc_word_t *)p)[1];
+        c = crc_table[7][one & 0xff] ^
+            crc_table[6][(one >> 8) & 0xff] ^
+            crc_table[5][(one >> 16) & 0xff] ^
+            crc_table[4][one >> 24] ^
+            crc_table[3][two & 0xff] ^
+            crc_table[2][(two >> 8) & 0xff] ^
+            crc_table[1][(two >> 16) & 0xff] ^ crc_table[0][two >> 24];
+        p += 8;
+        len -= 8;
+    }
+
     while (len--)
-        crc = (crc >> 8) ^ crc_table[(crc ^ *buf++) & 0xff];
-    return crc ^ 0xffffffff;
+        c = (c >> 8) ^ crc_table[0][(c ^ *p++) & 0xff];
+    return c ^ 0xffffffff;
 }
 
 /* end of crc32.c */
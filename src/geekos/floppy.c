@@ -559,7 +559,7 @@ static int Floppy_Write(int driveNum, int blockNum, char *buffer) {
  * This is the thread that processes floppy I/O requests.
  */
 static void Floppy_Request_Thread(ulong_t arg __attribute__ ((unused))) {
-    int rc;
+    int rc, i;
 
     Debug("FRQ: Floppy request thread starting...\n");
 
@@ -573,13 +573,16 @@ static void Floppy_Request_Thread(ulong_t arg __attribute__ ((unused))) {
         KASSERT(request->type == BLOCK_READ ||
                 request->type == BLOCK_WRITE);
 
-        /* Perform the I/O. */
-        if(request->type == BLOCK_READ)
-            rc = Floppy_Read(request->dev->unit, request->blockNum,
-                             request->buf);
-        else
-            rc = Floppy_Write(request->dev->unit, request->blockNum,
-                              request->buf);
+        /* Perform the I/O, one sector at a time. */
+        for(i = 0, rc = 0; i < request->numBlocks && rc == 0; i++) {
+            char *buf = (char *)request->buf + i * SECTOR_SIZE;
+            if(request->type == BLOCK_READ)
+                rc = Floppy_Read(request->dev->unit, request->blockNum + i,
+                                 buf);
+            else
+                rc = Floppy_Write(request->dev->unit,
+                                  request->blockNum + i, buf);
+        }
 
         /* Notify the requesting thread of the outcome of the I/O. */
         Debug("FRQ: Notifying requesting thread...\n");
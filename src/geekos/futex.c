@@ -0,0 +1,144 @@
+/*
+ * Futexes: sleeping and waking keyed by a user address
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#include <geekos/futex.h>
+#include <geekos/errno.h>
+#include <geekos/int.h>
+#include <geekos/kthread.h>
+#include <geekos/list.h>
+#include <geekos/string.h>
+#include <geekos/user.h>
+
+/*
+ * User-mode locks keep their state in an ordinary word of user
+ * memory and only enter the kernel to sleep when they find it taken,
+ * or to wake sleepers when they release it.  A sleeper is keyed by
+ * the kernel address of its word, so threads sharing a User_Context
+ * through Clone() meet on the same key, and unrelated processes
+ * never do.
+ *
+ * Sleepers hang a Futex_Waiter from their kernel stack on the hash
+ * bucket of their key.  FUTEX_WAIT compares the word with the
+ * bucket's lock held and sleeps before dropping it, and FUTEX_WAKE
+ * takes the same lock, so a wake that follows a change to the word
+ * can never slip in between a waiter's check and its sleep.  Buckets
+ * are only locked with interrupts disabled.
+ */
+struct Futex_Waiter;
+
+DEFINE_LIST(Futex_Waiter_List, Futex_Waiter);
+
+struct Futex_Waiter {
+    ulong_t key;
+    struct Thread_Queue waitQueue;
+     DEFINE_LINK(Futex_Waiter_List, Futex_Waiter);
+};
+
+IMPLEMENT_LIST(Futex_Waiter_List, Futex_Waiter);
+
+#define FUTEX_HASH_BITS 6
+static struct Futex_Waiter_List s_futexHash[1 << FUTEX_HASH_BITS];
+
+extern void Schedule_And_Unlock(Spin_Lock_t * unlock_me);
+
+static struct Futex_Waiter_List *Futex_Bucket(ulong_t key) {
+    return &s_futexHash[((key >> 2) * 2654435761U) >>
+                        (32 - FUTEX_HASH_BITS)];
+}
+
+/* the kernel address of an aligned user word, or 0 if it is not valid */
+static ulong_t Futex_Key(ulong_t userAddr) {
+    struct User_Context *userContext = CURRENT_THREAD->userContext;
+
+    if(userContext == NULL || (userAddr & (sizeof(int) - 1)) != 0 ||
+       !Validate_User_Memory(userContext, userAddr, sizeof(int),
+                             VUM_READING))
+        return 0;
+    return (ulong_t) User_To_Kernel(userContext, userAddr);
+}
+
+static int Futex_Wait(ulong_t key, int value) {
+    struct Futex_Waiter waiter;
+    struct Futex_Waiter_List *bucket = Futex_Bucket(key);
+    bool iflag = Begin_Int_Atomic();
+
+    Lock_Futex_Waiter_List(bucket);
+    if(*(volatile int *)key != value) {
+        Unlock_Futex_Waiter_List(bucket);
+        End_Int_Atomic(iflag);
+        return EWOULDBLOCK;
+    }
+
+    memset(&waiter, '\0', sizeof(waiter));
+    waiter.key = key;
+    Clear_Thread_Queue(&waiter.waitQueue);
+    Locked_Unchecked_Add_To_Back_Of_Futex_Waiter_List(bucket, &waiter);
+    Add_To_Back_Of_Thread_Queue(&waiter.waitQueue, CURRENT_THREAD);
+
+    /* FUTEX_WAKE unlinks the waiter before waking us */
+    Schedule_And_Unlock(&bucket->lock);
+
+    /*
+     * The waker may still be inside Wake_Up() on waiter.waitQueue,
+     * which lives on this stack; it holds the bucket lock until done.
+     */
+    Lock_Futex_Waiter_List(bucket);
+    Unlock_Futex_Waiter_List(bucket);
+    End_Int_Atomic(iflag);
+    return 0;
+}
+
+/* returns the number of threads woken */
+static int Futex_Wake(ulong_t key, int count) {
+    struct Futex_Waiter_List *bucket = Futex_Bucket(key);
+    struct Futex_Waiter *waiter, *next;
+    int woken = 0;
+    bool iflag = Begin_Int_Atomic();
+
+    Lock_Futex_Waiter_List(bucket);
+    for(waiter = Get_Front_Of_Futex_Waiter_List(bucket);
+        waiter != NULL && woken < count; waiter = next) {
+        next = Get_Next_In_Futex_Waiter_List(waiter);
+        if(waiter->key != key)
+            continue;
+        Locked_Remove_From_Futex_Waiter_List(bucket, waiter);
+        Wake_Up(&waiter->waitQueue);
+        ++woken;
+    }
+    Unlock_Futex_Waiter_List(bucket);
+
+    End_Int_Atomic(iflag);
+    return woken;
+}
+
+/*
+ * Sleep on or wake a user word.
+ * Params:
+ *   state->ebx - FUTEX_WAIT or FUTEX_WAKE
+ *   state->ecx - user address of the word, aligned to its size
+ *   state->edx - WAIT: the value the word must still hold to sleep;
+ *     WAKE: the most threads to wake
+ * Returns: WAIT: 0 once woken, or EWOULDBLOCK if the word no longer
+ *   held the value; WAKE: the number of threads woken; or error code
+ *   (< 0) on error
+ */
+int Sys_Futex(struct Interrupt_State *state) {
+    ulong_t key = Futex_Key(state->ecx);
+
+    if(key == 0)
+        return EINVALID;
+
+    switch (state->ebx) {
+        case FUTEX_WAIT:
+            return Futex_Wait(key, (int)state->edx);
+        case FUTEX_WAKE:
+            return (int)state->edx <= 0 ? EINVALID :
+                Futex_Wake(key, (int)state->edx);
+        default:
+            return EINVALID;
+    }
+}
@@ -82,6 +82,7 @@ static int GFS2_Close(struct File *file) {
     &GFS2_Seek,
     &GFS2_Close,
     0,                          /* Read_Entry */
+    0,                          /* Poll */
 };
 
 /*
@@ -117,6 +118,7 @@ static int GFS2_Read_Entry(struct File *dir, struct VFS_Dir_Entry *entry) {
     0,                          /* Seek */
     &GFS2_Close_Directory,
     &GFS2_Read_Entry,
+    0,                          /* Poll */
 };
 
 
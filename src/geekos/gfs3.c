@@ -31,6 +31,30 @@
  * Private data and functions
  * ---------------------------------------------------------------------- */
 
+#define GFS3_ICACHE_BUCKETS 64
+#define GFS3_DCACHE_SLOTS 256
+
+/*
+ * In-memory copy of an on-disk inode, hashed by inode number.
+ * Entries live until unmount, so pointers from get_inode stay valid.
+ */
+struct gfs3_icache_entry {
+    gfs3_inodenum inum;
+    struct gfs3_inode inode;
+    struct gfs3_icache_entry *next;
+};
+
+/*
+ * Direct-mapped cache of (directory, name) -> inode lookups.
+ * inum 0 is a negative entry: the name is known to be absent.
+ * dir 0 marks an unused slot.
+ */
+struct gfs3_dcache_entry {
+    gfs3_inodenum dir;
+    gfs3_inodenum inum;
+    char name[GFS3_MAX_PREFIX_LEN + 1];
+};
+
 struct GFS3_Instance {
     struct gfs3_superblock *superblock;
     ulong_t block_with_root;
@@ -38,6 +62,11 @@ struct GFS3_Instance {
     struct gfs3_inode *root_dir_inode;
     struct gfs3_dirent *root_dirent;
     char *bitmap;
+    struct Bit_Set_Index *free_map;    /* search index over bitmap */
+    struct Mutex cache_lock;           /* protects icache and dcache */
+    struct gfs3_icache_entry *icache[GFS3_ICACHE_BUCKETS];
+    struct gfs3_dcache_entry dcache[GFS3_DCACHE_SLOTS];
+    unsigned int dcache_gen;           /* bumped by each dcache_flush */
     // TODO
 };
 
@@ -121,28 +150,137 @@ ulong_t block_num_root(struct GFS3_Instance *inst){
 
 
 
-struct gfs3_inode *get_inode(struct FS_Buffer_Cache *bc, gfs3_inodenum inodenum){
+// copy inode inodenum out of the inode table
+static int read_inode(struct GFS3_Instance *inst, gfs3_inodenum inodenum,
+                      struct gfs3_inode *inode){
+    struct FS_Buffer *buf;
+    int rc = Get_FS_Buffer(inst->fs_buf_cache, BLOCKNUM_FROM_INODENUM(inodenum), &buf);
+    if (rc != 0){
+        return rc;
+    }
+    memcpy(inode, (char *)buf->data + OFFSET_IN_BLOCK(inodenum), sizeof(struct gfs3_inode));
+    Release_FS_Buffer(inst->fs_buf_cache, buf);
+    return 0;
+}
+
+static struct gfs3_icache_entry *icache_find(struct GFS3_Instance *inst,
+                                             gfs3_inodenum inodenum){
+    struct gfs3_icache_entry *entry;
+
+    KASSERT(IS_HELD(&inst->cache_lock));
+    for (entry = inst->icache[inodenum % GFS3_ICACHE_BUCKETS]; entry != 0; entry = entry->next){
+        if (entry->inum == inodenum){
+            return entry;
+        }
+    }
+    return 0;
+}
+
+// return the cached copy of an inode, reading it in on first use
+struct gfs3_inode *get_inode(struct GFS3_Instance *inst, gfs3_inodenum inodenum){
+    struct gfs3_icache_entry *entry, *other;
+
+    Mutex_Lock(&inst->cache_lock);
+    entry = icache_find(inst, inodenum);
+    Mutex_Unlock(&inst->cache_lock);
+    if (entry != 0){
+        return &entry->inode;
+    }
 
-    ulong_t block_num = BLOCKNUM_FROM_INODENUM(inodenum);
-    //Print("\tlooking for inode # %u in block %u with offset %d\n",
-    //      inodenum, (unsigned int)block_num, OFFSET_IN_BLOCK(inodenum) );
+    entry = (struct gfs3_icache_entry *)Malloc(sizeof(*entry));
+    if (entry == 0){
+        return 0;
+    }
+    entry->inum = inodenum;
+    if (read_inode(inst, inodenum, &entry->inode) != 0){
+        Free(entry);
+        return 0;
+    }
 
-    struct FS_Buffer *buf;
-    /*int n = */Get_FS_Buffer(bc, block_num, &buf);
-    //if (n != 0){
-    //    Print("\tn = %d\n",n);
-    //}
+    // someone may have read it in while we were waiting for the disk
+    Mutex_Lock(&inst->cache_lock);
+    other = icache_find(inst, inodenum);
+    if (other == 0){
+        entry->next = inst->icache[inodenum % GFS3_ICACHE_BUCKETS];
+        inst->icache[inodenum % GFS3_ICACHE_BUCKETS] = entry;
+    }
+    Mutex_Unlock(&inst->cache_lock);
 
-    //Print("\treading with offset = %u\n", OFFSET_IN_BLOCK(inodenum));
-    struct gfs3_inode *inode = (struct gfs3_inode *)(buf->data + OFFSET_IN_BLOCK(inodenum));
+    if (other != 0){
+        Free(entry);
+        entry = other;
+    }
+    return &entry->inode;
+}
+
+// reload a cached inode after its slot in the inode table was changed directly
+static void refresh_inode(struct GFS3_Instance *inst, gfs3_inodenum inodenum){
+    struct gfs3_icache_entry *entry;
+
+    Mutex_Lock(&inst->cache_lock);
+    entry = icache_find(inst, inodenum);
+    Mutex_Unlock(&inst->cache_lock);
+    if (entry != 0){
+        read_inode(inst, inodenum, &entry->inode);
+    }
+}
+
+static unsigned int dcache_slot(gfs3_inodenum dir, const char *name){
+    unsigned int hash = dir * 31;
+    while (*name != '\0'){
+        hash = hash * 33 + (unsigned char)*name++;
+    }
+    return hash % GFS3_DCACHE_SLOTS;
+}
+
+// true if (dir, name) is cached; *inum is 0 for a negative entry.
+// On a miss, *gen is what to pass to dcache_insert after the scan.
+static bool dcache_lookup(struct GFS3_Instance *inst, gfs3_inodenum dir,
+                          const char *name, gfs3_inodenum *inum,
+                          unsigned int *gen){
+    struct gfs3_dcache_entry *entry = &inst->dcache[dcache_slot(dir, name)];
+    bool hit;
+
+    Mutex_Lock(&inst->cache_lock);
+    hit = entry->dir == dir && strcmp(entry->name, name) == 0;
+    if (hit){
+        *inum = entry->inum;
+    }
+    *gen = inst->dcache_gen;
+    Mutex_Unlock(&inst->cache_lock);
+    return hit;
+}
+
+// cache a scan begun at generation gen, unless a flush came since:
+// the directory may have changed under the scan
+static void dcache_insert(struct GFS3_Instance *inst, gfs3_inodenum dir,
+                          const char *name, gfs3_inodenum inum,
+                          unsigned int gen){
+    struct gfs3_dcache_entry *entry = &inst->dcache[dcache_slot(dir, name)];
+    size_t len = strlen(name);
+
+    if (len > GFS3_MAX_PREFIX_LEN){
+        return;
+    }
+    Mutex_Lock(&inst->cache_lock);
+    if (inst->dcache_gen == gen){
+        entry->dir = dir;
+        entry->inum = inum;
+        memcpy(entry->name, name, len + 1);
+    }
+    Mutex_Unlock(&inst->cache_lock);
+}
 
-    Release_FS_Buffer(bc, buf);
-    //print_inode(inode, inodenum);
-    return inode;
+// forget all cached names; called whenever a directory changes
+static void dcache_flush(struct GFS3_Instance *inst){
+    Mutex_Lock(&inst->cache_lock);
+    memset(inst->dcache, '\0', sizeof(inst->dcache));
+    ++inst->dcache_gen;
+    Mutex_Unlock(&inst->cache_lock);
 }
 
 struct gfs3_inode * get_root_node(struct GFS3_Instance *inst){
-    return get_inode(inst->fs_buf_cache, 1);
+    return get_inode(inst, 1);
     /*
     struct FS_Buffer *buf;
     int n = Get_FS_Buffer(inst->fs_buf_cache, block_num_root(inst), &buf);
@@ -155,8 +293,11 @@ struct gfs3_inode * get_root_node(struct GFS3_Instance *inst){
 
 
 
-unsigned int get_inode_size(struct FS_Buffer_Cache *bc, gfs3_inodenum inodenum){
-    struct gfs3_inode *node = get_inode(bc, inodenum);
+unsigned int get_inode_size(struct GFS3_Instance *inst, gfs3_inodenum inodenum){
+    struct gfs3_inode *node = get_inode(inst, inodenum);
+    if (node == NULL){
+        return 0;
+    }
     return node->size;
 }
 
@@ -167,8 +308,11 @@ bool is_dir(struct gfs3_inode * inode){
 }
 
 
-bool inode_is_dir(struct FS_Buffer_Cache *bc, gfs3_inodenum inodenum){
-    struct gfs3_inode *node = get_inode(bc, inodenum);
+bool inode_is_dir(struct GFS3_Instance *inst, gfs3_inodenum inodenum){
+    struct gfs3_inode *node = get_inode(inst, inodenum);
+    if (node == NULL){
+        return false;
+    }
     if (node->type != GFS3_FILE && node->type != GFS3_DIRECTORY){
         print_inode(node,inodenum);
     }
@@ -219,7 +363,7 @@ bool file_in_dirent(
         extract_dirent_name(current, current_name);
 
         // compare name to what we are looking for
-        bool found = strncmp(name, current_name, strlen(name)) == 0;
+        bool found = strcmp(name, current_name) == 0;
         if (found){
             // Print("\t found file! Looked for \"%s\", found \"%s\"\n",name, current_name);
             *target = current->inum;
@@ -316,10 +460,37 @@ bool valid_path(const char *path){
 
 }
 
-// return 0 if directory not found
-gfs3_inodenum lookup(struct GFS3_Instance *instance, const char *path, struct gfs3_inode **node){
+// look name up in directory dir_num, consulting the dirent cache first
+static bool find_in_dir(struct GFS3_Instance *instance, gfs3_inodenum dir_num,
+                        struct gfs3_inode *dir, const char *name, gfs3_inodenum *target){
+    gfs3_inodenum inum = 0;
+    unsigned int gen;
+
+    if (!dcache_lookup(instance, dir_num, name, &inum, &gen)){
+        struct gfs3_dirent *dirent = get_dirent(instance->fs_buf_cache, dir);
+        if (dirent == NULL || !file_in_dirent(instance->fs_buf_cache, dirent, dir->size,
+                                              (char *)name, &inum)){
+            inum = 0;
+        }
+        dcache_insert(instance, dir_num, name, inum, gen);
+    }
+
+    if (inum == 0){
+        return false;
+    }
+    *target = inum;
+    return true;
+}
+
+// return 0 if directory not found, ENOMEM if an inode could not be read in
+int lookup(struct GFS3_Instance *instance, const char *path, struct gfs3_inode **node){
     struct gfs3_inode *root = get_root_node(instance);
 
+    *node = NULL;
+    if (root == NULL){
+        return ENOMEM;
+    }
+
     // looking for root
     if (strcmp(path, "/") == 0){
         *node = root;
@@ -337,7 +508,6 @@ gfs3_inodenum lookup(struct GFS3_Instance *instance, const char *path, struct gf
     // Print("suffix = %s\n", suffix);
 
     struct gfs3_inode *current_inode = root;
-    struct gfs3_dirent *current_dirent;
     gfs3_inodenum target = 1;
 
 //    int i = 0;
@@ -350,10 +520,7 @@ gfs3_inodenum lookup(struct GFS3_Instance *instance, const char *path, struct gf
         if (!is_dir(current_inode)){
             Print("current inode is not direcotort\n" );
         }
-        current_dirent = get_dirent(instance->fs_buf_cache, current_inode);
-
-        bool is_present =
-                file_in_dirent(instance->fs_buf_cache, current_dirent, current_inode->size, prefix, &target);
+        bool is_present = find_in_dir(instance, target, current_inode, prefix, &target);
         if (!is_present){
             // Print("\t did not find file or directory...\n");
             *node = NULL;
@@ -364,8 +531,10 @@ gfs3_inodenum lookup(struct GFS3_Instance *instance, const char *path, struct gf
         // Print("--> prefix \"%s\" found. Its inode is %u\n", prefix, target);
 
 
-        current_inode = get_inode(instance->fs_buf_cache, target);
-        is_dir(current_inode);
+        current_inode = get_inode(instance, target);
+        if (current_inode == NULL){
+            return ENOMEM;
+        }
 
 
         strncpy(mutable_path,suffix,GFS3_MAX_PATH_LEN+1);
@@ -374,10 +543,8 @@ gfs3_inodenum lookup(struct GFS3_Instance *instance, const char *path, struct gf
 
 
     // prefix now hold last part of path and current_inode is the inode of the final directory
-    struct gfs3_dirent *final_dirent = get_dirent(instance->fs_buf_cache, current_inode);
     gfs3_inodenum file_inodenum;
-    bool file_found =
-            file_in_dirent(instance->fs_buf_cache, final_dirent, current_inode->size,prefix,&file_inodenum);
+    bool file_found = find_in_dir(instance, target, current_inode, prefix, &file_inodenum);
     if (!file_found){
         *node = current_inode;
         Print("found directory, but not file in that directory...\n");
@@ -385,7 +552,10 @@ gfs3_inodenum lookup(struct GFS3_Instance *instance, const char *path, struct gf
     }
 
     // get
-    *node = get_inode(instance->fs_buf_cache, file_inodenum);
+    *node = get_inode(instance, file_inodenum);
+    if (*node == NULL){
+        return ENOMEM;
+    }
     return file_inodenum;
 }
 
@@ -407,7 +577,10 @@ gfs3_inodenum next_unused_inode(struct GFS3_Instance * inst){
     struct gfs3_inode *node;
 
     for(i = 1; i < 50; i++){
-        node = get_inode(inst->fs_buf_cache, i);
+        node = get_inode(inst, i);
+        if (node == NULL){
+            return 0;
+        }
         //print_inode(node, i);
 
         bool is_file = node->type == GFS3_FILE;
@@ -445,55 +618,13 @@ struct gfs3_inode *init_file_inode(struct GFS3_Instance *inst, gfs3_inodenum inu
     //Sync_FS_Buffer_Cache(inst->fs_buf_cache);
     //Print("all good so far...\n");
     Release_FS_Buffer(inst->fs_buf_cache, buf);
+    Free(inode);
 
-    return inode;
+    refresh_inode(inst, inum);
+    return get_inode(inst, inum);
 }
 
 
-// return false if pos is outside all extents
-bool pos_in_extents(struct GFS3_File *gfile, ulong_t pos, ulong_t *ext_id, ulong_t *free_in_ext){
-    if (gfile->inode->extents[0].length_blocks == 0){
-        *ext_id = 0;
-        *free_in_ext = 0;
-        return false;
-    }
-    ulong_t size_ext0 = gfile->inode->extents[0].length_blocks * GFS3_BLOCK_SIZE;
-    if (size_ext0 > pos){
-        // position is in the first extent
-        *ext_id = 0;
-        *free_in_ext = size_ext0 - pos;
-        return true;
-    }
-
-    if (gfile->inode->extents[1].length_blocks == 0){
-        *ext_id = 1;
-        *free_in_ext = 0;
-        return false;
-    }
-    ulong_t size_ext1 = gfile->inode->extents[1].length_blocks * GFS3_BLOCK_SIZE;
-    if (size_ext1 > (pos - size_ext0)){
-        // position is in second extent
-        *ext_id = 1;
-        *free_in_ext = size_ext1 - (pos - size_ext0);
-        return true;
-    }
-
-    if (gfile->inode->extents[2].length_blocks == 0){
-        *ext_id = 2;
-        *free_in_ext = 0;
-        return false;
-    }
-    ulong_t size_ext2 = gfile->inode->extents[2].length_blocks * GFS3_BLOCK_SIZE;
-    if (size_ext2 > (pos - size_ext0 - size_ext1)){
-        *ext_id = 2;
-        *free_in_ext = size_ext2 - (pos - size_ext0 - size_ext1);
-        return true;
-    }
-
-    return false;
-
-}
-
 // -1 if no free
 int id_of_next_free_extent(struct gfs3_inode *inode){
     if (inode->extents[0].length_blocks == 0){
@@ -572,49 +703,209 @@ bool has_data(struct gfs3_extent *extent){
     return extent->length_blocks > 0;
 }
 
-ulong_t get_extent_num(struct gfs3_inode *inode, ulong_t file_pos, gfs3_blocknum *pos_block){
+/*
+ * A contiguous piece of file data on disk: numBlocks blocks starting
+ * at disk block start.
+ */
+struct gfs3_run {
+    gfs3_blocknum start;
+    ulong_t numBlocks;
+};
+
+/*
+ * Resolve file blocks [fileBlock, fileBlock + numBlocks) against the
+ * inode's extent list in a single pass.  Fills runs[] with one entry
+ * per extent touched and returns the number of entries; the runs
+ * cover fewer than numBlocks blocks if the range extends past the
+ * allocated extents.
+ */
+static int map_extent_runs(struct gfs3_inode *inode, ulong_t fileBlock,
+                           ulong_t numBlocks,
+                           struct gfs3_run runs[GFS3_EXTENTS]) {
+    int i, numRuns = 0;
+
+    for(i = 0; i < GFS3_EXTENTS && numBlocks > 0; i++) {
+        struct gfs3_extent *extent = &inode->extents[i];
+        ulong_t avail;
+
+        if(!has_data(extent))
+            break;
+        if(fileBlock >= extent->length_blocks) {
+            fileBlock -= extent->length_blocks;
+            continue;
+        }
+
+        avail = extent->length_blocks - fileBlock;
+        if(avail > numBlocks)
+            avail = numBlocks;
+        runs[numRuns].start = extent->start_block + fileBlock;
+        runs[numRuns].numBlocks = avail;
+        ++numRuns;
 
-    gfs3_blocknum sequential_block = file_pos / GFS3_BLOCK_SIZE;
-    Print("sequential block = %d\n", sequential_block);
+        numBlocks -= avail;
+        fileBlock = 0;
+    }
 
-    gfs3_blocknum total = 0;
-    // check in extent 0
-    struct gfs3_extent *ext0 = get_extent(inode, 0);
-    gfs3_blocknum start0 = 0;
-    gfs3_blocknum len0 = 0;
+    return numRuns;
+}
 
-    get_start_block(ext0, &start0,&len0);
-    if (len0 > sequential_block){
-        *pos_block = start0 + sequential_block;
+/*
+ * Move numBytes between buf and the file data starting at byte pos.
+ * Whole blocks of each extent run go directly between the caller's
+ * buffer and the disk in one multi-block transfer; only a partial
+ * first or last block is staged through file_data_cache.  File data
+ * never goes through the buffer cache.  The range must already be
+ * backed by extents.
+ */
+static int transfer_file_data(struct File *file, char *buf, ulong_t pos,
+                              ulong_t numBytes, bool write) {
+    struct GFS3_File *gfs3_file = (struct GFS3_File *)file->fsData;
+    struct Block_Device *dev = file->mountPoint->dev;
+    char *cache = gfs3_file->file_data_cache;
+    struct gfs3_run runs[GFS3_EXTENTS];
+    ulong_t firstBlock = pos / GFS3_BLOCK_SIZE;
+    ulong_t lastBlock = (pos + numBytes - 1) / GFS3_BLOCK_SIZE;
+    ulong_t offset = pos % GFS3_BLOCK_SIZE;
+    ulong_t done = 0;
+    int numRuns, i, rc;
+
+    if(numBytes == 0)
         return 0;
-    }
-    total += len0;
 
-    // check extent 1
-    struct gfs3_extent *ext1 = get_extent(inode, 1);
-    gfs3_blocknum start1 = 0;
-    gfs3_blocknum len1 = 0;
-    get_start_block(ext1, &start1,&len1);
-    total += len1;
-    if (total > sequential_block){
-        *pos_block = start1 + sequential_block - len0;
-        return 1;
+    numRuns = map_extent_runs(gfs3_file->inode, firstBlock,
+                              lastBlock - firstBlock + 1, runs);
+
+    for(i = 0; i < numRuns; i++) {
+        gfs3_blocknum block = runs[i].start;
+        ulong_t left = runs[i].numBlocks;
+
+        while (left > 0) {
+            ulong_t remaining = numBytes - done;
+
+            if(offset != 0 || remaining < GFS3_BLOCK_SIZE) {
+                /* partial block */
+                ulong_t count = GFS3_BLOCK_SIZE - offset;
+                if(count > remaining)
+                    count = remaining;
+
+                /* no need to read a block that lies entirely past EOF */
+                if(!write || pos + done - offset < file->endPos) {
+                    rc = Block_Read(dev, (int)block, cache);
+                    if(rc != 0)
+                        return EIO;
+                } else {
+                    memset(cache, '\0', GFS3_BLOCK_SIZE);
+                }
+
+                if(write) {
+                    memcpy(cache + offset, buf + done, count);
+                    rc = Block_Write(dev, (int)block, cache);
+                    if(rc != 0)
+                        return EIO;
+                } else {
+                    memcpy(buf + done, cache + offset, count);
+                }
+
+                done += count;
+                offset = 0;
+                ++block;
+                --left;
+            } else {
+                /* aligned run of whole blocks, straight to/from buf */
+                ulong_t count = remaining / GFS3_BLOCK_SIZE;
+                if(count > left)
+                    count = left;
+
+                if(write)
+                    rc = Block_Write_Multi(dev, (int)block, (int)count,
+                                           buf + done);
+                else
+                    rc = Block_Read_Multi(dev, (int)block, (int)count,
+                                          buf + done);
+                if(rc != 0)
+                    return EIO;
+
+                done += count * GFS3_BLOCK_SIZE;
+                block += count;
+                left -= count;
+            }
+        }
     }
 
-    // check extent 2
-    struct gfs3_extent *ext2 = get_extent(inode, 2);
-    gfs3_blocknum start2 = 0;
-    gfs3_blocknum len2 = 0;
-    get_start_block(ext2, &start2,&len2);
-    total += len2;
-    if (total > sequential_block){
-        *pos_block = start2 + sequential_block - len1;
-        return 2;
+    return done == numBytes ? 0 : EIO;
+}
+
+/*
+ * Make sure the inode's extents hold at least numBlocks blocks.
+ * The last extent is extended in place when the blocks following it
+ * are free; otherwise the next unused extent gets a new run.
+ */
+static int grow_extents(struct GFS3_Instance *instance,
+                        struct gfs3_inode *inode, ulong_t numBlocks) {
+    struct gfs3_extent *extent;
+    ulong_t have = 0, need, i;
+    int last = -1, next, freeBlk;
+
+    for(next = 0; next < GFS3_EXTENTS; next++) {
+        if(!has_data(&inode->extents[next]))
+            break;
+        have += inode->extents[next].length_blocks;
+        last = next;
+    }
+    if(have >= numBlocks)
+        return 0;
+    need = numBlocks - have;
+
+    if(last >= 0) {
+        extent = &inode->extents[last];
+        for(i = 0; i < need; i++) {
+            ulong_t blk = extent->start_block + extent->length_blocks + i;
+            if(blk >= instance->free_map->totalBits
+               || Is_Bit_Set(instance->bitmap, (uint_t)blk))
+                break;
+        }
+        if(i == need) {
+            Index_Set_Bits(instance->free_map,
+                           extent->start_block + extent->length_blocks,
+                           (uint_t)need);
+            extent->length_blocks += (gfs3_blocknum)need;
+            return 0;
+        }
     }
 
+    if(next >= GFS3_EXTENTS)
+        return ENOSPACE;        /* must coalesce; TODO */
 
-    KASSERT(false);
+    freeBlk = Index_Find_First_N_Free(instance->free_map, (uint_t)need);
+    if(freeBlk < 0)
+        return ENOSPACE;
 
+    Index_Set_Bits(instance->free_map, (uint_t)freeBlk, (uint_t)need);
+    inode->extents[next].start_block = (gfs3_blocknum)freeBlk;
+    inode->extents[next].length_blocks = (gfs3_blocknum)need;
+    return 0;
+}
+
+/*
+ * Write an in-memory inode back to its slot in the inode table.
+ */
+static int write_back_inode(struct GFS3_Instance *instance,
+                            gfs3_inodenum inodenum,
+                            struct gfs3_inode *inode) {
+    struct FS_Buffer *buf;
+    void *slot;
+    int rc;
+
+    rc = Get_FS_Buffer(instance->fs_buf_cache,
+                       BLOCKNUM_FROM_INODENUM(inodenum), &buf);
+    if(rc != 0)
+        return rc;
+    Modify_FS_Buffer(instance->fs_buf_cache, buf);
+    slot = (char *)buf->data + OFFSET_IN_BLOCK(inodenum);
+    if(slot != (void *)inode)
+        memcpy(slot, inode, sizeof(struct gfs3_inode));
+    Release_FS_Buffer(instance->fs_buf_cache, buf);
+    return 0;
 }
 
 
@@ -652,280 +943,78 @@ static int GFS3_FStat(struct File *file, struct VFS_File_Stat *stat) {
  * Read data from current position in file.
  */
 static int GFS3_Read(struct File *file, void *buf, ulong_t numBytes) {
-
-    struct GFS3_File *gfs3_file = (struct GFS3_File * )file->fsData;
-    //struct GFS3_Instance *instance = (struct GFS3_Instance *)file->mountPoint->fsData;
-
-    // print_inode(gfs3_file->inode,gfs3_file->inodenum);
-
+    struct GFS3_File *gfs3_file = (struct GFS3_File *)file->fsData;
     ulong_t start, end;
-    ulong_t i;
+    int rc;
 
-    start = file->filePos;
-    end = file->filePos + numBytes;
-
-    if (is_dir(gfs3_file->inode)){
+    if(is_dir(gfs3_file->inode)) {
         return 0;
-        return EINVALID;
     }
 
-    if (end > file->endPos){
-        numBytes = file->endPos - file->filePos;
-        end = file->endPos;
-    }
-
-    // Make sure request represents a valid range within the file
-    if(start >= file->endPos || end > file->endPos || end < start) {
+    start = file->filePos;
+    if(start >= file->endPos) {
         return EINVALID;
     }
 
-
-    gfs3_blocknum start_block = 0;
-    get_extent_num(gfs3_file->inode, file->filePos, &start_block);
-
-    gfs3_blocknum end_block = 0;
-    get_extent_num(gfs3_file->inode, file->filePos + numBytes, &end_block);
-    // Print("read from filepos %d with size %d\n", (int)file->filePos, (int)numBytes);
-
-    // Print("starting to read from block #%d -->#%d\n", start_block, end_block);
-
-   //  Print("start_block = %d, end_block = %d\n", start_block, end_block);
-
-    gfs3_blocknum first_block = gfs3_file->inode->extents[0].start_block;
-
-    // TODO: this will not work if we're in a second or third extent.
-    ulong_t start_offset = start - (start_block -first_block) * GFS3_BLOCK_SIZE;
-    // Print("start_offset = %d\n", (int)start_offset);
-
-    gfs3_blocknum current_block = start_block;
-    ulong_t num_bytes_read = 0;
-
-    for (i = start_block; i <= end_block; i++){
-        int rc;
-
-        rc = Block_Read(file->mountPoint->dev, current_block, gfs3_file->file_data_cache);
-        if (rc != 0) {
-            Print("Error while reading block\n");
-            return EIO;
-        }
-
-
-        if (i == start_block){
-            // only copy parts of the first block
-            //Print("Reading from start block\n");
-
-            if (numBytes < GFS3_BLOCK_SIZE - start_offset){
-                // reading less than to end one block
-                // Print("\tReading less than to end of one block\n");
-                // KASSERT(end_block == i + 1);
-                memcpy(buf,gfs3_file->file_data_cache + start_offset, numBytes);
-                num_bytes_read += numBytes;
-            } else {
-                // Print("\tReading less more than one block\n");
-
-                // KASSERT(end_block >= i+1);
-                memcpy(buf, gfs3_file->file_data_cache + start_offset, GFS3_BLOCK_SIZE - start_offset);
-                num_bytes_read +=  GFS3_BLOCK_SIZE - start_offset;
-            }
-        } else if (i == end_block -1) {
-            // last block to read from
-            ulong_t to_read = numBytes-num_bytes_read;
-            memcpy(buf + num_bytes_read, gfs3_file->file_data_cache, to_read);
-            num_bytes_read += to_read;
-        } else {
-            // blocks in between
-            // Print("Reading from block in the middle\n");
-
-            memcpy(buf+num_bytes_read, gfs3_file->file_data_cache, GFS3_BLOCK_SIZE);
-            num_bytes_read += GFS3_BLOCK_SIZE;
-        }
+    end = start + numBytes;
+    if(end > file->endPos || end < start) {
+        end = file->endPos;
     }
+    numBytes = end - start;
 
-    // update file location
-    file->filePos += num_bytes_read;
-    // Print("bytes read (%d/%d)  [actually read / supposed to read]\n", (int)num_bytes_read, (int)numBytes);
-    KASSERT(num_bytes_read == numBytes);
-    // Print("successfully read %d bytes\n", (int)numBytes);
-    return (int) num_bytes_read;
-
-
-
-
-
-
-    TODO_P(PROJECT_GFS3, "GeekOS filesystem read operation");
+    rc = transfer_file_data(file, (char *)buf, start, numBytes, false);
+    if(rc != 0) {
+        return rc;
+    }
 
-    return EUNSUPPORTED;
+    file->filePos += numBytes;
+    return (int)numBytes;
 }
 
 /*
  * Write data to current position in file.
  */
 static int GFS3_Write(struct File *file, void *buf, ulong_t numBytes) {
-
-    //ulong_t start_blk, end_blk, current_blk;
-    //start_blk = Round_Down_To_Block(file->filePos);
-    //end_blk = Round_Up_To_Block(file->endPos);
-    //return 0;
-
-    struct GFS3_Instance *instance = (struct GFS3_Instance *)file->mountPoint->fsData;
+    struct GFS3_Instance *instance =
+        (struct GFS3_Instance *)file->mountPoint->fsData;
     struct GFS3_File *gfs3_file = (struct GFS3_File *)file->fsData;
-    Print("############# WRITE %d bytes ##################\n", (int)numBytes);
-    Print("inode before write:\n");
-    print_inode(gfs3_file->inode, gfs3_file->inodenum);
-
-    Print("want to write from pos %d --> %d\n",
-          (int)file->filePos, (int)(file->filePos + numBytes));
-
-
-
-
-
-    bool need_to_increase_size = file->filePos + numBytes > file->endPos;
-    if (!need_to_increase_size){
-        Print("writing in the middle of the file \n");
-        /*
-        ulong_t file_pos_blk = Round_Down_To_Block(file->filePos);
-        Print("file_pos_blk = %d\n", (int)file_pos_blk);
-
-        uint_t blks_in_ext0 = gfs3_file->inode->extents[0].length_blocks;
-        uint_t blks_in_ext1 = gfs3_file->inode->extents[1].length_blocks;
-        uint_t blks_in_ext2 = gfs3_file->inode->extents[2].length_blocks;
-
-        bool in_1st_extent =  blks_in_ext0 > file_pos_blk;
-        bool in_2nd_extent = blks_in_ext0 + blks_in_ext1 > file_pos_blk;
-
-        if (in_1st_extent){
-            gfs3_blocknum start_ext0 = gfs3_file->inode->extents[0].start_block;
-
-            struct FS_Buffer *fBuf;
-            Get_FS_Buffer(instance->fs_buf_cache, start_ext0 + file_pos_blk, &fBuf);
-
-            ulong_t offset_in_blk = file->filePos - (Round_Down_To_Block(file->filePos) * GFS3_BLOCK_SIZE);
-
-            Print("starting writing in extent[0] with blk_offset %d and byte offset %d\n",
-                  (int)file_pos_blk, (int)offset_in_blk);
-
-            memcpy(fBuf + file_pos_blk*GFS3_BLOCK_SIZE +  offset_in_blk, buf,numBytes);
-            Release_FS_Buffer(instance->fs_buf_cache, fBuf);
-            return (int) numBytes;
-
-        } else if (in_2nd_extent){
-
-        } else {
-
-        }
-
+    ulong_t end = file->filePos + numBytes;
+    ulong_t blocksNeeded;
+    int rc;
 
-    */
-
-        return (int) numBytes;
+    if(numBytes == 0) {
+        return 0;
     }
-
-    ulong_t id, free_in_ext;
-    bool starting_in_existing_extent = pos_in_extents(gfs3_file, file->filePos, &id, &free_in_ext);
-
-
-    bool fits_in_existing_extent = (numBytes <= free_in_ext) && starting_in_existing_extent;
-    if (fits_in_existing_extent){
-        Print("extent id = %d, free in extent %d\n", (int)id, (int) free_in_ext);
-        // trivial write...
-        Print("fits in current extent[%d]. Just have to append to it\n", (int)id);
-        struct FS_Buffer *fBuf;
-        Get_FS_Buffer(instance->fs_buf_cache, gfs3_file->inode->extents[id].start_block, &fBuf);
-        Modify_FS_Buffer(instance->fs_buf_cache, fBuf);
-        memcpy(fBuf->data + file->filePos,buf, numBytes);
-        Release_FS_Buffer(instance->fs_buf_cache, fBuf);
-
-        goto cleanup;
+    if(end < file->filePos) {
+        return EINVALID;
     }
 
-
-
-
-    Print("Doesn't fit in current extents...Have to alloc some...\n");
-    ulong_t extra_needed_space = (numBytes-free_in_ext);
-    ulong_t blks_needed = 1 + extra_needed_space / GFS3_BLOCK_SIZE;
-    Print("We need %d extra blocks. Can stuff %d bytes in existing blocks, but need room for %d\n",
-          (int)blks_needed, (int)free_in_ext, (int)extra_needed_space);
-    uint_t free_blk = (uint_t)Find_First_N_Free(instance->bitmap, (uint_t)blks_needed, GFS3_BITMAP_SIZE);
-    Print("next free block turned out to be #%d\n", (int)free_blk);
-
-
-    unsigned int last_blk = gfs3_file->inode->extents[id].start_block + gfs3_file->inode->extents[id].length_blocks;
-    Print("last block in extent[%d] is %d\n", (int)id, (int)last_blk);
-    bool free_space_beyond_extent = free_blk == last_blk;
-    if (free_space_beyond_extent){
-        Print("free space after current extent. expanding!\n");
-
-        // extend extent
-        gfs3_file->inode->extents[id].length_blocks += (uint_t)blks_needed;
-
-        // updating bitmap
-        int i;
-        for(i=0; i < (int)blks_needed; i++){
-            Print("setting block %d as occupied\n", free_blk + i);
-            Set_Bit(instance->bitmap, free_blk + i);
-        }
-
-        // write from last pos
-        struct FS_Buffer *fBuf;
-        Get_FS_Buffer(instance->fs_buf_cache, gfs3_file->inode->extents[id].start_block, &fBuf);
-        Modify_FS_Buffer(instance->fs_buf_cache, fBuf);
-        memcpy(fBuf->data + file->filePos, buf, numBytes);
-        Release_FS_Buffer(instance->fs_buf_cache, fBuf);
-        goto cleanup;
-
-
-
-        return (int)numBytes;
+    /* allocate everything this write needs up front, so the data
+       goes out in as few runs as the extents allow */
+    blocksNeeded = (end + GFS3_BLOCK_SIZE - 1) / GFS3_BLOCK_SIZE;
+    rc = grow_extents(instance, gfs3_file->inode, blocksNeeded);
+    if(rc != 0) {
+        return rc;
     }
 
-
-    bool free_extent = true;
-    if (free_extent){
-        int ext_id = id_of_next_free_extent(gfs3_file->inode);
-        Print("We have a free extent(%d)!\n",ext_id);
-        // fill up current extent
-        // allocate new extent & update in bitmap
-        int i;
-        for(i=0; i < (int)blks_needed; i++){
-            Print("setting block %d as occupied\n", free_blk + i);
-            Set_Bit(instance->bitmap, free_blk + i);
-        }
-
-
-        // save new extent
-        gfs3_file->inode->extents[ext_id].start_block= free_blk;
-        gfs3_file->inode->extents[ext_id].length_blocks = (uint_t)blks_needed;
-        struct FS_Buffer *fBuf;
-        Get_FS_Buffer(instance->fs_buf_cache, free_blk, &fBuf);
-        Modify_FS_Buffer(instance->fs_buf_cache, fBuf);
-        memcpy(fBuf->data, buf, numBytes);
-        Release_FS_Buffer(instance->fs_buf_cache, fBuf);
-        goto cleanup;
-
-        // write rest to new extent
-        return (int)numBytes;
+    rc = transfer_file_data(file, (char *)buf, file->filePos, numBytes,
+                            true);
+    if(rc != 0) {
+        return rc;
     }
 
-    // must coaless
-    // TODO
-    return ENOSPACE;
-
-
-
-    cleanup:
-        file->filePos += numBytes;
-        gfs3_file->inode->size += (unsigned int)numBytes;
-        if (file->filePos > file->endPos){
-            file->endPos = file->filePos;
-        }
-
-
-        return (int)numBytes;
+    file->filePos = end;
+    if(end > file->endPos) {
+        file->endPos = end;
+        gfs3_file->inode->size = (unsigned int)end;
+    }
 
+    rc = write_back_inode(instance, gfs3_file->inodenum, gfs3_file->inode);
+    if(rc != 0) {
+        return rc;
+    }
 
+    return (int)numBytes;
 }
 
 
@@ -979,6 +1068,7 @@ static int GFS3_Close(struct File *file) {
     &GFS3_Seek,
     &GFS3_Close,
     0,                          /* Read_Entry */
+    0,                          /* Poll */
 };
 
 /*
@@ -1030,7 +1120,10 @@ static int GFS3_Read_Entry(struct File *dir, struct VFS_Dir_Entry *entry) {
 
 
 
-    struct gfs3_inode *entry_inode = get_inode(instance->fs_buf_cache,dirent->inum);
+    struct gfs3_inode *entry_inode = get_inode(instance,dirent->inum);
+    if (entry_inode == NULL){
+        return ENOMEM;
+    }
 
     dir->filePos++;
 
@@ -1090,6 +1183,7 @@ static int GFS3_Read_Entry(struct File *dir, struct VFS_Dir_Entry *entry) {
     0,                          /* Seek */
     &GFS3_Close_Directory,
     &GFS3_Read_Entry,
+    0,                          /* Poll */
 };
 
 
@@ -1111,7 +1205,10 @@ static int GFS3_Open(struct Mount_Point *mountPoint, const char *path,
 
     // lookup path
     struct gfs3_inode *file_inode;
-    gfs3_inodenum node_num= lookup(instance, path, &file_inode);
+    int node_num = lookup(instance, path, &file_inode);
+    if (node_num < 0){
+        return node_num;
+    }
     if (node_num != 0){
         // Print("*** Lookup Successful ***\n");
         // print_inode(file_inode,node_num);
@@ -1133,6 +1230,9 @@ static int GFS3_Open(struct Mount_Point *mountPoint, const char *path,
             // Print("next free inode #%d\n", free);
             node_num = free;
             file_inode = init_file_inode(instance, free, mode);
+            if (file_inode == NULL){
+                return ENOMEM;
+            }
 
 
             // add file to directory
@@ -1155,7 +1255,10 @@ static int GFS3_Open(struct Mount_Point *mountPoint, const char *path,
             strncpy(dirent->name, prefix, name_len);
 
             struct gfs3_inode *dir = file_inode;
-            gfs3_inodenum dir_num = lookup(instance,prefix, &dir);
+            int dir_num = lookup(instance,prefix, &dir);
+            if (dir_num < 0){
+                return dir_num;
+            }
             //print_inode(dir, dir_num);
             dirent->inum = free;
             //print_dirent(dirent);
@@ -1169,8 +1272,7 @@ static int GFS3_Open(struct Mount_Point *mountPoint, const char *path,
 
             // update size of inode
             // Print("THE ONE WE GET FROM get_inode():\n");
-            struct gfs3_inode *parent_dir = get_inode(instance->fs_buf_cache, dir_num);
-            // print_inode(parent_dir, dir_num);
+            struct gfs3_inode *parent_dir;
             Get_FS_Buffer(instance->fs_buf_cache, BLOCKNUM_FROM_INODENUM(dir_num), &buffer);
             Modify_FS_Buffer(instance->fs_buf_cache, buffer);
             parent_dir = buffer->data + OFFSET_IN_BLOCK(dir_num);
@@ -1179,6 +1281,8 @@ static int GFS3_Open(struct Mount_Point *mountPoint, const char *path,
             parent_dir->size += dirent_size;
             // print_inode(parent_dir, dir_num);
             Release_FS_Buffer(instance->fs_buf_cache, buffer);
+            refresh_inode(instance, dir_num);
+            dcache_flush(instance);
 
             // print_inode(dir, dir_num);
 
@@ -1244,7 +1348,10 @@ static int GFS3_Create_Directory(struct Mount_Point *mountPoint,
     Print("suffix = \"%s\", prefix = \"%s\"\n", suffix, prefix);
 
     struct gfs3_inode *parent;
-    gfs3_inodenum parent_num = lookup(instance, prefix, &parent);
+    int parent_num = lookup(instance, prefix, &parent);
+    if (parent_num < 0){
+        return parent_num;
+    }
     if (!parent || parent_num == 0){
         Print("cannot find path %s\n", prefix);
         return ENOTFOUND;
@@ -1253,6 +1360,9 @@ static int GFS3_Create_Directory(struct Mount_Point *mountPoint,
     Print("Should make this inode...\n");
     gfs3_inodenum dir_num = next_unused_inode(instance);
     struct gfs3_inode *dir = init_file_inode(instance, dir_num, 0);
+    if (dir == NULL){
+        return ENOMEM;
+    }
     dir->type = GFS3_DIRECTORY;
 
     // create "."
@@ -1274,8 +1384,12 @@ static int GFS3_Create_Directory(struct Mount_Point *mountPoint,
     print_dirent(dotdot);
 
     // find and allocate blocks
-    gfs3_blocknum free_blk = (gfs3_blocknum)Find_First_Free_Bit(instance->bitmap, GFS3_BITMAP_SIZE);
-    Set_Bit(instance->bitmap, free_blk);
+    int first_free = Index_Find_First_Free(instance->free_map);
+    if (first_free < 0){
+        return ENOSPACE;
+    }
+    gfs3_blocknum free_blk = (gfs3_blocknum)first_free;
+    Index_Set_Bits(instance->free_map, free_blk, 1);
 
     // write dirents
     struct FS_Buffer *buf;
@@ -1320,11 +1434,13 @@ static int GFS3_Create_Directory(struct Mount_Point *mountPoint,
     size_t old_size_parent = parent->size;
     parent->size += dirent_size;
     Release_FS_Buffer(instance->fs_buf_cache, buf);
+    refresh_inode(instance, parent_num);
 
     Get_FS_Buffer(instance->fs_buf_cache, parent_ext0, &buf);
     Modify_FS_Buffer(instance->fs_buf_cache, buf);
     memcpy(buf->data + old_size_parent, dir_dirent, dirent_size);
     Release_FS_Buffer(instance->fs_buf_cache, buf);
+    dcache_flush(instance);
 
     /*
     struct gfs3_inode *dir = file_inode;
@@ -1373,7 +1489,10 @@ static int GFS3_Open_Directory(struct Mount_Point *mountPoint,
 
     // lookup path
     struct gfs3_inode *dir_inode ;
-    gfs3_inodenum node_num= lookup(instance, path, &dir_inode);
+    int node_num = lookup(instance, path, &dir_inode);
+    if (node_num < 0){
+        return node_num;
+    }
     if (node_num != 0){
         // Print("*** Lookup Successful ***\n");
         // print_inode(dir_inode,node_num);
@@ -1424,7 +1543,10 @@ static int GFS3_Delete(struct Mount_Point *mountPoint, const char *path,
     struct GFS3_Instance *instance = mountPoint->fsData;
     struct gfs3_inode *inode = 0;
 
-    gfs3_inodenum num = lookup(instance, path, &inode);
+    int num = lookup(instance, path, &inode);
+    if (num < 0){
+        return num;
+    }
     if (!inode || num == 0){
         Print("cannot delete what cannot be found\n");
         return ENOTFOUND;
@@ -1454,12 +1576,15 @@ static int GFS3_Delete(struct Mount_Point *mountPoint, const char *path,
     Print("suffix = \"%s\" with size %d\n", suffix, (int)strlen(suffix));
 
     struct gfs3_inode *dir;
-    gfs3_inodenum dir_num = lookup(instance, suffix, &dir);
+    int dir_num = lookup(instance, suffix, &dir);
+    if (dir_num < 0){
+        return dir_num;
+    }
 
     struct gfs3_dirent *dirent= get_dirent(instance->fs_buf_cache, dir);
     unsigned int seen = 0;
     while (seen < dir->size){
-        if (dirent->inum == num){
+        if (dirent->inum == (gfs3_inodenum)num){
             print_dirent(dirent);
         }
         seen += dirent->entry_length + 4;
@@ -1477,6 +1602,7 @@ static int GFS3_Delete(struct Mount_Point *mountPoint, const char *path,
     dir->size -= size_of_dirent; // reduce size with size of dirent
     print_inode(dir, dir_num);
     Release_FS_Buffer(instance->fs_buf_cache, buf);
+    refresh_inode(instance, dir_num);
 
     // delete dirent
     Get_FS_Buffer(instance->fs_buf_cache, dir->extents[0].start_block, &buf);
@@ -1488,8 +1614,10 @@ static int GFS3_Delete(struct Mount_Point *mountPoint, const char *path,
     // Delete inode
     Get_FS_Buffer(instance->fs_buf_cache,BLOCKNUM_FROM_INODENUM(num), &buf);
     Modify_FS_Buffer(instance->fs_buf_cache, buf);
-    memset(buf->data, '\0', sizeof(struct gfs3_inode));
+    memset(buf->data + OFFSET_IN_BLOCK(num), '\0', sizeof(struct gfs3_inode));
     Release_FS_Buffer(instance->fs_buf_cache, buf);
+    refresh_inode(instance, num);
+    dcache_flush(instance);
 
 
     return 0;
@@ -1515,7 +1643,10 @@ static int GFS3_Stat(struct Mount_Point *mountPoint, const char *path,
     // print_inode(n15, 15);
 
 
-    gfs3_inodenum  num = lookup(instance,path,&inode);
+    int num = lookup(instance,path,&inode);
+    if (num < 0){
+        return num;
+    }
     if (!inode || num == 0 ){
         return ENOTFOUND;
     }
@@ -1588,6 +1719,7 @@ static int GFS3_Mount(struct Mount_Point *mountPoint) {
     instance = (struct GFS3_Instance *)Malloc(sizeof(struct GFS3_Instance));
     if (instance == 0){ return ENOMEM; }
     memset(instance, '\0', sizeof(struct GFS3_Instance));
+    Mutex_Init(&instance->cache_lock);
 
     // create fs-buffer
     instance->fs_buf_cache = Create_FS_Buffer_Cache(mountPoint->dev,GFS3_BLOCK_SIZE);
@@ -1635,29 +1767,40 @@ static int GFS3_Mount(struct Mount_Point *mountPoint) {
     mountPoint->fsData = (void *)instance;
     mountPoint->ops = &s_gfs3MountPointOps;
 
-    // create bitmap in inode 2
-    instance->bitmap = (char *)Malloc(GFS3_BLOCK_SIZE); // must apparently allocate before...
-    instance->bitmap = Create_Bit_Set(GFS3_BITMAP_SIZE);
-    //Set_Bit(instance->bitmap, 0);
-    //Set_Bit(instance->bitmap, 1);
-    //Set_Bit(instance->bitmap, 2);
-    // Print("BEFORE: first 10 blocks: %d\n", Find_First_N_Free(instance->bitmap, 10, GFS3_BITMAP_SIZE));
-
     Release_FS_Buffer(instance->fs_buf_cache, buf);
 
 
-    // read bitmap stored in inode 2
-    struct gfs3_inode *inode2 = get_inode(instance->fs_buf_cache, 2);
+    // read the free block bitmap stored in inode 2; one bit per disk
+    // block, but never more than inode 2's first extent holds
+    struct gfs3_inode *inode2 = get_inode(instance, 2);
+    if (inode2 == NULL){
+        return ENOMEM;
+    }
+    ulong_t num_blocks = instance->superblock->blocks_per_disk;
+    ulong_t bitmap_blocks =
+        (num_blocks + GFS3_BLOCK_SIZE * 8 - 1) / (GFS3_BLOCK_SIZE * 8);
+    if (bitmap_blocks > inode2->extents[0].length_blocks){
+        bitmap_blocks = inode2->extents[0].length_blocks;
+        num_blocks = bitmap_blocks * GFS3_BLOCK_SIZE * 8;
+    }
+    if (bitmap_blocks == 0){
+        return EINVALIDFS;
+    }
 
-    struct FS_Buffer *bitmapBuf;
-    int rc = Get_FS_Buffer(instance->fs_buf_cache,inode2->extents->start_block, &bitmapBuf);
+    instance->bitmap = Create_Bit_Set(bitmap_blocks * GFS3_BLOCK_SIZE * 8);
+    if (instance->bitmap == 0){
+        return ENOMEM;
+    }
+    int rc = Block_Read_Multi(mountPoint->dev, (int)inode2->extents[0].start_block,
+                              (int)bitmap_blocks, instance->bitmap);
     if (rc != 0){
-        Print("\trc = %d\n",rc);
+        return EIO;
     }
 
-    memcpy(instance->bitmap, bitmapBuf->data, GFS3_BLOCK_SIZE);
-   //  Print("AFTER: first 10 blocks: %d\n", Find_First_N_Free(instance->bitmap,10, GFS3_BITMAP_SIZE));
-    Release_FS_Buffer(instance->fs_buf_cache, bitmapBuf);
+    instance->free_map = Create_Bit_Set_Index(instance->bitmap, num_blocks);
+    if (instance->free_map == 0){
+        return ENOMEM;
+    }
     // Print("done with mnt...\n");
 
 
@@ -58,6 +58,9 @@
 #define IDE_COMMAND_READ_BUFFER		0xE4
 #define IDE_COMMAND_WRITE_SECTORS	0x30
 #define IDE_COMMAND_WRITE_BUFFER	0xE8
+
+/* largest sector count one READ/WRITE SECTORS command can carry here */
+#define IDE_MAX_SECTORS_PER_COMMAND	255
 #define IDE_COMMAND_DIAGNOSTIC		0x90
 #define IDE_COMMAND_ATAPI_IDENT_DRIVE	0xA1
 
@@ -132,10 +135,12 @@ static int IDE_getNumBlocks(int driveNum) {
 }
 
 /*
- * Read a block at the logical block number indicated.
+ * Read numBlocks consecutive blocks starting at the logical block
+ * number indicated, using a single multi-sector command.
  */
-static int IDE_Read(int driveNum, int blockNum, char *buffer) {
-    int i;
+static int IDE_Read(int driveNum, int blockNum, int numBlocks,
+                    char *buffer) {
+    int i, n;
     int head;
     int sector;
     int cylinder;
@@ -147,7 +152,9 @@ static int IDE_Read(int driveNum, int blockNum, char *buffer) {
         return IDE_ERROR_BAD_DRIVE;
     }
 
-    if(blockNum < 0 || blockNum >= IDE_getNumBlocks(driveNum)) {
+    if(blockNum < 0 || numBlocks < 1
+       || numBlocks > IDE_MAX_SECTORS_PER_COMMAND
+       || blockNum + numBlocks > IDE_getNumBlocks(driveNum)) {
         if(ideDebug)
             Print("ide: invalid block %d\n", blockNum);
         return IDE_ERROR_INVALID_BLOCK;
@@ -171,7 +178,7 @@ static int IDE_Read(int driveNum, int blockNum, char *buffer) {
     reEnable = Deprecated_Begin_Int_Atomic();
 #endif
 
-    Out_Byte(IDE_SECTOR_COUNT_REGISTER, 1);
+    Out_Byte(IDE_SECTOR_COUNT_REGISTER, numBlocks);
     Out_Byte(IDE_SECTOR_NUMBER_REGISTER, sector);
     Out_Byte(IDE_CYLINDER_LOW_REGISTER, LOW_BYTE(cylinder));
     Out_Byte(IDE_CYLINDER_HIGH_REGISTER, HIGH_BYTE(cylinder));
@@ -182,19 +189,24 @@ static int IDE_Read(int driveNum, int blockNum, char *buffer) {
     if(ideDebug > 2)
         Print("About to wait for Read \n");
 
-    /* wait for the drive */
-    while (In_Byte(IDE_STATUS_REGISTER) & IDE_STATUS_DRIVE_BUSY) ;
-    if(In_Byte(IDE_STATUS_REGISTER) & IDE_STATUS_DRIVE_ERROR) {
-        Print("ERROR: Got Read %d\n", In_Byte(IDE_STATUS_REGISTER));
-        return IDE_ERROR_DRIVE_ERROR;
-    }
+    bufferW = (short *)buffer;
+    for(n = 0; n < numBlocks; n++) {
+        /* wait for the drive to have the next sector ready */
+        while (In_Byte(IDE_STATUS_REGISTER) & IDE_STATUS_DRIVE_BUSY) ;
+        if(In_Byte(IDE_STATUS_REGISTER) & IDE_STATUS_DRIVE_ERROR) {
+            Print("ERROR: Got Read %d\n", In_Byte(IDE_STATUS_REGISTER));
+#ifndef NS_INTERRUPTABLE_NO_GLOBAL_LOCK
+            Deprecated_End_Int_Atomic(reEnable);
+#endif
+            return IDE_ERROR_DRIVE_ERROR;
+        }
 
-    if(ideDebug > 2)
-        Print("got buffer \n");
+        if(ideDebug > 2)
+            Print("got buffer \n");
 
-    bufferW = (short *)buffer;
-    for(i = 0; i < 256; i++) {
-        bufferW[i] = In_Word(IDE_DATA_REGISTER);
+        for(i = 0; i < 256; i++) {
+            *bufferW++ = In_Word(IDE_DATA_REGISTER);
+        }
     }
     if(ideDebug > 2)
         Print("read buffer \n");
@@ -207,10 +219,12 @@ static int IDE_Read(int driveNum, int blockNum, char *buffer) {
 }
 
 /*
- * Write a block at the logical block number indicated.
+ * Write numBlocks consecutive blocks starting at the logical block
+ * number indicated, using a single multi-sector command.
  */
-static int IDE_Write(int driveNum, int blockNum, char *buffer) {
-    int i;
+static int IDE_Write(int driveNum, int blockNum, int numBlocks,
+                     char *buffer) {
+    int i, n;
     int head;
     int sector;
     int cylinder;
@@ -220,7 +234,9 @@ static int IDE_Write(int driveNum, int blockNum, char *buffer) {
         return IDE_ERROR_BAD_DRIVE;
     }
 
-    if(blockNum < 0 || blockNum >= IDE_getNumBlocks(driveNum)) {
+    if(blockNum < 0 || numBlocks < 1
+       || numBlocks > IDE_MAX_SECTORS_PER_COMMAND
+       || blockNum + numBlocks > IDE_getNumBlocks(driveNum)) {
         return IDE_ERROR_INVALID_BLOCK;
     }
 
@@ -241,7 +257,7 @@ static int IDE_Write(int driveNum, int blockNum, char *buffer) {
     reEnable = Deprecated_Begin_Int_Atomic();
 #endif
 
-    Out_Byte(IDE_SECTOR_COUNT_REGISTER, 1);
+    Out_Byte(IDE_SECTOR_COUNT_REGISTER, numBlocks);
     Out_Byte(IDE_SECTOR_NUMBER_REGISTER, sector);
     Out_Byte(IDE_CYLINDER_LOW_REGISTER, LOW_BYTE(cylinder));
     Out_Byte(IDE_CYLINDER_HIGH_REGISTER, HIGH_BYTE(cylinder));
@@ -249,13 +265,14 @@ static int IDE_Write(int driveNum, int blockNum, char *buffer) {
 
     Out_Byte(IDE_COMMAND_REGISTER, IDE_COMMAND_WRITE_SECTORS);
 
-
-    /* wait for the drive */
-    while (In_Byte(IDE_STATUS_REGISTER) & IDE_STATUS_DRIVE_BUSY) ;
-
     bufferW = (short *)buffer;
-    for(i = 0; i < 256; i++) {
-        Out_Word(IDE_DATA_REGISTER, bufferW[i]);
+    for(n = 0; n < numBlocks; n++) {
+        /* wait for the drive to accept the next sector */
+        while (In_Byte(IDE_STATUS_REGISTER) & IDE_STATUS_DRIVE_BUSY) ;
+
+        for(i = 0; i < 256; i++) {
+            Out_Word(IDE_DATA_REGISTER, *bufferW++);
+        }
     }
 
     if(ideDebug)
@@ -305,18 +322,27 @@ static struct Block_Device_Ops s_ideDeviceOps = {
 static void IDE_Request_Thread(ulong_t arg __attribute__ ((unused))) {
     for(;;) {
         struct Block_Request *request;
-        int rc;
+        int blockNum, left, count;
+        char *buf;
+        int rc = 0;
 
         /* Wait for a request to arrive */
         request = Dequeue_Request(&s_ideRequestQueue);
 
-        /* Do the I/O */
-        if(request->type == BLOCK_READ)
-            rc = IDE_Read(request->dev->unit, request->blockNum,
-                          request->buf);
-        else
-            rc = IDE_Write(request->dev->unit, request->blockNum,
-                           request->buf);
+        /* Do the I/O, in as few multi-sector commands as possible */
+        blockNum = request->blockNum;
+        buf = (char *)request->buf;
+        for(left = request->numBlocks; left > 0 && rc == 0; left -= count) {
+            count = left;
+            if(count > IDE_MAX_SECTORS_PER_COMMAND)
+                count = IDE_MAX_SECTORS_PER_COMMAND;
+            if(request->type == BLOCK_READ)
+                rc = IDE_Read(request->dev->unit, blockNum, count, buf);
+            else
+                rc = IDE_Write(request->dev->unit, blockNum, count, buf);
+            blockNum += count;
+            buf += count * SECTOR_SIZE;
+        }
 
         /* Notify requesting thread of final status */
         Notify_Request_Completion(request, rc == 0 ? COMPLETED : ERROR,
@@ -23,6 +23,8 @@
 #include <geekos/io.h>
 #include <geekos/irq.h>
 #include <geekos/smp.h>
+#include <geekos/timer.h>
+#include <geekos/trace.h>
 
 /* ----------------------------------------------------------------------
  * Private functions and data
@@ -113,9 +115,14 @@ void Disable_IRQ(int irq) {
 
 /*
  * Called by an IRQ handler to begin the interrupt.
- * Currently a no-op.
+ * Only does accounting and tracing.
  */
-void Begin_IRQ(struct Interrupt_State *state __attribute__ ((unused))) {
+void Begin_IRQ(struct Interrupt_State *state) {
+    int id = Get_CPU_ID();
+
+    ++CPUs[id].irqs;
+    CPUs[id].irqStart = Read_TSC();
+    TRACE(TRACE_IRQ_ENTER, state->intNum, 0, 0, 0);
 }
 
 /*
@@ -125,6 +132,11 @@ void Begin_IRQ(struct Interrupt_State *state __attribute__ ((unused))) {
 void End_IRQ(struct Interrupt_State *state) {
     int irq = state->intNum - FIRST_EXTERNAL_INT;
     uchar_t command = 0x60 | (irq & 0x7);
+    int id;
+
+    TRACE(TRACE_IRQ_EXIT, state->intNum, 0, 0, 0);
+    id = Get_CPU_ID();
+    CPUs[id].irqCycles += Read_TSC() - CPUs[id].irqStart;
 
     if(irq < 8) {
         /* Specific EOI to master PIC */
@@ -36,6 +36,7 @@
 #include <geekos/irq.h>
 #include <geekos/io.h>
 #include <geekos/keyboard.h>
+#include <geekos/poll.h>
 
 #define DEBUG_KEYBOARD(x...)
 // #define DEBUG_KEYBOARD(x...) Print("KBD: " x)
@@ -75,6 +76,11 @@ static Spin_Lock_t s_kbdQueueLock;
  */
 static struct Thread_Queue s_keyboardWaitQueue;
 
+/*
+ * Threads in Poll() watching for keyboard events.
+ */
+static struct Poll_Queue s_keyboardPollQueue;
+
 /*
  * Translate from scan code to key code, when shift is not pressed.
  */
@@ -285,6 +291,7 @@ void Keyboard_Interrupt_Handler(struct Interrupt_State *state) {
 
         /* Wake up event consumers */
         Wake_Up(&s_keyboardWaitQueue);
+        Poll_Wake(&s_keyboardPollQueue);
 
         /*
          * Pick a new thread upon return from interrupt
@@ -311,6 +318,7 @@ void Init_Keyboard(void) {
 
     /* Buffer is initially empty. */
     s_queueHead = s_queueTail = 0;
+    Poll_Queue_Init(&s_keyboardPollQueue);
 
     /* Install interrupt handler */
     Install_IRQ(KB_IRQ, Keyboard_Interrupt_Handler);
@@ -342,6 +350,26 @@ bool Read_Key(Keycode * keycode) {
     return result;
 }
 
+/*
+ * Check for a key event without taking it, for Poll().
+ * Registers entry, if given, so the next key event wakes the poller.
+ * Returns POLLIN if Wait_For_Key() would not block.
+ */
+int Keyboard_Poll(struct Poll_Entry *entry) {
+    bool result, iflag;
+
+    if(entry != NULL)
+        Poll_Register(&s_keyboardPollQueue, entry);
+
+    iflag = Begin_Int_Atomic();
+    Spin_Lock(&s_kbdQueueLock);
+    result = !Is_Queue_Empty();
+    Spin_Unlock(&s_kbdQueueLock);
+    End_Int_Atomic(iflag);
+
+    return result ? POLLIN : 0;
+}
+
 Keycode Get_Test_Input() {
     Keycode ret;
     ret = In_Byte(0x510);
@@ -26,6 +26,7 @@
 #include <geekos/projects.h>
 #include <geekos/smp.h>
 #include <geekos/synch.h>
+#include <geekos/epoch.h>
 
 extern Spin_Lock_t kthreadLock;
 
@@ -70,6 +71,17 @@ static struct Thread_Queue s_graveyardQueue;
 static struct Mutex s_graveyardMutex;
 static struct Thread_Queue s_reaperWaitQueue;
 
+/*
+ * Pool of reaped thread objects, each still holding its stack page.
+ * Recycle_Thread returns threads here instead of to the page
+ * allocator, and Create_Thread takes from here first, so that
+ * spawn-heavy workloads do not churn two pages per thread.
+ * Guarded by the queue's own lock, with interrupts disabled.
+ */
+#define THREAD_POOL_MAX 32
+static struct Thread_Queue s_threadPool;
+static int s_threadPoolCount;
+
 /*
  * Counter for keys that access thread-local data, and an array
  * of destructors for freeing that data when the thread dies.  This is
@@ -83,16 +95,119 @@ static tlocal_destructor_t s_tlocalDestructors[MAX_TLOCAL_KEYS];
  * ---------------------------------------------------------------------- */
 
 
+/*
+ * Pids are recycled: a bitmap records those in use, and allocation
+ * scans forward from the last pid handed out, so a freed pid is
+ * reused only after the rest of the space has been cycled through.
+ * Pid 0 is never handed out, since it means "no parent".
+ * Guarded by pidLock.
+ */
+#define PID_MAX 32768
+#define PID_WORD_BITS 32
+
 Spin_Lock_t pidLock;
+static ulong_t s_pidMap[PID_MAX / PID_WORD_BITS];
+static int s_lastPid;
 
 int nextPid() {
-    int ret;
-    static int nextFreePid = 1;
+    int pid, scanned;
+    ulong_t word;
 
     Spin_Lock(&pidLock);
-    ret = nextFreePid++;
+    pid = s_lastPid;
+    for(scanned = 0; scanned < PID_MAX; ++scanned) {
+        pid = (pid + 1) % PID_MAX;
+        word = s_pidMap[pid / PID_WORD_BITS];
+        if(pid % PID_WORD_BITS == 0 && word == ~0UL) {
+            /* skip a full word at once */
+            pid += PID_WORD_BITS - 1;
+            scanned += PID_WORD_BITS - 1;
+            continue;
+        }
+        if(pid != 0 && !(word & (1UL << (pid % PID_WORD_BITS)))) {
+            s_pidMap[pid / PID_WORD_BITS] |= 1UL << (pid % PID_WORD_BITS);
+            s_lastPid = pid;
+            break;
+        }
+    }
     Spin_Unlock(&pidLock);
-    return ret;
+
+    KASSERT0(scanned < PID_MAX, "out of process ids");
+    return pid;
+}
+
+static void Free_Pid(int pid) {
+    KASSERT(pid > 0 && pid < PID_MAX);
+
+    Spin_Lock(&pidLock);
+    s_pidMap[pid / PID_WORD_BITS] &= ~(1UL << (pid % PID_WORD_BITS));
+    Spin_Unlock(&pidLock);
+}
+
+/*
+ * Live threads are also chained by pid in s_pidHash, so that
+ * Lookup_Thread need not walk the list of all threads.
+ *
+ * Lookups walk the hash without a lock.  Writers hold kthreadLock with interrupts
+ * disabled and publish a thread only once its chain link is set; an
+ * unlinked thread keeps its link so a reader standing on it can carry
+ * on.  Readers count themselves, with interrupts disabled, in
+ * s_pidEpoch; before the reaper recycles the threads it unlinked, it
+ * flips the epoch and waits for the old one to drain.
+ */
+#define PID_HASH_BITS 8
+static struct Kernel_Thread *s_pidHash[1 << PID_HASH_BITS];
+
+static struct Epoch s_pidEpoch = EPOCH_INITIALIZER;
+
+static __inline__ uint_t Pid_Hash(int pid) {
+    return (uint_t) pid & ((1 << PID_HASH_BITS) - 1);
+}
+
+/*
+ * Wait until no lookup can still see a thread unlinked before the
+ * call.  Only the reaper calls this.  Readers run with interrupts
+ * disabled and never block, so the wait is short.
+ */
+static void Wait_For_Pid_Readers(void) {
+    int epoch = Epoch_Flip(&s_pidEpoch);
+
+    while (!Epoch_Drained(&s_pidEpoch, epoch)) ;
+}
+
+/*
+ * Make a newly initialized thread visible in the list of all
+ * threads and to Lookup_Thread.
+ */
+static void Publish_Thread(struct Kernel_Thread *kthread) {
+    struct Kernel_Thread **bucket = &s_pidHash[Pid_Hash(kthread->pid)];
+    bool iflag = Begin_Int_Atomic();
+
+    Spin_Lock(&kthreadLock);
+    Add_To_Back_Of_All_Thread_List(&s_allThreadList, kthread);
+    kthread->pidHashNext = *bucket;
+    __sync_synchronize();
+    *bucket = kthread;
+    Spin_Unlock(&kthreadLock);
+
+    End_Int_Atomic(iflag);
+}
+
+/* The inverse of Publish_Thread; the thread keeps its chain link. */
+static void Unpublish_Thread(struct Kernel_Thread *kthread) {
+    struct Kernel_Thread **link = &s_pidHash[Pid_Hash(kthread->pid)];
+    bool iflag = Begin_Int_Atomic();
+
+    Spin_Lock(&kthreadLock);
+    Remove_From_All_Thread_List(&s_allThreadList, kthread);
+    while (*link != kthread) {
+        KASSERT(*link != NULL);
+        link = &(*link)->pidHashNext;
+    }
+    *link = kthread->pidHashNext;
+    Spin_Unlock(&kthreadLock);
+
+    End_Int_Atomic(iflag);
 }
 
 
@@ -137,18 +252,37 @@ static struct Kernel_Thread *Create_Thread(int priority, bool detached) {
     struct Kernel_Thread *kthread;
     void *stackPage = 0;
 
-    /*
-     * For now, just allocate one page each for the thread context
-     * object and the thread's stack.
-     */
-    kthread = Alloc_Page();
-    if(kthread == 0)
-        return 0;
+    /* Reuse a reaped thread object and its stack, if there is one. */
+    int iflag = Begin_Int_Atomic();
+    Lock_Thread_Queue(&s_threadPool);
+    kthread = Get_Front_Of_Thread_Queue(&s_threadPool);
+    if(kthread != 0) {
+        Locked_Remove_From_Thread_Queue(&s_threadPool, kthread);
+        --s_threadPoolCount;
+    }
+    Unlock_Thread_Queue(&s_threadPool);
+    End_Int_Atomic(iflag);
 
-    stackPage = Alloc_Page();
-    if(stackPage == 0) {
-        Free_Page(kthread);
-        return 0;
+    if(kthread != 0) {
+        stackPage = kthread->stackPage;
+    } else if((stackPage = Alloc_Pages(2)) != 0) {
+        /*
+         * Otherwise, allocate the thread's stack and its context
+         * object as one run, the stack first so that an overflow
+         * runs off the bottom of the stack rather than into the object.
+         */
+        kthread = (struct Kernel_Thread *)((char *)stackPage + PAGE_SIZE);
+    } else {
+        /* No two free pages are adjacent; take them one at a time. */
+        kthread = Alloc_Page();
+        if(kthread == 0)
+            return 0;
+
+        stackPage = Alloc_Page();
+        if(stackPage == 0) {
+            Free_Page(kthread);
+            return 0;
+        }
     }
 
     /*Print("New thread @ %x, stack @ %x\n", kthread, stackPage); */
@@ -160,9 +294,7 @@ static struct Kernel_Thread *Create_Thread(int priority, bool detached) {
     Init_Thread(kthread, stackPage, priority, detached);
 
     /* Add to the list of all threads in the system. */
-    int iflag = Begin_Int_Atomic();
-    Add_To_Back_Of_All_Thread_List(&s_allThreadList, kthread);
-    End_Int_Atomic(iflag);
+    Publish_Thread(kthread);
 
     return kthread;
 }
@@ -180,8 +312,9 @@ static __inline__ void Push(struct Kernel_Thread *kthread, ulong_t value) {
 /*
  * Destroy given thread.
  * This function should perform all cleanup needed to
- * reclaim the resources used by a thread.
- * Called with kthread lock held
+ * reclaim the resources used by a thread, except its memory and
+ * pid: lookups may still see it until Wait_For_Pid_Readers, after
+ * which Recycle_Thread releases those.
  */
 static void Destroy_Thread(struct Kernel_Thread *kthread) {
     /*
@@ -191,15 +324,35 @@ static void Destroy_Thread(struct Kernel_Thread *kthread) {
     if(kthread->userContext != 0)
         Detach_User_Context(kthread);
 
-    /* Remove from list of all threads */
+    /* Remove from list of all threads and the pid hash */
+    Unpublish_Thread(kthread);
+}
+
+/*
+ * Release the pid and memory of a destroyed thread that no lookup
+ * can still see.
+ */
+static void Recycle_Thread(struct Kernel_Thread *kthread) {
+    Free_Pid(kthread->pid);
+
+    /* Keep the thread object and stack for reuse if the pool has room. */
     int iflag = Begin_Int_Atomic();
-    Remove_From_All_Thread_List(&s_allThreadList, kthread);
+    Lock_Thread_Queue(&s_threadPool);
+    if(s_threadPoolCount < THREAD_POOL_MAX) {
+        Locked_Unchecked_Add_To_Back_Of_Thread_Queue(&s_threadPool,
+                                                     kthread);
+        ++s_threadPoolCount;
+        kthread = 0;
+    }
+    Unlock_Thread_Queue(&s_threadPool);
     End_Int_Atomic(iflag);
 
-    /* Dispose of the thread's memory. */
-    Free_Page(kthread->stackPage);
-    kthread->stackPage = 0;
-    Free_Page(kthread);
+    if(kthread != 0) {
+        /* Dispose of the thread's memory. */
+        Free_Page(kthread->stackPage);
+        kthread->stackPage = 0;
+        Free_Page(kthread);
+    }
 }
 
 /*
@@ -371,7 +524,8 @@ static void Setup_Kernel_Thread(struct Kernel_Thread *kthread,
 }
 
 /*
- * Set up the a user mode thread.
+ * Set up the a user mode thread, to start at entryAddr with the
+ * given user stack pointer and esi.
  * 
  * This assumes exclusive access to kthread->esp; you may call it
  * on a process being created, but not on a running process unless
@@ -379,9 +533,10 @@ static void Setup_Kernel_Thread(struct Kernel_Thread *kthread,
  * esp.  That is, if called from within a running process, disable 
  * interrupts so that the process is not preempted.
  */
-/*static*/ void Setup_User_Thread(
-                                     struct Kernel_Thread *kthread,
-                                     struct User_Context *userContext) {
+static void Setup_User_Thread_At(struct Kernel_Thread *kthread,
+                                 struct User_Context *userContext,
+                                 ulong_t entryAddr, ulong_t stackPointer,
+                                 ulong_t esi) {
     extern int userDebug;
 
     /*
@@ -404,14 +559,14 @@ static void Setup_Kernel_Thread(struct Kernel_Thread *kthread,
 
     /* Stack segment and stack pointer within user mode. */
     Push(kthread, dsSelector);  /* user ss */
-    Push(kthread, userContext->stackPointerAddr);       /* user esp */
+    Push(kthread, stackPointer);        /* user esp */
 
     /* eflags, cs, eip */
     Push(kthread, eflags);
     Push(kthread, csSelector);
-    Push(kthread, userContext->entryAddr);
+    Push(kthread, entryAddr);
     if(userDebug)
-        Print("Entry addr=%lx\n", userContext->entryAddr);
+        Print("Entry addr=%lx\n", entryAddr);
 
     /* Push fake error code and interrupt number. */
     Push(kthread, 0);
@@ -426,7 +581,7 @@ static void Setup_Kernel_Thread(struct Kernel_Thread *kthread,
     Push(kthread, 0);           /* ebx */
     Push(kthread, 0);           /* edx */
     Push(kthread, 0);           /* edx */
-    Push(kthread, userContext->argBlockAddr);   /* esi */
+    Push(kthread, esi);         /* esi */
     Push(kthread, 0);           /* edi */
     Push(kthread, 0);           /* ebp */
 
@@ -440,6 +595,18 @@ static void Setup_Kernel_Thread(struct Kernel_Thread *kthread,
     kthread->affinity = -1;
 }
 
+/*
+ * Set up the first thread of a process: it starts at the entry point
+ * with esi pointing to the argument block.
+ */
+/*static*/ void Setup_User_Thread(
+                                     struct Kernel_Thread *kthread,
+                                     struct User_Context *userContext) {
+    Setup_User_Thread_At(kthread, userContext, userContext->entryAddr,
+                         userContext->stackPointerAddr,
+                         userContext->argBlockAddr);
+}
+
 
 /*
  * This is the body of the idle thread.  Its job is to preserve
@@ -448,7 +615,14 @@ static void Setup_Kernel_Thread(struct Kernel_Thread *kthread,
  */
 static void Idle(ulong_t arg __attribute__ ((unused))) {
     while (true) {
-        /* 
+        /*
+         * Spend idle time clearing free pages, so that Alloc_Page
+         * does not have to.  Halt only once the zeroed pool is full.
+         */
+        if(Idle_Zero_Free_Page())
+            continue;
+
+        /*
          * The hlt instruction tells the CPU to wait until an interrupt is called.
          * We call this in this loop so the Idle process does not eat up 100% cpu,
          * and make our laptops catch fire.
@@ -491,6 +665,7 @@ static void Reaper(ulong_t arg __attribute__ ((unused))) {
             Mutex_Unlock(&s_graveyardMutex);
 
             /* Dispose of the dead threads. */
+            struct Kernel_Thread *dead = kthread;
             while (kthread != 0) {
                 struct Kernel_Thread *next =
                     Get_Next_In_Thread_Queue(kthread);
@@ -499,6 +674,16 @@ static void Reaper(ulong_t arg __attribute__ ((unused))) {
                 kthread = next;
             }
 
+            /* Once no lookup can see them, reuse their pids and memory. */
+            Wait_For_Pid_Readers();
+            kthread = dead;
+            while (kthread != 0) {
+                struct Kernel_Thread *next =
+                    Get_Next_In_Thread_Queue(kthread);
+                Recycle_Thread(kthread);
+                kthread = next;
+            }
+
         }
     }
 }
@@ -567,7 +752,7 @@ void Init_Scheduler(unsigned int cpuID, void *stack) {
     Init_Thread(mainThread, stack, PRIORITY_NORMAL, true);
     g_currentThreads[Get_CPU_ID()] = mainThread;
     TODO_P(PROJECT_PERCPU, "set the current thread now that we have one");
-    Add_To_Back_Of_All_Thread_List(&s_allThreadList, mainThread);
+    Publish_Thread(mainThread);
     strcpy(mainThread->threadName, "{Main}");
 
     /*
@@ -645,6 +830,29 @@ struct Kernel_Thread *Start_User_Thread(struct User_Context *userContext,
     return kthread;
 }
 
+/*
+ * Start another thread in the current thread's user context, running
+ * from entryAddr on the stack whose top is stackPointer.  The new
+ * thread is a child of the current one, so it may be Wait()ed on.
+ * Returns pointer to the new thread if successful, null otherwise.
+ */
+struct Kernel_Thread *Clone_User_Thread(ulong_t entryAddr,
+                                        ulong_t stackPointer) {
+    struct User_Context *userContext = CURRENT_THREAD->userContext;
+    struct Kernel_Thread *kthread;
+
+    KASSERT(userContext != NULL);
+    kthread = Create_Thread(PRIORITY_USER, false);
+    if(kthread != 0) {
+        /* Attaching takes a reference, so the context outlives its creator */
+        Setup_User_Thread_At(kthread, userContext, entryAddr, stackPointer,
+                             0);
+        Make_Runnable_Atomic(kthread);
+    }
+
+    return kthread;
+}
+
 /*
  * Get the thread that currently has the CPU.
  */
@@ -677,7 +885,8 @@ void Schedule(void) {
 
     /* Get next thread to run from the run queue */
     runnable = Get_Next_Runnable();
-
+    if(runnable != get_current_thread(0))
+        ++get_current_thread(0)->stats.voluntarySwitches;
 
     // Print("switching to %d, %s (core %d)\n", runnable->pid, runnable->userContext? runnable->userContext->name : runnable->threadName, Get_CPU_ID());
 
@@ -689,6 +898,7 @@ void Schedule(void) {
      */
 
     Switch_To_Thread(runnable);
+    Finish_Switch();
 }
 
 void Schedule_And_Unlock(Spin_Lock_t * unlock_me) {
@@ -700,10 +910,13 @@ void Schedule_And_Unlock(Spin_Lock_t * unlock_me) {
 
     /* Get next thread to run from the run queue */
     runnable = Get_Next_Runnable();
+    if(runnable != get_current_thread(0))
+        ++get_current_thread(0)->stats.voluntarySwitches;
 
     Spin_Unlock(unlock_me);
 
     Switch_To_Thread(runnable);
+    Finish_Switch();
 }
 
 /*
@@ -810,11 +1023,10 @@ int Join(struct Kernel_Thread *kthread) {
  * calling from a non parent (e.g., for kill), false if
  * calling from a parent (e.g., for wait).
  * 
- * If the thread is NOT the owner, and thus doesn't have a
- * reference to the child already, then it is assumed the
- * caller will not retain the extra reference with
- * interrupts enabled, or else the thread could die and
- * create a dangling pointer.
+ * A parent relies on the reference it already holds to its
+ * child.  Otherwise the thread is returned with a new reference,
+ * taken before its pid can be recycled, which the caller must
+ * drop with Detach_Thread() when done with it.
  */
 struct Kernel_Thread *Lookup_Thread(int pid,
                                     int
@@ -827,24 +1039,22 @@ struct Kernel_Thread *Lookup_Thread(int pid,
 
     struct Kernel_Thread *current = get_current_thread(0);      /* interrupts disabled, may use fast */
 
-    /*
-     * TODO: we could remove the requirement that the caller
-     * needs to be the thread's owner by specifying that another
-     * reference is added to the thread before it is returned.
-     */
-
-    Spin_Lock(&kthreadLock);
-    result = Get_Front_Of_All_Thread_List(&s_allThreadList);
-    while (result != 0) {
-        if(result->pid == pid) {
-            if(current != result->owner &&
-               !return_a_thread_even_if_not_my_child)
-                result = 0;
-            break;
-        }
-        result = Get_Next_In_All_Thread_List(result);
+    int epoch = Epoch_Read_Begin(&s_pidEpoch);
+    result = s_pidHash[Pid_Hash(pid)];
+    while (result != 0 && result->pid != pid)
+        result = result->pidHashNext;
+    if(result != 0 && return_a_thread_even_if_not_my_child) {
+        /* a thread whose last reference is gone is being reaped */
+        Spin_Lock(&kthreadLock);
+        if(result->refCount > 0)
+            ++result->refCount;
+        else
+            result = 0;
+        Spin_Unlock(&kthreadLock);
+    } else if(result != 0 && current != result->owner) {
+        result = 0;
     }
-    Spin_Unlock(&kthreadLock);
+    Epoch_Read_End(&s_pidEpoch, epoch);
 
     End_Int_Atomic(iflag);
 
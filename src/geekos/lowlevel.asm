@@ -338,6 +338,10 @@ Handle_Interrupt:
     ; macro defined above to push registers and create Interrupt_State 
     Save_Registers
 
+    ; user code may have left the direction flag set; the C handlers,
+    ; and the rep string instructions in memcpy() et al., assume it clear
+    cld
+
 
     ; Ensure that we're using the kernel data segment
     mov	ax, KERNEL_DS
@@ -95,6 +95,10 @@ void Hardware_Shutdown() {
        failure during submission testing.  Adding code that
        may fail here can lead to test timeout. */
 
+    /* Flush_Console() is safe here: it gives up on a lock it
+       cannot get, and does nothing if it fails and reenters. */
+    Flush_Console();
+
     // works with > 1.3 qemu with the command line: -device isa-debug-exit,iobase=0x501
     Out_Byte(0x501, 0x00);
 
@@ -114,6 +118,7 @@ void Hardware_Shutdown() {
 
 void Main(struct Boot_Info *bootInfo) {
     Init_BSS();
+    Init_String_Features(0);
     Init_Screen();
     Init_Mem(bootInfo);
     Init_CRC32();
@@ -146,6 +151,7 @@ void Main(struct Boot_Info *bootInfo) {
     Init_GOSFS();
     Init_CFS();
     Init_Alarm();
+    Init_Console_Thread();
     Init_Serial();
 
     /* Expect that the global lock is not held. */
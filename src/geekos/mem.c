@@ -60,6 +60,30 @@ extern int debugFaults;
  */
 static struct Page_List s_freeList;
 
+/*
+ * Free pages that the idle thread has already cleared.  Allocation
+ * prefers these, so that it need not zero the page synchronously.
+ * Lock order: s_freeList before s_zeroedList.
+ */
+static struct Page_List s_zeroedList;
+static uint_t s_zeroedPageCount = 0;
+#define ZEROED_POOL_TARGET 256
+
+/*
+ * Per-CPU caches of free pages.  Each CPU allocates from and frees
+ * to its own short list, and only visits the global lists to refill
+ * or drain PAGE_CACHE_BATCH pages at a time.  The list's own lock
+ * guards the cache; it is always taken before the global list locks.
+ */
+#define PAGE_CACHE_BATCH 16
+#define PAGE_CACHE_HIGH  (4 * PAGE_CACHE_BATCH)
+
+struct Page_Cache {
+    struct Page_List list;
+    int count;
+};
+static struct Page_Cache s_pageCache[MAX_CPUS];
+
 /*
  * Total number of physical pages.
  */
@@ -234,38 +258,209 @@ void Init_BSS(void) {
     memset(&BSS_START, '\0', &BSS_END - &BSS_START);
 }
 
+/*
+ * Remove the first page from a free list whose lock is held.
+ */
+static struct Page *Locked_Pop_Free_Page(struct Page_List *list) {
+    struct Page *page = Get_Front_Of_Page_List(list);
+    if(page)
+        Locked_Remove_From_Page_List(list, page);
+    return page;
+}
+
+/*
+ * Move up to PAGE_CACHE_BATCH pages from the global lists into
+ * the given per-CPU cache, preferring pages that are already zeroed.
+ * Called with the cache locked and interrupts disabled.
+ */
+static void Refill_Page_Cache(struct Page_Cache *cache) {
+    struct Page *page;
+
+    Lock_Page_List(&s_zeroedList);
+    while (cache->count < PAGE_CACHE_BATCH &&
+           (page = Locked_Pop_Free_Page(&s_zeroedList)) != 0) {
+        --s_zeroedPageCount;
+        Locked_Unchecked_Add_To_Back_Of_Page_List(&cache->list, page);
+        ++cache->count;
+    }
+    Unlock_Page_List(&s_zeroedList);
+
+    if(cache->count < PAGE_CACHE_BATCH) {
+        Lock_Page_List(&s_freeList);
+        while (cache->count < PAGE_CACHE_BATCH &&
+               (page = Locked_Pop_Free_Page(&s_freeList)) != 0) {
+            Locked_Unchecked_Add_To_Back_Of_Page_List(&cache->list, page);
+            ++cache->count;
+        }
+        Unlock_Page_List(&s_freeList);
+    }
+}
+
+/*
+ * Return the coldest PAGE_CACHE_BATCH pages of a per-CPU cache
+ * to the global lists.
+ * Called with the cache locked and interrupts disabled.
+ */
+static void Drain_Page_Cache(struct Page_Cache *cache) {
+    struct Page *page;
+    int i;
+
+    Lock_Page_List(&s_freeList);
+    Lock_Page_List(&s_zeroedList);
+    for(i = 0; i < PAGE_CACHE_BATCH; i++) {
+        page = Locked_Pop_Free_Page(&cache->list);
+        if(!page)
+            break;
+        --cache->count;
+        if(page->flags & PAGE_ZEROED) {
+            Locked_Unchecked_Add_To_Back_Of_Page_List(&s_zeroedList,
+                                                      page);
+            ++s_zeroedPageCount;
+        } else {
+            Locked_Unchecked_Add_To_Back_Of_Page_List(&s_freeList, page);
+        }
+    }
+    Unlock_Page_List(&s_zeroedList);
+    Unlock_Page_List(&s_freeList);
+}
+
+/*
+ * Last resort when this CPU's cache and the global lists are empty:
+ * take a page out of another CPU's cache.
+ */
+static struct Page *Steal_Cached_Page(void) {
+    struct Page *page = 0;
+    int i;
+
+    for(i = 0; i < MAX_CPUS && !page; i++) {
+        struct Page_Cache *cache = &s_pageCache[i];
+        if(cache->count == 0)
+            continue;
+        bool iflag = Begin_Int_Atomic();
+        Lock_Page_List(&cache->list);
+        page = Locked_Pop_Free_Page(&cache->list);
+        if(page)
+            --cache->count;
+        Unlock_Page_List(&cache->list);
+        End_Int_Atomic(iflag);
+    }
+    return page;
+}
+
+/*
+ * Mark a page taken off a free list as allocated, clearing it
+ * unless the idle thread already did.
+ */
+static void Claim_Page_Frame(struct Page *page) {
+    KASSERT((page->flags & PAGE_ALLOCATED) == 0);
+    /* Mark page as having been allocated. */
+    page->flags |= PAGE_ALLOCATED;
+    KASSERT(!(page->flags & PAGE_PAGEABLE));
+    g_freePageCount--;
+
+    if(page->flags & PAGE_ZEROED) {
+        page->flags &= ~(PAGE_ZEROED);
+    } else {
+        memset((void *)Get_Page_Address(page), '\0', PAGE_SIZE);
+    }
+}
+
 /* 
  * Allocates a page frame, if one is available.  Fails if 
  * there are no free pages.
  * 
  * The struct Page associated with the physical page frame 
  * will be marked with flag PAGE_ALLOCATED
- * 
- * Should be called with the allocator_mutex held.
  *
+ * Pages come from this CPU's page cache, which is refilled
+ * in batches from the global lists when it runs dry.
  */
 
 static void *Alloc_Page_Frame(void) {
     struct Page *page;
-    void *result = 0;
-
-    /* See if we have a free page */
-    /* Remove the first page on the freelist. */
-    page = Remove_From_Front_Of_Page_List(&s_freeList);
+    struct Page_Cache *cache;
+
+    bool iflag = Begin_Int_Atomic();
+    cache = &s_pageCache[Get_CPU_ID()];
+    Lock_Page_List(&cache->list);
+    if(cache->count == 0)
+        Refill_Page_Cache(cache);
+    /* most recently freed first; it is the most likely to be cache-warm. */
+    page = Get_Back_Of_Page_List(&cache->list);
     if(page) {
-        KASSERT((page->flags & PAGE_ALLOCATED) == 0);
-        /* Mark page as having been allocated. */
-        page->flags |= PAGE_ALLOCATED;
-        KASSERT(!(page->flags & PAGE_PAGEABLE));
-        g_freePageCount--;
-        result = (void *)Get_Page_Address(page);
+        Locked_Remove_From_Page_List(&cache->list, page);
+        --cache->count;
     }
+    Unlock_Page_List(&cache->list);
+    End_Int_Atomic(iflag);
+
+    if(!page)
+        page = Steal_Cached_Page();
+    if(!page)
+        return 0;
 
+    Claim_Page_Frame(page);
+    return (void *)Get_Page_Address(page);
+}
+
+/*
+ * Put a page that is neither allocated nor locked back on this
+ * CPU's page cache, draining a batch to the global lists if the
+ * cache has grown too long.
+ */
+static void Release_Page_Frame(struct Page *page) {
+    struct Page_Cache *cache;
 
-    if(result) {
-        memset(result, '\0', 4096);
+    if(debugFreeList) {
+        KASSERT0(page->inPage_List == 0,
+                 "Freeing a page that is already on a free list.");
     }
-    return result;
+
+    bool iflag = Begin_Int_Atomic();
+    cache = &s_pageCache[Get_CPU_ID()];
+    Lock_Page_List(&cache->list);
+    Locked_Unchecked_Add_To_Back_Of_Page_List(&cache->list, page);
+    if(++cache->count > PAGE_CACHE_HIGH)
+        Drain_Page_Cache(cache);
+    g_freePageCount++;
+    Unlock_Page_List(&cache->list);
+    End_Int_Atomic(iflag);
+}
+
+/*
+ * Zero one page from the global freelist and move it to the
+ * zeroed pool.  Called from the idle thread, so that Alloc_Page
+ * can usually skip the memset.  Returns false when there is
+ * nothing to do, in which case the caller may halt.
+ */
+bool Idle_Zero_Free_Page(void) {
+    struct Page *page;
+    bool iflag;
+
+    if(s_zeroedPageCount >= ZEROED_POOL_TARGET)
+        return false;
+
+    iflag = Begin_Int_Atomic();
+    Lock_Page_List(&s_freeList);
+    page = Locked_Pop_Free_Page(&s_freeList);
+    Unlock_Page_List(&s_freeList);
+    End_Int_Atomic(iflag);
+
+    if(!page)
+        return false;
+
+    /* the page is on no list while we clear it, so no lock is needed. */
+    memset((void *)Get_Page_Address(page), '\0', PAGE_SIZE);
+    page->flags |= PAGE_ZEROED;
+
+    iflag = Begin_Int_Atomic();
+    Lock_Page_List(&s_zeroedList);
+    Locked_Unchecked_Add_To_Back_Of_Page_List(&s_zeroedList, page);
+    ++s_zeroedPageCount;
+    Unlock_Page_List(&s_zeroedList);
+    End_Int_Atomic(iflag);
+
+    return true;
 }
 
 /*
@@ -315,13 +510,7 @@ void Unlock_Page(struct Page *page) {
         page->context = (void *)0xbad10000;
 
         /* Put the page back on the freelist */
-        if(debugFreeList) {
-            Add_To_Back_Of_Page_List(&s_freeList, page);
-        } else {
-            Unchecked_Add_To_Back_Of_Page_List(&s_freeList, page);
-        }
-        g_freePageCount++;
-
+        Release_Page_Frame(page);
     }
 
     /* Unlock the page */
@@ -426,6 +615,65 @@ void *Alloc_Page(void) {
     return ret;
 }
 
+/*
+ * Allocate numPages physically contiguous pinned pages.
+ * Returns the address of the first page, or null if no run of
+ * free pages is long enough.  Pages held in per-CPU caches are
+ * not considered.  The scan already knows which free list each
+ * page of the run is on, so each is unlinked without a list walk.
+ */
+void *Alloc_Pages(unsigned int numPages) {
+    unsigned int i, first, run = 0;
+    struct Page *page;
+    bool iflag;
+
+    KASSERT(numPages > 0);
+    if(numPages == 1)
+        return Alloc_Page();
+
+    iflag = Begin_Int_Atomic();
+    Lock_Page_List(&s_freeList);
+    Lock_Page_List(&s_zeroedList);
+
+    for(i = 0; i < g_numPages && run < numPages; i++) {
+        page = &g_pageList[i];
+        if(page->inPage_List == &s_freeList ||
+           page->inPage_List == &s_zeroedList)
+            ++run;
+        else
+            run = 0;
+    }
+
+    if(run < numPages) {
+        Unlock_Page_List(&s_zeroedList);
+        Unlock_Page_List(&s_freeList);
+        End_Int_Atomic(iflag);
+        return 0;
+    }
+
+    first = i - numPages;
+    for(i = first; i < first + numPages; i++) {
+        page = &g_pageList[i];
+        if(page->inPage_List == &s_zeroedList)
+            --s_zeroedPageCount;
+        Locked_Unchecked_Remove_From_Page_List(page->inPage_List, page);
+    }
+
+    Unlock_Page_List(&s_zeroedList);
+    Unlock_Page_List(&s_freeList);
+    End_Int_Atomic(iflag);
+
+    for(i = first; i < first + numPages; i++) {
+        page = &g_pageList[i];
+        Claim_Page_Frame(page);
+        page->entry = NULL;
+        page->vaddr = 0;
+        page->context = NULL;
+    }
+
+    return (void *)Get_Page_Address(&g_pageList[first]);
+}
+
 /**
  * Allocate a page of pageable physical memory, to be mapped
  * into a user address space.
@@ -458,8 +706,10 @@ void Free_Page(void *pageAddr) {
     KASSERT0(page,
              "Couldn't find a struct Page * for the given pageAddr");
 
-    /* useful to find use-after-free bugs */
-    memset(pageAddr, '\0', 4096);
+    /* useful to find use-after-free bugs; otherwise the page is
+       cleared when reallocated, or earlier by the idle thread. */
+    if(debugFreeList)
+        memset(pageAddr, '\0', 4096);
     // Print("freeing %p because of %lx\n", pageAddr, (ulong_t) __builtin_return_address(0));
 
     KASSERT0((page->flags & PAGE_ALLOCATED) != 0,
@@ -486,3 +736,13 @@ void Free_Page(void *pageAddr) {
     }
 
 }
+
+/*
+ * Free numPages contiguous pages obtained from Alloc_Pages().
+ */
+void Free_Pages(void *pageAddr, unsigned int numPages) {
+    unsigned int i;
+
+    for(i = 0; i < numPages; i++)
+        Free_Page((char *)pageAddr + i * PAGE_SIZE);
+}
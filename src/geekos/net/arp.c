@@ -24,13 +24,51 @@
 #include <geekos/projects.h>
 
 #define ARP_TIMEOUT_MS 10000    /* 10 second timeout */
+#define ARP_RETRY_MS 1000       /* resend an unanswered request */
+#define ARP_ENTRY_LIFETIME_MS 60000
+#define ARP_SWEEP_MS 1000       /* how often entries are aged */
+
+/* byte offsets of the addresses within struct ARP_Packet */
+#define ARP_SHA_OFFSET 8
+#define ARP_SPA_OFFSET 14
+#define ARP_THA_OFFSET 18
+#define ARP_TPA_OFFSET 24
+
+/* requests ARP_Table_Cleanse resends per sweep; the rest wait a sweep */
+#define ARP_SWEEP_REQUESTS 16
+
+#define ARP_MS_TO_TICKS(ms) ((ms) * TICKS_PER_SEC / 1000)
 
 // #define DEBUG_ARP(x...) Print("ARP: " x)
 #define DEBUG_ARP(x...)
 
-static struct ARP_Table s_arpTable;
+/* hash chains keyed by protocol address, all under s_arpTableMutex */
+static struct ARP_Table s_arpTable[ARP_HASH_BUCKETS];
 static struct Mutex s_arpTableMutex;
 
+/*
+ * Transmitting can block on a full device queue, so nothing is sent
+ * with s_arpTableMutex held.  Work found under the mutex is copied out
+ * into one of these and done once it is dropped, since the entry may
+ * be gone by then.
+ */
+
+/* a request to (re)send */
+struct ARP_Request {
+    struct Net_Device *device;
+    ushort_t htype;
+    ushort_t ptype;
+    ARP_Protocol_Address protocolAddress;
+};
+
+/* the frames that were waiting on an entry that has just resolved */
+struct ARP_Release {
+    struct Net_Device *device;
+    ushort_t ptype;
+    ARP_Hardware_Address hardwareAddress;
+    struct Packet_Queue frames;
+};
+
 
 static int ARP_Table_Insert(ushort_t htype, ushort_t ptype,
                             const uchar_t
@@ -46,6 +84,22 @@ static int ARP_Send_Request(struct Net_Device *device, ushort_t htype,
                             ushort_t ptype,
                             const uchar_t
                             protocolAddress[ARP_PROT_ADDR_SIZE]);
+static struct ARP_Table_Element *ARP_Find_By_Proto(ushort_t htype,
+                                                   ushort_t ptype,
+                                                   const uchar_t
+                                                   protocolAddress
+                                                   [ARP_PROT_ADDR_SIZE]);
+static struct ARP_Table_Element *ARP_Entry_Create(struct Net_Device
+                                                  *device, ushort_t htype,
+                                                  ushort_t ptype,
+                                                  const uchar_t
+                                                  protocolAddress
+                                                  [ARP_PROT_ADDR_SIZE]);
+static void ARP_Entry_Resolve(struct ARP_Table_Element *entry,
+                              const uchar_t
+                              hardwareAddress[ARP_HWARE_ADDR_SIZE],
+                              struct ARP_Release *release);
+static void ARP_Send_Released(struct ARP_Release *release);
 
 
 static bool ARP_Compare_Protocol_Addresses(ushort_t ptype
@@ -88,26 +142,63 @@ static int ARP_Get_Protocol_Address(struct Net_Device *device, int ptype,
 /* Arp networking */
 int ARP_Dispatch(struct Net_Device *device, struct Net_Buf *nBuf) {
     struct ARP_Packet packet;
+    /* the address fields are contiguous bytes despite the split types */
+    const uchar_t *raw = (const uchar_t *)&packet;
+    const uchar_t *senderHardware = raw + ARP_SHA_OFFSET;
+    const uchar_t *senderProtocol = raw + ARP_SPA_OFFSET;
+    const uchar_t *targetProtocol = raw + ARP_TPA_OFFSET;
+    ARP_Protocol_Address ourAddress;
+    struct ARP_Table_Element *entry;
+    struct ARP_Release release;
+    bool forUs;
+    int rc;
+
+    rc = Net_Buf_Extract(nBuf, 0, &packet, sizeof(packet));
+    Net_Buf_Destroy(nBuf);
+    if(rc != 0)
+        return rc;
+
+    if(ntohs(packet.htype) != ARP_HTYPE_ETH ||
+       ntohs(packet.ptype) != ARP_PTYPE_IPV4)
+        return EUNSUPPORTED;
 
-    Net_Buf_Extract(nBuf, 0, &packet, sizeof(packet));
+    forUs = ARP_Get_Protocol_Address(device, ARP_PTYPE_IPV4,
+                                     ourAddress) == 0 &&
+        ARP_Compare_Protocol_Addresses(ARP_PTYPE_IPV4, targetProtocol,
+                                       ourAddress);
 
-    TODO_P(PROJECT_ARP,
-           "handle a received arp packet which may be a request issued by someone else or a response to our query.");
-    return EUNSUPPORTED;
+    /* refresh the sender if we know it; learn it if it asked us */
+    Mutex_Lock(&s_arpTableMutex);
+    entry = ARP_Find_By_Proto(ARP_HTYPE_ETH, ARP_PTYPE_IPV4,
+                              senderProtocol);
+    if(entry == NULL && forUs)
+        entry = ARP_Entry_Create(device, ARP_HTYPE_ETH, ARP_PTYPE_IPV4,
+                                 senderProtocol);
+    Clear_Packet_Queue(&release.frames);
+    if(entry != NULL)
+        ARP_Entry_Resolve(entry, senderHardware, &release);
+    Mutex_Unlock(&s_arpTableMutex);
+
+    ARP_Send_Released(&release);
+
+    if(forUs && ntohs(packet.oper) == ARP_OPER_REQUEST)
+        return ARP_Send_Reply(device, &packet, ourAddress);
+
+    return 0;
 }
 
 int ARP_Transmit(struct Net_Device *device, struct ARP_Packet *packet,
                  uchar_t * ethDestAddr) {
     // unused int paddingNeeded = sizeof(struct ARP_Packet) - ETH_MIN_DATA;
     struct Net_Buf *nBuf = NULL;
-    int rc = Net_Buf_Create(&nBuf);
+    int rc = Net_Buf_Create_Linear(&nBuf, NET_BUF_HEADROOM,
+                                   MAX(sizeof(struct ARP_Packet),
+                                       ETH_MIN_DATA));
     if(rc != 0)
         goto fail;
 
-    rc = Net_Buf_Prepend(nBuf, packet, sizeof(struct ARP_Packet),
-                         NET_BUF_ALLOC_LEND);
-    if(rc != 0)
-        goto fail;
+    memcpy(Net_Buf_Put(nBuf, sizeof(struct ARP_Packet)), packet,
+           sizeof(struct ARP_Packet));
 
     Eth_Transmit(device, nBuf, ethDestAddr, ETH_ARP);
 
@@ -126,42 +217,52 @@ static int ARP_Send_Request(struct Net_Device *device,
                             const uchar_t
                             protocolAddress[ARP_PROT_ADDR_SIZE]) {
     uchar_t ethDestAddr[] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
-    int rc = 0;
-
-    struct ARP_Packet *packet = Malloc(sizeof(struct ARP_Packet));
-    if(packet == NULL)
-        return ENOMEM;
-
-    TODO_P(PROJECT_ARP, "Fill in the arp request");
-
-    rc = ARP_Transmit(device, packet, ethDestAddr);
+    struct ARP_Packet packet;
+    uchar_t *raw = (uchar_t *) & packet;
+    int rc;
+
+    memset(&packet, '\0', sizeof(packet));
+    packet.htype = htons(htype);
+    packet.ptype = htons(ptype);
+    packet.hlen = ARP_HWARE_ADDR_SIZE;
+    packet.plen = ARP_PROT_ADDR_SIZE;
+    packet.oper = htons(ARP_OPER_REQUEST);
+    memcpy(raw + ARP_SHA_OFFSET, device->devAddr, ARP_HWARE_ADDR_SIZE);
+    rc = ARP_Get_Protocol_Address(device, ptype, raw + ARP_SPA_OFFSET);
+    if(rc != 0)
+        return rc;
+    /* the target hardware address is what we are asking for */
+    memcpy(raw + ARP_TPA_OFFSET, protocolAddress, ARP_PROT_ADDR_SIZE);
 
-    Free(packet);
-    return rc;
+    return ARP_Transmit(device, &packet, ethDestAddr);
 }
 
+/* turn a request for protocolAddress, ours, around into the reply */
 static int ARP_Send_Reply(struct Net_Device *device,
                           struct ARP_Packet *receivedPacket,
                           const uchar_t
                           protocolAddress[ARP_PROT_ADDR_SIZE]) {
-    int rc = 0;
-    TODO_P(PROJECT_ARP,
-           "construct a reply to this received packet and transmit (you may reuse the packet)");
+    uchar_t *raw = (uchar_t *) receivedPacket;
+    ARP_Hardware_Address requester;
 
-    return rc;
-}
+    memcpy(requester, raw + ARP_SHA_OFFSET, ARP_HWARE_ADDR_SIZE);
 
-int ARP_Send_Request_And_Wait(struct Net_Device *device, ushort_t htype,
-                              ushort_t ptype,
-                              ARP_Protocol_Address protocolAddress) {
-    int rc = 0;
+    receivedPacket->oper = htons(ARP_OPER_REPLY);
+    memmove(raw + ARP_THA_OFFSET, raw + ARP_SHA_OFFSET,
+            ARP_HWARE_ADDR_SIZE + ARP_PROT_ADDR_SIZE);
+    memcpy(raw + ARP_SHA_OFFSET, device->devAddr, ARP_HWARE_ADDR_SIZE);
+    memcpy(raw + ARP_SPA_OFFSET, protocolAddress, ARP_PROT_ADDR_SIZE);
 
-    KASSERT(Interrupts_Enabled());
+    return ARP_Transmit(device, receivedPacket, requester);
+}
 
-    TODO_P(PROJECT_ARP,
-           "ready this thread to wait on a reply or timeout; construct and send the request.");
+static uint_t ARP_Hash(const uchar_t protocolAddress[ARP_PROT_ADDR_SIZE]) {
+    uint_t key = ((uint_t) protocolAddress[0] << 24) |
+        ((uint_t) protocolAddress[1] << 16) |
+        ((uint_t) protocolAddress[2] << 8) | protocolAddress[3];
 
-    return rc;
+    /* multiplicative hash; hosts on a subnet differ in the low bits */
+    return ((key * 2654435761U) >> 16) % ARP_HASH_BUCKETS;
 }
 
 /* the arp table mutex should be locked */
@@ -171,7 +272,9 @@ static struct ARP_Table_Element *ARP_Find_By_Proto(ushort_t htype,
                                                    protocolAddress
                                                    [ARP_PROT_ADDR_SIZE]) {
     struct ARP_Table_Element *curr;
-    for(curr = Get_Front_Of_ARP_Table(&s_arpTable);
+    struct ARP_Table *bucket = &s_arpTable[ARP_Hash(protocolAddress)];
+
+    for(curr = Get_Front_Of_ARP_Table(bucket);
         curr != NULL; curr = Get_Next_In_ARP_Table(curr)) {
         if(curr->htype == htype &&
            curr->ptype == ptype &&
@@ -183,6 +286,117 @@ static struct ARP_Table_Element *ARP_Find_By_Proto(ushort_t htype,
     return NULL;
 }
 
+/* add a pending entry; the arp table mutex should be locked */
+static struct ARP_Table_Element *ARP_Entry_Create(struct Net_Device
+                                                  *device, ushort_t htype,
+                                                  ushort_t ptype,
+                                                  const uchar_t
+                                                  protocolAddress
+                                                  [ARP_PROT_ADDR_SIZE]) {
+    struct ARP_Table_Element *entry =
+        Malloc(sizeof(struct ARP_Table_Element));
+    if(entry == NULL)
+        return NULL;
+
+    memset(entry, '\0', sizeof(struct ARP_Table_Element));
+    entry->htype = htype;
+    entry->ptype = ptype;
+    memcpy(entry->protocolAddress, protocolAddress, ARP_PROT_ADDR_SIZE);
+    entry->insertTime = g_numTicks;
+    entry->state = ARP_ENTRY_PENDING;
+    entry->device = device;
+    Cond_Init(&entry->resolved);
+
+    Add_To_Front_Of_ARP_Table(&s_arpTable[ARP_Hash(protocolAddress)],
+                              entry);
+    return entry;
+}
+
+/* note that a pending entry is due a request, for ARP_Send; mutex held */
+static void ARP_Entry_Request(struct ARP_Table_Element *entry,
+                              struct ARP_Request *request) {
+    entry->requestTime = g_numTicks;
+    request->device = entry->device;
+    request->htype = entry->htype;
+    request->ptype = entry->ptype;
+    memcpy(request->protocolAddress, entry->protocolAddress,
+           ARP_PROT_ADDR_SIZE);
+}
+
+/* send a request noted by ARP_Entry_Request; mutex not held */
+static void ARP_Send(struct ARP_Request *request) {
+    ARP_Send_Request(request->device, request->htype, request->ptype,
+                     request->protocolAddress);
+}
+
+/*
+ * Record the hardware address for an entry and wake the threads
+ * waiting on it.  Whatever was queued behind its request moves to
+ * release, whose frames the caller must have cleared, for
+ * ARP_Send_Released.  The arp table mutex should be locked.
+ */
+static void ARP_Entry_Resolve(struct ARP_Table_Element *entry,
+                              const uchar_t
+                              hardwareAddress[ARP_HWARE_ADDR_SIZE],
+                              struct ARP_Release *release) {
+    memcpy(entry->hardwareAddress, hardwareAddress, ARP_HWARE_ADDR_SIZE);
+    entry->insertTime = g_numTicks;
+
+    if(entry->state == ARP_ENTRY_RESOLVED)
+        return;
+
+    entry->state = ARP_ENTRY_RESOLVED;
+    release->device = entry->device;
+    release->ptype = entry->ptype;
+    memcpy(release->hardwareAddress, hardwareAddress, ARP_HWARE_ADDR_SIZE);
+    release->frames = entry->queued;
+    Clear_Packet_Queue(&entry->queued);
+    entry->queuedCount = 0;
+
+    Cond_Broadcast(&entry->resolved);
+}
+
+/* send the frames ARP_Entry_Resolve released; mutex not held */
+static void ARP_Send_Released(struct ARP_Release *release) {
+    struct Net_Buf *nBuf;
+
+    while (!Is_Packet_Queue_Empty(&release->frames)) {
+        nBuf = Remove_From_Front_Of_Packet_Queue(&release->frames);
+        Eth_Transmit(release->device, nBuf, release->hardwareAddress,
+                     release->ptype);
+        Net_Buf_Destroy(nBuf);
+    }
+}
+
+/*
+ * Take an entry out of the table.  A pending one fails: its queued
+ * frames are dropped and its waiters see ETIMEOUT, the last of them
+ * freeing it.  Entries with waiters are otherwise left alone, so a
+ * woken waiter never finds its entry gone.  Mutex held.
+ */
+static bool ARP_Entry_Remove(struct ARP_Table_Element *entry) {
+    if(entry->state == ARP_ENTRY_RESOLVED && entry->waiters > 0)
+        return false;
+
+    Remove_From_ARP_Table(&s_arpTable[ARP_Hash(entry->protocolAddress)],
+                          entry);
+
+    while (!Is_Packet_Queue_Empty(&entry->queued))
+        Net_Buf_Destroy(Remove_From_Front_Of_Packet_Queue
+                        (&entry->queued));
+    entry->queuedCount = 0;
+
+    if(entry->state == ARP_ENTRY_PENDING) {
+        entry->state = ARP_ENTRY_FAILED;
+        Cond_Broadcast(&entry->resolved);
+    }
+
+    if(entry->waiters == 0)
+        Free(entry);
+
+    return true;
+}
+
 /* Arp Table */
 static int ARP_Table_Lookup(ushort_t htype, ushort_t ptype,
                             const uchar_t
@@ -213,23 +427,23 @@ static int ARP_Table_Insert(ushort_t htype, ushort_t ptype,
                             hardwareAddress[ARP_HWARE_ADDR_SIZE],
                             const uchar_t
                             protocolAddress[ARP_PROT_ADDR_SIZE]) {
+    struct ARP_Table_Element *element;
+    struct ARP_Release release;
+    int rc = 0;
+
+    Clear_Packet_Queue(&release.frames);
     Mutex_Lock(&s_arpTableMutex);
-    struct ARP_Table_Element *element =
-        Malloc(sizeof(struct ARP_Table_Element));
+    element = ARP_Find_By_Proto(htype, ptype, protocolAddress);
     if(element == NULL)
-        return ENOMEM;
-
-    element->htype = htype;
-    element->ptype = ptype;
-    memcpy(element->hardwareAddress, hardwareAddress,
-           ARP_HWARE_ADDR_SIZE);
-    memcpy(element->protocolAddress, protocolAddress, ARP_PROT_ADDR_SIZE);
-
-    Add_To_Front_Of_ARP_Table(&s_arpTable, element);
-
+        element = ARP_Entry_Create(NULL, htype, ptype, protocolAddress);
+    if(element != NULL)
+        ARP_Entry_Resolve(element, hardwareAddress, &release);
+    else
+        rc = ENOMEM;
     Mutex_Unlock(&s_arpTableMutex);
 
-    return 0;
+    ARP_Send_Released(&release);
+    return rc;
 }
 
 /* unused static */
@@ -241,9 +455,7 @@ int ARP_Table_Delete(ushort_t htype, ushort_t ptype,
     Mutex_Lock(&s_arpTableMutex);
     curr = ARP_Find_By_Proto(htype, ptype, protocolAddress);
     if(curr) {
-        Remove_From_ARP_Table(&s_arpTable, curr);
-        Free(curr);
-        ret = 0;
+        ret = ARP_Entry_Remove(curr) ? 0 : EBUSY;
     } else {
         ret = -1;
     }
@@ -251,38 +463,165 @@ int ARP_Table_Delete(ushort_t htype, ushort_t ptype,
     return ret;
 }
 
-/* unused static */
+/*
+ * Drop stale entries of the given types: resolved ones past their
+ * lifetime and pending ones that have gone unanswered for
+ * ARP_TIMEOUT_MS.  Pending entries due a retry get a fresh request.
+ */
 int ARP_Table_Cleanse(ushort_t htype, ushort_t ptype) {
-    TODO_P(PROJECT_ARP,
-           "Implement ARP_Table_Cleanse() to remove stale arp entries");
-    (void)htype;
-    (void)ptype;
+    struct ARP_Table_Element *curr, *next;
+    struct ARP_Request requests[ARP_SWEEP_REQUESTS];
+    ulong_t now = g_numTicks;
+    int i, count = 0;
+
+    Mutex_Lock(&s_arpTableMutex);
+    for(i = 0; i < ARP_HASH_BUCKETS; ++i) {
+        for(curr = Get_Front_Of_ARP_Table(&s_arpTable[i]); curr != NULL;
+            curr = next) {
+            next = Get_Next_In_ARP_Table(curr);
+            if(curr->htype != htype || curr->ptype != ptype)
+                continue;
+
+            if(curr->state == ARP_ENTRY_RESOLVED) {
+                if(now - curr->insertTime >=
+                   ARP_MS_TO_TICKS(ARP_ENTRY_LIFETIME_MS))
+                    ARP_Entry_Remove(curr);
+            } else if(now - curr->insertTime >=
+                      ARP_MS_TO_TICKS(ARP_TIMEOUT_MS)) {
+                ARP_Entry_Remove(curr);
+            } else if(now - curr->requestTime >=
+                      ARP_MS_TO_TICKS(ARP_RETRY_MS) &&
+                      count < ARP_SWEEP_REQUESTS) {
+                ARP_Entry_Request(curr, &requests[count++]);
+            }
+        }
+    }
+    Mutex_Unlock(&s_arpTableMutex);
+
+    for(i = 0; i < count; ++i)
+        ARP_Send(&requests[i]);
+
     return 0;
 }
 
+/* alarm callback: age the cache, then rearm */
+static void ARP_Sweep(void *data __attribute__ ((unused))) {
+    ARP_Table_Cleanse(ARP_HTYPE_ETH, ARP_PTYPE_IPV4);
+    Alarm_Create(ARP_Sweep, NULL, ARP_SWEEP_MS);
+}
+
 /* should be the main arp routine. check the cache, if not in cache, send
-   request, add to wait queue for receipt of a reply or timeout. */
+   request, add to wait queue for receipt of a reply or timeout.  Threads
+   asking for the same address share one outstanding request. */
 int ARP_Resolve_Address(struct Net_Device *device,
                         ushort_t htype,
                         ushort_t ptype,
                         ARP_Protocol_Address protocolAddress,
                         ARP_Hardware_Address hardwareAddress) {
+    struct ARP_Table_Element *entry;
+    struct ARP_Request request;
     int rc = 0;
 
     KASSERT(Interrupts_Enabled());
 
-    TODO_P(PROJECT_ARP,
-           "Consult the cache, if not in cache, send request and wait");
+    Mutex_Lock(&s_arpTableMutex);
+    entry = ARP_Find_By_Proto(htype, ptype, protocolAddress);
+    if(entry == NULL) {
+        entry = ARP_Entry_Create(device, htype, ptype, protocolAddress);
+        if(entry == NULL) {
+            Mutex_Unlock(&s_arpTableMutex);
+            return ENOMEM;
+        }
+        ARP_Entry_Request(entry, &request);
+
+        /* as a waiter, we keep the entry from being freed meanwhile */
+        ++entry->waiters;
+        Mutex_Unlock(&s_arpTableMutex);
+        ARP_Send(&request);
+        Mutex_Lock(&s_arpTableMutex);
+    } else {
+        ++entry->waiters;
+    }
+
+    while (entry->state == ARP_ENTRY_PENDING)
+        Cond_Wait(&entry->resolved, &s_arpTableMutex);
+    --entry->waiters;
+
+    if(entry->state == ARP_ENTRY_RESOLVED) {
+        memcpy(hardwareAddress, entry->hardwareAddress,
+               ARP_HWARE_ADDR_SIZE);
+    } else {
+        /* timed out and already unlinked; the last waiter frees it */
+        rc = ETIMEOUT;
+        if(entry->waiters == 0)
+            Free(entry);
+    }
+    Mutex_Unlock(&s_arpTableMutex);
 
     return rc;
+}
+
+/*
+ * Send a frame of protocol ptype to protocolAddress.  If the address
+ * isn't resolved yet the frame waits behind the single outstanding
+ * request (the oldest is dropped past ARP_MAX_QUEUED) and the caller
+ * doesn't block.  Takes ownership of nBuf.
+ */
+int ARP_Output(struct Net_Device *device, ushort_t ptype,
+               ARP_Protocol_Address protocolAddress, struct Net_Buf *nBuf) {
+    struct ARP_Table_Element *entry;
+    ARP_Hardware_Address hardwareAddress;
+    struct ARP_Request request;
+    bool mustRequest = false;
+    int rc;
+
+    KASSERT(Interrupts_Enabled());
 
+    Mutex_Lock(&s_arpTableMutex);
+    entry = ARP_Find_By_Proto(ARP_HTYPE_ETH, ptype, protocolAddress);
+    if(entry != NULL && entry->state == ARP_ENTRY_RESOLVED) {
+        memcpy(hardwareAddress, entry->hardwareAddress,
+               ARP_HWARE_ADDR_SIZE);
+        Mutex_Unlock(&s_arpTableMutex);
+
+        rc = Eth_Transmit(device, nBuf, hardwareAddress, ptype);
+        Net_Buf_Destroy(nBuf);
+        return rc;
+    }
+
+    if(entry == NULL) {
+        entry = ARP_Entry_Create(device, ARP_HTYPE_ETH, ptype,
+                                 protocolAddress);
+        if(entry == NULL) {
+            Mutex_Unlock(&s_arpTableMutex);
+            Net_Buf_Destroy(nBuf);
+            return ENOMEM;
+        }
+        ARP_Entry_Request(entry, &request);
+        mustRequest = true;
+    }
+
+    if(entry->queuedCount == ARP_MAX_QUEUED) {
+        Net_Buf_Destroy(Remove_From_Front_Of_Packet_Queue
+                        (&entry->queued));
+        --entry->queuedCount;
+    }
+    Add_To_Back_Of_Packet_Queue(&entry->queued, nBuf);
+    ++entry->queuedCount;
+    Mutex_Unlock(&s_arpTableMutex);
+
+    if(mustRequest)
+        ARP_Send(&request);
+
+    return 0;
 }
 
 
 void Init_ARP_Protocol(void) {
     Mutex_Init(&s_arpTableMutex);
-    s_arpTable.head = s_arpTable.tail = 0;
-    TODO_P(PROJECT_ARP, "Initialize other needed variables");
+    memset(s_arpTable, '\0', sizeof(s_arpTable));
+
+    Alarm_Create(ARP_Sweep, NULL, ARP_SWEEP_MS);
 
     Eth_Dispatch_Table_Add(ETH_ARP, ARP_Dispatch);
 }
@@ -0,0 +1,57 @@
+/*
+ * Internet checksum (RFC 1071)
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#include <geekos/net/checksum.h>
+
+/* 32-bit loads at any alignment, which x86 handles at full speed */
+typedef uint_t __attribute__ ((__may_alias__, __aligned__(1))) csum_word_t;
+
+/*
+ * The one's complement sum does not depend on byte order, so sum the
+ * data as little-endian 32-bit words into a 64-bit accumulator, whose
+ * top half collects the carries, and swap the bytes of the folded
+ * result once at the end.
+ */
+ulong_t Checksum_Partial(ulong_t sum, const void *data, ulong_t length) {
+    const uchar_t *p = data;
+    unsigned long long acc = 0;
+    uint_t folded;
+
+    while (length >= 16) {
+        acc += ((const csum_word_t *)p)[0];
+        acc += ((const csum_word_t *)p)[1];
+        acc += ((const csum_word_t *)p)[2];
+        acc += ((const csum_word_t *)p)[3];
+        p += 16;
+        length -= 16;
+    }
+    while (length >= 4) {
+        acc += *(const csum_word_t *)p;
+        p += 4;
+        length -= 4;
+    }
+    if(length >= 2) {
+        acc += p[0] | (p[1] << 8);
+        p += 2;
+        length -= 2;
+    }
+    if(length > 0)
+        acc += p[0];
+
+    acc = (acc & 0xffffffff) + (acc >> 32);
+    acc = (acc & 0xffffffff) + (acc >> 32);
+    folded = (acc & 0xffff) + (acc >> 16);
+    folded = (folded & 0xffff) + (folded >> 16);
+
+    return sum + (((folded & 0xff) << 8) | (folded >> 8));
+}
+
+ushort_t Checksum_Fold(ulong_t sum) {
+    while (sum >> 16)
+        sum = (sum & 0xffff) + (sum >> 16);
+    return (ushort_t) ~ sum;
+}
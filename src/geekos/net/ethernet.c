@@ -29,8 +29,8 @@ IMPLEMENT_LIST(Ethernet_Dispatch_Table, Ethernet_Dispatch_Entry);
 static struct Ethernet_Dispatch_Table s_ethDispatchTable;
 /* end dispatch table declaration and definition */
 
-#define DEBUG_ETH(x...) Print("Eth: " x)
-// #define DEBUG_ETH(x...) 
+// #define DEBUG_ETH(x...) Print("Eth: " x)
+#define DEBUG_ETH(x...)
 
 
 int Eth_Transmit(struct Net_Device *device, struct Net_Buf *nBuf,
@@ -44,6 +44,7 @@ int Eth_Transmit(struct Net_Device *device, struct Net_Buf *nBuf,
     TODO_P(PROJECT_RAW_ETHERNET,
            "construct the ethernet header for the destination, this device's address, and the type.");
 
+    /* lands in the headroom of a linear buffer */
     rc = Net_Buf_Prepend(nBuf, &header, sizeof(header),
                          NET_BUF_ALLOC_COPY);
     if(rc != 0)
@@ -54,21 +55,38 @@ int Eth_Transmit(struct Net_Device *device, struct Net_Buf *nBuf,
 
     KASSERT0(size >= ETH_MIN_DATA, "input to Eth_Transmit should be at least ETH_MIN_DATA long");       /* paranoia. */
 
-    void *buffer = Malloc(size);
-    if(buffer == 0)
-        return ENOMEM;
+    /* pad in the tailroom, so a linear frame goes to the driver as is */
+    if(size > NET_BUF_SIZE(nBuf)) {
+        ulong_t padding = size - NET_BUF_SIZE(nBuf);
+        void *pad = Net_Buf_Put(nBuf, padding);
+        if(pad != NULL)
+            memset(pad, '\0', padding);
+    }
 
-    rc = Net_Buf_Extract_All(nBuf, buffer);
-    if(rc != 0) {
-        Free(buffer);
-        return rc;
+    void *buffer = Net_Buf_Data(nBuf);
+    void *copy = NULL;
+
+    if(buffer == NULL || NET_BUF_SIZE(nBuf) < size) {
+        /* chained buffer: flatten it */
+        copy = Malloc(size);
+        if(copy == 0)
+            return ENOMEM;
+
+        memset(copy, '\0', size);
+        rc = Net_Buf_Extract_All(nBuf, copy);
+        if(rc != 0) {
+            Free(copy);
+            return rc;
+        }
+        buffer = copy;
     }
 
-    Deprecated_Disable_Interrupts();
-    device->transmit(device, buffer, size);
-    Deprecated_Enable_Interrupts();
+    rc = Net_Device_Transmit(device, buffer, size);
 
-    return 0;
+    if(copy != NULL)
+        Free(copy);
+
+    return rc;
 }
 
 int Eth_Dispatch(struct Net_Device *device, struct Net_Buf *nBuf) {
@@ -19,9 +19,16 @@
 #include <geekos/net/tcp.h>
 #include <geekos/net/socket.h>
 #include <geekos/net/net.h>
+#include <geekos/net/checksum.h>
+#include <geekos/alarm.h>
+#include <geekos/synch.h>
+#include <geekos/timer.h>
 
 #include <geekos/projects.h>
 
+#define MS_TO_TICKS(ms) ((ulong_t) (ms) * TICKS_PER_SEC / 1000)
+#define DEADLINE_PASSED(deadline) ((int)(g_numTicks - (deadline)) >= 0)
+
 static uchar_t s_baseIpAddress[] = { 169, 254, 0, 0 };
 static uchar_t s_baseSubnet[] = { 255, 255, 255, 0 };
 
@@ -31,6 +38,40 @@ union IP_Address s_inaddrBroadcast = {.address = INADDR_BROADCAST };
 static int IP_Device_Get_By_IP(struct IP_Device **device,
                                IP_Address * address);
 
+static uchar_t s_ethBroadcast[6] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
+static ushort_t s_nextIdent;
+
+/* one piece of a datagram being reassembled, its IP header stripped */
+struct IP_Fragment {
+    ulong_t offset;
+    ulong_t length;
+    struct Net_Buf *nBuf;
+    struct IP_Fragment *next;
+};
+
+/*
+ * A datagram being reassembled.  Fragments are kept as the buffers
+ * they arrived in, sorted by offset and trimmed so they never
+ * overlap; the finished datagram chains them together rather than
+ * copying them into one block.  Datagrams not completed within
+ * IP_REASSEMBLY_TIMEOUT_MS are dropped by a periodic sweep.
+ */
+struct IP_Reassembly {
+    IP_Address source;
+    IP_Address destination;
+    ushort_t ident;
+    uchar_t protocol;
+    ulong_t totalLength;        /* payload length, 0 until the last fragment arrives */
+    ulong_t received;           /* payload bytes held */
+    ulong_t deadline;           /* in ticks */
+    struct IP_Fragment *fragments;
+    struct IP_Reassembly *hashNext;
+};
+
+static struct IP_Reassembly *s_reassemblyHash[1 << IP_REASSEMBLY_HASH_BITS];
+static int s_reassemblyCount;
+static struct Mutex s_reassemblyMutex;
+
 /* dispatch table declaration and definition. (callbacks for each protocol type) */
 struct IP_Dispatch_Table_Entry;
 DEFINE_LIST(IP_Dispatch_Table, IP_Dispatch_Table_Entry);
@@ -76,9 +117,93 @@ static int IP_Deliver(struct IP_Device *device, ushort_t protocol,
         return 0;
     }
     Print("IP packet received - Destroying netbuf in ip layer\n");
+    Net_Buf_Destroy(nBuf);
     return -1;
 }
 
+/* the internet checksum, in host order; 0 over a header that checks out */
+static ushort_t IP_Checksum(const void *data, ulong_t length) {
+    return Checksum_Fold(Checksum_Partial(0, data, length));
+}
+
+static ushort_t IP_Next_Ident(void) {
+    return __sync_fetch_and_add(&s_nextIdent, 1);
+}
+
+static void IP_Fill_Header(struct IP_Header *header, IP_Address * src,
+                           IP_Address * dest, ulong_t length,
+                           ushort_t ident, ushort_t fragOff, uchar_t tos,
+                           uchar_t ttl, uchar_t protocol) {
+    memset(header, '\0', IP_HEADER_SIZE);
+    header->version = IP_VERSION;
+    header->hLen = IP_HEADER_SIZE / 4;
+    header->tos = tos;
+    header->length = htons(length);
+    header->ident = htons(ident);
+    header->frag_off = htons(fragOff);
+    header->ttl = ttl;
+    header->protocol = protocol;
+    header->sourceAddr = src->address;
+    header->destAddr = dest->address;
+    header->checksum = htons(IP_Checksum(header, IP_HEADER_SIZE));
+}
+
+/* hand a finished datagram to the link layer; takes ownership of nBuf */
+static int IP_Link_Output(struct IP_Device *device, IP_Address * nextHop,
+                          struct Net_Buf *nBuf) {
+    int rc;
+
+    if(nextHop->address == INADDR_BROADCAST) {
+        rc = Eth_Transmit(device->netDevice, nBuf, s_ethBroadcast,
+                          ETH_IPV4);
+        Net_Buf_Destroy(nBuf);
+        return rc;
+    }
+    return ARP_Output(device->netDevice, ETH_IPV4, nextHop->ptr, nBuf);
+}
+
+/*
+ * Send payload as fragments that fit in IP_MTU.  Each fragment is a
+ * fresh linear buffer with headroom for the link header, so payload
+ * is only read and still belongs to the caller.
+ */
+static int IP_Fragment_Output(struct IP_Device *device,
+                              IP_Address * nextHop, IP_Address * src,
+                              IP_Address * dest, struct Net_Buf *payload,
+                              uchar_t tos, uchar_t ttl, uchar_t protocol) {
+    ulong_t total = NET_BUF_SIZE(payload);
+    ulong_t maxLength = (IP_MTU - IP_HEADER_SIZE) & ~7UL;
+    ulong_t offset = 0, length;
+    ushort_t ident = IP_Next_Ident(), fragOff;
+    struct Net_Buf *fragment;
+    struct IP_Header *header;
+    int rc;
+
+    do {
+        length = MIN(total - offset, maxLength);
+        rc = Net_Buf_Create_Linear(&fragment, NET_BUF_HEADROOM,
+                                   IP_HEADER_SIZE + length);
+        if(rc != 0)
+            return rc;
+
+        header = Net_Buf_Put(fragment, IP_HEADER_SIZE);
+        if(length > 0)
+            Net_Buf_Extract(payload, offset, Net_Buf_Put(fragment, length),
+                            length);
+
+        fragOff = offset / 8;
+        if(offset + length < total)
+            fragOff |= IP_FLAG_MF;
+        IP_Fill_Header(header, src, dest, IP_HEADER_SIZE + length, ident,
+                       fragOff, tos, ttl, protocol);
+
+        rc = IP_Link_Output(device, nextHop, fragment);
+        offset += length;
+    } while (rc == 0 && offset < total);
+
+    return rc;
+}
+
 /* construct our IP address implicitly from the last two bytes of the hardware address */
 static int IP_Get_Address(struct Net_Device *device,
                           IP_Address * ipAddress) {
@@ -90,12 +215,375 @@ static int IP_Get_Address(struct Net_Device *device,
     return 0;
 }
 
-static int IP_Broadcast(struct IP_Header *ipHeader, struct Net_Buf *nBuf) {
+static int IP_Broadcast(IP_Address * src, struct Net_Buf *nBuf,
+                        uchar_t tos, uchar_t protocol) {
+    struct IP_Device *curr;
+    IP_Address source;
+    int rc, result = ENODEV;
+
     // Send the packet out on all local interfaces
     // note that broadcast IP is sent with ttl=1 to prevent badness 
     // and that broadcast IP is not forwarded (redundant safety measures)
-    TODO_P(PROJECT_IP,
-           "broadcast helper function (send on all interfaces if needed)");
+    for(curr = Get_Front_Of_IP_Device_List(&s_ipDeviceList);
+        curr != NULL; curr = Get_Next_In_IP_Device_List(curr)) {
+        source = (src != NULL && src->address != INADDR_ANY) ?
+            *src : curr->ipAddress;
+        rc = IP_Fragment_Output(curr, &s_inaddrBroadcast, &source,
+                                &s_inaddrBroadcast, nBuf, tos, 1,
+                                protocol);
+        if(result != 0)
+            result = rc;
+    }
+    return result;
+}
+
+/*
+ * Send a datagram.  One that fits in the MTU gets its header pushed
+ * into nBuf's headroom and goes out as is; a larger one is sent as
+ * fragments.  A NULL or INADDR_ANY source means the address of the
+ * outgoing interface.  Takes ownership of nBuf.
+ */
+int IP_Transmit(IP_Address * src, IP_Address * destination,
+                struct Net_Buf *nBuf, uchar_t tos, ushort_t protocol) {
+    struct IP_Device *device;
+    struct IP_Header header;
+    IP_Address gateway, source, nextHop;
+    bool fGateway;
+    ulong_t length = NET_BUF_SIZE(nBuf) + IP_HEADER_SIZE;
+    int rc;
+
+    if(length > IP_MAX_LENGTH) {
+        rc = EINVALID;
+        goto done;
+    }
+
+    if(destination->address == INADDR_BROADCAST) {
+        rc = IP_Broadcast(src, nBuf, tos, protocol);
+        goto done;
+    }
+
+    rc = Net_Get_Route(&device, destination, &fGateway, &gateway);
+    if(rc != 0)
+        goto done;
+    nextHop = fGateway ? gateway : *destination;
+    source = (src != NULL && src->address != INADDR_ANY) ?
+        *src : device->ipAddress;
+
+    if(length > IP_MTU) {
+        rc = IP_Fragment_Output(device, &nextHop, &source, destination,
+                                nBuf, tos, IP_DEFAULT_TTL, protocol);
+        goto done;
+    }
+
+    IP_Fill_Header(&header, &source, destination, length, IP_Next_Ident(),
+                   0, tos, IP_DEFAULT_TTL, protocol);
+    rc = Net_Buf_Prepend(nBuf, &header, IP_HEADER_SIZE,
+                         NET_BUF_ALLOC_COPY);
+    if(rc != 0)
+        goto done;
+    return IP_Link_Output(device, &nextHop, nBuf);
+
+  done:
+    Net_Buf_Destroy(nBuf);
+    return rc;
+}
+
+static uint_t Reassembly_Hash(IP_Address * source, IP_Address * destination,
+                              ushort_t ident, uchar_t protocol) {
+    uint_t key = source->address ^ destination->address ^
+        ((uint_t) ident << 8 | protocol);
+
+    return (key * 2654435761U) >> (32 - IP_REASSEMBLY_HASH_BITS);
+}
+
+static void Reassembly_Free(struct IP_Reassembly *reassembly) {
+    struct IP_Fragment *fragment, *next;
+
+    for(fragment = reassembly->fragments; fragment != NULL;
+        fragment = next) {
+        next = fragment->next;
+        Net_Buf_Destroy(fragment->nBuf);
+        Free(fragment);
+    }
+    Free(reassembly);
+}
+
+/* the reassembly mutex should be held */
+static void Reassembly_Unlink(struct IP_Reassembly *reassembly) {
+    struct IP_Reassembly **link;
+
+    for(link = &s_reassemblyHash[Reassembly_Hash(&reassembly->source,
+                                                 &reassembly->destination,
+                                                 reassembly->ident,
+                                                 reassembly->protocol)];
+        *link != reassembly; link = &(*link)->hashNext) ;
+    *link = reassembly->hashNext;
+    --s_reassemblyCount;
+}
+
+/* make room by dropping the datagram closest to timing out; mutex held */
+static void Reassembly_Evict_Oldest(void) {
+    struct IP_Reassembly *reassembly, *oldest = NULL;
+    int i;
+
+    for(i = 0; i < (1 << IP_REASSEMBLY_HASH_BITS); ++i)
+        for(reassembly = s_reassemblyHash[i]; reassembly != NULL;
+            reassembly = reassembly->hashNext)
+            if(oldest == NULL ||
+               (int)(reassembly->deadline - oldest->deadline) < 0)
+                oldest = reassembly;
+
+    if(oldest != NULL) {
+        Reassembly_Unlink(oldest);
+        Reassembly_Free(oldest);
+    }
+}
+
+/* find or start the reassembly of a datagram; mutex held */
+static struct IP_Reassembly *Reassembly_Get(IP_Address * source,
+                                            IP_Address * destination,
+                                            ushort_t ident,
+                                            uchar_t protocol) {
+    struct IP_Reassembly *reassembly;
+    uint_t hash = Reassembly_Hash(source, destination, ident, protocol);
+
+    for(reassembly = s_reassemblyHash[hash]; reassembly != NULL;
+        reassembly = reassembly->hashNext)
+        if(reassembly->source.address == source->address &&
+           reassembly->destination.address == destination->address &&
+           reassembly->ident == ident && reassembly->protocol == protocol)
+            return reassembly;
+
+    if(s_reassemblyCount >= IP_MAX_REASSEMBLIES)
+        Reassembly_Evict_Oldest();
+
+    reassembly = Malloc(sizeof(struct IP_Reassembly));
+    if(reassembly == NULL)
+        return NULL;
+    memset(reassembly, '\0', sizeof(struct IP_Reassembly));
+    reassembly->source = *source;
+    reassembly->destination = *destination;
+    reassembly->ident = ident;
+    reassembly->protocol = protocol;
+    reassembly->deadline = g_numTicks + MS_TO_TICKS(IP_REASSEMBLY_TIMEOUT_MS);
+
+    reassembly->hashNext = s_reassemblyHash[hash];
+    s_reassemblyHash[hash] = reassembly;
+    ++s_reassemblyCount;
+    return reassembly;
+}
+
+/* chain a complete datagram's fragments into one buffer; frees reassembly */
+static struct Net_Buf *Reassembly_Join(struct IP_Reassembly *reassembly) {
+    struct IP_Fragment *fragment = reassembly->fragments, *next;
+    struct Net_Buf *datagram = fragment->nBuf;
+    bool failed = false;
+
+    next = fragment->next;
+    Free(fragment);
+    for(fragment = next; fragment != NULL; fragment = next) {
+        next = fragment->next;
+        if(!failed && Net_Buf_Concatenate(datagram, fragment->nBuf) != 0)
+            failed = true;
+        if(failed)
+            Net_Buf_Destroy(fragment->nBuf);
+        Free(fragment);
+    }
+    Free(reassembly);
+
+    if(failed) {
+        Net_Buf_Destroy(datagram);
+        return NULL;
+    }
+    return datagram;
+}
+
+/*
+ * Add a fragment, its header already stripped, to its datagram.
+ * Returns the whole datagram once every byte has arrived, or NULL
+ * while some are missing.  Takes ownership of nBuf.
+ */
+static struct Net_Buf *IP_Reassemble(IP_Address * source,
+                                     IP_Address * destination,
+                                     ushort_t ident, uchar_t protocol,
+                                     ulong_t offset, bool more,
+                                     struct Net_Buf *nBuf) {
+    struct IP_Reassembly *reassembly;
+    struct IP_Fragment *fragment, *prev = NULL, *next, **link;
+    ulong_t length = NET_BUF_SIZE(nBuf), end = offset + length, trim;
+    struct Net_Buf *datagram = NULL;
+
+    /* every fragment but the last carries a multiple of 8 bytes */
+    if(end > IP_MAX_LENGTH - IP_HEADER_SIZE ||
+       (more && (length == 0 || (length & 7) != 0))) {
+        Net_Buf_Destroy(nBuf);
+        return NULL;
+    }
+
+    Mutex_Lock(&s_reassemblyMutex);
+    reassembly = Reassembly_Get(source, destination, ident, protocol);
+    if(reassembly == NULL)
+        goto drop;
+
+    for(link = &reassembly->fragments;
+        *link != NULL && (*link)->offset <= offset; link = &(*link)->next)
+        prev = *link;
+
+    if(!more) {
+        /* a second, different end, or data past this one: inconsistent */
+        if((reassembly->totalLength != 0 && reassembly->totalLength != end)
+           || (*link != NULL) ||
+           (prev != NULL && prev->offset + prev->length > end))
+            goto drop;
+        reassembly->totalLength = end;
+    } else if(reassembly->totalLength != 0 && end > reassembly->totalLength)
+        goto drop;
+
+    /* keep what already arrived where the new fragment overlaps it */
+    if(prev != NULL && prev->offset + prev->length > offset) {
+        trim = prev->offset + prev->length - offset;
+        if(trim >= length)
+            goto drop;
+        Net_Buf_Remove(nBuf, 0, trim);
+        offset += trim;
+        length -= trim;
+    }
+    while ((next = *link) != NULL && next->offset < offset + length) {
+        if(next->offset + next->length <= offset + length) {
+            /* wholly covered: the new fragment replaces it */
+            *link = next->next;
+            reassembly->received -= next->length;
+            Net_Buf_Destroy(next->nBuf);
+            Free(next);
+        } else {
+            trim = offset + length - next->offset;
+            Net_Buf_Remove(nBuf, length - trim, trim);
+            length -= trim;
+            break;
+        }
+    }
+
+    if(length > 0) {
+        fragment = Malloc(sizeof(struct IP_Fragment));
+        if(fragment == NULL)
+            goto drop;
+        fragment->offset = offset;
+        fragment->length = length;
+        fragment->nBuf = nBuf;
+        fragment->next = *link;
+        *link = fragment;
+        reassembly->received += length;
+    } else {
+        Net_Buf_Destroy(nBuf);
+    }
+
+    if(reassembly->totalLength != 0 &&
+       reassembly->received == reassembly->totalLength) {
+        Reassembly_Unlink(reassembly);
+        if(reassembly->fragments != NULL)
+            datagram = Reassembly_Join(reassembly);
+        else
+            Free(reassembly);
+    }
+    Mutex_Unlock(&s_reassemblyMutex);
+    return datagram;
+
+  drop:
+    Mutex_Unlock(&s_reassemblyMutex);
+    Net_Buf_Destroy(nBuf);
+    return NULL;
+}
+
+/* alarm callback: drop datagrams that have waited too long, then rearm */
+static void IP_Reassembly_Sweep(void *data __attribute__ ((unused))) {
+    struct IP_Reassembly **link, *reassembly;
+    int i;
+
+    Mutex_Lock(&s_reassemblyMutex);
+    for(i = 0; i < (1 << IP_REASSEMBLY_HASH_BITS); ++i) {
+        for(link = &s_reassemblyHash[i]; (reassembly = *link) != NULL;) {
+            if(DEADLINE_PASSED(reassembly->deadline)) {
+                *link = reassembly->hashNext;
+                --s_reassemblyCount;
+                Reassembly_Free(reassembly);
+            } else {
+                link = &reassembly->hashNext;
+            }
+        }
+    }
+    Mutex_Unlock(&s_reassemblyMutex);
+
+    Alarm_Create(IP_Reassembly_Sweep, NULL, IP_REASSEMBLY_SWEEP_MS);
+}
+
+static struct IP_Device *IP_Device_Get_By_Net_Device(struct Net_Device
+                                                     *netDevice) {
+    struct IP_Device *curr;
+
+    for(curr = Get_Front_Of_IP_Device_List(&s_ipDeviceList);
+        curr != NULL && curr->netDevice != netDevice;
+        curr = Get_Next_In_IP_Device_List(curr)) ;
+    return curr;
+}
+
+/*
+ * Ethernet dispatcher for IPv4: check the header, put fragments back
+ * together and hand whole datagrams for this host to their protocol.
+ */
+int IP_Dispatch(struct Net_Device *netDevice, struct Net_Buf *nBuf) {
+    uchar_t headerBytes[IP_MAX_HEADER_SIZE];
+    struct IP_Header *header = (struct IP_Header *)headerBytes;
+    struct IP_Device *device, *local;
+    IP_Address source, destination;
+    ulong_t headerLength, totalLength;
+    ushort_t fragOff;
+
+    if(Net_Buf_Extract(nBuf, 0, headerBytes, IP_HEADER_SIZE) != 0)
+        goto drop;
+    headerLength = header->hLen * 4;
+    totalLength = ntohs(header->length);
+    if(header->version != IP_VERSION || headerLength < IP_HEADER_SIZE ||
+       totalLength < headerLength || totalLength > NET_BUF_SIZE(nBuf))
+        goto drop;
+    if(headerLength > IP_HEADER_SIZE &&
+       Net_Buf_Extract(nBuf, IP_HEADER_SIZE, headerBytes + IP_HEADER_SIZE,
+                       headerLength - IP_HEADER_SIZE) != 0)
+        goto drop;
+    if(IP_Checksum(headerBytes, headerLength) != 0)
+        goto drop;
+
+    device = IP_Device_Get_By_Net_Device(netDevice);
+    if(device == NULL)
+        goto drop;
+
+    source.address = header->sourceAddr;
+    destination.address = header->destAddr;
+    if(destination.address != INADDR_BROADCAST &&
+       IP_Device_Get_By_IP(&local, &destination) != 0) {
+        TODO_P(PROJECT_IP, "forward datagrams addressed to other hosts");
+        goto drop;
+    }
+
+    /* strip ethernet's padding of short frames, then the header */
+    if(NET_BUF_SIZE(nBuf) > totalLength)
+        Net_Buf_Remove(nBuf, totalLength, NET_BUF_SIZE(nBuf) - totalLength);
+    Net_Buf_Remove(nBuf, 0, headerLength);
+
+    fragOff = ntohs(header->frag_off);
+    if(fragOff & (IP_FLAG_MF | IP_OFFSET_MASK)) {
+        nBuf = IP_Reassemble(&source, &destination, ntohs(header->ident),
+                             header->protocol,
+                             (ulong_t) (fragOff & IP_OFFSET_MASK) * 8,
+                             (fragOff & IP_FLAG_MF) != 0, nBuf);
+        if(nBuf == NULL)
+            return 0;
+    }
+
+    return IP_Deliver(device, header->protocol, &destination, &source,
+                      nBuf);
+
+  drop:
+    Net_Buf_Destroy(nBuf);
     return 0;
 }
 
@@ -124,6 +612,10 @@ int IP_Device_Register(struct Net_Device *device, IP_Address * address,
 }
 
 
+struct IP_Device_List *IP_Get_Device_List(void) {
+    return &s_ipDeviceList;
+}
+
 int IP_Device_Get_By_Name(struct IP_Device **device, char *name) {
     struct IP_Device *curr;
     for(curr = Get_Front_Of_IP_Device_List(&s_ipDeviceList);
@@ -170,10 +662,60 @@ int IP_Device_Configure(char *name, IP_Address * ipAddress,
     return 0;
 }
 
+/*
+ * Fill in info for up to deviceCount devices, or for just the one
+ * called name if name is not null.  Returns how many were filled in.
+ */
 int IP_Device_Stat(struct IP_Device_Info *info, ulong_t deviceCount,
                    char *name) {
+    struct IP_Device *curr;
     unsigned int counter = 0;
-    TODO_P(PROJECT_IP, "ifconfig device statistics");
+
+    for(curr = Get_Front_Of_IP_Device_List(&s_ipDeviceList);
+        curr != NULL && counter < deviceCount;
+        curr = Get_Next_In_IP_Device_List(curr)) {
+        struct Net_Device *device = curr->netDevice;
+        struct IP_Device_Info *out = &info[counter];
+        ulong_t elapsed;
+
+        if(name != NULL && strcmp(device->devName, name) != 0)
+            continue;
+
+        memset(out, '\0', sizeof(*out));
+        out->ipAddress = curr->ipAddress;
+        out->netmask = curr->subnet;
+        memcpy(out->name, device->devName, NET_NAME_SIZE);
+        out->name[NET_NAME_SIZE - 1] = '\0';
+        memcpy(out->mac, device->devAddr, sizeof(out->mac));
+        out->ioport = device->baseAddr;
+        out->interrupt = device->irq;
+
+        out->rxPackets = device->rxPackets;
+        out->txPackets = device->txPackets;
+        out->rxPacketErrors = device->rxPacketErrors;
+        out->txPacketErrors = device->txPacketErrors;
+        out->rxBytes = device->rxBytes;
+        out->txBytes = device->txBytes;
+        out->rxDropped = device->rxDropped;
+
+        /* the receive thread only updates the rates while frames
+           arrive, so an idle device's last rates are stale */
+        elapsed = g_numTicks - device->rateStart;
+        if(elapsed >= 2 * TICKS_PER_SEC) {
+            out->rxPacketRate =
+                (device->rxPackets - device->rateRxPackets) * TICKS_PER_SEC /
+                elapsed;
+            out->rxInterruptRate =
+                (device->rxInterrupts -
+                 device->rateRxInterrupts) * TICKS_PER_SEC / elapsed;
+        } else {
+            out->rxPacketRate = device->rxPacketRate;
+            out->rxInterruptRate = device->rxInterruptRate;
+        }
+
+        ++counter;
+    }
+
     return counter;
 }
 
@@ -193,10 +735,12 @@ void Init_IP(void) {
         KASSERT0(rc == 0, "unable to register IP device");      // only will get here if malloc fails
     }
 
-    TODO_P(PROJECT_IP, "add to ethernet dispatch table");
+    Mutex_Init(&s_reassemblyMutex);
+    Alarm_Create(IP_Reassembly_Sweep, NULL, IP_REASSEMBLY_SWEEP_MS);
+    Eth_Dispatch_Table_Add(ETH_IPV4, IP_Dispatch);
 
     TODO_P(PROJECT_UDP, "add UDP to IP dispatch table, if doing UDP");
-    TODO_P(PROJECT_TCP, "add TCP to IP dispatch table, if doing TCP");
+    IP_Dispatch_Table_Add(IP_TCP_PROTOCOL, TCP_Dispatch);
 
     Start_Kernel_Thread(Forwarding_Thread, 0, PRIORITY_NORMAL, false,
                         "{Forwarding}");
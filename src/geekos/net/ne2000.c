@@ -14,16 +14,46 @@
 #include <geekos/net/net.h>
 #include <geekos/malloc.h>
 #include <geekos/idt.h>
-#include <geekos/net/net.h>
+#include <geekos/errno.h>
+#include <geekos/string.h>
 
 // #define DEBUG_NE2K(x...) Print("NE2k: " x)
 #define DEBUG_NE2K(x...)
 
-/* called when an interrupt tells us to. */
-static void NE2000_Do_Receive(struct Net_Device *device) {
+/* most cards the driver keeps transmit state for */
+#define NE2K_MAX_DEVICES 4
+
+/* spins waiting for a remote DMA to finish before giving up */
+#define NE2K_RDC_SPIN 10000
+
+/*
+ * The transmit area holds two frames: one goes out on the wire while
+ * the next is uploaded.  txLength is 0 for a free slot.
+ */
+struct NE2000_State {
+    ulong_t txLength[NE2K_TX_SLOTS];
+    int txCurrent;              /* slot on the wire, -1 if idle */
+    int txNext;                 /* slot the next frame is loaded into */
+};
+
+static struct NE2000_State s_state[NE2K_MAX_DEVICES];
+static int s_numDevices;
+
+static void NE2000_Transmit_Done(struct Net_Device *device);
+
+/* interrupts we take; receive is masked while the device is polled */
+#define NE2K_IMR_DEFAULT (NE2K_IMR_PRXE | NE2K_IMR_PTXE | NE2K_IMR_RXEE | \
+                          NE2K_IMR_TXEE | NE2K_IMR_OVWE)
+
+/* the ring can't hold more frames than it has pages */
+#define NE2K_RB_MAX_FRAMES (NE2K_RB_STOP - NE2K_RB_START)
+
+/* take up to budget frames off the ring; returns how many it took */
+static int NE2000_Do_Receive(struct Net_Device *device, int budget) {
     uchar_t currentBuffer;
     ulong_t baseAddr = device->baseAddr;
     ushort_t ringBufferPage;
+    int count = 0;
 
 
     Out_Byte(baseAddr + NE2K_CR,
@@ -32,11 +62,12 @@ static void NE2000_Do_Receive(struct Net_Device *device) {
     Out_Byte(baseAddr + NE2K_CR,
              NE2K_CR_PAGE0 + NE2K_CR_NODMA + NE2K_CR_STA);
 
-    while (currentBuffer != In_Byte(baseAddr + NE2K0R_BNRY)) {
+    while (count < budget && currentBuffer != In_Byte(baseAddr + NE2K0R_BNRY)) {
         ringBufferPage = In_Byte(baseAddr + NE2K0R_BNRY) << 8;
 
         /* Receive as a packet; enqueue for further processing */
         Net_Device_Receive(device, ringBufferPage);
+        ++count;
 
         /* Read the current buffer register */
         Out_Byte(baseAddr + NE2K_CR,
@@ -48,6 +79,20 @@ static void NE2000_Do_Receive(struct Net_Device *device) {
         //Print("Current buffer: %x\n", currentBuffer);
         //Print("Boundary pointer: %x\n", In_Byte(baseAddr + NE2K0R_BNRY));
     }
+
+    return count;
+}
+
+/* called by the receive thread, with the device locked */
+int NE2000_Poll(struct Net_Device *device, int budget) {
+    KASSERT(Is_Locked(&device->lock));
+    return NE2000_Do_Receive(device, budget);
+}
+
+/* the device should be locked */
+void NE2000_Receive_Interrupt(struct Net_Device *device, bool enable) {
+    Out_Byte(device->baseAddr + NE2K0W_IMR,
+             enable ? NE2K_IMR_DEFAULT : NE2K_IMR_DEFAULT & ~NE2K_IMR_PRXE);
 }
 
 static void NE2000_Interrupt_Handler(struct Interrupt_State *state) {
@@ -67,6 +112,9 @@ static void NE2000_Interrupt_Handler(struct Interrupt_State *state) {
         goto fail;
     }
 
+    /* the other CPUs may be using the card or its queues */
+    Spin_Lock(&device->lock);
+
     baseAddr = device->baseAddr;
     isrMask = In_Byte(NE2K0R_ISR + baseAddr);
 
@@ -80,6 +128,7 @@ static void NE2000_Interrupt_Handler(struct Interrupt_State *state) {
     if(isrMask & NE2K_ISR_TXE) {
         //Print("TSR: %x\n", In_Byte(NE2K0R_TSR + baseAddr));
         ++device->txPacketErrors;
+        NE2000_Transmit_Done(device);
     }
 
     if(isrMask & NE2K_ISR_OVW) {
@@ -88,9 +137,11 @@ static void NE2000_Interrupt_Handler(struct Interrupt_State *state) {
     }
 
     if(isrMask & NE2K_ISR_PRX) {
+        /* leave the ring to the receive thread until it is drained */
         DEBUG_NE2K("Receiving packet\n");
-        NE2000_Do_Receive(device);
-        ++device->rxPackets;
+        ++device->rxInterrupts;
+        NE2000_Receive_Interrupt(device, false);
+        Net_Device_Schedule_Receive(device);
     }
 
     if(isrMask & NE2K_ISR_PTX) {
@@ -98,9 +149,12 @@ static void NE2000_Interrupt_Handler(struct Interrupt_State *state) {
         DEBUG_NE2K("Transmitted.\n");
         //Print("TSR: %x\n", In_Byte(NE2K0R_TSR + baseAddr));
         ++device->txPackets;
+        if(!(isrMask & NE2K_ISR_TXE))
+            NE2000_Transmit_Done(device);
     }
 
     Out_Byte(baseAddr + NE2K0R_ISR, isrMask);
+    Spin_Unlock(&device->lock);
 
   fail:
     End_IRQ(state);
@@ -139,6 +193,14 @@ int Init_NE2000(struct Net_Device *device) {
         return -1;
     }
 
+    if(s_numDevices == NE2K_MAX_DEVICES) {
+        Print("NE2000: too many devices\n");
+        return ENODEV;
+    }
+    device->driverData = &s_state[s_numDevices++];
+    memset(device->driverData, '\0', sizeof(struct NE2000_State));
+    ((struct NE2000_State *)device->driverData)->txCurrent = -1;
+
     /* Print out the mac address */
     device->addrLength = 6;
     Print("Mac address: ");
@@ -180,7 +242,7 @@ int Init_NE2000(struct Net_Device *device) {
     Out_Byte(baseAddr + NE2K0R_ISR, 0xFF);
 
     /* Initialize Interrupt Mask Register */
-    Out_Byte(baseAddr + NE2K0W_IMR, 0x0F + NE2K_ISR_OVW);
+    Out_Byte(baseAddr + NE2K0W_IMR, NE2K_IMR_DEFAULT);
 
     /* Initialize the Receive Buffer Ring (BNDRY, PSTART, PSTOP) */
     Out_Byte(baseAddr + NE2K0W_PSTART, NE2K_RB_START);
@@ -223,25 +285,16 @@ int Init_NE2000(struct Net_Device *device) {
 
 }
 
-void NE2000_Transmit(struct Net_Device *device, void *buffer,
-                     ulong_t length) {
-
+/* copy a frame into the card's memory at page; the device is locked */
+static void NE2000_Upload(struct Net_Device *device, void *buffer,
+                          ulong_t length, uchar_t page) {
     ulong_t baseAddr = device->baseAddr;
-
-    KASSERT(!Interrupts_Enabled());
-
     unsigned int i;
     unsigned int newLength = length >> 1;
     unsigned short *newBuffer = (unsigned short *)buffer;
-
-    /* Make sure we aren't currently transmitting */
-    if(In_Byte(baseAddr + NE2K_CR) & NE2K_CR_TXP) {
-        Print("ERROR - Currently transmitting\n");
-        return;
-    }
-
-    /* Reset the card */
-    NE2000_Reset(device);
+    /* remote DMA moves whole words */
+    ulong_t dmaLength = (length + 1) & ~1UL;
+    int spin;
 
     /* Set the Command Register */
     Out_Byte(baseAddr + NE2K_CR, 0x22);
@@ -255,12 +308,12 @@ void NE2000_Transmit(struct Net_Device *device, void *buffer,
     Out_Byte(baseAddr + NE2K0R_ISR, NE2K_ISR_RDC);
 
     /* Load the packet size into the registers */
-    Out_Byte(baseAddr + NE2K0W_RBCR0, length & 0xFF);
-    Out_Byte(baseAddr + NE2K0W_RBCR1, length >> 8);
+    Out_Byte(baseAddr + NE2K0W_RBCR0, dmaLength & 0xFF);
+    Out_Byte(baseAddr + NE2K0W_RBCR1, dmaLength >> 8);
 
     /* Load the page start  into the RSARX registers */
     Out_Byte(baseAddr + NE2K0W_RSAR0, 0x00);
-    Out_Byte(baseAddr + NE2K0W_RSAR1, NE2K_TRANSMIT_PAGE);
+    Out_Byte(baseAddr + NE2K0W_RSAR1, page);
 
     /* Start the remote write */
     Out_Byte(baseAddr + NE2K_CR, NE2K_CR_DMA_RWRITE | NE2K_CR_STA);
@@ -276,19 +329,28 @@ void NE2000_Transmit(struct Net_Device *device, void *buffer,
                  ((uchar_t *) buffer)[length - 1]);
     }
 
-
-    /* Wait for transmit remote DMA */
-    while ((In_Byte(baseAddr + NE2K0R_ISR) & NE2K_ISR_RDC) == 0) {
-        Print("Waiting on remote DMA for transmit \n");
+    /* Wait for transmit remote DMA; it completes with the last write */
+    for(spin = 0; spin < NE2K_RDC_SPIN; ++spin) {
+        if(In_Byte(baseAddr + NE2K0R_ISR) & NE2K_ISR_RDC)
+            break;
     }
+    if(spin == NE2K_RDC_SPIN)
+        Print("NE2000: remote DMA for transmit did not complete\n");
 
     /* Ack the interrupt */
     Out_Byte(baseAddr + NE2K0R_ISR, NE2K_ISR_RDC);
+}
+
+/* put the frame in slot on the wire */
+static void NE2000_Start_Transmit(struct Net_Device *device, int slot) {
+    struct NE2000_State *state = device->driverData;
+    ulong_t baseAddr = device->baseAddr;
+    ulong_t length = state->txLength[slot];
 
-    /* Now that Remote DMA is complete, set up the transmit */
+    state->txCurrent = slot;
 
     /* Store the transmit page in the transmit register */
-    Out_Byte(baseAddr + NE2K0W_TPSR, NE2K_TRANSMIT_PAGE);
+    Out_Byte(baseAddr + NE2K0W_TPSR, NE2K_TX_SLOT_PAGE(slot));
 
     /* Set transmit byte count */
     Out_Byte(baseAddr + NE2K0W_TBCR0, length & 0xFF);
@@ -297,8 +359,55 @@ void NE2000_Transmit(struct Net_Device *device, void *buffer,
     /* Issue transmit command */
     Out_Byte(baseAddr + NE2K_CR,
              NE2K_CR_NODMA | NE2K_CR_STA | NE2K_CR_TXP);
+}
+
+/*
+ * Called on PTX or TXE, with the device locked: free the slot that was
+ * on the wire and start the other one if it has been loaded meanwhile.
+ */
+static void NE2000_Transmit_Done(struct Net_Device *device) {
+    struct NE2000_State *state = device->driverData;
+    int next;
+
+    if(state->txCurrent < 0)
+        return;
+
+    state->txLength[state->txCurrent] = 0;
+    next = state->txCurrent ^ 1;
+    if(state->txLength[next] != 0)
+        NE2000_Start_Transmit(device, next);
+    else
+        state->txCurrent = -1;
+
+    Net_Device_Transmit_Complete(device);
+}
+
+/*
+ * Load a frame into a free transmit slot, and start it unless the
+ * other slot is on the wire; PTX will start it then.  Returns EBUSY
+ * when both slots are taken.  The device should be locked.
+ */
+int NE2000_Transmit(struct Net_Device *device, void *buffer,
+                    ulong_t length) {
+    struct NE2000_State *state = device->driverData;
+    int slot = state->txNext;
+
+    KASSERT(Is_Locked(&device->lock));
+    KASSERT(length <= NE2K_TX_SLOT_PAGES * 256);
+
+    if(state->txLength[slot] != 0)
+        return EBUSY;
+
+    NE2000_Upload(device, buffer, length, NE2K_TX_SLOT_PAGE(slot));
+    state->txLength[slot] = length;
+    state->txNext = slot ^ 1;
+
+    if(state->txCurrent < 0)
+        NE2000_Start_Transmit(device, slot);
 
     device->txBytes += length;
+
+    return 0;
 }
 
 /* actually reads the data out of the device */
@@ -427,7 +536,7 @@ void NE2000_Handle_Ring_Buffer_Overflow(struct Net_Device *device) {
     Out_Byte(baseAddr + NE2K_CR, 0x22);
 
     /* 8. Remove one or more packets from the receive buffer ring */
-    NE2000_Do_Receive(device);
+    NE2000_Do_Receive(device, NE2K_RB_MAX_FRAMES);
 
     /* 9. Reset the overwrite warning (OVW) bit in the ISR */
     Out_Byte(baseAddr + NE2K0R_ISR, NE2K_ISR_OVW);
@@ -449,5 +558,7 @@ struct Net_Device_Capabilities g_ne2000Capabilities = {
     NE2000_Receive,
     NE2000_Reset,
     NE2000_Get_Dev_Hdr,
-    NE2000_Complete_Receive
+    NE2000_Complete_Receive,
+    NE2000_Poll,
+    NE2000_Receive_Interrupt
 };
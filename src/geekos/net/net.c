@@ -17,17 +17,14 @@
 #include <geekos/io.h>
 #include <geekos/errno.h>
 #include <geekos/net/ethernet.h>
+#include <geekos/timer.h>
 #include <geekos/syscall.h>     /* for checking the syscall table on init */
 #include <geekos/sys_net.h>     /* for checking the syscall table on init */
 
 /* Sorted list of devices */
 static struct Net_Device_List s_deviceList;
 
-/* packets waiting to be read */
-static struct Net_Device_Receive_Packet_Queue s_receivePacketQueue;
-
-/* threads blocked awaiting a packet */
-static struct Thread_Queue s_receiveThreadQueue;
+extern void Schedule_And_Unlock(Spin_Lock_t * unlock_me);
 
 /* Private Functions */
 static struct Net_Device *Allocate_Net_Device(void) {
@@ -36,14 +33,49 @@ static struct Net_Device *Allocate_Net_Device(void) {
     KASSERT(device != 0);
 
     memset(device, '\0', sizeof(struct Net_Device));
+    Spin_Lock_Init(&device->lock);
     return device;
 }
 
 
 static void Destroy_Net_Device(struct Net_Device *dev) {
+    bool iflag = Begin_Int_Atomic();
+
+    Spin_Lock(&dev->lock);
+    while (!Is_Packet_Queue_Empty(&dev->rxPool))
+        Net_Buf_Destroy(Remove_From_Front_Of_Packet_Queue(&dev->rxPool));
+    while (!Is_Packet_Queue_Empty(&dev->rxQueue))
+        Net_Buf_Destroy(Remove_From_Front_Of_Packet_Queue(&dev->rxQueue));
+    while (!Is_Packet_Queue_Empty(&dev->txQueue))
+        Net_Buf_Destroy(Remove_From_Front_Of_Packet_Queue(&dev->txQueue));
+    dev->rxPoolCount = 0;
+    Spin_Unlock(&dev->lock);
+
+    End_Int_Atomic(iflag);
+
     Free(dev);
 }
 
+/*
+ * Top a device's receive pool back up to NET_RX_POOL_SIZE buffers.
+ * Allocates, so must be called from thread context.
+ */
+static void Refill_Receive_Pool(struct Net_Device *device) {
+    struct Net_Buf *nBuf;
+    bool iflag;
+
+    while (device->rxPoolCount < NET_RX_POOL_SIZE) {
+        if(Net_Buf_Create_Linear(&nBuf, 0, NET_RX_BUF_SIZE) != 0)
+            break;
+
+        iflag = Begin_Int_Atomic();
+        Spin_Lock(&device->lock);
+        Add_To_Back_Of_Packet_Queue(&device->rxPool, nBuf);
+        ++device->rxPoolCount;
+        Spin_Unlock(&device->lock);
+        End_Int_Atomic(iflag);
+    }
+}
 
 static int Get_Next_Device_Number(const char *nameBase
                                   __attribute__ ((unused))) {
@@ -52,31 +84,126 @@ static int Get_Next_Device_Number(const char *nameBase
     return s_nextDeviceNumber++;
 }
 
-static void Net_Device_Receive_Thread(ulong_t arg
-                                      __attribute__ ((unused))) {
-    while (1) {
-        Deprecated_Disable_Interrupts();
-        if(!Is_Net_Device_Receive_Packet_Queue_Empty
-           (&s_receivePacketQueue)) {
-            struct Net_Buf *nBuf;
-            struct Net_Device_Packet *packet;
+/* recompute the per-second receive rates about once a second */
+static void Update_Receive_Rates(struct Net_Device *device) {
+    ulong_t now = g_numTicks;
+    ulong_t elapsed = now - device->rateStart;
 
-            packet =
-                Remove_From_Front_Of_Net_Device_Receive_Packet_Queue
-                (&s_receivePacketQueue);
-            Deprecated_Enable_Interrupts();
+    if(elapsed < TICKS_PER_SEC)
+        return;
 
-            Net_Buf_Create(&nBuf);
-            Net_Buf_Prepend(nBuf, packet->buffer, packet->bufferLen,
-                            NET_BUF_ALLOC_OWN);
+    device->rxPacketRate =
+        (device->rxPackets - device->rateRxPackets) * TICKS_PER_SEC /
+        elapsed;
+    device->rxInterruptRate =
+        (device->rxInterrupts - device->rateRxInterrupts) * TICKS_PER_SEC /
+        elapsed;
 
-            Eth_Dispatch(packet->device, nBuf);
+    device->rateStart = now;
+    device->rateRxPackets = device->rxPackets;
+    device->rateRxInterrupts = device->rxInterrupts;
+}
 
-            Free(packet);
+/*
+ * Sleep on waitQueue, dropping the device lock, which the caller
+ * holds with interrupts disabled; it is held again on return.
+ */
+static void Wait_Unlocked(struct Net_Device *device,
+                          struct Thread_Queue *waitQueue) {
+    Lock_Thread_Queue(waitQueue);
+    Spin_Unlock(&device->lock);
+    Locked_Unchecked_Add_To_Back_Of_Thread_Queue(waitQueue, CURRENT_THREAD);
+    Schedule_And_Unlock(&waitQueue->lock);
+    Spin_Lock(&device->lock);
+}
+
+/*
+ * Hand queued frames to the device while it has room for them.  The
+ * check and the hand-off happen under the device lock, so a
+ * completion that frees room afterwards sees the queue non-empty and
+ * schedules the device thread.
+ */
+static void Drain_Transmit_Queue(struct Net_Device *device) {
+    struct Net_Buf *nBuf;
+    bool iflag;
+
+    while (1) {
+        iflag = Begin_Int_Atomic();
+        Spin_Lock(&device->lock);
+        nBuf = Get_Front_Of_Packet_Queue(&device->txQueue);
+        if(nBuf != 0 &&
+           device->transmit(device, Net_Buf_Data(nBuf),
+                            NET_BUF_SIZE(nBuf)) == 0) {
+            Remove_From_Front_Of_Packet_Queue(&device->txQueue);
+            --device->txQueueLength;
+            Wake_Up(&device->txWaitQueue);
         } else {
-            Wait(&s_receiveThreadQueue);
-            Deprecated_Enable_Interrupts();
+            nBuf = 0;
         }
+        Spin_Unlock(&device->lock);
+        End_Int_Atomic(iflag);
+
+        if(nBuf == 0)
+            break;
+
+        Net_Buf_Destroy(nBuf);
+    }
+}
+
+/*
+ * One per device.  Sleeps until the driver schedules it.  For receive
+ * it takes up to NET_RX_BUDGET frames off the ring in one hold of the
+ * device lock, and dispatches the batch with it dropped.  A full
+ * budget means the ring may still hold frames, so the thread stays in
+ * poll mode and yields; otherwise the receive interrupt is turned back
+ * on.  For transmit it feeds the queue to the device.
+ */
+static void Net_Device_Thread(ulong_t arg) {
+    struct Net_Device *device = (struct Net_Device *)arg;
+    struct Packet_Queue batch;
+    struct Net_Buf *nBuf;
+    bool drainTransmit;
+    int count;
+    bool iflag;
+
+    while (1) {
+        iflag = Begin_Int_Atomic();
+        Spin_Lock(&device->lock);
+        while (!device->rxScheduled && !device->txScheduled)
+            Wait_Unlocked(device, &device->workWaitQueue);
+
+        count = 0;
+        if(device->rxScheduled) {
+            if(device->poll)
+                count = device->poll(device, NET_RX_BUDGET);
+            if(count < NET_RX_BUDGET) {
+                device->rxScheduled = false;
+                if(device->receiveInterrupt)
+                    device->receiveInterrupt(device, true);
+            }
+        }
+
+        batch = device->rxQueue;
+        Clear_Packet_Queue(&device->rxQueue);
+
+        drainTransmit = device->txScheduled;
+        device->txScheduled = false;
+        Spin_Unlock(&device->lock);
+        End_Int_Atomic(iflag);
+
+        if(drainTransmit)
+            Drain_Transmit_Queue(device);
+
+        while (!Is_Packet_Queue_Empty(&batch)) {
+            nBuf = Remove_From_Front_Of_Packet_Queue(&batch);
+            Eth_Dispatch(device, nBuf);
+        }
+
+        Refill_Receive_Pool(device);
+        Update_Receive_Rates(device);
+
+        if(count >= NET_RX_BUDGET)
+            Yield();
     }
 }
 
@@ -90,10 +217,6 @@ void Init_Network_Devices(void) {
     Register_Net_Device(&g_ne2000Capabilities, 0x300, 9, "eth");
     Register_Net_Device(&g_ne2000Capabilities, 0x320, 10, "eth");
     Register_Net_Device(&g_ne2000Capabilities, 0x340, 3, "eth");
-
-    /* Start the receive kernel thread */
-    Start_Kernel_Thread(Net_Device_Receive_Thread, 0, PRIORITY_NORMAL,
-                        false, "{NetRecv}");
 }
 
 
@@ -103,6 +226,7 @@ int Register_Net_Device(struct Net_Device_Capabilities *caps,
                         ulong_t irq, const char *nameBase) {
     int devNumber;
     int rc;
+    bool iflag;
     struct Net_Device *device = NULL;
 
     device = Allocate_Net_Device();
@@ -123,16 +247,21 @@ int Register_Net_Device(struct Net_Device_Capabilities *caps,
     device->reset = caps->reset;
     device->getHeader = caps->getHeader;
     device->completeReceive = caps->completeReceive;
+    device->poll = caps->poll;
+    device->receiveInterrupt = caps->receiveInterrupt;
+
+    /* Have receive buffers ready before the device can interrupt */
+    Refill_Receive_Pool(device);
 
     /* Add the device to the device list */
     Add_To_Back_Of_Net_Device_List(&s_deviceList, device);
 
-    Deprecated_Disable_Interrupts();
-
     /* initialize the device being registered */
+    iflag = Begin_Int_Atomic();
+    Spin_Lock(&device->lock);
     rc = device->init(device);
-
-    Deprecated_Enable_Interrupts();
+    Spin_Unlock(&device->lock);
+    End_Int_Atomic(iflag);
 
     if(rc != 0) {
         Remove_From_Net_Device_List(&s_deviceList, device);
@@ -140,6 +269,10 @@ int Register_Net_Device(struct Net_Device_Capabilities *caps,
         return rc;
     }
 
+    device->rateStart = g_numTicks;
+    Start_Kernel_Thread(Net_Device_Thread, (ulong_t) device,
+                        PRIORITY_NORMAL, false, "{NetDev}");
+
     return 0;
 }
 
@@ -185,44 +318,140 @@ int Get_Net_Device_By_IRQ(unsigned int irq, /*@out@ */
     return -1;
 }
 
-/* called by the device-specific code to notify of a ready packet */
-int Net_Device_Receive(struct Net_Device *device, ushort_t ringBufferPage) {
-    struct Net_Device_Packet *packet;
-    struct Net_Device_Header hdr;
-    ushort_t ringBufferOffset;
-    int rc = 0;
+/*
+ * Called by a driver, with the device locked, to have the device's
+ * receive thread poll it.
+ */
+void Net_Device_Schedule_Receive(struct Net_Device *device) {
+    KASSERT(Is_Locked(&device->lock));
+
+    if(!device->rxScheduled) {
+        device->rxScheduled = true;
+        Wake_Up(&device->workWaitQueue);
+    }
+}
+
+/*
+ * Send a frame.  It goes straight to the device if the device has room
+ * and nothing is queued ahead of it; otherwise a copy is queued, and
+ * the caller blocks first if the queue is full.  The caller keeps
+ * ownership of buffer either way.
+ */
+int Net_Device_Transmit(struct Net_Device *device, void *buffer,
+                        ulong_t length) {
+    struct Net_Buf *nBuf, *front;
+    bool iflag;
+    int rc;
 
-    KASSERT(!Interrupts_Enabled());
+    KASSERT(Interrupts_Enabled());
 
-    //Print("Receiving packet in NET layer\n");
+    iflag = Begin_Int_Atomic();
+    Spin_Lock(&device->lock);
+    if(Is_Packet_Queue_Empty(&device->txQueue) &&
+       device->transmit(device, buffer, length) == 0) {
+        Spin_Unlock(&device->lock);
+        End_Int_Atomic(iflag);
+        return 0;
+    }
+    Spin_Unlock(&device->lock);
+    End_Int_Atomic(iflag);
 
-    device->getHeader(device, &hdr, ringBufferPage >> 8);
+    rc = Net_Buf_Create_Linear(&nBuf, 0, length);
+    if(rc != 0) {
+        ++device->txPacketErrors;
+        return rc;
+    }
+    memcpy(Net_Buf_Put(nBuf, length), buffer, length);
+
+    /*
+     * Queue full: feed the device from it ourselves rather than rely on
+     * the device thread, which may be the caller.  The attempt and the
+     * Wait share one hold of the device lock; completions wake
+     * txWaitQueue.  The last check of the length and the enqueue share
+     * one too, so concurrent senders cannot overfill the queue.
+     */
+    iflag = Begin_Int_Atomic();
+    Spin_Lock(&device->lock);
+    while (device->txQueueLength >= NET_TX_QUEUE_MAX) {
+        front = Get_Front_Of_Packet_Queue(&device->txQueue);
+        if(device->transmit(device, Net_Buf_Data(front),
+                            NET_BUF_SIZE(front)) == 0) {
+            Remove_From_Front_Of_Packet_Queue(&device->txQueue);
+            --device->txQueueLength;
+            Spin_Unlock(&device->lock);
+            End_Int_Atomic(iflag);
+            Net_Buf_Destroy(front);
+            iflag = Begin_Int_Atomic();
+            Spin_Lock(&device->lock);
+        } else {
+            Wait_Unlocked(device, &device->txWaitQueue);
+        }
+    }
+    Add_To_Back_Of_Packet_Queue(&device->txQueue, nBuf);
+    ++device->txQueueLength;
+    Spin_Unlock(&device->lock);
+    End_Int_Atomic(iflag);
 
-    packet = Malloc(sizeof(struct Net_Device_Packet));
-    if(packet == 0)
-        goto fail;
+    /* room may have freed up while we copied */
+    Drain_Transmit_Queue(device);
 
-    memset(packet, '\0', sizeof(struct Net_Device_Packet));
+    return 0;
+}
 
-    //Print("Packet addr on malloc: %p\n", packet);
+/*
+ * Called by a driver, with the device locked, when the device has
+ * finished with a frame and has room for another.
+ */
+void Net_Device_Transmit_Complete(struct Net_Device *device) {
+    KASSERT(Is_Locked(&device->lock));
 
-    packet->device = device;
-    packet->bufferLen = hdr.count - sizeof(struct Net_Device_Header);
-    packet->buffer = Malloc(packet->bufferLen);
-    if(packet->buffer == 0)
-        goto fail;
+    Wake_Up(&device->txWaitQueue);
 
-    ringBufferOffset = ringBufferPage + sizeof(struct Net_Device_Header);
+    if(!Is_Packet_Queue_Empty(&device->txQueue) && !device->txScheduled) {
+        device->txScheduled = true;
+        Wake_Up(&device->workWaitQueue);
+    }
+}
+
+/*
+ * called by the device-specific code to notify of a ready packet.
+ * Runs with the device locked: the frame is read into a buffer from the
+ * device's receive pool, or dropped if the pool has run dry.
+ */
+int Net_Device_Receive(struct Net_Device *device, ushort_t ringBufferPage) {
+    struct Net_Buf *nBuf;
+    struct Net_Device_Header hdr;
+    ulong_t length;
+    ushort_t ringBufferOffset;
+    int rc = 0;
+
+    KASSERT(Is_Locked(&device->lock));
 
-    device->receive(device, packet->buffer, packet->bufferLen,
-                    ringBufferOffset);
+    device->getHeader(device, &hdr, ringBufferPage >> 8);
 
-    /* Add the packet to the back of the receive packet queue */
-    Add_To_Back_Of_Net_Device_Receive_Packet_Queue(&s_receivePacketQueue,
-                                                   packet);
-    Wake_Up(&s_receiveThreadQueue);
+    length = hdr.count - sizeof(struct Net_Device_Header);
+    ringBufferOffset = ringBufferPage + sizeof(struct Net_Device_Header);
 
+    if(length > NET_RX_BUF_SIZE) {
+        ++device->rxPacketErrors;
+        rc = EINVALID;
+    } else if(Is_Packet_Queue_Empty(&device->rxPool)) {
+        ++device->rxDropped;
+        rc = ENOMEM;
+    } else {
+        nBuf = Remove_From_Front_Of_Packet_Queue(&device->rxPool);
+        --device->rxPoolCount;
+
+        device->receive(device, Net_Buf_Put(nBuf, length), length,
+                        ringBufferOffset);
+        ++device->rxPackets;
+
+        Add_To_Back_Of_Packet_Queue(&device->rxQueue, nBuf);
+        Net_Device_Schedule_Receive(device);
+    }
+
+    /* release the ring buffer slot even if the frame was dropped */
     device->completeReceive(device, &hdr);
-  fail:
+
     return rc;
 }
@@ -8,6 +8,7 @@
  */
 
 #include <geekos/net/netbuf.h>
+#include <geekos/net/checksum.h>
 #include <geekos/errno.h>
 #include <geekos/malloc.h>
 #include <geekos/ktypes.h>
@@ -107,6 +108,7 @@ static int Split_Buffer(struct Net_Buf *nBuf, ulong_t split) {
     buf1->length = buf1Size;
     buf1->valid = 1;
     buf1->mustFree = curr->mustFree;    // only free if we needed to free the original buffer
+    buf1->owner = NULL;
 
     /* Change pointers for second buffer */
     buf2Size = (curr->length - offset);
@@ -114,6 +116,7 @@ static int Split_Buffer(struct Net_Buf *nBuf, ulong_t split) {
     buf2->length = buf2Size;
     buf2->valid = 1;
     buf2->mustFree = 0;
+    buf2->owner = NULL;
 
     curr->valid = 0;
     curr->mustFree = 0;
@@ -142,6 +145,59 @@ int Net_Buf_Create(struct Net_Buf **nBuf) {
     return 0;
 }
 
+/*
+ * Allocate a Net_Buf whose data lives in one contiguous block, with
+ * headroom bytes in front for lower layers to push their headers
+ * into and size bytes behind for the payload and any padding.  The
+ * storage is part of the same allocation as the Net_Buf itself.
+ */
+int Net_Buf_Create_Linear(struct Net_Buf **nBuf, ulong_t headroom,
+                          ulong_t size) {
+    struct Net_Buf *buffer =
+        Malloc(sizeof(struct Net_Buf) + headroom + size);
+    if(buffer == 0)
+        return ENOMEM;
+
+    memset(buffer, '\0', sizeof(struct Net_Buf));
+
+    buffer->head = (uchar_t *) (buffer + 1);
+    buffer->data = buffer->head + headroom;
+    buffer->end = buffer->data + size;
+
+    *nBuf = buffer;
+
+    return 0;
+}
+
+void *Net_Buf_Push(struct Net_Buf *nBuf, ulong_t size) {
+    if(!NET_BUF_IS_LINEAR(nBuf) || (ulong_t) (nBuf->data - nBuf->head) < size)
+        return NULL;
+
+    nBuf->data -= size;
+    nBuf->length += size;
+
+    return nBuf->data;
+}
+
+void *Net_Buf_Put(struct Net_Buf *nBuf, ulong_t size) {
+    uchar_t *tail;
+
+    if(!NET_BUF_IS_LINEAR(nBuf))
+        return NULL;
+
+    tail = nBuf->data + nBuf->length;
+    if((ulong_t) (nBuf->end - tail) < size)
+        return NULL;
+
+    nBuf->length += size;
+
+    return tail;
+}
+
+void *Net_Buf_Data(struct Net_Buf *nBuf) {
+    return NET_BUF_IS_LINEAR(nBuf) ? nBuf->data : NULL;
+}
+
 int Net_Buf_Destroy(struct Net_Buf *nBuf) {
 
     Net_Buf_Remove_All(nBuf);
@@ -207,6 +263,33 @@ static int Create_Message_Buffer(struct Net_Buf *nBuf,
     return 0;
 }
 
+/*
+ * Hand the contiguous bytes of a linear buffer to the buffer list, for
+ * the operations the linear fast paths don't cover.  The storage stays
+ * owned by the Net_Buf, so the entry is only lent.
+ */
+static int Unlinearize(struct Net_Buf *nBuf) {
+    struct Message_Buffer *mBuf;
+    int rc;
+
+    if(!NET_BUF_IS_LINEAR(nBuf))
+        return 0;
+
+    if(nBuf->length == 0) {
+        nBuf->head = nBuf->data = nBuf->end = 0;
+        return 0;
+    }
+
+    rc = Create_Message_Buffer(nBuf, &mBuf, nBuf->data, nBuf->length,
+                               NET_BUF_ALLOC_LEND);
+    if(rc != 0)
+        return rc;
+
+    Add_To_Back_Of_Message_Buffer_List(&nBuf->buffers, mBuf);
+
+    return 0;
+}
+
 int Net_Buf_Prepend(struct Net_Buf *nBuf, void *buffer, ulong_t size,
                     uchar_t allocScheme) {
 
@@ -215,6 +298,20 @@ int Net_Buf_Prepend(struct Net_Buf *nBuf, void *buffer, ulong_t size,
 
     KASSERT0(size > 0, "size of prepended buffer should be nonzero");
 
+    if(NET_BUF_IS_LINEAR(nBuf)) {
+        void *dest = Net_Buf_Push(nBuf, size);
+        if(dest != NULL) {
+            memcpy(dest, buffer, size);
+            if(allocScheme == NET_BUF_ALLOC_OWN)
+                Free(buffer);
+            return 0;
+        }
+
+        rc = Unlinearize(nBuf);
+        if(rc != 0)
+            return rc;
+    }
+
     rc = Create_Message_Buffer(nBuf, &mBuf, buffer, size, allocScheme);
     if(rc != 0)
         return rc;
@@ -233,6 +330,20 @@ int Net_Buf_Append(struct Net_Buf *nBuf, void *buffer, ulong_t size,
 
     KASSERT0(size > 0, "size of appended  buffer should be nonzero");
 
+    if(NET_BUF_IS_LINEAR(nBuf)) {
+        void *dest = Net_Buf_Put(nBuf, size);
+        if(dest != NULL) {
+            memcpy(dest, buffer, size);
+            if(allocScheme == NET_BUF_ALLOC_OWN)
+                Free(buffer);
+            return 0;
+        }
+
+        rc = Unlinearize(nBuf);
+        if(rc != 0)
+            return rc;
+    }
+
     rc = Create_Message_Buffer(nBuf, &mBuf, buffer, size, allocScheme);
     if(rc != 0)
         return rc;
@@ -244,6 +355,50 @@ int Net_Buf_Append(struct Net_Buf *nBuf, void *buffer, ulong_t size,
     return 0;
 }
 
+/*
+ * Chain tail's data onto the end of nBuf.  Entries of a chained tail
+ * move across as they are; a linear tail is lent.  Either way an
+ * entry holds on to tail itself, so its storage lives until nBuf is
+ * destroyed.
+ */
+int Net_Buf_Concatenate(struct Net_Buf *nBuf, struct Net_Buf *tail) {
+    struct Message_Buffer *mBuf, *moved;
+    ulong_t length = NET_BUF_SIZE(tail);
+    int rc;
+
+    rc = Unlinearize(nBuf);
+    if(rc != 0)
+        return rc;
+
+    if(NET_BUF_IS_LINEAR(tail) && length > 0) {
+        rc = Create_Message_Buffer(nBuf, &mBuf, tail->data, length,
+                                   NET_BUF_ALLOC_LEND);
+        if(rc != 0)
+            return rc;
+    } else {
+        rc = Create_Message_Buffer(nBuf, &mBuf, NULL, 0,
+                                   NET_BUF_ALLOC_LEND);
+        if(rc != 0)
+            return rc;
+        mBuf->valid = 0;
+
+        while ((moved = Remove_From_Front_Of_Message_Buffer_List
+                (&tail->buffers)) != NULL)
+            Add_To_Back_Of_Message_Buffer_List(&nBuf->buffers, moved);
+        tail->length = 0;
+#ifndef NDEBUG
+        nBuf->mallocCount += tail->mallocCount;
+        tail->mallocCount = 0;
+#endif
+    }
+
+    mBuf->owner = tail;
+    Add_To_Back_Of_Message_Buffer_List(&nBuf->buffers, mBuf);
+    nBuf->length += length;
+
+    return 0;
+}
+
 int Net_Buf_Extract(struct Net_Buf *nBuf, ulong_t start, void *dest,
                     ulong_t size) {
     ulong_t bytesLeft = size;
@@ -256,6 +411,11 @@ int Net_Buf_Extract(struct Net_Buf *nBuf, ulong_t start, void *dest,
     if(start + size > NET_BUF_SIZE(nBuf))
         return -1;
 
+    if(NET_BUF_IS_LINEAR(nBuf)) {
+        memcpy(dest, nBuf->data + start, size);
+        return 0;
+    }
+
     /* Find the message buffer containing the start address */
     startBuf = Find_Buffer_At_Offset(nBuf, start, &bufOffset);
 
@@ -295,6 +455,51 @@ int Net_Buf_Extract_All(struct Net_Buf *nBuf, void *dest) {
     return Net_Buf_Extract(nBuf, 0, dest, NET_BUF_SIZE(nBuf));
 }
 
+/*
+ * Add the bytes start..start+size to the partial internet checksum in
+ * *sum, straight from the buffers.  A buffer that starts at an odd
+ * offset into the range has its bytes in the other halves of the
+ * 16 bit words, so its sum is byte-swapped.
+ */
+int Net_Buf_Checksum(struct Net_Buf *nBuf, ulong_t start, ulong_t size,
+                     ulong_t * sum) {
+    struct Message_Buffer *currBuf;
+    ulong_t bufOffset = 0;
+    ulong_t numBytes, part;
+    ulong_t done = 0;
+
+    if(start + size > NET_BUF_SIZE(nBuf))
+        return -1;
+
+    if(NET_BUF_IS_LINEAR(nBuf)) {
+        *sum = Checksum_Partial(*sum, nBuf->data + start, size);
+        return 0;
+    }
+    if(size == 0)
+        return 0;
+
+    currBuf = Find_Buffer_At_Offset(nBuf, start, &bufOffset);
+    while (done < size) {
+        KASSERT(currBuf != NULL);
+        if(!currBuf->valid) {
+            currBuf = Get_Next_In_Message_Buffer_List(currBuf);
+            continue;
+        }
+
+        numBytes = MIN(size - done, currBuf->length - bufOffset);
+        part = Checksum_Partial(0, currBuf->buffer + bufOffset, numBytes);
+        if(done & 1)
+            part = ((part & 0xff) << 8) | (part >> 8);
+        *sum += part;
+        done += numBytes;
+        bufOffset = 0;
+
+        currBuf = Get_Next_In_Message_Buffer_List(currBuf);
+    }
+
+    return 0;
+}
+
 int Net_Buf_Remove(struct Net_Buf *nBuf, ulong_t start, ulong_t length) {
 
     struct Message_Buffer *splitBegin, *splitEnd, *next;
@@ -306,6 +511,21 @@ int Net_Buf_Remove(struct Net_Buf *nBuf, ulong_t start, ulong_t length) {
     if(length == 0)
         return -1;
 
+    if(NET_BUF_IS_LINEAR(nBuf)) {
+        if(start + length > NET_BUF_SIZE(nBuf))
+            return -1;
+
+        /* stripping a header just moves the start of the data */
+        if(start == 0)
+            nBuf->data += length;
+        else
+            memmove(nBuf->data + start, nBuf->data + start + length,
+                    NET_BUF_SIZE(nBuf) - start - length);
+
+        nBuf->length -= length;
+        return 0;
+    }
+
     /* Split the buffer where we need to delete stuff */
     rc = Split_Buffer(nBuf, start);
     if(rc != 0) {
@@ -358,6 +578,8 @@ int Net_Buf_Remove_All(struct Net_Buf *nBuf) {
             freeCount++;
 #endif
         }
+        if(curr->owner != NULL)
+            Net_Buf_Destroy(curr->owner);
 
         Free(curr);
 
@@ -369,6 +591,7 @@ int Net_Buf_Remove_All(struct Net_Buf *nBuf) {
     }
 
     Clear_Message_Buffer_List(&nBuf->buffers);
+    nBuf->length = 0;
 
 #ifndef NDEBUG
     KASSERT(freeCount == nBuf->mallocCount);
@@ -9,57 +9,407 @@
 #include <geekos/int.h>
 #include <geekos/synch.h>
 #include <geekos/timer.h>
+#include <geekos/string.h>
 
-#include <geekos/projects.h>
 
-/* Use a routing table; this declares it, but the attribute
-   asks the compiler not to warn about it being unused while
-   you develop other code */
-static struct Routing_Table s_routingTable __attribute__ ((unused));
+/* slots in the per-destination route cache */
+#define ROUTE_CACHE_SLOTS 64
+
+/*
+ * Longest-prefix match is a path-compressed binary trie over the
+ * destination in host byte order.  Each node covers the first length
+ * bits of prefix; a node without a route only branches.  Lookup walks
+ * at most one node per prefix bit.
+ */
+struct Route_Trie_Node {
+    uint_t prefix;              /* bits past length are zero */
+    uint_t length;
+    struct Route *route;
+    struct Route_Trie_Node *child[2];
+};
+
+/*
+ * Recent lookups.  Entries are valid only for the generation they were
+ * filled in, and every change to the table bumps the generation.
+ */
+struct Route_Cache_Entry {
+    uint_t destination;
+    uint_t generation;
+    struct Route *route;
+};
+
+/* every route, for listing; the trie is used for lookups */
+static struct Routing_Table s_routingTable;
+static struct Route_Trie_Node *s_routeTrie;
+static struct Route_Cache_Entry s_routeCache[ROUTE_CACHE_SLOTS];
+static uint_t s_routeGeneration = 1;
 static struct Mutex s_routingTableMutex;
 
+static uint_t Route_Key(const IP_Address * address) {
+    return ((uint_t) address->ptr[0] << 24) |
+        ((uint_t) address->ptr[1] << 16) |
+        ((uint_t) address->ptr[2] << 8) | address->ptr[3];
+}
+
+static uint_t Prefix_Mask(uint_t length) {
+    return length == 0 ? 0 : 0xFFFFFFFFU << (32 - length);
+}
+
+/* bit index of key, counting from the most significant */
+static int Prefix_Bit(uint_t key, uint_t index) {
+    return (key >> (31 - index)) & 1;
+}
+
+/* number of leading bits a and b share, at most max */
+static uint_t Common_Prefix_Length(uint_t a, uint_t b, uint_t max) {
+    uint_t diff = a ^ b;
+    uint_t common = diff == 0 ? 32 : (uint_t) __builtin_clz(diff);
+
+    return MIN(common, max);
+}
+
+/* prefix length of a netmask, or -1 if its ones aren't contiguous */
+static int Netmask_Length(const Netmask * netmask) {
+    uint_t mask = Route_Key((const IP_Address *)netmask);
+    uint_t length = Common_Prefix_Length(mask, 0xFFFFFFFFU, 32);
+
+    return mask == Prefix_Mask(length) ? (int)length : -1;
+}
+
+static struct Route_Trie_Node *Create_Trie_Node(uint_t prefix,
+                                                uint_t length,
+                                                struct Route *route) {
+    struct Route_Trie_Node *node = Malloc(sizeof(struct Route_Trie_Node));
+    if(node == NULL)
+        return NULL;
+
+    node->prefix = prefix & Prefix_Mask(length);
+    node->length = length;
+    node->route = route;
+    node->child[0] = node->child[1] = NULL;
+    return node;
+}
+
+static int Trie_Insert(struct Route_Trie_Node **link, uint_t prefix,
+                       uint_t length, struct Route *route) {
+    struct Route_Trie_Node *node, *branch, *leaf;
+    uint_t common;
+
+    while ((node = *link) != NULL) {
+        common = Common_Prefix_Length(node->prefix, prefix,
+                                      MIN(node->length, length));
+        if(common == node->length) {
+            if(length == node->length) {
+                node->route = route;
+                return 0;
+            }
+            link = &node->child[Prefix_Bit(prefix, node->length)];
+            continue;
+        }
+
+        if(common == length) {
+            /* the new prefix sits above node */
+            leaf = Create_Trie_Node(prefix, length, route);
+            if(leaf == NULL)
+                return ENOMEM;
+            leaf->child[Prefix_Bit(node->prefix, length)] = node;
+            *link = leaf;
+            return 0;
+        }
+
+        /* they part ways inside node's prefix: branch where they do */
+        branch = Create_Trie_Node(prefix, common, NULL);
+        leaf = Create_Trie_Node(prefix, length, route);
+        if(branch == NULL || leaf == NULL) {
+            Free(branch);
+            Free(leaf);
+            return ENOMEM;
+        }
+        branch->child[Prefix_Bit(node->prefix, common)] = node;
+        branch->child[Prefix_Bit(prefix, common)] = leaf;
+        *link = branch;
+        return 0;
+    }
+
+    *link = Create_Trie_Node(prefix, length, route);
+    return *link == NULL ? ENOMEM : 0;
+}
+
+static struct Route *Trie_Find_Exact(uint_t prefix, uint_t length) {
+    struct Route_Trie_Node *node = s_routeTrie;
+
+    while (node != NULL && node->length <= length &&
+           Common_Prefix_Length(node->prefix, prefix,
+                                node->length) == node->length) {
+        if(node->length == length)
+            return node->route;
+        node = node->child[Prefix_Bit(prefix, node->length)];
+    }
+    return NULL;
+}
+
+/*
+ * Detach the route for prefix/length, folding away nodes that no
+ * longer carry a route or a branch on the way back up.
+ */
+static struct Route *Trie_Remove(struct Route_Trie_Node **link,
+                                 uint_t prefix, uint_t length) {
+    struct Route_Trie_Node *node = *link;
+    struct Route *route;
+
+    if(node == NULL || node->length > length ||
+       Common_Prefix_Length(node->prefix, prefix,
+                            node->length) < node->length)
+        return NULL;
+
+    if(node->length == length) {
+        route = node->route;
+        node->route = NULL;
+    } else {
+        route =
+            Trie_Remove(&node->child[Prefix_Bit(prefix, node->length)],
+                        prefix, length);
+    }
+
+    if(route != NULL && node->route == NULL &&
+       (node->child[0] == NULL || node->child[1] == NULL)) {
+        *link = node->child[0] ? node->child[0] : node->child[1];
+        Free(node);
+    }
+    return route;
+}
+
+/* longest matching prefix for key; the table mutex should be held */
+static struct Route *Route_Lookup(uint_t key) {
+    struct Route_Cache_Entry *slot =
+        &s_routeCache[(key * 2654435761U) >> 26];
+    struct Route_Trie_Node *node;
+    struct Route *best = NULL;
+
+    if(slot->generation == s_routeGeneration && slot->destination == key)
+        return slot->route;
+
+    for(node = s_routeTrie; node != NULL;
+        node = node->child[Prefix_Bit(key, node->length)]) {
+        if(Common_Prefix_Length(node->prefix, key, node->length) <
+           node->length)
+            break;
+        if(node->route != NULL)
+            best = node->route;
+        if(node->length == 32)
+            break;
+    }
+
+    slot->destination = key;
+    slot->generation = s_routeGeneration;
+    slot->route = best;
+    return best;
+}
+
+static void Fill_IP_Route(const struct Route *route,
+                          struct IP_Route *ipRoute) {
+    memset(ipRoute, '\0', sizeof(struct IP_Route));
+    ipRoute->destination = route->destination;
+    ipRoute->netmask = route->netmask;
+    ipRoute->gateway = route->gateway;
+    ipRoute->metric = route->metric;
+    ipRoute->ticks = route->ticks;
+    memcpy(ipRoute->interface, route->interface->netDevice->devName,
+           NET_NAME_SIZE);
+    ipRoute->fGateway = (route->flags & NET_ROUTE_GATEWAY) != 0;
+    ipRoute->fUp = (route->flags & NET_ROUTE_UP) != 0;
+}
+
+/* unlink and free a route; the table mutex should be held */
+static void Remove_Route(struct Route *route) {
+    Trie_Remove(&s_routeTrie, Route_Key(&route->destination),
+                route->prefixLength);
+    Remove_From_Routing_Table(&s_routingTable, route);
+    ++s_routeGeneration;
+    Free(route);
+}
+
 
 void Init_Routing(void) {
-    // Initialize the routing table with all local routes
+    struct IP_Device *device;
+    IP_Address network;
 
     Mutex_Init(&s_routingTableMutex);
 
-    TODO_P(PROJECT_ROUTING,
-           "generate routes for directly attached IP devices");
+    // Initialize the routing table with all local routes
+    for(device = Get_Front_Of_IP_Device_List(IP_Get_Device_List());
+        device != NULL; device = Get_Next_In_IP_Device_List(device)) {
+        network.address = device->ipAddress.address & device->subnet.mask;
+        Net_Add_Route(&network, &device->subnet, NULL, 0,
+                      device->netDevice->devName);
+    }
 }
 
 int Net_Add_Route(IP_Address * destination, Netmask * mask,
                   IP_Address * gateway, int metric, char *interface) {
+    struct IP_Device *device;
+    struct Route *route;
+    int length = Netmask_Length(mask);
+    uint_t key;
+    int rc = 0;
+
+    if(length < 0)
+        return EINVALID;
+    if(IP_Device_Get_By_Name(&device, interface) != 0)
+        return ENODEV;
 
+    key = Route_Key(destination) & Prefix_Mask(length);
 
     Mutex_Lock(&s_routingTableMutex);
 
-    TODO_P(PROJECT_ROUTING, "add route to the table");
+    /* adding an existing destination replaces how we get there */
+    route = Trie_Find_Exact(key, length);
+    if(route == NULL) {
+        route = Malloc(sizeof(struct Route));
+        if(route == NULL) {
+            rc = ENOMEM;
+            goto out;
+        }
+        memset(route, '\0', sizeof(struct Route));
 
+        rc = Trie_Insert(&s_routeTrie, key, length, route);
+        if(rc != 0) {
+            Free(route);
+            goto out;
+        }
+        Add_To_Back_Of_Routing_Table(&s_routingTable, route);
+    }
+
+    route->destination.address = destination->address & mask->mask;
+    route->netmask = *mask;
+    route->prefixLength = length;
+    route->interface = device;
+    route->metric = metric;
+    route->ticks = g_numTicks;
+    route->flags = NET_ROUTE_UP;
+    if(gateway != NULL) {
+        route->gateway = *gateway;
+        route->flags |= NET_ROUTE_GATEWAY;
+    } else {
+        route->gateway.address = 0;
+    }
+    ++s_routeGeneration;
+
+  out:
     Mutex_Unlock(&s_routingTableMutex);
 
-    return 0;
+    return rc;
 }
 
 int Net_Delete_Route(IP_Address * destination, Netmask * netmask) {
+    struct Route *route;
+    int length = Netmask_Length(netmask);
 
-    Mutex_Lock(&s_routingTableMutex);
-    TODO_P(PROJECT_ROUTING, "delete this route");
+    if(length < 0)
+        return EINVALID;
 
+    Mutex_Lock(&s_routingTableMutex);
+    route = Trie_Find_Exact(Route_Key(destination) & Prefix_Mask(length),
+                            length);
+    if(route != NULL)
+        Remove_Route(route);
     Mutex_Unlock(&s_routingTableMutex);
 
-    return -1;
+    return route != NULL ? 0 : ENOTFOUND;
 }
 
 /*
  * Clean gatewayed routes
  */
 int Net_Clean_Routes(ulong_t msecs) {
+    struct Route *route, *next;
+    ulong_t maxAge = msecs * TICKS_PER_SEC / 1000;
     int cleanedRoutes = 0;
-    Mutex_Lock(&s_routingTableMutex);
 
-    TODO_P(PROJECT_ROUTING, "remove stale routes");
+    Mutex_Lock(&s_routingTableMutex);
+    for(route = Get_Front_Of_Routing_Table(&s_routingTable);
+        route != NULL; route = next) {
+        next = Get_Next_In_Routing_Table(route);
+        if((route->flags & NET_ROUTE_GATEWAY) &&
+           g_numTicks - route->ticks > maxAge) {
+            Remove_Route(route);
+            ++cleanedRoutes;
+        }
+    }
     Mutex_Unlock(&s_routingTableMutex);
 
     return cleanedRoutes;
 }
+
+int Net_Get_Route_Info(struct IP_Device **device,
+                       IP_Address * ipAddress,
+                       IP_Address * network, Netmask * subnet,
+                       bool * fGateway, IP_Address * gateway) {
+    struct Route *route;
+
+    Mutex_Lock(&s_routingTableMutex);
+    route = Route_Lookup(Route_Key(ipAddress));
+    if(route != NULL) {
+        *device = route->interface;
+        if(network != NULL)
+            *network = route->destination;
+        if(subnet != NULL)
+            *subnet = route->netmask;
+        *fGateway = (route->flags & NET_ROUTE_GATEWAY) != 0;
+        if(*fGateway)
+            *gateway = route->gateway;
+    }
+    Mutex_Unlock(&s_routingTableMutex);
+
+    return route != NULL ? 0 : ENOTFOUND;
+}
+
+int Net_Get_Route(struct IP_Device **device,
+                  IP_Address * ipAddress, bool * fGateway,
+                  IP_Address * gateway) {
+    return Net_Get_Route_Info(device, ipAddress, NULL, NULL, fGateway,
+                              gateway);
+}
+
+int Net_Get_Route_Table(struct IP_Route *table, ulong_t maxEntries) {
+    struct Route *route;
+    ulong_t count = 0;
+
+    Mutex_Lock(&s_routingTableMutex);
+    for(route = Get_Front_Of_Routing_Table(&s_routingTable);
+        route != NULL && count < maxEntries;
+        route = Get_Next_In_Routing_Table(route))
+        Fill_IP_Route(route, &table[count++]);
+    Mutex_Unlock(&s_routingTableMutex);
+
+    return count;
+}
+
+int Net_Route_Get_Metric(IP_Address * ipAddress, Netmask * subnet,
+                         int *metric) {
+    struct IP_Route ipRoute;
+    int rc = Net_Get_Route_Table_Entry(ipAddress, subnet, &ipRoute);
+
+    if(rc == 0)
+        *metric = ipRoute.metric;
+    return rc;
+}
+
+int Net_Get_Route_Table_Entry(const IP_Address * ipAddress,
+                              const Netmask * netmask,
+                              struct IP_Route *ipRoute) {
+    struct Route *route;
+    int length = Netmask_Length(netmask);
+
+    if(length < 0)
+        return EINVALID;
+
+    Mutex_Lock(&s_routingTableMutex);
+    route = Trie_Find_Exact(Route_Key(ipAddress) & Prefix_Mask(length),
+                            length);
+    if(route != NULL)
+        Fill_IP_Route(route, ipRoute);
+    Mutex_Unlock(&s_routingTableMutex);
+
+    return route != NULL ? 0 : ENOTFOUND;
+}
@@ -17,52 +17,501 @@
 #include <geekos/net/tcp.h>
 #include <geekos/alarm.h>
 #include <geekos/screen.h>
-#include <geekos/kassert.h>
+#include <geekos/epoch.h>
+#include <geekos/net/routing.h>
 
 #include <geekos/projects.h>
 
 
-int Socket_Create(uchar_t type, int flags __attribute__ ((unused))) {
-    TODO_P(PROJECT_SOCKETS, "Create");
-    return -1;
+#define MAX_SOCKETS 1024
+#define EPHEMERAL_PORT_FIRST 49152
+#define EPHEMERAL_PORT_LAST 65535
+
+/* demultiplexing hash sizes, as powers of two */
+#define CONNECTED_HASH_BITS 8
+#define LISTEN_HASH_BITS 6
+
+/* values of Socket.hashed */
+#define SOCKET_UNHASHED 0
+#define SOCKET_CONNECTED 1
+#define SOCKET_LISTENING 2
+
+/*
+ * Socket ids index this table.  Lock order is the table, then a
+ * socket's own lock; the table lock is never taken while holding a
+ * socket lock.  System calls hold a reference from Get_Socket while
+ * they use a socket, and a retired socket is not freed until the
+ * last one is put.
+ */
+static struct Socket *s_sockets[MAX_SOCKETS];
+static struct Mutex s_socketMutex;
+static ushort_t s_nextEphemeralPort = EPHEMERAL_PORT_FIRST;
+
+/*
+ * Received segments find their socket through two hash tables: one
+ * keyed by the full 4-tuple for connected sockets, and one keyed by
+ * local port for listeners and bound datagram sockets, where a
+ * socket bound to INADDR_ANY matches any local address.
+ *
+ * Lookups take no lock.  Writers hold s_socketMutex and publish a
+ * socket only once its chain link is set; an unlinked socket keeps
+ * its link so a reader standing on it can carry on.  Unlinked
+ * sockets are freed only after every reader that might have seen
+ * them is done: readers count themselves in s_demuxEpoch, and the
+ * timer flips it and frees what was retired before the flip once
+ * the old epoch drains.
+ */
+static struct Socket *s_connectedHash[1 << CONNECTED_HASH_BITS];
+static struct Socket *s_listenHash[1 << LISTEN_HASH_BITS];
+
+static struct Epoch s_demuxEpoch = EPOCH_INITIALIZER;
+static struct Socket *s_retired;
+static struct Socket *s_reclaiming;
+static int s_reclaimEpoch;
+
+static uint_t Connected_Hash(uint_t localAddress, ushort_t localPort,
+                             uint_t remoteAddress, ushort_t remotePort) {
+    uint_t key = localAddress ^ remoteAddress ^
+        (((uint_t) localPort << 16) | remotePort);
+
+    return (key * 2654435761U) >> (32 - CONNECTED_HASH_BITS);
+}
+
+static uint_t Listen_Hash(ushort_t type, ushort_t localPort) {
+    return (((uint_t) type << 16 | localPort) * 2654435761U) >>
+        (32 - LISTEN_HASH_BITS);
+}
+
+static struct Socket **Demux_Bucket(struct Socket *sock) {
+    if(sock->hashed == SOCKET_CONNECTED)
+        return &s_connectedHash[Connected_Hash
+                                (sock->localAddress.address,
+                                 sock->localPort,
+                                 sock->remoteAddress.address,
+                                 sock->remotePort)];
+    return &s_listenHash[Listen_Hash(sock->type, sock->localPort)];
+}
+
+/* make sock findable by received segments; the table lock should be held */
+static void Demux_Insert(struct Socket *sock, int table) {
+    struct Socket **bucket;
+
+    sock->hashed = table;
+    bucket = Demux_Bucket(sock);
+    sock->hashNext = *bucket;
+    __sync_synchronize();
+    *bucket = sock;
+}
+
+/* the table lock should be held */
+static void Demux_Remove(struct Socket *sock) {
+    struct Socket **link;
+
+    if(sock->hashed == SOCKET_UNHASHED)
+        return;
+    for(link = Demux_Bucket(sock); *link != NULL;
+        link = &(*link)->hashNext) {
+        if(*link == sock) {
+            *link = sock->hashNext;
+            break;
+        }
+    }
+    sock->hashed = SOCKET_UNHASHED;
+}
+
+static struct Socket *Demux_Lookup(uchar_t type, ushort_t localPort,
+                                   ushort_t remotePort,
+                                   IP_Address * localAddress,
+                                   IP_Address * remoteAddress) {
+    struct Socket *sock, *wildcard = NULL;
+
+    for(sock = s_connectedHash[Connected_Hash(localAddress->address,
+                                              localPort,
+                                              remoteAddress->address,
+                                              remotePort)];
+        sock != NULL; sock = sock->hashNext) {
+        if(sock->type == type && sock->localPort == localPort &&
+           sock->remotePort == remotePort &&
+           sock->localAddress.address == localAddress->address &&
+           sock->remoteAddress.address == remoteAddress->address)
+            return sock;
+    }
+
+    for(sock = s_listenHash[Listen_Hash(type, localPort)]; sock != NULL;
+        sock = sock->hashNext) {
+        if(sock->type != type || sock->localPort != localPort)
+            continue;
+        if(sock->localAddress.address == localAddress->address)
+            return sock;
+        if(sock->multihomed)
+            wildcard = sock;
+    }
+    return wildcard;
+}
+
+/* take a reference on socket id, if there is one; Put_Socket drops it */
+static struct Socket *Get_Socket(ulong_t id) {
+    struct Socket *sock;
+
+    if(id >= MAX_SOCKETS)
+        return NULL;
+    Mutex_Lock(&s_socketMutex);
+    sock = s_sockets[id];
+    if(sock != NULL)
+        __sync_fetch_and_add(&sock->refCount, 1);
+    Mutex_Unlock(&s_socketMutex);
+    return sock;
+}
+
+static void Put_Socket(void *sock) {
+    __sync_fetch_and_sub(&((struct Socket *)sock)->refCount, 1);
+}
+
+/* as Get_Socket, for a stream socket only */
+static struct TCP_Socket *Get_TCP_Socket(ulong_t id) {
+    struct Socket *sock = Get_Socket(id);
+
+    if(sock != NULL && sock->type != SOCK_STREAM) {
+        Put_Socket(sock);
+        sock = NULL;
+    }
+    return (struct TCP_Socket *)sock;
+}
+
+static void Free_Socket(struct Socket *sock) {
+    if(sock->type == SOCK_STREAM)
+        TCP_Socket_Free((struct TCP_Socket *)sock);
+    Free(sock);
+}
+
+/* drop the socket from both tables; the table lock should be held */
+static void Retire_Socket(struct Socket *sock) {
+    s_sockets[sock->id] = NULL;
+    Demux_Remove(sock);
+    if(sock->type == SOCK_STREAM)
+        Poll_Queue_Destroy(&((struct TCP_Socket *)sock)->pollQueue);
+    sock->retiredNext = s_retired;
+    s_retired = sock;
+}
+
+/*
+ * Free retired sockets no reader can still see; the table lock
+ * should be held.  Only one batch is in its grace period at a time.
+ */
+static void Reclaim_Sockets(void) {
+    struct Socket *sock;
+
+    if(s_reclaiming != NULL) {
+        if(!Epoch_Drained(&s_demuxEpoch, s_reclaimEpoch))
+            return;
+        while ((sock = s_reclaiming) != NULL) {
+            s_reclaiming = sock->retiredNext;
+            if(sock->refCount > 0) {
+                /* a system call is still using it; try next time */
+                sock->retiredNext = s_retired;
+                s_retired = sock;
+            } else {
+                Free_Socket(sock);
+            }
+        }
+    }
+
+    if(s_retired != NULL) {
+        s_reclaiming = s_retired;
+        s_retired = NULL;
+        s_reclaimEpoch = Epoch_Flip(&s_demuxEpoch);
+    }
+}
+
+/* true if another socket is already bound to port on address */
+static bool Port_In_Use(ushort_t type, ushort_t port, IP_Address * address) {
+    struct Socket *sock;
+    int i;
+
+    for(i = 0; i < MAX_SOCKETS; ++i) {
+        sock = s_sockets[i];
+        if(sock != NULL && sock->bound && sock->type == type &&
+           sock->localPort == port &&
+           (sock->multihomed || address->address == INADDR_ANY ||
+            sock->localAddress.address == address->address))
+            return true;
+    }
+    return false;
+}
+
+/* the table lock should be held */
+static int Choose_Ephemeral_Port(ushort_t type, IP_Address * address) {
+    int tries;
+    ushort_t port;
+
+    for(tries = EPHEMERAL_PORT_LAST - EPHEMERAL_PORT_FIRST + 1; tries > 0;
+        --tries) {
+        port = s_nextEphemeralPort;
+        s_nextEphemeralPort = port == EPHEMERAL_PORT_LAST ?
+            EPHEMERAL_PORT_FIRST : port + 1;
+        if(!Port_In_Use(type, port, address))
+            return port;
+    }
+    return EBUSY;
+}
+
+int Socket_Create(uchar_t type, int flags, ulong_t sendBufferSize,
+                  ulong_t receiveBufferSize) {
+    struct Socket *sock;
+    struct UDP_Socket *udp;
+    int id, rc = 0;
+
+    if(type == SOCK_STREAM) {
+        sock = Malloc(sizeof(struct TCP_Socket));
+        if(sock == NULL)
+            return ENOMEM;
+        memset(sock, '\0', sizeof(struct TCP_Socket));
+        rc = TCP_Socket_Init((struct TCP_Socket *)sock, sendBufferSize,
+                             receiveBufferSize);
+        if(rc != 0) {
+            Free(sock);
+            return rc;
+        }
+    } else if(type == SOCK_DGRAM) {
+        udp = Malloc(sizeof(struct UDP_Socket));
+        if(udp == NULL)
+            return ENOMEM;
+        memset(udp, '\0', sizeof(struct UDP_Socket));
+        udp->bufferSize = SOCK_BUFFER_SIZE;
+        Mutex_Init(&udp->mutex);
+        Cond_Init(&udp->condition);
+        sock = (struct Socket *)udp;
+    } else {
+        return EINVALID;
+    }
+
+    sock->type = type;
+    sock->flags = flags;
+    sock->state = SOCK_CLOSED;
+    sock->initialzed = true;
+
+    Mutex_Lock(&s_socketMutex);
+    for(id = 0; id < MAX_SOCKETS && s_sockets[id] != NULL; ++id) ;
+    if(id < MAX_SOCKETS) {
+        sock->id = id;
+        s_sockets[id] = sock;
+    }
+    Mutex_Unlock(&s_socketMutex);
+
+    if(id == MAX_SOCKETS) {
+        Free_Socket(sock);
+        return EMFILE;
+    }
+    return id;
 }
 
 
 int Socket_Connect(ulong_t id, ushort_t port, IP_Address * ipAddress) {
+    struct TCP_Socket *sock = Get_TCP_Socket(id);
+    struct IP_Device *device;
+    IP_Address gateway;
+    bool fGateway;
     int rc = 0;
-    TODO_P(PROJECT_SOCKETS, "Connect");
+
+    if(sock == NULL)
+        return EINVALID;
+    if(sock->state != SOCK_CLOSED && sock->state != SOCK_STATE_BOUND) {
+        rc = EBUSY;
+        goto done;
+    }
+
+    rc = Net_Get_Route(&device, ipAddress, &fGateway, &gateway);
+    if(rc != 0)
+        goto done;
+
+    Mutex_Lock(&s_socketMutex);
+    if(!sock->bound || sock->multihomed)
+        sock->localAddress = device->ipAddress;
+    if(!sock->bound) {
+        rc = Choose_Ephemeral_Port(SOCK_STREAM, &sock->localAddress);
+        if(rc >= 0) {
+            sock->localPort = rc;
+            sock->bound = true;
+            rc = 0;
+        }
+    }
+    sock->multihomed = false;
+    if(rc == 0) {
+        sock->remoteAddress = *ipAddress;
+        sock->remotePort = port;
+        Demux_Insert((struct Socket *)sock, SOCKET_CONNECTED);
+    }
+    Mutex_Unlock(&s_socketMutex);
+    if(rc != 0)
+        goto done;
+
+    Mutex_Lock(&sock->lock);
+    rc = TCP_Connect(sock);
+    Mutex_Unlock(&sock->lock);
+
+  done:
+    Put_Socket(sock);
     return rc;
 }
 
 int Socket_Bind(ulong_t id, ushort_t port, IP_Address * ipAddress) {
-    TODO_P(PROJECT_SOCKETS, "Bind");
-    return 0;
+    struct Socket *sock = Get_Socket(id);
+    int rc = 0;
+
+    if(sock == NULL)
+        return EINVALID;
+
+    Mutex_Lock(&s_socketMutex);
+    if(sock->bound)
+        rc = EINVALID;
+    else if(Port_In_Use(sock->type, port, ipAddress))
+        rc = EBUSY;
+    else {
+        sock->localPort = port;
+        sock->localAddress = *ipAddress;
+        sock->multihomed = ipAddress->address == INADDR_ANY;
+        sock->bound = true;
+        sock->state = SOCK_STATE_BOUND;
+        if(sock->type == SOCK_DGRAM)
+            Demux_Insert(sock, SOCKET_LISTENING);
+    }
+    Mutex_Unlock(&s_socketMutex);
+
+    Put_Socket(sock);
+    return rc;
 }
 
 int Socket_Listen(ulong_t id, ulong_t backlog) {
+    struct TCP_Socket *sock = Get_TCP_Socket(id);
     int rc = 0;
-    TODO_P(PROJECT_SOCKETS, "Listen");
+
+    if(sock == NULL)
+        return EINVALID;
+
+    Mutex_Lock(&s_socketMutex);
+    Mutex_Lock(&sock->lock);
+    if(sock->state != SOCK_STATE_BOUND) {
+        rc = EINVALID;
+    } else {
+        sock->backlogMaxSize = MAX(backlog, 1UL);
+        sock->backlog =
+            Malloc(sizeof(struct TCP_Connection) * sock->backlogMaxSize);
+        if(sock->backlog == NULL) {
+            rc = ENOMEM;
+        } else {
+            sock->backlogIndex = sock->backlogSize = 0;
+            sock->listening = true;
+            sock->state = SOCK_STATE_LISTENING;
+        }
+    }
+    Mutex_Unlock(&sock->lock);
+    if(rc == 0)
+        Demux_Insert((struct Socket *)sock, SOCKET_LISTENING);
+    Mutex_Unlock(&s_socketMutex);
+
+    Put_Socket(sock);
     return rc;
 }
 
 
 int Socket_Accept(ulong_t id, IP_Address * clientIpAddress,
                   ushort_t * clientPort) {
-    int fd = -1;
-    (void)clientIpAddress;
-    (void)clientPort;
-    TODO_P(PROJECT_SOCKETS, "Accept (returns a socket!)");
+    struct TCP_Socket *sock = Get_TCP_Socket(id);
+    struct TCP_Socket *client;
+    struct TCP_Connection connection;
+    int fd, rc;
+
+    if(sock == NULL)
+        return EINVALID;
+
+    Mutex_Lock(&sock->lock);
+    while (sock->state == SOCK_STATE_LISTENING && sock->backlogSize == 0)
+        Cond_Wait(&sock->listenCond, &sock->lock);
+    if(sock->state != SOCK_STATE_LISTENING) {
+        Mutex_Unlock(&sock->lock);
+        Put_Socket(sock);
+        return EINVALID;
+    }
+    connection = sock->backlog[sock->backlogIndex];
+    sock->backlogIndex = (sock->backlogIndex + 1) % sock->backlogMaxSize;
+    --sock->backlogSize;
+    Mutex_Unlock(&sock->lock);
+
+    fd = Socket_Create(SOCK_STREAM, sock->flags, sock->maxSendBuffer,
+                       sock->maxReceiveBuffer);
+    Put_Socket(sock);
+    if(fd < 0)
+        return fd;
+    client = Get_TCP_Socket(fd);
+    if(client == NULL)
+        return EINVALID;        /* closed by another thread already */
+
+    Mutex_Lock(&s_socketMutex);
+    client->localAddress = connection.targetAddress;
+    client->localPort = connection.targetPort;
+    client->remoteAddress = connection.address;
+    client->remotePort = connection.port;
+    client->bound = true;
+    Demux_Insert((struct Socket *)client, SOCKET_CONNECTED);
+    Mutex_Unlock(&s_socketMutex);
+
+    Mutex_Lock(&client->lock);
+    rc = TCP_Accept(client, &connection);
+    Mutex_Unlock(&client->lock);
+    Put_Socket(client);
+
+    if(rc != 0) {
+        Socket_Destroy(fd);
+        return rc;
+    }
+
+    *clientIpAddress = connection.address;
+    *clientPort = connection.port;
     return fd;
 }
 
 int Socket_Receive(ulong_t id, uchar_t * buffer, ulong_t bufferSize) {
-    TODO_P(PROJECT_SOCKETS, "Receive");
-    return 0;
+    struct Socket *sock = Get_Socket(id);
+    struct TCP_Socket *tcp;
+    int rc;
+
+    if(sock == NULL)
+        return EINVALID;
+    if(sock->type != SOCK_STREAM) {
+        Put_Socket(sock);
+        TODO_P(PROJECT_SOCKETS, "Receive on a UDP socket");
+        return EUNSUPPORTED;
+    }
+
+    tcp = (struct TCP_Socket *)sock;
+    Mutex_Lock(&tcp->lock);
+    rc = TCP_Receive(tcp, buffer, bufferSize);
+    Mutex_Unlock(&tcp->lock);
+
+    Put_Socket(sock);
+    return rc;
 }
 
 int Socket_Send(ulong_t id, uchar_t * buffer, ulong_t bufferSize) {
-    TODO_P(PROJECT_SOCKETS, "Send");
-    return 0;
+    struct Socket *sock = Get_Socket(id);
+    struct TCP_Socket *tcp;
+    int rc;
+
+    if(sock == NULL)
+        return EINVALID;
+    if(sock->type != SOCK_STREAM) {
+        Put_Socket(sock);
+        TODO_P(PROJECT_SOCKETS, "Send on a UDP socket");
+        return EUNSUPPORTED;
+    }
+
+    tcp = (struct TCP_Socket *)sock;
+    Mutex_Lock(&tcp->lock);
+    rc = TCP_Send(tcp, buffer, bufferSize);
+    Mutex_Unlock(&tcp->lock);
+
+    Put_Socket(sock);
+    return rc;
 }
 
 int Socket_Send_To(ulong_t id, uchar_t * buffer, ulong_t bufferSize,
@@ -77,31 +526,156 @@ int Socket_Receive_From(ulong_t id, uchar_t * buffer, ulong_t bufferSize,
     return 0;
 }
 
+/* free a socket right away, without closing its connection */
 int Socket_Destroy(ulong_t id) {
-    TODO_P(PROJECT_SOCKETS, "Socket Destroy");
-    return 0;
+    struct Socket *sock;
+
+    if(id >= MAX_SOCKETS)
+        return EINVALID;
+
+    Mutex_Lock(&s_socketMutex);
+    sock = s_sockets[id];
+    if(sock != NULL)
+        Retire_Socket(sock);
+    Mutex_Unlock(&s_socketMutex);
+
+    return sock != NULL ? 0 : EINVALID;
 }
 
 
 
+/*
+ * Closing a TCP socket starts the FIN exchange; the socket itself is
+ * freed by the timer once the connection has finished closing.
+ */
 int Socket_Close(ulong_t id) {
-    TODO_P(PROJECT_SOCKETS, "Socket Close");
-    return EUNSUPPORTED;
+    struct Socket *sock = Get_Socket(id);
+    struct TCP_Socket *tcp;
+
+    if(sock == NULL)
+        return EINVALID;
+    if(sock->type != SOCK_STREAM) {
+        Put_Socket(sock);
+        return Socket_Destroy(id);
+    }
+
+    tcp = (struct TCP_Socket *)sock;
+    Mutex_Lock(&tcp->lock);
+    tcp->closed = true;
+    TCP_Close(tcp);
+    if(tcp->listening) {
+        tcp->listening = false;
+        Cond_Broadcast(&tcp->listenCond);
+    }
+    Poll_Wake(&tcp->pollQueue);
+    Mutex_Unlock(&tcp->lock);
+
+    Put_Socket(sock);
+    return 0;
 }
 
+/*
+ * Readiness of a socket for Poll().  The entry is registered while
+ * the table lock is held, so the socket cannot be retired in between;
+ * retiring it detaches the entry again.
+ */
+int Socket_Poll(ulong_t id, struct Poll_Entry *entry) {
+    struct Socket *sock;
+    struct TCP_Socket *tcp;
+    int revents;
+
+    if(id >= MAX_SOCKETS)
+        return POLLNVAL;
+
+    Mutex_Lock(&s_socketMutex);
+    sock = s_sockets[id];
+    if(sock == NULL) {
+        Mutex_Unlock(&s_socketMutex);
+        return POLLNVAL;
+    }
+    if(sock->type != SOCK_STREAM) {
+        Mutex_Unlock(&s_socketMutex);
+        TODO_P(PROJECT_SOCKETS, "poll a datagram socket");
+        return POLLNVAL;
+    }
+
+    tcp = (struct TCP_Socket *)sock;
+    Mutex_Lock(&tcp->lock);
+    if(tcp->closed)
+        revents = POLLNVAL;
+    else {
+        if(entry != NULL)
+            Poll_Register(&tcp->pollQueue, entry);
+        revents = TCP_Poll(tcp);
+    }
+    Mutex_Unlock(&tcp->lock);
+    Mutex_Unlock(&s_socketMutex);
+
+    return revents;
+}
 
 
 int Socket_Dispatch(struct IP_Device *device, uchar_t type,
                     ushort_t destPort, ushort_t srcPort,
                     IP_Address * destAddress, IP_Address * srcAddress,
                     struct Net_Buf *nBuf, void *data) {
-    int rc = 0;
+    struct Socket *sock;
+    struct TCP_Socket *tcp;
+    int epoch, rc = 0;
     (void)device;
-    TODO_P(PROJECT_SOCKETS, "socket dispatch (received packet)");
+
+    epoch = Epoch_Read_Begin(&s_demuxEpoch);
+    sock = Demux_Lookup(type, destPort, srcPort, destAddress, srcAddress);
+    if(sock == NULL) {
+        rc = ENOTFOUND;
+    } else if(type != SOCK_STREAM) {
+        TODO_P(PROJECT_SOCKETS, "socket dispatch (received datagram)");
+    } else {
+        tcp = (struct TCP_Socket *)sock;
+        Mutex_Lock(&tcp->lock);
+        if(tcp->state == SOCK_CLOSED)
+            rc = ENOTFOUND;
+        else
+            TCP_Input(tcp, destAddress, srcAddress,
+                      (struct TCP_Segment *)data);
+        Mutex_Unlock(&tcp->lock);
+    }
+    Epoch_Read_End(&s_demuxEpoch, epoch);
+
     return rc;
 }
 
+/* alarm callback: run every TCP socket's timers and reap closed ones */
+static void Socket_Timer(void *data __attribute__ ((unused))) {
+    struct TCP_Socket *sock;
+    bool done;
+    int i;
+
+    Mutex_Lock(&s_socketMutex);
+    for(i = 0; i < MAX_SOCKETS; ++i) {
+        sock = (struct TCP_Socket *)s_sockets[i];
+        if(sock == NULL || sock->type != SOCK_STREAM)
+            continue;
+
+        Mutex_Lock(&sock->lock);
+        done = TCP_Timer(sock) && sock->closed;
+        Mutex_Unlock(&sock->lock);
+
+        if(done)
+            Retire_Socket((struct Socket *)sock);
+    }
+    Reclaim_Sockets();
+    Mutex_Unlock(&s_socketMutex);
+
+    Alarm_Create(Socket_Timer, NULL, TCP_TIMER_MS);
+}
+
 
 void Init_Sockets(void) {
-    TODO_P(PROJECT_SOCKETS, "initialization");
+    Mutex_Init(&s_socketMutex);
+    memset(s_sockets, '\0', sizeof(s_sockets));
+    memset(s_connectedHash, '\0', sizeof(s_connectedHash));
+    memset(s_listenHash, '\0', sizeof(s_listenHash));
+
+    Alarm_Create(Socket_Timer, NULL, TCP_TIMER_MS);
 }
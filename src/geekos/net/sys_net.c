@@ -50,14 +50,7 @@ extern int Sys_EthPacketSend(struct Interrupt_State *state) {
         goto fail;
     }
 
-    buffer = Malloc(bufLength);
-    if(buffer == 0)
-        return ENOMEM;
-
-    memset(buffer, '\0', bufLength);
-
     Copy_From_User(destAddress, state->edx, 6);
-    Copy_From_User(buffer, state->ebx, state->ecx);
 
     char *device_name;
     Copy_User_String(state->esi, state->edi, 10, &device_name);
@@ -66,27 +59,29 @@ extern int Sys_EthPacketSend(struct Interrupt_State *state) {
     if(rc != 0)
         goto fail;
 
-    rc = Net_Buf_Create(&nBuf);
+    /* copy the payload from user space straight behind the headroom
+       the ethernet header will be pushed into */
+    rc = Net_Buf_Create_Linear(&nBuf, NET_BUF_HEADROOM, bufLength);
     if(rc != 0)
         goto fail;
 
-    rc = Net_Buf_Prepend(nBuf, buffer, bufLength, NET_BUF_ALLOC_COPY);
-    if(rc != 0)
+    buffer = Net_Buf_Put(nBuf, bufLength);
+    memset(buffer, '\0', bufLength);
+    if(!Copy_From_User(buffer, state->ebx, state->ecx)) {
+        Net_Buf_Destroy(nBuf);
+        rc = EINVALID;
         goto fail;
+    }
 
     Deprecated_Enable_Interrupts();
 
     rc = Eth_Transmit(device, nBuf, destAddress, bufLength);
-    if(rc != 0)
-        goto fail;
 
     Net_Buf_Destroy(nBuf);
 
     Deprecated_Disable_Interrupts();
 
   fail:
-    Free(buffer);
-
     return rc;
 }
 
@@ -280,7 +275,7 @@ extern int Sys_RouteGet(struct Interrupt_State *state) {
         return ENOMEM;
 
     Deprecated_Enable_Interrupts();
-    TODO_P(PROJECT_ROUTING, "collect route table into routes");
+    rc = Net_Get_Route_Table(routes, state->ecx);
     Deprecated_Disable_Interrupts();
 
     if(rc < 0)
@@ -296,6 +291,53 @@ extern int Sys_RouteGet(struct Interrupt_State *state) {
     return rc;
 }
 
+/*
+ * Look up the route to a destination
+ * Params:
+ *   state->ebx - address of 4 byte destination address
+ *   state->ecx - number of lookups; each steps the destination by one
+ *   state->edx - address of structure to receive the last route found
+ */
+extern int Sys_RouteLookup(struct Interrupt_State *state) {
+    IP_Address destination, network;
+    Netmask netmask;
+    struct IP_Device *device;
+    struct IP_Route route;
+    bool fGateway;
+    IP_Address gateway;
+    ulong_t count = state->ecx == 0 ? 1 : state->ecx;
+    uint_t host;
+    int rc = 0;
+
+    if(!Copy_From_User(destination.ptr, state->ebx, 4))
+        return EINVALID;
+
+    Deprecated_Enable_Interrupts();
+    host = ((uint_t) destination.ptr[0] << 24) |
+        ((uint_t) destination.ptr[1] << 16) |
+        ((uint_t) destination.ptr[2] << 8) | destination.ptr[3];
+    while (count-- > 0 && rc == 0) {
+        destination.ptr[0] = host >> 24;
+        destination.ptr[1] = host >> 16;
+        destination.ptr[2] = host >> 8;
+        destination.ptr[3] = host++;
+        rc = Net_Get_Route_Info(&device, &destination, &network, &netmask,
+                                &fGateway, &gateway);
+    }
+    if(rc == 0)
+        rc = Net_Get_Route_Table_Entry(&network, &netmask, &route);
+    Deprecated_Disable_Interrupts();
+
+    if(rc != 0)
+        return rc;
+
+    if(state->edx != 0 &&
+       !Copy_To_User(state->edx, &route, sizeof(struct IP_Route)))
+        return EINVALID;
+
+    return 0;
+}
+
 /*
  * Configure the IP address mapping to devices
  * Params:
@@ -425,11 +467,14 @@ extern int Sys_IPSend(struct Interrupt_State *state) {
  * Params
  *   state->ebx - type
  *   state->ecx - flags
+ *   state->edx - send buffer size, 0 for the default
+ *   state->esi - receive buffer size, 0 for the default
  */
 extern int Sys_Socket(struct Interrupt_State *state) {
     int rc;
     Deprecated_Enable_Interrupts();
-    rc = Socket_Create((uchar_t) state->ebx, (int)state->ecx);
+    rc = Socket_Create((uchar_t) state->ebx, (int)state->ecx, state->edx,
+                       state->esi);
     Deprecated_Disable_Interrupts();
     return rc;
 }
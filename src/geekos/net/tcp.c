@@ -11,23 +11,1027 @@
 #include <geekos/malloc.h>
 #include <geekos/errno.h>
 #include <geekos/screen.h>
+#include <geekos/string.h>
+#include <geekos/timer.h>
+#include <geekos/net/net.h>
+#include <geekos/net/checksum.h>
 #include <geekos/net/socket.h>
-#include <geekos/projects.h>
+
+/*
+ * Data transfer follows RFC 793 with the usual refinements: the
+ * sender keeps up to min(peer window, congestion window) bytes in
+ * flight (slow start and congestion avoidance), retransmits on three
+ * duplicate ACKs and recovers NewReno-style, and times out with a
+ * Jacobson/Karels estimate of the round trip.  The receiver keeps
+ * out-of-order data in its ring, ACKs every second segment or after
+ * TCP_DELAYED_ACK_MS, and only reopens its window in useful steps.
+ */
+
+#define SEQ_LT(a, b) ((int)((a) - (b)) < 0)
+#define SEQ_LEQ(a, b) ((int)((a) - (b)) <= 0)
+#define SEQ_GT(a, b) ((int)((a) - (b)) > 0)
+#define SEQ_GEQ(a, b) ((int)((a) - (b)) >= 0)
+
+#define MS_TO_TICKS(ms) ((ulong_t) (ms) * TICKS_PER_SEC / 1000)
+#define DEADLINE_PASSED(deadline) ((int)(g_numTicks - (deadline)) >= 0)
+
+static ulong_t s_isnCounter;
+
+static bool Is_Synchronized(int state) {
+    switch (state) {
+        case SOCK_STATE_ESTABLISHED:
+        case SOCK_FIN_WAIT_1:
+        case SOCK_FIN_WAIT_2:
+        case SOCK_CLOSE_WAIT:
+        case SOCK_CLOSING:
+        case SOCK_LAST_ACK:
+        case SOCK_TIME_WAIT:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static ulong_t Round_Buffer_Size(ulong_t size) {
+    ulong_t rounded = SOCK_MIN_BUFFER_SIZE;
+
+    if(size == 0)
+        return SOCK_DEFAULT_BUFFER_SIZE;
+    while (rounded < size && rounded < SOCK_MAX_BUFFER_SIZE)
+        rounded <<= 1;
+    return rounded;
+}
+
+/* copy between a ring buffer and a linear one; seq picks the ring offset */
+static void Ring_Write(uchar_t * ring, ulong_t size, ulong_t seq,
+                       const uchar_t * src, ulong_t length) {
+    ulong_t offset = seq & (size - 1);
+    ulong_t first = MIN(length, size - offset);
+
+    memcpy(ring + offset, src, first);
+    memcpy(ring, src + first, length - first);
+}
+
+static void Ring_Read(const uchar_t * ring, ulong_t size, ulong_t seq,
+                      uchar_t * dest, ulong_t length) {
+    ulong_t offset = seq & (size - 1);
+    ulong_t first = MIN(length, size - offset);
+
+    memcpy(dest, ring + offset, first);
+    memcpy(dest + first, ring, length - first);
+}
+
+static void Ring_Write_Net_Buf(uchar_t * ring, ulong_t size, ulong_t seq,
+                               struct Net_Buf *nBuf, ulong_t start,
+                               ulong_t length) {
+    ulong_t offset = seq & (size - 1);
+    ulong_t first = MIN(length, size - offset);
+
+    Net_Buf_Extract(nBuf, start, ring + offset, first);
+    if(length > first)
+        Net_Buf_Extract(nBuf, start + first, ring, length - first);
+}
+
+/* checksum of a whole segment, header included, with its pseudo header */
+static int TCP_Checksum(IP_Address * srcAddress, IP_Address * destAddress,
+                        struct Net_Buf *nBuf, ushort_t * checksum) {
+    ulong_t length = NET_BUF_SIZE(nBuf);
+    uchar_t pseudo[12];
+    ulong_t sum;
+
+    memcpy(pseudo, srcAddress->ptr, 4);
+    memcpy(pseudo + 4, destAddress->ptr, 4);
+    pseudo[8] = 0;
+    pseudo[9] = IP_TCP_PROTOCOL;
+    pseudo[10] = length >> 8;
+    pseudo[11] = length;
+
+    sum = Checksum_Partial(0, pseudo, sizeof(pseudo));
+    if(Net_Buf_Checksum(nBuf, 0, length, &sum) != 0)
+        return EINVALID;
+    *checksum = Checksum_Fold(sum);
+    return 0;
+}
+
+static void Put16(uchar_t * p, ulong_t value) {
+    p[0] = value >> 8;
+    p[1] = value;
+}
+
+static void Put32(uchar_t * p, ulong_t value) {
+    p[0] = value >> 24;
+    p[1] = value >> 16;
+    p[2] = value >> 8;
+    p[3] = value;
+}
+
+static ulong_t Get16(const uchar_t * p) {
+    return ((ulong_t) p[0] << 8) | p[1];
+}
+
+static ulong_t Get32(const uchar_t * p) {
+    return ((ulong_t) p[0] << 24) | ((ulong_t) p[1] << 16) |
+        ((ulong_t) p[2] << 8) | p[3];
+}
 
 int TCP_Dispatch(struct IP_Device *device, IP_Address * destAddress,
                  IP_Address * srcAddress, struct Net_Buf *nBuf) {
-    TODO_P(PROJECT_TCP, "Find and remove the tcp header");
+    uchar_t header[60];
+    struct TCP_Segment segment;
+    ushort_t srcPort, destPort, checksum;
+    ulong_t headerLength, i;
+    int rc;
+
+    if(NET_BUF_SIZE(nBuf) < TCP_HEADER_SIZE)
+        goto drop;
+
+    Net_Buf_Extract(nBuf, 0, header, TCP_HEADER_SIZE);
+    headerLength = (header[12] >> 4) * 4;
+    if(headerLength < TCP_HEADER_SIZE || headerLength > NET_BUF_SIZE(nBuf))
+        goto drop;
+    Net_Buf_Extract(nBuf, 0, header, headerLength);
+
+    rc = TCP_Checksum(srcAddress, destAddress, nBuf, &checksum);
+    if(rc != 0 || checksum != 0)
+        goto drop;
 
-    TODO_P(PROJECT_TCP, "dispatch this packet's contents to socket");
+    segment.srcPort = srcPort = Get16(header);
+    segment.destPort = destPort = Get16(header + 2);
+    segment.seqNum = Get32(header + 4);
+    segment.ackNum = Get32(header + 8);
+    segment.flags = header[13];
+    segment.window = Get16(header + 14);
+    segment.mss = 0;
 
+    /* the only option we care about is the peer's MSS */
+    for(i = TCP_HEADER_SIZE; i < headerLength;) {
+        if(header[i] == 0)
+            break;
+        if(header[i] == 1) {
+            ++i;
+            continue;
+        }
+        if(i + 1 >= headerLength || header[i + 1] < 2)
+            break;
+        if(header[i] == TCP_OPTION_MSS && header[i + 1] == 4 &&
+           i + 4 <= headerLength)
+            segment.mss = Get16(header + i + 2);
+        i += header[i + 1];
+    }
+
+    Net_Buf_Remove(nBuf, 0, headerLength);
+    segment.length = NET_BUF_SIZE(nBuf);
+    segment.nBuf = nBuf;
+
+    rc = Socket_Dispatch(device, SOCK_STREAM, destPort, srcPort,
+                         destAddress, srcAddress, nBuf, &segment);
+    if(rc == ENOTFOUND && !(segment.flags & TCP_RST))
+        TCP_Send_Reset(destAddress, srcAddress, destPort, srcPort,
+                       &segment);
+
+  drop:
+    Net_Buf_Destroy(nBuf);
     return 0;
 }
 
+/*
+ * Put a TCP header in front of nBuf and hand it to IP.  SYNs carry
+ * our MSS.  Takes ownership of nBuf.
+ */
 int TCP_Transmit(IP_Address * srcAddress, IP_Address * destAddress,
                  ushort_t srcPort, ushort_t destPort, uchar_t flags,
                  ulong_t seqNum, ulong_t ackNum, ulong_t advertisedWindow,
                  struct Net_Buf *nBuf) {
-    int rc = 0;
-    TODO_P(PROJECT_TCP, "transmit with these params");
+    uchar_t header[TCP_HEADER_SIZE + 4];
+    ulong_t headerLength = TCP_HEADER_SIZE;
+    ushort_t checksum;
+    int rc;
+
+    if(flags & TCP_SYN) {
+        header[TCP_HEADER_SIZE] = TCP_OPTION_MSS;
+        header[TCP_HEADER_SIZE + 1] = 4;
+        Put16(header + TCP_HEADER_SIZE + 2, MSS);
+        headerLength += 4;
+    }
+
+    Put16(header, srcPort);
+    Put16(header + 2, destPort);
+    Put32(header + 4, seqNum);
+    Put32(header + 8, ackNum);
+    header[12] = (headerLength / 4) << 4;
+    header[13] = flags;
+    Put16(header + 14, MIN(advertisedWindow, TCP_MAX_WINDOW));
+    Put16(header + 16, 0);
+    Put16(header + 18, 0);
+
+    rc = Net_Buf_Prepend(nBuf, header, headerLength, NET_BUF_ALLOC_COPY);
+    if(rc != 0)
+        goto fail;
+
+    rc = TCP_Checksum(srcAddress, destAddress, nBuf, &checksum);
+    if(rc != 0)
+        goto fail;
+    Put16(header + 16, checksum);
+    if(Net_Buf_Data(nBuf) != NULL)
+        memcpy((uchar_t *) Net_Buf_Data(nBuf) + 16, header + 16, 2);
+    else {
+        Net_Buf_Remove(nBuf, 0, headerLength);
+        rc = Net_Buf_Prepend(nBuf, header, headerLength,
+                             NET_BUF_ALLOC_COPY);
+        if(rc != 0)
+            goto fail;
+    }
+
+    return IP_Transmit(srcAddress, destAddress, nBuf, 0, IP_TCP_PROTOCOL);
+
+  fail:
+    Net_Buf_Destroy(nBuf);
     return rc;
 }
+
+/* answer a segment that has no connection (RFC 793, "Reset Generation") */
+int TCP_Send_Reset(IP_Address * srcAddress, IP_Address * destAddress,
+                   ushort_t srcPort, ushort_t destPort,
+                   struct TCP_Segment *segment) {
+    struct Net_Buf *nBuf;
+    ulong_t seq = 0, ack = 0;
+    uchar_t flags = TCP_RST;
+    int rc;
+
+    if(segment->flags & TCP_ACK) {
+        seq = segment->ackNum;
+    } else {
+        ack = segment->seqNum + segment->length +
+            ((segment->flags & TCP_SYN) ? 1 : 0) +
+            ((segment->flags & TCP_FIN) ? 1 : 0);
+        flags |= TCP_ACK;
+    }
+
+    rc = Net_Buf_Create_Linear(&nBuf, NET_BUF_HEADROOM, 0);
+    if(rc != 0)
+        return rc;
+    rc = TCP_Transmit(srcAddress, destAddress, srcPort, destPort, flags,
+                      seq, ack, 0, nBuf);
+    return rc;
+}
+
+/* data bytes waiting in the receive ring */
+static ulong_t Receive_Buffered(struct TCP_Socket *sock) {
+    return sock->receiveNext - sock->receiveRead -
+        (sock->finReceived ? 1 : 0);
+}
+
+static ulong_t Receive_Window(struct TCP_Socket *sock) {
+    return MIN(sock->maxReceiveBuffer - Receive_Buffered(sock),
+               TCP_MAX_WINDOW);
+}
+
+/* send length bytes of the send ring starting at seq */
+static int Send_Segment(struct TCP_Socket *sock, ulong_t seq,
+                        ulong_t length, uchar_t flags) {
+    struct Net_Buf *nBuf;
+    ulong_t window = Receive_Window(sock);
+    int rc;
+
+    rc = Net_Buf_Create_Linear(&nBuf, NET_BUF_HEADROOM, length);
+    if(rc != 0)
+        return rc;
+    if(length > 0)
+        Ring_Read(sock->sendBuffer, sock->maxSendBuffer, seq,
+                  Net_Buf_Put(nBuf, length), length);
+
+    rc = TCP_Transmit(&sock->localAddress, &sock->remoteAddress,
+                      sock->localPort, sock->remotePort, flags, seq,
+                      (flags & TCP_ACK) ? sock->receiveNext : 0, window,
+                      nBuf);
+
+    if(flags & TCP_ACK) {
+        sock->ackPending = 0;
+        sock->receiveAdvertised = sock->receiveNext + window;
+    }
+    return rc;
+}
+
+static void Send_Ack(struct TCP_Socket *sock) {
+    Send_Segment(sock, sock->sendNext, 0, TCP_ACK);
+}
+
+static void Send_Syn(struct TCP_Socket *sock) {
+    Send_Segment(sock, sock->initialSendSeq, 0,
+                 sock->state == SOCK_STATE_CONNECTING_SERVER ?
+                 TCP_SYN | TCP_ACK : TCP_SYN);
+    if(sock->sendTimer == 0)
+        sock->sendTimer = g_numTicks + MS_TO_TICKS(sock->rto);
+}
+
+static void Restart_Send_Timer(struct TCP_Socket *sock) {
+    sock->sendTimer = sock->sendUnacked == sock->sendMax ? 0 :
+        g_numTicks + MS_TO_TICKS(sock->rto);
+}
+
+/*
+ * Send whatever the windows allow.  Short segments only go out when
+ * they finish the data written so far and nothing is in flight
+ * (Nagle), or when they carry the FIN.
+ */
+static void TCP_Output(struct TCP_Socket *sock) {
+    ulong_t flight, unsent, window, usable, length;
+    uchar_t flags;
+    bool fin;
+
+    if(!Is_Synchronized(sock->state))
+        return;
+
+    for(;;) {
+        flight = sock->sendNext - sock->sendUnacked;
+        unsent = sock->finSent ? 0 : sock->sendWritten - sock->sendNext;
+        window = MIN(sock->advertisedWindow, sock->congestionWindow);
+        usable = window > flight ? window - flight : 0;
+        length = MIN(MIN(unsent, usable), sock->mss);
+        fin = sock->finQueued && !sock->finSent && length == unsent;
+
+        if(length == 0 && !fin)
+            break;
+        if(length < sock->mss && !fin && (length < unsent || flight > 0))
+            break;
+
+        flags = TCP_ACK;
+        if(length > 0 && length == unsent)
+            flags |= TCP_PSH;
+        if(fin)
+            flags |= TCP_FIN;
+
+        /* time one segment per round trip, never a retransmitted one */
+        if(!sock->timingRtt && length > 0 &&
+           SEQ_GEQ(sock->sendNext, sock->sendMax)) {
+            sock->timingRtt = true;
+            sock->rttSeq = sock->sendNext + length;
+            sock->rttStart = g_numTicks;
+        }
+
+        Send_Segment(sock, sock->sendNext, length, flags);
+        sock->sendNext += length + (fin ? 1 : 0);
+        if(fin)
+            sock->finSent = true;
+        if(SEQ_GT(sock->sendNext, sock->sendMax))
+            sock->sendMax = sock->sendNext;
+        if(sock->sendTimer == 0)
+            sock->sendTimer = g_numTicks + MS_TO_TICKS(sock->rto);
+    }
+
+    /* a closed window needs probing, or we'd never hear it reopen */
+    if(sock->sendTimer == 0 && sock->advertisedWindow == 0 &&
+       SEQ_LT(sock->sendNext, sock->sendWritten))
+        sock->sendTimer = g_numTicks + MS_TO_TICKS(sock->rto);
+}
+
+/* resend the oldest unacknowledged segment */
+static void Retransmit_First(struct TCP_Socket *sock) {
+    ulong_t length = 0;
+    uchar_t flags = TCP_ACK;
+
+    if(SEQ_LT(sock->sendUnacked, sock->sendWritten))
+        length = MIN(sock->sendWritten - sock->sendUnacked, sock->mss);
+    if(sock->finSent && sock->sendUnacked + length == sock->sendWritten)
+        flags |= TCP_FIN;
+
+    sock->timingRtt = false;
+    Send_Segment(sock, sock->sendUnacked, length, flags);
+    sock->sendTimer = g_numTicks + MS_TO_TICKS(sock->rto);
+}
+
+static void Update_Rto(struct TCP_Socket *sock, int sample) {
+    int delta;
+
+    if(sock->smoothedRtt == 0) {
+        sock->smoothedRtt = sample << 3;
+        sock->rttVariance = sample << 1;
+    } else {
+        delta = sample - (sock->smoothedRtt >> 3);
+        sock->smoothedRtt += delta;
+        if(delta < 0)
+            delta = -delta;
+        sock->rttVariance += delta - (sock->rttVariance >> 2);
+    }
+
+    sock->rto = (sock->smoothedRtt >> 3) + sock->rttVariance;
+    sock->rto = MAX(sock->rto, TCP_RTO_MIN_MS);
+    sock->rto = MIN(sock->rto, TCP_RTO_MAX_MS);
+}
+
+static void Connection_Failed(struct TCP_Socket *sock, int error) {
+    sock->state = SOCK_STATE_ERROR;
+    sock->error = error;
+    sock->sendTimer = 0;
+    sock->ackPending = 0;
+    Cond_Broadcast(&sock->sendCond);
+    Cond_Broadcast(&sock->receiveCond);
+    Cond_Broadcast(&sock->closeCond);
+    Poll_Wake(&sock->pollQueue);
+}
+
+static void Enter_Time_Wait(struct TCP_Socket *sock) {
+    sock->state = SOCK_TIME_WAIT;
+    sock->sendTimer = 0;
+    sock->closeTimer = g_numTicks + MS_TO_TICKS(TCP_TIME_WAIT_MS);
+}
+
+static void Connection_Closed(struct TCP_Socket *sock) {
+    sock->state = SOCK_CLOSED;
+    sock->sendTimer = 0;
+    Cond_Broadcast(&sock->sendCond);
+    Cond_Broadcast(&sock->receiveCond);
+    Cond_Broadcast(&sock->closeCond);
+    Poll_Wake(&sock->pollQueue);
+}
+
+static void Process_Ack(struct TCP_Socket *sock, struct TCP_Segment *seg) {
+    ulong_t ack = seg->ackNum;
+    ulong_t acked, flight;
+
+    if(SEQ_GT(ack, sock->sendMax)) {
+        /* acknowledges something we never sent */
+        Send_Ack(sock);
+        return;
+    }
+
+    if(SEQ_GT(ack, sock->sendUnacked)) {
+        acked = ack - sock->sendUnacked;
+        sock->sendUnacked = ack;
+        if(SEQ_LT(sock->sendNext, ack))
+            sock->sendNext = ack;
+        sock->retries = 0;
+
+        if(sock->timingRtt && SEQ_GEQ(ack, sock->rttSeq)) {
+            sock->timingRtt = false;
+            Update_Rto(sock, (g_numTicks - sock->rttStart) * 1000 /
+                       TICKS_PER_SEC);
+        }
+
+        if(sock->fastRecovery) {
+            if(SEQ_GEQ(ack, sock->recoverySeq)) {
+                sock->fastRecovery = false;
+                sock->congestionWindow = sock->slowStartThreshold;
+            } else {
+                /* partial ACK: the next hole was lost too */
+                Retransmit_First(sock);
+                sock->congestionWindow -= MIN(acked,
+                                              sock->congestionWindow);
+                sock->congestionWindow += sock->mss;
+            }
+        } else if(sock->congestionWindow < sock->slowStartThreshold) {
+            sock->congestionWindow += MIN(acked, sock->mss);
+        } else {
+            sock->congestionWindow +=
+                MAX(sock->mss * sock->mss / sock->congestionWindow, 1UL);
+        }
+        sock->congestionWindow = MIN(sock->congestionWindow,
+                                     sock->maxSendBuffer + sock->mss);
+        sock->dupAcks = 0;
+        sock->advertisedWindow = seg->window;
+
+        Restart_Send_Timer(sock);
+        Cond_Broadcast(&sock->sendCond);
+        Poll_Wake(&sock->pollQueue);
+        return;
+    }
+
+    if(ack == sock->sendUnacked && seg->length == 0 &&
+       !(seg->flags & (TCP_SYN | TCP_FIN)) &&
+       seg->window == sock->advertisedWindow &&
+       sock->sendMax != sock->sendUnacked) {
+        if(++sock->dupAcks == TCP_DUP_ACK_THRESHOLD &&
+           !sock->fastRecovery) {
+            flight = sock->sendMax - sock->sendUnacked;
+            sock->slowStartThreshold = MAX(flight / 2, 2 * sock->mss);
+            sock->recoverySeq = sock->sendMax;
+            sock->fastRecovery = true;
+            Retransmit_First(sock);
+            sock->congestionWindow = sock->slowStartThreshold +
+                TCP_DUP_ACK_THRESHOLD * sock->mss;
+        } else if(sock->fastRecovery) {
+            /* each duplicate means a segment has left the network */
+            sock->congestionWindow += sock->mss;
+        }
+        return;
+    }
+
+    if(ack == sock->sendUnacked)
+        sock->advertisedWindow = seg->window;
+}
+
+/* note that [start, end) arrived early, merging with what we hold */
+static bool Add_Out_Of_Order(struct TCP_Socket *sock, ulong_t start,
+                             ulong_t end) {
+    struct TCP_Range *ranges = sock->outOfOrder;
+    int i, j;
+
+    for(i = 0; i < sock->outOfOrderCount; ++i) {
+        if(SEQ_LT(end, ranges[i].start))
+            break;
+        if(SEQ_LEQ(start, ranges[i].end)) {
+            /* overlaps or touches: grow it and swallow later ones */
+            if(SEQ_LT(start, ranges[i].start))
+                ranges[i].start = start;
+            if(SEQ_GT(end, ranges[i].end))
+                ranges[i].end = end;
+            while (i + 1 < sock->outOfOrderCount &&
+                   SEQ_GEQ(ranges[i].end, ranges[i + 1].start)) {
+                if(SEQ_GT(ranges[i + 1].end, ranges[i].end))
+                    ranges[i].end = ranges[i + 1].end;
+                for(j = i + 1; j + 1 < sock->outOfOrderCount; ++j)
+                    ranges[j] = ranges[j + 1];
+                --sock->outOfOrderCount;
+            }
+            return true;
+        }
+    }
+
+    if(sock->outOfOrderCount == TCP_MAX_OOO_RANGES)
+        return false;
+    for(j = sock->outOfOrderCount; j > i; --j)
+        ranges[j] = ranges[j - 1];
+    ranges[i].start = start;
+    ranges[i].end = end;
+    ++sock->outOfOrderCount;
+    return true;
+}
+
+/* advance receiveNext over early data the new bytes have joined up with */
+static bool Merge_Out_Of_Order(struct TCP_Socket *sock) {
+    struct TCP_Range *ranges = sock->outOfOrder;
+    bool merged = false;
+    int j;
+
+    while (sock->outOfOrderCount > 0 &&
+           SEQ_LEQ(ranges[0].start, sock->receiveNext)) {
+        if(SEQ_GT(ranges[0].end, sock->receiveNext))
+            sock->receiveNext = ranges[0].end;
+        for(j = 0; j + 1 < sock->outOfOrderCount; ++j)
+            ranges[j] = ranges[j + 1];
+        --sock->outOfOrderCount;
+        merged = true;
+    }
+    return merged;
+}
+
+/* store the segment's data; true if it should be ACKed right away */
+static bool Process_Data(struct TCP_Socket *sock, struct TCP_Segment *seg) {
+    ulong_t seq = seg->seqNum;
+    ulong_t length = seg->length;
+    ulong_t offset = 0;
+    ulong_t limit = sock->receiveRead + sock->maxReceiveBuffer;
+    bool ackNow = false;
+
+    if(SEQ_LT(seq, sock->receiveNext)) {
+        ulong_t skip = sock->receiveNext - seq;
+        if(skip >= length) {
+            /* nothing new; the peer may have lost our ACK */
+            return length > 0 || (seg->flags & TCP_FIN);
+        }
+        seq += skip;
+        offset = skip;
+        length -= skip;
+    }
+    if(SEQ_GEQ(seq, limit))
+        return true;
+    if(SEQ_GT(seq + length, limit))
+        length = limit - seq;
+    if(length == 0)
+        return false;
+
+    Ring_Write_Net_Buf(sock->receiveBuffer, sock->maxReceiveBuffer, seq,
+                       seg->nBuf, offset, length);
+
+    if(seq != sock->receiveNext) {
+        /* a hole in front: a duplicate ACK tells the sender */
+        Add_Out_Of_Order(sock, seq, seq + length);
+        return true;
+    }
+
+    sock->receiveNext += length;
+    if(Merge_Out_Of_Order(sock))
+        ackNow = true;
+    Cond_Broadcast(&sock->receiveCond);
+    Poll_Wake(&sock->pollQueue);
+
+    if(++sock->ackPending >= 2)
+        ackNow = true;
+    else if(sock->ackPending == 1)
+        sock->ackTimer = g_numTicks + MS_TO_TICKS(TCP_DELAYED_ACK_MS);
+    return ackNow;
+}
+
+static void Process_Fin(struct TCP_Socket *sock, struct TCP_Segment *seg) {
+    if(sock->finReceived || seg->seqNum + seg->length != sock->receiveNext)
+        return;
+
+    ++sock->receiveNext;
+    sock->finReceived = true;
+    Cond_Broadcast(&sock->receiveCond);
+    Poll_Wake(&sock->pollQueue);
+
+    switch (sock->state) {
+        case SOCK_STATE_ESTABLISHED:
+            sock->state = SOCK_CLOSE_WAIT;
+            break;
+        case SOCK_FIN_WAIT_1:
+            sock->state = SOCK_CLOSING;
+            break;
+        case SOCK_FIN_WAIT_2:
+            Enter_Time_Wait(sock);
+            break;
+    }
+}
+
+/* our FIN has been acknowledged */
+static void Fin_Acked(struct TCP_Socket *sock) {
+    switch (sock->state) {
+        case SOCK_FIN_WAIT_1:
+            sock->state = SOCK_FIN_WAIT_2;
+            break;
+        case SOCK_CLOSING:
+            Enter_Time_Wait(sock);
+            break;
+        case SOCK_LAST_ACK:
+            Connection_Closed(sock);
+            break;
+    }
+}
+
+static void Listen_Input(struct TCP_Socket *sock, IP_Address * destAddress,
+                         IP_Address * srcAddress, struct TCP_Segment *seg) {
+    struct TCP_Connection *connection;
+    ulong_t i;
+
+    if(seg->flags & TCP_RST)
+        return;
+    if(seg->flags & TCP_ACK) {
+        TCP_Send_Reset(destAddress, srcAddress, sock->localPort,
+                       seg->srcPort, seg);
+        return;
+    }
+    if(!(seg->flags & TCP_SYN))
+        return;
+
+    /* a retransmitted SYN for a connection not yet accepted */
+    for(i = 0; i < sock->backlogSize; ++i) {
+        connection = &sock->backlog[(sock->backlogIndex + i) %
+                                    sock->backlogMaxSize];
+        if(connection->address.address == srcAddress->address &&
+           connection->port == seg->srcPort)
+            return;
+    }
+
+    if(sock->backlogSize == sock->backlogMaxSize) {
+        sock->backlogOverflow = true;
+        return;
+    }
+
+    connection = &sock->backlog[(sock->backlogIndex + sock->backlogSize) %
+                                sock->backlogMaxSize];
+    connection->address = *srcAddress;
+    connection->port = seg->srcPort;
+    connection->sequenceNumber = seg->seqNum;
+    connection->targetPort = seg->destPort;
+    connection->targetAddress = *destAddress;
+    connection->mss = seg->mss;
+    ++sock->backlogSize;
+
+    Cond_Broadcast(&sock->listenCond);
+    Poll_Wake(&sock->pollQueue);
+}
+
+static void Established(struct TCP_Socket *sock, struct TCP_Segment *seg) {
+    sock->state = SOCK_STATE_ESTABLISHED;
+    sock->sendTimer = 0;
+    sock->retries = 0;
+    sock->advertisedWindow = seg->window;
+    Cond_Broadcast(&sock->sendCond);
+    Poll_Wake(&sock->pollQueue);
+}
+
+void TCP_Input(struct TCP_Socket *sock, IP_Address * destAddress,
+               IP_Address * srcAddress, struct TCP_Segment *seg) {
+    bool ackNow = false;
+
+    switch (sock->state) {
+        case SOCK_STATE_LISTENING:
+            Listen_Input(sock, destAddress, srcAddress, seg);
+            return;
+
+        case SOCK_STATE_CONNECTING_CLIENT:
+            if((seg->flags & TCP_ACK) &&
+               seg->ackNum != sock->initialSendSeq + 1) {
+                if(!(seg->flags & TCP_RST))
+                    TCP_Send_Reset(destAddress, srcAddress,
+                                   sock->localPort, sock->remotePort, seg);
+                return;
+            }
+            if(seg->flags & TCP_RST) {
+                if(seg->flags & TCP_ACK)
+                    Connection_Failed(sock, EPIPE);
+                return;
+            }
+            if(!(seg->flags & TCP_SYN) || !(seg->flags & TCP_ACK))
+                return;
+
+            sock->initialReceiveSeq = seg->seqNum;
+            sock->receiveNext = sock->receiveRead = seg->seqNum + 1;
+            sock->sendUnacked = seg->ackNum;
+            if(seg->mss != 0)
+                sock->mss = MIN(seg->mss, MSS);
+            sock->congestionWindow = 2 * sock->mss;
+            Established(sock, seg);
+            Send_Ack(sock);
+            return;
+
+        case SOCK_STATE_CONNECTING_SERVER:
+            if(seg->flags & TCP_RST) {
+                Connection_Failed(sock, EPIPE);
+                return;
+            }
+            if(seg->flags & TCP_SYN) {
+                /* our SYN-ACK was lost */
+                Send_Syn(sock);
+                return;
+            }
+            if(!(seg->flags & TCP_ACK))
+                return;
+            if(seg->ackNum != sock->initialSendSeq + 1) {
+                TCP_Send_Reset(destAddress, srcAddress, sock->localPort,
+                               sock->remotePort, seg);
+                return;
+            }
+            sock->sendUnacked = seg->ackNum;
+            Established(sock, seg);
+            break;
+
+        case SOCK_STATE_ERROR:
+        case SOCK_CLOSED:
+            return;
+    }
+
+    if(!Is_Synchronized(sock->state))
+        return;
+
+    if(seg->flags & TCP_RST) {
+        if(SEQ_GEQ(seg->seqNum, sock->receiveNext) &&
+           SEQ_LT(seg->seqNum, sock->receiveNext + Receive_Window(sock) + 1))
+            Connection_Failed(sock, EPIPE);
+        return;
+    }
+    if(seg->flags & TCP_SYN) {
+        Send_Ack(sock);
+        return;
+    }
+    if(!(seg->flags & TCP_ACK))
+        return;
+
+    Process_Ack(sock, seg);
+    if(sock->finSent && sock->sendUnacked == sock->sendWritten + 1)
+        Fin_Acked(sock);
+
+    if(seg->length > 0 && !sock->finReceived)
+        ackNow = Process_Data(sock, seg);
+    else if(seg->length > 0)
+        ackNow = true;
+
+    if(seg->flags & TCP_FIN) {
+        Process_Fin(sock, seg);
+        ackNow = true;
+    }
+
+    /* data going out carries the ACK for free */
+    if(ackNow && sock->ackPending == 0)
+        sock->ackPending = 1;
+    TCP_Output(sock);
+    if(ackNow && sock->ackPending > 0)
+        Send_Ack(sock);
+}
+
+int TCP_Socket_Init(struct TCP_Socket *sock, ulong_t sendBufferSize,
+                    ulong_t receiveBufferSize) {
+    sock->maxSendBuffer = Round_Buffer_Size(sendBufferSize);
+    sock->maxReceiveBuffer = Round_Buffer_Size(receiveBufferSize);
+    sock->sendBuffer = Malloc(sock->maxSendBuffer);
+    sock->receiveBuffer = Malloc(sock->maxReceiveBuffer);
+    if(sock->sendBuffer == NULL || sock->receiveBuffer == NULL) {
+        TCP_Socket_Free(sock);
+        return ENOMEM;
+    }
+
+    Mutex_Init(&sock->lock);
+    Cond_Init(&sock->sendCond);
+    Cond_Init(&sock->receiveCond);
+    Cond_Init(&sock->closeCond);
+    Cond_Init(&sock->listenCond);
+    Poll_Queue_Init(&sock->pollQueue);
+
+    sock->mss = MSS;
+    sock->rto = TCP_RTO_INITIAL_MS;
+    sock->congestionWindow = 2 * MSS;
+    sock->slowStartThreshold = TCP_MAX_WINDOW;
+    return 0;
+}
+
+void TCP_Socket_Free(struct TCP_Socket *sock) {
+    Free(sock->sendBuffer);
+    Free(sock->receiveBuffer);
+    Free(sock->backlog);
+    sock->sendBuffer = sock->receiveBuffer = NULL;
+    sock->backlog = NULL;
+}
+
+static void Choose_Initial_Sequence(struct TCP_Socket *sock) {
+    s_isnCounter += 64000;
+    sock->initialSendSeq = (g_numTicks << 8) + s_isnCounter;
+    sock->sendUnacked = sock->initialSendSeq;
+    sock->sendNext = sock->sendMax = sock->initialSendSeq + 1;
+    sock->sendWritten = sock->initialSendSeq + 1;
+}
+
+static int Wait_For_Established(struct TCP_Socket *sock, int connecting) {
+    while (sock->state == connecting)
+        Cond_Wait(&sock->sendCond, &sock->lock);
+    return Is_Synchronized(sock->state) ? 0 : sock->error;
+}
+
+/* active open: the socket's addresses and ports are already set */
+int TCP_Connect(struct TCP_Socket *sock) {
+    Choose_Initial_Sequence(sock);
+    sock->state = SOCK_STATE_CONNECTING_CLIENT;
+    Send_Syn(sock);
+    return Wait_For_Established(sock, SOCK_STATE_CONNECTING_CLIENT);
+}
+
+/* passive open of sock for a SYN that was queued on a listener */
+int TCP_Accept(struct TCP_Socket *sock, struct TCP_Connection *connection) {
+    sock->initialReceiveSeq = connection->sequenceNumber;
+    sock->receiveNext = sock->receiveRead = connection->sequenceNumber + 1;
+    if(connection->mss != 0)
+        sock->mss = MIN(connection->mss, MSS);
+    sock->congestionWindow = 2 * sock->mss;
+
+    Choose_Initial_Sequence(sock);
+    sock->state = SOCK_STATE_CONNECTING_SERVER;
+    Send_Syn(sock);
+    return Wait_For_Established(sock, SOCK_STATE_CONNECTING_SERVER);
+}
+
+/* copy into the send ring, waiting for room; returns bytes taken */
+int TCP_Send(struct TCP_Socket *sock, uchar_t * buffer, ulong_t bufferSize) {
+    ulong_t sent = 0, room, length;
+
+    while (sent < bufferSize) {
+        for(;;) {
+            if((sock->state != SOCK_STATE_ESTABLISHED &&
+                sock->state != SOCK_CLOSE_WAIT) || sock->finQueued)
+                goto done;
+            room = sock->maxSendBuffer -
+                (sock->sendWritten - sock->sendUnacked);
+            if(room > 0)
+                break;
+            Cond_Wait(&sock->sendCond, &sock->lock);
+        }
+
+        length = MIN(room, bufferSize - sent);
+        Ring_Write(sock->sendBuffer, sock->maxSendBuffer,
+                   sock->sendWritten, buffer + sent, length);
+        sock->sendWritten += length;
+        sent += length;
+
+        TCP_Output(sock);
+    }
+
+  done:
+    if(sent == 0 && bufferSize > 0)
+        return sock->error != 0 ? sock->error : EPIPE;
+    return sent;
+}
+
+/* take what has arrived, waiting for something; 0 at end of stream */
+int TCP_Receive(struct TCP_Socket *sock, uchar_t * buffer,
+                ulong_t bufferSize) {
+    ulong_t length, edge;
+
+    while (Receive_Buffered(sock) == 0) {
+        if(sock->finReceived)
+            return 0;
+        if(!Is_Synchronized(sock->state))
+            return sock->error != 0 ? sock->error : EINVALID;
+        Cond_Wait(&sock->receiveCond, &sock->lock);
+    }
+
+    length = MIN(Receive_Buffered(sock), bufferSize);
+    Ring_Read(sock->receiveBuffer, sock->maxReceiveBuffer,
+              sock->receiveRead, buffer, length);
+    sock->receiveRead += length;
+
+    /* tell the sender once the window has opened by a useful amount */
+    edge = sock->receiveNext + Receive_Window(sock);
+    if(!sock->finReceived &&
+       (int)(edge - sock->receiveAdvertised) >=
+       (int)MIN(sock->mss, sock->maxReceiveBuffer / 2))
+        Send_Ack(sock);
+
+    return length;
+}
+
+/* start an orderly close; data already written still goes out */
+int TCP_Close(struct TCP_Socket *sock) {
+    switch (sock->state) {
+        case SOCK_STATE_ESTABLISHED:
+            sock->state = SOCK_FIN_WAIT_1;
+            break;
+        case SOCK_CLOSE_WAIT:
+            sock->state = SOCK_LAST_ACK;
+            break;
+        case SOCK_FIN_WAIT_1:
+        case SOCK_FIN_WAIT_2:
+        case SOCK_CLOSING:
+        case SOCK_LAST_ACK:
+        case SOCK_TIME_WAIT:
+            return 0;
+        default:
+            Connection_Closed(sock);
+            return 0;
+    }
+
+    sock->finQueued = true;
+    Cond_Broadcast(&sock->sendCond);
+    Poll_Wake(&sock->pollQueue);
+    TCP_Output(sock);
+    return 0;
+}
+
+/* readiness for Poll(); see <geekos/poll.h> */
+int TCP_Poll(struct TCP_Socket *sock) {
+    int revents = 0;
+
+    if(sock->state == SOCK_STATE_LISTENING)
+        return sock->backlogSize > 0 ? POLLIN : 0;
+
+    if(Receive_Buffered(sock) > 0 || sock->finReceived)
+        revents |= POLLIN;
+    if((sock->state == SOCK_STATE_ESTABLISHED ||
+        sock->state == SOCK_CLOSE_WAIT) && !sock->finQueued &&
+       sock->sendWritten - sock->sendUnacked < sock->maxSendBuffer)
+        revents |= POLLOUT;
+    if(sock->state == SOCK_STATE_ERROR)
+        revents |= POLLERR | POLLIN;
+    else if(sock->state == SOCK_CLOSED)
+        revents |= POLLHUP;
+    return revents;
+}
+
+/*
+ * Run the socket's timers.  Returns true once the connection is over
+ * and the socket can be freed.
+ */
+bool TCP_Timer(struct TCP_Socket *sock) {
+    ulong_t flight;
+
+    if(sock->ackPending > 0 && DEADLINE_PASSED(sock->ackTimer))
+        Send_Ack(sock);
+
+    if(sock->state == SOCK_TIME_WAIT && DEADLINE_PASSED(sock->closeTimer))
+        Connection_Closed(sock);
+
+    if(sock->sendTimer != 0 && DEADLINE_PASSED(sock->sendTimer)) {
+        flight = sock->sendMax - sock->sendUnacked;
+        sock->sendTimer = 0;
+
+        if(Is_Synchronized(sock->state) && sock->advertisedWindow == 0 &&
+           SEQ_LT(sock->sendUnacked, sock->sendWritten)) {
+            /* zero window: probe with the oldest unacknowledged byte */
+            Send_Segment(sock, sock->sendUnacked, 1, TCP_ACK);
+            if(SEQ_LT(sock->sendNext, sock->sendUnacked + 1))
+                sock->sendNext = sock->sendUnacked + 1;
+            if(SEQ_LT(sock->sendMax, sock->sendNext))
+                sock->sendMax = sock->sendNext;
+            sock->rto = MIN(sock->rto * 2, TCP_RTO_MAX_MS);
+            sock->sendTimer = g_numTicks + MS_TO_TICKS(sock->rto);
+        } else if(++sock->retries > TCP_MAX_RETRIES) {
+            Connection_Failed(sock, ETIMEOUT);
+        } else {
+            sock->rto = MIN(sock->rto * 2, TCP_RTO_MAX_MS);
+            if(!Is_Synchronized(sock->state)) {
+                Send_Syn(sock);
+            } else {
+                /* assume everything in flight was lost: go back N */
+                sock->slowStartThreshold = MAX(flight / 2, 2 * sock->mss);
+                sock->congestionWindow = sock->mss;
+                sock->fastRecovery = false;
+                sock->dupAcks = 0;
+                sock->timingRtt = false;
+                sock->sendNext = sock->sendUnacked;
+                if(SEQ_LEQ(sock->sendUnacked, sock->sendWritten))
+                    sock->finSent = false;
+                TCP_Output(sock);
+            }
+        }
+    }
+
+    return sock->state == SOCK_CLOSED || sock->state == SOCK_STATE_ERROR;
+}
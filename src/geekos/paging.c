@@ -105,6 +105,8 @@ union type_pun_workaround {
 
     KASSERT(!Interrupts_Enabled());
 
+    ++get_current_thread(0)->stats.pageFaults;
+
     /* Get the address that caused the page fault */
     address = Get_Page_Fault_Address();
     Debug("Page fault @%lx\n", address);
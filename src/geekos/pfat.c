@@ -384,6 +384,7 @@ static const struct File_Ops s_pfatFileOps = {
     &PFAT_Seek,
     &PFAT_Close,
     0,                          /* Read_Entry */
+    0,                          /* Poll */
 };
 
 static int PFAT_FStat_Dir(struct File *dir, struct VFS_File_Stat *stat) {
@@ -440,6 +441,7 @@ static struct File_Ops s_pfatDirOps = {
     0,                          /* Seek */
     &PFAT_Close_Dir,
     &PFAT_Read_Entry,
+    0,                          /* Poll */
 };
 
 
@@ -16,12 +16,13 @@
 #include <geekos/errno.h>
 #include <geekos/projects.h>
 #include <geekos/int.h>
+#include <geekos/poll.h>
 
 
 const struct File_Ops Pipe_Read_Ops =
-    { NULL, Pipe_Read, NULL, NULL, Pipe_Close, NULL };
+    { NULL, Pipe_Read, NULL, NULL, Pipe_Close, NULL, Pipe_Poll };
 const struct File_Ops Pipe_Write_Ops =
-    { NULL, NULL, Pipe_Write, NULL, Pipe_Close, NULL };
+    { NULL, NULL, Pipe_Write, NULL, Pipe_Close, NULL, Pipe_Poll };
 
 int Pipe_Create(struct File **read_file, struct File **write_file) {
     TODO_P(PROJECT_PIPE, "Create a pipe");
@@ -42,3 +43,15 @@ int Pipe_Close(struct File *f) {
     TODO_P(PROJECT_PIPE, "Pipe close");
     return 0;
 }
+
+/*
+ * A pipe keeps a Poll_Queue, registers entry on it, and reports POLLIN
+ * when data is buffered or all writers are gone, POLLOUT when there
+ * is room or all readers are gone.  Pipe_Read and Pipe_Write call
+ * Poll_Wake() whenever they change either; Pipe_Close wakes too, and
+ * the last close calls Poll_Queue_Destroy().
+ */
+int Pipe_Poll(struct File *f, struct Poll_Entry *entry) {
+    TODO_P(PROJECT_PIPE, "Pipe poll");
+    return POLLIN | POLLOUT;
+}
@@ -0,0 +1,304 @@
+/*
+ * Readiness multiplexing over files, sockets and the keyboard
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#include <geekos/poll.h>
+#include <geekos/errno.h>
+#include <geekos/kthread.h>
+#include <geekos/int.h>
+#include <geekos/malloc.h>
+#include <geekos/string.h>
+#include <geekos/user.h>
+#include <geekos/timer.h>
+#include <geekos/vfs.h>
+#include <geekos/keyboard.h>
+#include <geekos/net/socket.h>
+
+/* longer timeouts are cut to this, so the tick count cannot overflow */
+#define POLL_MAX_TIMEOUT_MS (0x7fffffff / TICKS_PER_SEC)
+
+/*
+ * A thread in Poll() hangs one Poll_Entry on the poll queue of each
+ * object it watches, all pointing at its own Poll_Waiter, and sleeps
+ * on the waiter's thread queue.  Objects call Poll_Wake() when their
+ * state changes, which marks every watching waiter woken and wakes
+ * it; the poller then rescans.  Since a poller registers before it
+ * checks readiness, and only sleeps if nothing marked it woken since
+ * the scan began, a change during the scan is never missed.
+ *
+ * s_pollLock guards every poll queue, the woken flags and the list of
+ * waiters with a timeout pending.  Poll_Wake() runs from interrupt
+ * handlers, so it is only ever taken with interrupts disabled.
+ */
+static Spin_Lock_t s_pollLock;
+static struct Poll_Waiter *s_pollTimers;
+
+extern void Schedule_And_Unlock(Spin_Lock_t * unlock_me);
+
+void Poll_Queue_Init(struct Poll_Queue *queue) {
+    Clear_Poll_Entry_List(&queue->entries);
+}
+
+/* s_pollLock should be held, with interrupts disabled */
+static void Wake_Waiter(struct Poll_Waiter *waiter) {
+    waiter->woken = 1;
+    Wake_Up(&waiter->waitQueue);
+}
+
+void Poll_Register(struct Poll_Queue *queue, struct Poll_Entry *entry) {
+    bool iflag = Begin_Int_Atomic();
+
+    Spin_Lock(&s_pollLock);
+    entry->queue = queue;
+    Locked_Unchecked_Add_To_Back_Of_Poll_Entry_List(&queue->entries, entry);
+    Spin_Unlock(&s_pollLock);
+    End_Int_Atomic(iflag);
+}
+
+static void Poll_Unregister(struct Poll_Entry *entry) {
+    bool iflag = Begin_Int_Atomic();
+
+    Spin_Lock(&s_pollLock);
+    if(entry->queue != NULL) {
+        Locked_Remove_From_Poll_Entry_List(&entry->queue->entries, entry);
+        entry->queue = NULL;
+    }
+    Spin_Unlock(&s_pollLock);
+    End_Int_Atomic(iflag);
+}
+
+/* wake everything polling this object; safe from interrupt handlers */
+void Poll_Wake(struct Poll_Queue *queue) {
+    struct Poll_Entry *entry;
+    bool iflag;
+
+    /* pairs with the barrier in the lock taken by Poll_Register() */
+    __sync_synchronize();
+    if(Is_Poll_Entry_List_Empty(&queue->entries))
+        return;
+
+    iflag = Begin_Int_Atomic();
+    Spin_Lock(&s_pollLock);
+    for(entry = Get_Front_Of_Poll_Entry_List(&queue->entries);
+        entry != NULL; entry = Get_Next_In_Poll_Entry_List(entry))
+        Wake_Waiter(entry->waiter);
+    Spin_Unlock(&s_pollLock);
+    End_Int_Atomic(iflag);
+}
+
+/*
+ * The object is going away: wake its pollers and detach them, so
+ * they see it as invalid on their rescan and never touch it again.
+ */
+void Poll_Queue_Destroy(struct Poll_Queue *queue) {
+    struct Poll_Entry *entry;
+    bool iflag = Begin_Int_Atomic();
+
+    Spin_Lock(&s_pollLock);
+    while ((entry = Get_Front_Of_Poll_Entry_List(&queue->entries)) != NULL) {
+        Locked_Remove_From_Poll_Entry_List(&queue->entries, entry);
+        entry->queue = NULL;
+        Wake_Waiter(entry->waiter);
+    }
+    Spin_Unlock(&s_pollLock);
+    End_Int_Atomic(iflag);
+}
+
+/* timer callback, in interrupt context */
+static void Poll_Timeout(int id) {
+    struct Poll_Waiter **link, *waiter;
+
+    Spin_Lock(&s_pollLock);
+    for(link = &s_pollTimers; (waiter = *link) != NULL;
+        link = &waiter->timerNext) {
+        if(waiter->timerId == id) {
+            *link = waiter->timerNext;
+            Cancel_Timer(id);
+            waiter->timerId = 0;
+            waiter->timedOut = 1;
+            Wake_Waiter(waiter);
+            break;
+        }
+    }
+    Spin_Unlock(&s_pollLock);
+}
+
+static int Start_Poll_Timer(struct Poll_Waiter *waiter, int timeout) {
+    int ticks, id;
+    bool iflag;
+
+    if(timeout > POLL_MAX_TIMEOUT_MS)
+        timeout = POLL_MAX_TIMEOUT_MS;
+    ticks = (timeout * TICKS_PER_SEC + 999) / 1000;
+
+    iflag = Begin_Int_Atomic();
+    Spin_Lock(&s_pollLock);
+    id = Start_Timer(ticks, Poll_Timeout);
+    if(id > 0) {
+        waiter->timerId = id;
+        waiter->timerNext = s_pollTimers;
+        s_pollTimers = waiter;
+    }
+    Spin_Unlock(&s_pollLock);
+    End_Int_Atomic(iflag);
+
+    return id > 0 ? 0 : EBUSY;
+}
+
+static void Stop_Poll_Timer(struct Poll_Waiter *waiter) {
+    struct Poll_Waiter **link;
+    bool iflag = Begin_Int_Atomic();
+
+    Spin_Lock(&s_pollLock);
+    if(waiter->timerId != 0) {
+        for(link = &s_pollTimers; *link != waiter;
+            link = &(*link)->timerNext) ;
+        *link = waiter->timerNext;
+        Cancel_Timer(waiter->timerId);
+        waiter->timerId = 0;
+    }
+    Spin_Unlock(&s_pollLock);
+    End_Int_Atomic(iflag);
+}
+
+/* sleep unless something has woken the waiter since it was last reset */
+static void Poll_Sleep(struct Poll_Waiter *waiter) {
+    bool iflag = Begin_Int_Atomic();
+
+    Spin_Lock(&s_pollLock);
+    if(!waiter->woken) {
+        Add_To_Back_Of_Thread_Queue(&waiter->waitQueue, CURRENT_THREAD);
+        Schedule_And_Unlock(&s_pollLock);
+    } else {
+        Spin_Unlock(&s_pollLock);
+    }
+    End_Int_Atomic(iflag);
+}
+
+static void Poll_Reset(struct Poll_Waiter *waiter) {
+    bool iflag = Begin_Int_Atomic();
+
+    Spin_Lock(&s_pollLock);
+    waiter->woken = 0;
+    Spin_Unlock(&s_pollLock);
+    End_Int_Atomic(iflag);
+}
+
+/* readiness of one descriptor, registering entry on it if given */
+static int Poll_One(struct Poll_Descriptor *fd, struct Poll_Entry *entry) {
+    struct User_Context *userContext = CURRENT_THREAD->userContext;
+    struct File *file;
+
+    switch (fd->kind) {
+        case POLL_FILE:
+            if(userContext == NULL || fd->fd < 0 || fd->fd >= USER_MAX_FILES)
+                return POLLNVAL;
+            file = userContext->file_descriptor_table[fd->fd];
+            if(file == NULL)
+                return POLLNVAL;
+            return Poll_File(file, entry);
+        case POLL_SOCKET:
+            if(fd->fd < 0)
+                return POLLNVAL;
+            return Socket_Poll(fd->fd, entry);
+        case POLL_KEYBOARD:
+            return Keyboard_Poll(entry);
+        default:
+            return POLLNVAL;
+    }
+}
+
+/*
+ * Wait until at least one of the descriptors is ready, or timeout
+ * milliseconds pass (POLL_INFINITE waits forever, 0 just checks).
+ * Fills in each revents and returns how many descriptors are ready.
+ */
+int Poll(struct Poll_Descriptor *fds, int count, int timeout) {
+    struct Poll_Waiter waiter;
+    struct Poll_Entry *entries;
+    int i, ready, rc = 0;
+    bool registered = false;
+
+    if(count < 0 || count > POLL_MAX_DESCRIPTORS)
+        return EINVALID;
+
+    entries = Malloc(sizeof(struct Poll_Entry) * (count > 0 ? count : 1));
+    if(entries == NULL)
+        return ENOMEM;
+    memset(entries, '\0', sizeof(struct Poll_Entry) * count);
+    memset(&waiter, '\0', sizeof(waiter));
+    Clear_Thread_Queue(&waiter.waitQueue);
+    Spin_Lock_Init(&waiter.waitQueue.lock);
+    for(i = 0; i < count; ++i)
+        entries[i].waiter = &waiter;
+
+    for(;;) {
+        Poll_Reset(&waiter);
+
+        ready = 0;
+        for(i = 0; i < count; ++i) {
+            fds[i].revents = Poll_One(&fds[i],
+                                      registered ? NULL : &entries[i]);
+            fds[i].revents &= fds[i].events | POLLHUP | POLLERR | POLLNVAL;
+            if(fds[i].revents != 0)
+                ++ready;
+        }
+        registered = true;
+
+        if(ready > 0 || timeout == 0 || waiter.timedOut)
+            break;
+        if(timeout > 0 && waiter.timerId == 0) {
+            rc = Start_Poll_Timer(&waiter, timeout);
+            if(rc != 0)
+                break;
+        }
+
+        Poll_Sleep(&waiter);
+    }
+
+    Stop_Poll_Timer(&waiter);
+    for(i = 0; i < count; ++i)
+        Poll_Unregister(&entries[i]);
+    Free(entries);
+
+    return rc != 0 ? rc : ready;
+}
+
+/*
+ * Wait for readiness on a set of descriptors.
+ * Params:
+ *   state->ebx - user address of an array of struct Poll_Descriptor
+ *   state->ecx - number of descriptors
+ *   state->edx - timeout in milliseconds, or POLL_INFINITE
+ * Returns: number of ready descriptors (0 on timeout),
+ *   or error code (< 0) on error
+ */
+int Sys_Poll(struct Interrupt_State *state) {
+    struct Poll_Descriptor *fds;
+    int count = (int)state->ecx;
+    ulong_t size;
+    int rc;
+
+    if(count < 0 || count > POLL_MAX_DESCRIPTORS)
+        return EINVALID;
+
+    size = sizeof(struct Poll_Descriptor) * count;
+    fds = Malloc(size > 0 ? size : 1);
+    if(fds == NULL)
+        return ENOMEM;
+
+    if(!Copy_From_User(fds, state->ebx, size)) {
+        Free(fds);
+        return EINVALID;
+    }
+
+    rc = Poll(fds, count, (int)state->edx);
+
+    if(rc >= 0 && !Copy_To_User(state->ebx, fds, size))
+        rc = EINVALID;
+    Free(fds);
+    return rc;
+}
@@ -0,0 +1,144 @@
+/*
+ * Sampling profiler driven by the timer interrupt
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#include <geekos/profile.h>
+#include <geekos/cpuring.h>
+#include <geekos/errno.h>
+#include <geekos/defs.h>
+#include <geekos/int.h>
+#include <geekos/kthread.h>
+#include <geekos/smp.h>
+#include <geekos/synch.h>
+#include <geekos/user.h>
+
+/*
+ * Every CPU's timer interrupt calls Profile_Tick(), which every
+ * s_period ticks appends the interrupted EIP to that CPU's ring in
+ * s_samples; see cpuring.h.  Readers are serialized by s_profileMutex.
+ */
+static struct CPU_Rings s_samples =
+CPU_RINGS_INITIALIZER(struct Profile_Sample, PROFILE_RING_SIZE);
+static int s_countdown[MAX_CPUS];       /* ticks until each CPU's next sample */
+static volatile int s_profiling;
+static volatile int s_period;
+static volatile int s_flags;
+static struct Mutex s_profileMutex = MUTEX_INITIALIZER;
+
+/*
+ * Follow the saved frame pointers up the interrupted thread's kernel
+ * stack.  Every frame is checked to lie within the stack page and
+ * above the last, so code built without frame pointers only costs
+ * bogus entries, never a bad access.
+ */
+static int Walk_Stack(struct Kernel_Thread *current, ulong_t ebp,
+                      ulong_t * stack) {
+    ulong_t low = (ulong_t) current->stackPage, high = low + PAGE_SIZE;
+    ulong_t *frame;
+    int depth = 0;
+
+    if(current->stackPage == 0)
+        return 0;
+
+    while (depth < PROFILE_MAX_DEPTH && ebp >= low &&
+           ebp + 2 * sizeof(ulong_t) <= high && (ebp & 3) == 0) {
+        frame = (ulong_t *) ebp;
+        stack[depth++] = frame[1];
+        if(frame[0] <= ebp)
+            break;
+        ebp = frame[0];
+    }
+    return depth;
+}
+
+/* called from the timer interrupt on every CPU */
+void Profile_Tick(struct Interrupt_State *state, int cpu) {
+    struct Profile_Sample *sample;
+    struct Kernel_Thread *current;
+
+    if(!s_profiling)
+        return;
+    if(--s_countdown[cpu] > 0)
+        return;
+    s_countdown[cpu] = s_period;
+
+    sample = CPU_Ring_Reserve(&s_samples, cpu);
+    if(sample == NULL)
+        return;
+
+    current = CURRENT_THREAD;
+    sample->eip = state->eip;
+    sample->pid = current->pid;
+    sample->cpu = cpu;
+    sample->flags = 0;
+    sample->depth = 0;
+    if(Is_User_Interrupt(state))
+        sample->flags |= PROFILE_USER;
+    else if(s_flags & PROFILE_STACKS)
+        sample->depth = Walk_Stack(current, state->ebp, sample->stack);
+
+    CPU_Ring_Commit(&s_samples, cpu);
+}
+
+/* s_profileMutex should be held */
+static int Profile_Start(int period, int flags) {
+    int i, rc;
+
+    if(period <= 0 || (flags & ~PROFILE_STACKS) != 0)
+        return EINVALID;
+
+    s_profiling = 0;
+    rc = CPU_Rings_Start(&s_samples);
+    if(rc != 0)
+        return rc;
+
+    s_period = period;
+    s_flags = flags;
+    for(i = 0; i < MAX_CPUS; ++i)
+        s_countdown[i] = period;
+    __sync_synchronize();
+    s_profiling = 1;
+    return 0;
+}
+
+/* s_profileMutex should be held; returns samples dropped since the start */
+static int Profile_Stop(void) {
+    s_profiling = 0;
+    return CPU_Rings_Dropped(&s_samples);
+}
+
+/*
+ * Control the sampling profiler.
+ * Params:
+ *   state->ebx - PROFILE_START, PROFILE_STOP or PROFILE_READ
+ *   state->ecx - START: sampling period in ticks; READ: user buffer
+ *   state->edx - START: PROFILE_ flags; READ: buffer size in samples
+ * Returns: START: 0; STOP: samples dropped because a ring was full;
+ *   READ: samples copied; or error code (< 0) on error
+ */
+int Sys_Profile(struct Interrupt_State *state) {
+    int rc;
+
+    Mutex_Lock(&s_profileMutex);
+    switch (state->ebx) {
+        case PROFILE_START:
+            rc = Profile_Start((int)state->ecx, (int)state->edx);
+            break;
+        case PROFILE_STOP:
+            rc = Profile_Stop();
+            break;
+        case PROFILE_READ:
+            rc = (int)state->edx < 0 ? EINVALID :
+                CPU_Rings_Read(&s_samples, state->ecx, (int)state->edx);
+            break;
+        default:
+            rc = EINVALID;
+            break;
+    }
+    Mutex_Unlock(&s_profileMutex);
+
+    return rc;
+}
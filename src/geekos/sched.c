@@ -12,6 +12,7 @@
 #include <geekos/projects.h>
 #include <geekos/smp.h>
 #include <geekos/synch.h>
+#include <geekos/trace.h>
 
 /* The lock associated with the run queue(s). */
 static Spin_Lock_t run_queue_spinlock;
@@ -97,6 +98,18 @@ static __inline__ struct Kernel_Thread *Find_Best(struct Thread_Queue
     return best;
 }
 
+/* Count a switch from the current thread to next, which may be the same. */
+static void Account_Switch(struct Kernel_Thread *next) {
+    struct Kernel_Thread *current = get_current_thread(0);
+
+    if(next != current) {
+        ++current->stats.switches;
+        ++CPUs[Get_CPU_ID()].switches;
+    }
+    next->stats.lastCore = Get_CPU_ID();
+    TRACE(TRACE_SCHED_SWITCH, current->pid, next->pid, 0, 0);
+}
+
 /*
  * Get the next runnable thread from the run queue.
  * This is the scheduler.
@@ -159,9 +172,79 @@ struct Kernel_Thread *Get_Next_Runnable(void) {
     KASSERT(((unsigned long)(ret->esp - 1) & ~0xfff) ==
             ((unsigned long)ret->stackPage));
 
+    Account_Switch(ret);
+
     return ret;
 }
 
+/*
+ * Per CPU, a thread that switched away with Switch_To_Woken_And_Unlock
+ * and is still to be made runnable.
+ */
+static struct Kernel_Thread *s_yieldedThread[MAX_CPUS];
+
+/*
+ * Directed yield: switch straight to kthread, just taken off a wait
+ * queue, instead of making kthread runnable and leaving the choice to
+ * the scheduler; the current thread stays runnable.  Must be called
+ * with interrupts disabled; unlock_me is released just before the
+ * switch.
+ *
+ * Only safe if kthread has finished switching out, which is certain
+ * when it last ran on this CPU; see Can_Switch_To_Woken.  For the same
+ * reason the current thread is only put on the run queue once kthread
+ * is running and its own context is saved, by Finish_Switch.
+ */
+void Switch_To_Woken_And_Unlock(struct Kernel_Thread *kthread,
+                                Spin_Lock_t * unlock_me) {
+    struct Kernel_Thread *current = get_current_thread(0);
+    int cpuID = Get_CPU_ID();
+
+    KASSERT(!Interrupts_Enabled());
+    KASSERT(Can_Switch_To_Woken(kthread));
+    KASSERT(s_yieldedThread[cpuID] == NULL);
+
+    g_preemptionDisabled[cpuID] = false;
+    s_yieldedThread[cpuID] = current;
+    ++current->stats.voluntarySwitches;
+    Account_Switch(kthread);
+
+    Spin_Unlock(unlock_me);
+    Switch_To_Thread(kthread);
+    Finish_Switch();
+}
+
+/*
+ * Called, with interrupts disabled, by a thread that slept in
+ * Schedule or Schedule_And_Unlock as soon as it runs again: requeue
+ * a thread that switched to it with Switch_To_Woken_And_Unlock, now
+ * that nothing is running on that thread's stack.
+ */
+void Finish_Switch(void) {
+    int cpuID = Get_CPU_ID();
+    struct Kernel_Thread *yielded = s_yieldedThread[cpuID];
+
+    if(yielded != NULL) {
+        s_yieldedThread[cpuID] = NULL;
+        Make_Runnable(yielded);
+    }
+}
+
+/*
+ * True if a thread just taken off a wait queue may be switched to
+ * directly on this CPU: it last ran (and so blocked) here, and its
+ * affinity allows this CPU.  Interrupts should be disabled.
+ */
+bool Can_Switch_To_Woken(const struct Kernel_Thread *kthread) {
+    int cpuID = Get_CPU_ID();
+
+    return kthread->stats.lastCore == cpuID &&
+        (kthread->affinity == AFFINITY_ANY_CORE ||
+         kthread->affinity == cpuID) &&
+        kthread->priority != PRIORITY_IDLE &&
+        get_current_thread(0)->priority != PRIORITY_IDLE;
+}
+
 
 /* This helper function is meant to facilitate implementing PS */
 int Is_Thread_On_Run_Queue(const struct Kernel_Thread *thread) {
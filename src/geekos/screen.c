@@ -15,6 +15,9 @@
 #include <geekos/fmtout.h>
 #include <geekos/screen.h>
 #include <geekos/lock.h>
+#include <geekos/kthread.h>
+#include <geekos/string.h>
+#include <geekos/serial.h>
 
 /*
  * Information sources for VT100 and ANSI escape sequences:
@@ -53,38 +56,144 @@ struct Console_State {
 
 static struct Console_State s_cons;
 
-#define NUM_SCREEN_DWORDS ((NUMROWS * NUMCOLS * 2) / 4)
-#define NUM_SCROLL_DWORDS (((NUMROWS-1) * NUMCOLS * 2) / 4)
-#define NUM_DWORDS_PER_LINE ((NUMCOLS*2)/4)
-#define FILL_DWORD (0x00200020 | (s_cons.currentAttr<<24) | (s_cons.currentAttr<<8))
+/*
+ * Output is drawn into s_cells, a copy of the screen kept in ordinary
+ * memory, and copied to video memory a row at a time by Flush_Screen()
+ * once a batch is done.  The rows form a ring starting at s_topRow,
+ * so scrolling moves no text; after any scroll the whole screen is
+ * copied once, however many lines the batch scrolled.  The hardware
+ * cursor is likewise only moved at the end of a batch.
+ */
+static ushort_t s_cells[NUMROWS][NUMCOLS];
+static int s_topRow;
+static uint_t s_dirtyRows;      /* screen rows to copy out, one bit each */
+static int s_cursorPos;         /* where the hardware cursor is */
+
+#define ALL_ROWS ((1U << NUMROWS) - 1)
+#define CELL(c) ((ushort_t) ((uchar_t) (c) | (s_cons.currentAttr << 8)))
+
+/*
+ * Sys_PrintString() queues user output in s_ring, to be drawn by the
+ * console thread, so printing costs a process no more than a copy.
+ * Everything else writes synchronously, but first draws whatever is
+ * queued, so output always appears in the order it was written.
+ */
+#define CONSOLE_RING_SIZE 16384
+#define CONSOLE_BATCH 1024      /* most the thread draws per lock hold */
+#define CONSOLE_LOCK_TRIES 1000000      /* before a shutdown flush gives up */
+
+static char s_ring[CONSOLE_RING_SIZE];
+static volatile ulong_t s_ringHead;     /* next byte to fill */
+static volatile ulong_t s_ringTail;     /* next byte to draw */
+static struct Thread_Queue s_consoleWaitQueue;
+static struct Kernel_Thread *s_consoleThread;
 
-/* This module called Begin_Int_Atomic lots for locking.
-   Removed 16au.  Left placeholders in case necessary. */
+/*
+ * s_consoleLock guards all of the above and is only taken with
+ * interrupts disabled, so Print() is safe from interrupt handlers.
+ * It is not used until the console thread exists: before then only
+ * the boot CPU is running and get_current_thread(), which Spin_Lock()
+ * calls, may not work yet.
+ *
+ * The only way to lock the console again while holding it is a
+ * failed KASSERT in the console code itself, whose message would
+ * otherwise deadlock; the holder goes straight through instead, and
+ * s_consoleNesting counts how deep.
+ */
+static Spin_Lock_t s_consoleLock;
+static int s_consoleNesting;
+
+static bool Lock_Console(void) {
+    bool iflag = Begin_Int_Atomic();
+    if(s_consoleThread == 0)
+        return iflag;
+    if(Is_Locked(&s_consoleLock) &&
+       s_consoleLock.locker == get_current_thread(0))
+        ++s_consoleNesting;
+    else
+        Spin_Lock(&s_consoleLock);
+    return iflag;
+}
+static void Unlock_Console(bool iflag) {
+    if(s_consoleThread == 0)
+        ;
+    else if(s_consoleNesting > 0)
+        --s_consoleNesting;
+    else
+        Spin_Unlock(&s_consoleLock);
+    End_Int_Atomic(iflag);
+}
+
+static void Put_Buf_Imp(const char *buf, ulong_t length);
+
+/* draw up to max queued bytes; the console should be locked */
+static void Drain_Ring(ulong_t max) {
+    ulong_t count = MIN(s_ringHead - s_ringTail, max);
+    ulong_t offset = s_ringTail % CONSOLE_RING_SIZE;
+    ulong_t first = MIN(count, CONSOLE_RING_SIZE - offset);
+
+    Put_Buf_Imp(s_ring + offset, first);
+    Put_Buf_Imp(s_ring, count - first);
+    s_ringTail += count;
+}
+
+static void Flush_Screen(void);
+static void Reset(void);
+
+/*
+ * Lock the console for synchronous output, drawing what is queued.
+ * A backlog is drawn a batch per lock hold, so interrupts are never
+ * off for longer than a batch takes.  A caller that may sleep first
+ * waits, before each batch, for the serial port to have room for the
+ * batch and as much again of its own output.  Nested in a failed
+ * assertion, the queue is left alone and any half-read escape
+ * sequence dropped.
+ */
 static bool Lock_Screen(void) {
-    return false;
+    bool mayWait = s_consoleThread != 0 && Interrupts_Enabled();
+    bool iflag;
+
+    if(mayWait)
+        Serial_Wait_Room(2 * CONSOLE_BATCH);
+    iflag = Lock_Console();
+    if(s_consoleNesting > 0) {
+        Reset();
+        return iflag;
+    }
+    while (s_ringHead - s_ringTail > CONSOLE_BATCH) {
+        Drain_Ring(CONSOLE_BATCH);
+        Flush_Screen();
+        Unlock_Console(iflag);
+        if(mayWait)
+            Serial_Wait_Room(2 * CONSOLE_BATCH);
+        iflag = Lock_Console();
+    }
+    Drain_Ring(CONSOLE_BATCH);
+    return iflag;
 }
 static void Unlock_Screen(bool iflag) {
-    (void)iflag;
+    Flush_Screen();
+    Unlock_Console(iflag);
+}
+
+static ushort_t *Row_Cells(int row) {
+    return s_cells[(s_topRow + row) % NUMROWS];
+}
+
+static void Fill_Cells(ushort_t * cell, int n) {
+    ushort_t fill = CELL(' ');
+    while (n-- > 0)
+        *cell++ = fill;
 }
 
 /*
- * Scroll the display one line.
- * We speed things up by copying 4 bytes at a time.
+ * Scroll the display one line: the old top row becomes the bottom
+ * row, cleared.
  */
 static void Scroll(void) {
-    uint_t *v;
-    int i, n = NUM_SCROLL_DWORDS;
-    uint_t fill = FILL_DWORD;
-
-    /* Move lines 1..NUMROWS-1 up one position. */
-    for(v = (uint_t *) VIDMEM, i = 0; i < n; ++i) {
-        *v = *(v + NUM_DWORDS_PER_LINE);
-        ++v;
-    }
-
-    /* Clear out last line. */
-    for(v = (uint_t *) VIDMEM + n, i = 0; i < NUM_DWORDS_PER_LINE; ++i)
-        *v++ = fill;
+    s_topRow = (s_topRow + 1) % NUMROWS;
+    Fill_Cells(Row_Cells(NUMROWS - 1), NUMCOLS);
+    s_dirtyRows = ALL_ROWS;
 }
 
 /*
@@ -92,12 +201,14 @@ static void Scroll(void) {
  * current attribute.
  */
 static void Clear_To_EOL(void) {
-    int n = (NUMCOLS - s_cons.col);
-    uchar_t *v = VIDMEM + s_cons.row * (NUMCOLS * 2) + s_cons.col * 2;
-    while (n-- > 0) {
-        *v++ = ' ';
-        *v++ = s_cons.currentAttr;
-    }
+    Fill_Cells(Row_Cells(s_cons.row) + s_cons.col, NUMCOLS - s_cons.col);
+    s_dirtyRows |= 1U << s_cons.row;
+}
+
+/* Clear the whole screen using the current attribute. */
+static void Clear_Cells(void) {
+    Fill_Cells(&s_cells[0][0], NUMROWS * NUMCOLS);
+    s_dirtyRows = ALL_ROWS;
 }
 
 /*
@@ -119,11 +230,9 @@ static void Newline(void) {
  * necessary.
  */
 static void Put_Graphic_Char(int c) {
-    uchar_t *v = VIDMEM + s_cons.row * (NUMCOLS * 2) + s_cons.col * 2;
-
     /* Put character at current position */
-    *v++ = (uchar_t) c;
-    *v = s_cons.currentAttr;
+    Row_Cells(s_cons.row)[s_cons.col] = CELL(c);
+    s_dirtyRows |= 1U << s_cons.row;
 
     if(s_cons.col < NUMCOLS - 1)
         ++s_cons.col;
@@ -350,8 +459,8 @@ static void Put_Char_Imp(int c) {
                     break;
                 case 'J':
                     if(s_cons.numArgs == 1 && Get_Arg(0) == 2) {
-                        Clear_Screen();
-                        Put_Cursor(0, 0);
+                        Clear_Cells();
+                        Move_Cursor(0, 0);
                     }
                     break;
                 default:
@@ -398,6 +507,110 @@ static void Update_Cursor(void) {
 
     /* Restore contents of the CRT address register */
     Out_Byte(CRT_ADDR_REG, origAddr);
+
+    s_cursorPos = characterPos;
+}
+
+/*
+ * Copy the rows changed since the last flush to video memory, and
+ * move the hardware cursor if it is out of date.
+ */
+static void Flush_Screen(void) {
+    int row;
+
+    for(row = 0; s_dirtyRows != 0; ++row) {
+        if(s_dirtyRows & (1U << row)) {
+            memcpy(VIDMEM + row * (NUMCOLS * 2), Row_Cells(row),
+                   NUMCOLS * 2);
+            s_dirtyRows &= ~(1U << row);
+        }
+    }
+
+    if(s_cursorPos != s_cons.row * NUMCOLS + s_cons.col)
+        Update_Cursor();
+}
+
+/* characters Put_Char_Imp() would just draw */
+static __inline__ bool Is_Plain(char c) {
+    return c != ESC && c != '\n' && c != '\t';
+}
+
+/*
+ * Draw a run of plain characters straight into the rows, a row's worth
+ * at a time.
+ */
+static void Put_Plain_Run(const char *buf, ulong_t length) {
+    ushort_t *cell;
+    ulong_t i, n;
+
+    while (length > 0) {
+        cell = Row_Cells(s_cons.row) + s_cons.col;
+        n = MIN(length, (ulong_t) (NUMCOLS - s_cons.col));
+        for(i = 0; i < n; ++i)
+            cell[i] = CELL(buf[i]);
+#ifndef NDEBUG
+        /* see Output_Literal_Character() */
+        for(i = 0; i < n; ++i)
+            Out_Byte(0xE9, buf[i]);
+#endif
+        s_dirtyRows |= 1U << s_cons.row;
+
+        s_cons.col += n;
+        if(s_cons.col == NUMCOLS)
+            Newline();
+        buf += n;
+        length -= n;
+    }
+}
+
+/* the console should be locked */
+static void Put_Buf_Imp(const char *buf, ulong_t length) {
+    ulong_t n;
+
+    Serial_Put_Buf(buf, length);
+
+    while (length > 0) {
+        if(s_cons.state == S_NORMAL && Is_Plain(*buf)) {
+            for(n = 1; n < length && Is_Plain(buf[n]); ++n) ;
+            Put_Plain_Run(buf, n);
+        } else {
+            Put_Char_Imp(*buf);
+            n = 1;
+        }
+        buf += n;
+        length -= n;
+    }
+}
+
+extern void Schedule_And_Unlock(Spin_Lock_t * unlock_me);
+
+/*
+ * Draw queued output a batch at a time, sleeping while there is none
+ * or while the serial port has no room for a batch.  A writer that
+ * finds the ring empty wakes us; one that finds it full draws the
+ * backlog and its own output itself.
+ */
+static void Console_Thread(ulong_t arg __attribute__ ((unused))) {
+    struct Kernel_Thread *current = CURRENT_THREAD;
+    bool iflag;
+
+    for(;;) {
+        iflag = Begin_Int_Atomic();
+        Lock_Thread_Queue(&s_consoleWaitQueue);
+        if(s_ringHead == s_ringTail) {
+            Locked_Unchecked_Add_To_Back_Of_Thread_Queue(&s_consoleWaitQueue,
+                                                         current);
+            Schedule_And_Unlock(&s_consoleWaitQueue.lock);
+        } else
+            Unlock_Thread_Queue(&s_consoleWaitQueue);
+        End_Int_Atomic(iflag);
+
+        Serial_Wait_Room(CONSOLE_BATCH);
+        iflag = Lock_Console();
+        Drain_Ring(CONSOLE_BATCH);
+        Flush_Screen();
+        Unlock_Console(iflag);
+    }
 }
 
 /* ----------------------------------------------------------------------
@@ -410,22 +623,26 @@ static void Update_Cursor(void) {
 void Init_Screen(void) {
     s_cons.row = s_cons.col = 0;
     s_cons.currentAttr = DEFAULT_ATTRIBUTE;
+    s_cursorPos = -1;
     Clear_Screen();
 }
 
+/*
+ * Start the thread that draws output queued by Put_Buf_Async().
+ * Call once the scheduler is running, before other CPUs are released.
+ */
+void Init_Console_Thread(void) {
+    s_consoleThread =
+        Start_Kernel_Thread(Console_Thread, 0, PRIORITY_LOW, true,
+                            "{Console}");
+}
+
 /*
  * Clear the screen using the current attribute.
  */
 void Clear_Screen(void) {
-    uint_t *v = (uint_t *) VIDMEM;
-    int i;
-    uint_t fill = FILL_DWORD;
-
     bool iflag = Lock_Screen();
-
-    for(i = 0; i < NUM_SCREEN_DWORDS; ++i)
-        *v++ = fill;
-
+    Clear_Cells();
     Unlock_Screen(iflag);
 }
 
@@ -453,7 +670,6 @@ bool Put_Cursor(int row, int col) {
     iflag = Lock_Screen();
     s_cons.row = row;
     s_cons.col = col;
-    Update_Cursor();
     Unlock_Screen(iflag);
 
     return true;
@@ -463,7 +679,10 @@ bool Put_Cursor(int row, int col) {
  * Get the current character attribute.
  */
 uchar_t Get_Current_Attr(void) {
-    return s_cons.currentAttr;
+    bool iflag = Lock_Screen();
+    uchar_t attrib = s_cons.currentAttr;
+    Unlock_Screen(iflag);
+    return attrib;
 }
 
 /*
@@ -480,9 +699,9 @@ void Set_Current_Attr(uchar_t attrib) {
  * using current attribute, handling scrolling, special characters, etc.
  */
 void Put_Char(int c) {
+    char ch = c;
     bool iflag = Lock_Screen();
-    Put_Char_Imp(c);
-    Update_Cursor();
+    Put_Buf_Imp(&ch, 1);
     Unlock_Screen(iflag);
 }
 
@@ -492,9 +711,7 @@ void Put_Char(int c) {
  */
 void Put_String(const char *s) {
     bool iflag = Lock_Screen();
-    while (*s != '\0')
-        Put_Char_Imp(*s++);
-    Update_Cursor();
+    Put_Buf_Imp(s, strlen(s));
     Unlock_Screen(iflag);
 }
 
@@ -504,23 +721,90 @@ void Put_String(const char *s) {
  */
 void Put_Buf(const char *buf, ulong_t length) {
     bool iflag = Lock_Screen();
-    while (length > 0) {
-        Put_Char_Imp(*buf++);
-        --length;
-    }
-    Update_Cursor();
+    Put_Buf_Imp(buf, length);
     Unlock_Screen(iflag);
 }
 
-/* Support for Print(). */
-static void Print_Emit(struct Output_Sink *o
-                       __attribute__ ((unused)), int ch) {
-    Put_Char_Imp(ch);
+/*
+ * Queue a buffer of characters for the console thread to write, so
+ * the caller need not wait for it to be drawn.  Written at once,
+ * like Put_Buf(), if there is no room or no console thread yet.
+ */
+void Put_Buf_Async(const char *buf, ulong_t length) {
+    bool queued = false, wake = false;
+    bool iflag = Lock_Console();
+    ulong_t offset = s_ringHead % CONSOLE_RING_SIZE;
+    ulong_t first = MIN(length, CONSOLE_RING_SIZE - offset);
+
+    if(s_consoleThread != 0 &&
+       length <= CONSOLE_RING_SIZE - (s_ringHead - s_ringTail)) {
+        queued = true;
+        wake = s_ringHead == s_ringTail;
+        memcpy(s_ring + offset, buf, first);
+        memcpy(s_ring, buf + first, length - first);
+        s_ringHead += length;
+    }
+    Unlock_Console(iflag);
+
+    if(!queued) {
+        Put_Buf(buf, length);
+        return;
+    }
+
+    /* after unlocking: Wake_Up() takes kthreadLock, under which Print() works */
+    if(wake) {
+        iflag = Begin_Int_Atomic();
+        Wake_Up(&s_consoleWaitQueue);
+        End_Int_Atomic(iflag);
+    }
 }
-static void Print_Finish(struct Output_Sink *o __attribute__ ((unused))) {
-    Update_Cursor();
+
+/*
+ * Draw everything queued and send it out the serial port, as before a
+ * shutdown.  Called from Hardware_Shutdown(), maybe by an assertion
+ * that failed with the console locked, so it goes ahead without the
+ * lock if it cannot take it, and does nothing if it fails itself.
+ */
+void Flush_Console(void) {
+    static bool flushing;
+    bool iflag = Begin_Int_Atomic();
+    bool locked = false;
+    int tries;
+
+    if(!flushing) {
+        flushing = true;
+        if(s_consoleThread != 0 &&
+           s_consoleLock.locker != get_current_thread(0))
+            for(tries = 0; tries < CONSOLE_LOCK_TRIES && !locked; ++tries)
+                locked = Try_Spin_Lock(&s_consoleLock);
+        Reset();
+        Drain_Ring(CONSOLE_RING_SIZE);
+        Flush_Screen();
+        if(locked)
+            Spin_Unlock(&s_consoleLock);
+        Serial_Flush();
+    }
+    End_Int_Atomic(iflag);
+}
+
+/* Support for Print(): formatted text is written a run at a time. */
+struct Print_Sink {
+    struct Output_Sink o;
+    ulong_t length;
+    char buf[128];
+};
+
+static void Print_Finish(struct Output_Sink *o_) {
+    struct Print_Sink *o = (struct Print_Sink *)o_;
+    Put_Buf_Imp(o->buf, o->length);
+    o->length = 0;
+}
+static void Print_Emit(struct Output_Sink *o_, int ch) {
+    struct Print_Sink *o = (struct Print_Sink *)o_;
+    o->buf[o->length++] = ch;
+    if(o->length == sizeof(o->buf))
+        Print_Finish(o_);
 }
-static struct Output_Sink s_outputSink = { &Print_Emit, &Print_Finish };
 
 Spin_Lock_t printLock;
 
@@ -529,13 +813,13 @@ Spin_Lock_t printLock;
  * Calls into Format_Output in common library.
  */
 void Print(const char *fmt, ...) {
+    struct Print_Sink sink = { {&Print_Emit, &Print_Finish}, 0, {0} };
     va_list args;
-
-    // Spin_Lock(&printLock);
+    bool iflag = Lock_Screen();
 
     va_start(args, fmt);
-    Format_Output(&s_outputSink, fmt, args);
+    Format_Output(&sink.o, fmt, args);
     va_end(args);
 
-    // Spin_Unlock(&printLock);
+    Unlock_Screen(iflag);
 }
@@ -27,6 +27,97 @@
 #include <geekos/projects.h>
 #include <geekos/smp.h>
 
+/*
+ * Semaphores live in a fixed table and are named by their index.
+ * Open_Semaphore finds a name through a hash of chains threaded
+ * through the table, and takes a free slot from a free list, so
+ * every operation is O(1).  Each semaphore has its own wait queue.
+ *
+ * V on a semaphore with sleepers does not raise the count: it hands
+ * the unit straight to the first sleeper, so a thread that wakes
+ * from P never has to retry.  If that sleeper last ran on this CPU
+ * and may run here, V also switches to it directly, so ping-pong
+ * pairs pass control without a trip through the run queue.
+ *
+ * s_semLock guards everything here, and is only taken with
+ * interrupts disabled so that P can drop it as it goes to sleep.
+ * Each User_Context counts its own opens of each semaphore, so a
+ * process can only P, V or close what it has opened, and whatever
+ * it still has open when it exits is closed for it.
+ */
+#define MAX_SEMAPHORE_NAME 32
+#define SEM_HASH_BITS 6
+
+struct Semaphore {
+    char name[MAX_SEMAPHORE_NAME + 1];
+    int count;
+    int refCount;               /* opens not yet closed; 0 when the slot is free */
+    struct Thread_Queue waitQueue;
+    int next;                   /* next id in its hash chain or the free list, or -1 */
+};
+
+static struct Semaphore s_semaphores[MAX_SEMAPHORES];
+static int s_semHash[1 << SEM_HASH_BITS];
+static int s_semFree = -1;
+static bool s_semInitialized;
+static Spin_Lock_t s_semLock;
+
+extern void Schedule_And_Unlock(Spin_Lock_t * unlock_me);
+
+/* s_semLock should be held */
+static void Init_Semaphores(void) {
+    int i;
+
+    for(i = 0; i < (1 << SEM_HASH_BITS); ++i)
+        s_semHash[i] = -1;
+    for(i = MAX_SEMAPHORES - 1; i >= 0; --i) {
+        Clear_Thread_Queue(&s_semaphores[i].waitQueue);
+        s_semaphores[i].next = s_semFree;
+        s_semFree = i;
+    }
+    s_semInitialized = true;
+}
+
+static uint_t Sem_Hash(const char *name) {
+    uint_t hash = 2166136261U;
+
+    while (*name != '\0')
+        hash = (hash ^ (uchar_t) * name++) * 16777619U;
+    return hash >> (32 - SEM_HASH_BITS);
+}
+
+/*
+ * Drop refs opens of the semaphore with this id, returning its slot
+ * to the free list once none remain; s_semLock should be held.
+ */
+static void Put_Semaphore(int id, int refs) {
+    struct Semaphore *sem = &s_semaphores[id];
+    int *link;
+
+    sem->refCount -= refs;
+    KASSERT(sem->refCount >= 0);
+    if(sem->refCount == 0) {
+        KASSERT(Is_Thread_Queue_Empty(&sem->waitQueue));
+        link = &s_semHash[Sem_Hash(sem->name)];
+        while (*link != id)
+            link = &s_semaphores[*link].next;
+        *link = sem->next;
+        sem->next = s_semFree;
+        s_semFree = id;
+    }
+}
+
+/*
+ * The semaphore with this id, or NULL if the calling process does
+ * not have it open; s_semLock should be held.
+ */
+static struct Semaphore *Get_Semaphore(int id) {
+    if(id < 0 || id >= MAX_SEMAPHORES ||
+       CURRENT_THREAD->userContext->semaphoreOpens[id] == 0)
+        return NULL;
+    return &s_semaphores[id];
+}
+
 
 /*
  * Create or find a semaphore.
@@ -37,9 +128,48 @@
  * Returns: the global semaphore id
  */
 int Sys_Open_Semaphore(struct Interrupt_State *state) {
-    KASSERT(state);             // may be removed; just to avoid compiler warnings in distributed code.
-    TODO_P(PROJECT_SEMAPHORES, "Open_Semaphore system call");
-    return EUNSUPPORTED;
+    char name[MAX_SEMAPHORE_NAME + 1];
+    ulong_t length = state->ecx;
+    int count = state->edx;
+    int *link, id;
+    bool iflag;
+
+    if(length == 0 || length > MAX_SEMAPHORE_NAME)
+        return length == 0 ? EINVALID : ENAMETOOLONG;
+    if(count < 0)
+        return EINVALID;
+    if(!Copy_From_User(name, state->ebx, length))
+        return EINVALID;
+    name[length] = '\0';
+
+    iflag = Begin_Int_Atomic();
+    Spin_Lock(&s_semLock);
+    if(!s_semInitialized)
+        Init_Semaphores();
+
+    link = &s_semHash[Sem_Hash(name)];
+    for(id = *link; id >= 0 && strcmp(s_semaphores[id].name, name) != 0;
+        id = s_semaphores[id].next) ;
+
+    if(id >= 0) {
+        /* already open: the initial count is ignored */
+        ++s_semaphores[id].refCount;
+    } else if((id = s_semFree) >= 0) {
+        s_semFree = s_semaphores[id].next;
+        strcpy(s_semaphores[id].name, name);
+        s_semaphores[id].count = count;
+        s_semaphores[id].refCount = 1;
+        s_semaphores[id].next = *link;
+        *link = id;
+    } else {
+        id = ENOMEM;
+    }
+    if(id >= 0)
+        ++CURRENT_THREAD->userContext->semaphoreOpens[id];
+
+    Spin_Unlock(&s_semLock);
+    End_Int_Atomic(iflag);
+    return id;
 }
 
 /*
@@ -52,9 +182,28 @@ int Sys_Open_Semaphore(struct Interrupt_State *state) {
  * Returns: 0 if successful, error code (< 0) if unsuccessful
  */
 int Sys_P(struct Interrupt_State *state) {
-    KASSERT(state);             // may be removed; just to avoid compiler warnings in distributed code.
-    TODO_P(PROJECT_SEMAPHORES, "P (semaphore acquire) system call");
-    return EUNSUPPORTED;
+    struct Semaphore *sem;
+    bool iflag = Begin_Int_Atomic();
+
+    Spin_Lock(&s_semLock);
+    sem = Get_Semaphore(state->ebx);
+    if(sem == NULL) {
+        Spin_Unlock(&s_semLock);
+        End_Int_Atomic(iflag);
+        return EINVALID;
+    }
+
+    if(sem->count > 0) {
+        --sem->count;
+        Spin_Unlock(&s_semLock);
+    } else {
+        /* V hands us its unit before waking us */
+        Add_To_Back_Of_Thread_Queue(&sem->waitQueue, CURRENT_THREAD);
+        Schedule_And_Unlock(&s_semLock);
+    }
+
+    End_Int_Atomic(iflag);
+    return 0;
 }
 
 /*
@@ -65,9 +214,31 @@ int Sys_P(struct Interrupt_State *state) {
  * Returns: 0 if successful, error code (< 0) if unsuccessful
  */
 int Sys_V(struct Interrupt_State *state) {
-    KASSERT(state);             // may be removed; just to avoid compiler warnings in distributed code.
-    TODO_P(PROJECT_SEMAPHORES, "V (semaphore release) system call");
-    return EUNSUPPORTED;
+    struct Semaphore *sem;
+    struct Kernel_Thread *waiter = NULL;
+    bool iflag = Begin_Int_Atomic();
+
+    Spin_Lock(&s_semLock);
+    sem = Get_Semaphore(state->ebx);
+    if(sem == NULL) {
+        Spin_Unlock(&s_semLock);
+        End_Int_Atomic(iflag);
+        return EINVALID;
+    }
+
+    waiter = Remove_From_Front_Of_Thread_Queue(&sem->waitQueue);
+    if(waiter == NULL) {
+        ++sem->count;
+        Spin_Unlock(&s_semLock);
+    } else if(Can_Switch_To_Woken(waiter)) {
+        Switch_To_Woken_And_Unlock(waiter, &s_semLock);
+    } else {
+        Make_Runnable(waiter);
+        Spin_Unlock(&s_semLock);
+    }
+
+    End_Int_Atomic(iflag);
+    return 0;
 }
 
 /*
@@ -75,10 +246,48 @@ int Sys_V(struct Interrupt_State *state) {
  * Params:
  *   state->ebx - the semaphore id
  *
- * Returns: 0 if successful, error code (< 0) if unsuccessful
+ * Returns: 0 if successful, EBUSY if this is the last open and
+ *   other threads of the process sleep on it, or error code (< 0)
  */
 int Sys_Close_Semaphore(struct Interrupt_State *state) {
-    KASSERT(state);             // may be removed; just to avoid compiler warnings in distributed code.
-    TODO_P(PROJECT_SEMAPHORES, "Close_Semaphore system call");
-    return EUNSUPPORTED;
+    struct Semaphore *sem;
+    int id = state->ebx, rc = 0;
+    bool iflag = Begin_Int_Atomic();
+
+    Spin_Lock(&s_semLock);
+    sem = Get_Semaphore(id);
+    if(sem == NULL) {
+        rc = EINVALID;
+    } else if(sem->refCount == 1 && !Is_Thread_Queue_Empty(&sem->waitQueue)) {
+        /* a sleeper's process holds an open, so it is one of ours */
+        rc = EBUSY;
+    } else {
+        --CURRENT_THREAD->userContext->semaphoreOpens[id];
+        Put_Semaphore(id, 1);
+    }
+    Spin_Unlock(&s_semLock);
+
+    End_Int_Atomic(iflag);
+    return rc;
+}
+
+/*
+ * Close every semaphore the given process still has open.  Called
+ * as its last thread detaches from the context, so none of its
+ * threads can be sleeping on them.
+ */
+void Release_Semaphores(struct User_Context *context) {
+    int id;
+    bool iflag = Begin_Int_Atomic();
+
+    Spin_Lock(&s_semLock);
+    for(id = 0; id < MAX_SEMAPHORES; ++id) {
+        if(context->semaphoreOpens[id] != 0) {
+            Put_Semaphore(id, context->semaphoreOpens[id]);
+            context->semaphoreOpens[id] = 0;
+        }
+    }
+    Spin_Unlock(&s_semLock);
+
+    End_Int_Atomic(iflag);
 }
@@ -1,3 +1,10 @@
+/*
+ * 16550 UART serial console
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
 #include <geekos/io.h>
 #include <geekos/screen.h>
 #include <geekos/int.h>
@@ -5,8 +12,307 @@
 #include <geekos/kthread.h>
 #include <geekos/string.h>
 #include <geekos/projects.h>
+#include <geekos/serial.h>
+
+/*
+ * Console output is mirrored to COM1.  Writers copy it into s_txRing
+ * and return; the UART raises its transmitter-empty interrupt each time
+ * its FIFO runs dry, and the handler refills the whole FIFO from the
+ * ring, so the line stays busy at the full baud rate without anyone
+ * polling the line status register per byte.
+ *
+ * Writers run with the console locked and interrupts disabled, so
+ * they must not wait for the UART.  Instead, a writer that may sleep
+ * first calls Serial_Wait_Room(), which waits for the interrupt
+ * handler to free enough of the ring.  Output that still does not fit,
+ * as from an interrupt handler during a flood, is counted, and the
+ * count is reported in the output once there is room again.
+ *
+ * s_serialLock guards the ring and the UART registers and is only
+ * taken with interrupts disabled.
+ */
+
+/* UART registers, as offsets from the port base */
+#define UART_DATA 0             /* receive buffer / transmit holding */
+#define UART_IER 1              /* interrupt enable */
+#define UART_IIR 2              /* interrupt identification (read) */
+#define UART_FCR 2              /* FIFO control (write) */
+#define UART_LCR 3              /* line control */
+#define UART_MCR 4              /* modem control */
+#define UART_LSR 5              /* line status */
+#define UART_MSR 6              /* modem status */
+#define UART_SCRATCH 7
+#define UART_DLL 0              /* divisor latch, while LCR_DLAB is set */
+#define UART_DLM 1
+
+#define IER_RX_DATA 0x01
+#define IER_TX_EMPTY 0x02
+#define IER_LINE_STATUS 0x04
+
+#define IIR_NO_INTERRUPT 0x01
+#define IIR_ID_MASK 0x0e
+#define IIR_MODEM_STATUS 0x00
+#define IIR_TX_EMPTY 0x02
+#define IIR_RX_DATA 0x04
+#define IIR_LINE_STATUS 0x06
+#define IIR_RX_TIMEOUT 0x0c
+#define IIR_FIFO_ENABLED 0xc0
+
+#define FCR_ENABLE 0x01
+#define FCR_CLEAR_RX 0x02
+#define FCR_CLEAR_TX 0x04
+#define FCR_TRIGGER_14 0xc0
+
+#define LCR_8N1 0x03
+#define LCR_DLAB 0x80
+
+#define MCR_DTR 0x01
+#define MCR_RTS 0x02
+#define MCR_OUT2 0x08           /* gates the UART interrupt onto the IRQ line */
+
+#define LSR_RX_READY 0x01
+#define LSR_TX_EMPTY 0x20       /* transmit holding register / FIFO empty */
+#define LSR_TX_IDLE 0x40        /* ... and the shift register too */
+
+#define COM1_BASE 0x3f8
+#define COM1_IRQ 4
+#define UART_CLOCK 115200
+#define SERIAL_BAUD 115200
+
+#define UART_FIFO_SIZE 16       /* transmit FIFO of a 16550A */
+#define SERIAL_RING_SIZE 8192
+
+/* polls of the line status register before giving up on a stuck UART */
+#define SERIAL_POLL_LIMIT 1000000
+
+static char s_txRing[SERIAL_RING_SIZE];
+static ulong_t s_txHead;        /* next byte to fill */
+static ulong_t s_txTail;        /* next byte to send */
+static int s_fifoSize;          /* bytes the UART takes per empty interrupt */
+static uchar_t s_ier;           /* what we last wrote to UART_IER */
+static bool s_serialReady;
+static Spin_Lock_t s_serialLock;
+static ulong_t s_txDropped;     /* bytes dropped since last reported */
+static ulong_t s_roomWanted;    /* least room a waiter wants, or 0 */
+static struct Thread_Queue s_roomWaitQueue;
+
+extern void Schedule_And_Unlock(Spin_Lock_t * unlock_me);
+
+static __inline__ ulong_t Ring_Room(void) {
+    return SERIAL_RING_SIZE - (s_txHead - s_txTail);
+}
+
+static void Set_IER(uchar_t ier) {
+    s_ier = ier;
+    Out_Byte(COM1_BASE + UART_IER, ier);
+}
+
+/* hand the UART as much of the ring as its empty FIFO will take */
+static void Fill_FIFO(void) {
+    int n;
+
+    for(n = 0; n < s_fifoSize && s_txTail != s_txHead; ++n)
+        Out_Byte(COM1_BASE + UART_DATA,
+                 s_txRing[s_txTail++ % SERIAL_RING_SIZE]);
+}
+
+/* wait for the transmitter to empty; false if it never does */
+static bool Wait_TX_Empty(void) {
+    int polls;
+
+    for(polls = 0; polls < SERIAL_POLL_LIMIT; ++polls)
+        if(In_Byte(COM1_BASE + UART_LSR) & LSR_TX_EMPTY)
+            return true;
+    return false;
+}
+
+/* s_serialLock should be held; false, counting c as dropped, if the ring is full */
+static bool Put_Ring(char c) {
+    if(Ring_Room() == 0) {
+        ++s_txDropped;
+        return false;
+    }
+    s_txRing[s_txHead++ % SERIAL_RING_SIZE] = c;
+    return true;
+}
+
+/* s_serialLock should be held; say how much was dropped, if there is room */
+static void Report_Dropped(void) {
+    char notice[48];
+    int i, n;
+
+    n = snprintf(notice, sizeof(notice), "\r\n[serial: %lu bytes dropped]\r\n",
+                 s_txDropped);
+    if(Ring_Room() < (ulong_t) n)
+        return;
+    for(i = 0; i < n; ++i)
+        s_txRing[s_txHead++ % SERIAL_RING_SIZE] = notice[i];
+    s_txDropped = 0;
+}
+
+static void Serial_Interrupt_Handler(struct Interrupt_State *state) {
+    uchar_t iir;
+    bool wake = false;
+
+    Begin_IRQ(state);
+    Spin_Lock(&s_serialLock);
+
+    while (!((iir = In_Byte(COM1_BASE + UART_IIR)) & IIR_NO_INTERRUPT)) {
+        switch (iir & IIR_ID_MASK) {
+            case IIR_TX_EMPTY:
+                if(s_txTail == s_txHead)
+                    Set_IER(s_ier & ~IER_TX_EMPTY);
+                else
+                    Fill_FIFO();
+                if(s_roomWanted != 0 && Ring_Room() >= s_roomWanted) {
+                    s_roomWanted = 0;
+                    wake = true;
+                }
+                break;
+            case IIR_RX_DATA:
+            case IIR_RX_TIMEOUT:
+                TODO_P(PROJECT_SERIAL, "deliver serial input as keys");
+                while (In_Byte(COM1_BASE + UART_LSR) & LSR_RX_READY)
+                    In_Byte(COM1_BASE + UART_DATA);
+                break;
+            case IIR_LINE_STATUS:
+                In_Byte(COM1_BASE + UART_LSR);
+                break;
+            default:
+                In_Byte(COM1_BASE + UART_MSR);
+                break;
+        }
+    }
+
+    Spin_Unlock(&s_serialLock);
+    if(wake)
+        Wake_Up(&s_roomWaitQueue);
+    End_IRQ(state);
+}
+
+/*
+ * Set up COM1 at SERIAL_BAUD, 8N1, with its FIFOs enabled, and start
+ * mirroring console output to it.  Does nothing if there is no UART.
+ */
+void Init_Serial(void) {
+    uint_t divisor = UART_CLOCK / SERIAL_BAUD;
+
+    /* a UART keeps what is written to its scratch register */
+    Out_Byte(COM1_BASE + UART_SCRATCH, 0x5a);
+    if(In_Byte(COM1_BASE + UART_SCRATCH) != 0x5a) {
+        Print("No serial port found\n");
+        return;
+    }
+
+    Set_IER(0);
+    Out_Byte(COM1_BASE + UART_LCR, LCR_DLAB);
+    Out_Byte(COM1_BASE + UART_DLL, divisor & 0xff);
+    Out_Byte(COM1_BASE + UART_DLM, divisor >> 8);
+    Out_Byte(COM1_BASE + UART_LCR, LCR_8N1);
+    Out_Byte(COM1_BASE + UART_FCR,
+             FCR_ENABLE | FCR_CLEAR_RX | FCR_CLEAR_TX | FCR_TRIGGER_14);
+    /* an 8250 or 16450 has no FIFO and ignores the write */
+    s_fifoSize =
+        (In_Byte(COM1_BASE + UART_IIR) & IIR_FIFO_ENABLED) ==
+        IIR_FIFO_ENABLED ? UART_FIFO_SIZE : 1;
+    Out_Byte(COM1_BASE + UART_MCR, MCR_DTR | MCR_RTS | MCR_OUT2);
+
+    Install_IRQ(COM1_IRQ, Serial_Interrupt_Handler);
+    Enable_IRQ(COM1_IRQ);
+    Set_IER(IER_RX_DATA | IER_LINE_STATUS);
+
+    s_serialReady = true;
+    Print("Serial console on COM1 at %d baud, %d byte FIFO\n", SERIAL_BAUD,
+          s_fifoSize);
+}
+
+/*
+ * Queue console output for the serial port, turning each newline into
+ * the CR LF a terminal expects.  Safe from any context; never waits
+ * for the UART, so what does not fit is dropped and counted.
+ */
+void Serial_Put_Buf(const char *buf, ulong_t length) {
+    bool iflag;
+
+    if(!s_serialReady)
+        return;
+
+    iflag = Begin_Int_Atomic();
+    Spin_Lock(&s_serialLock);
+
+    if(s_txDropped != 0)
+        Report_Dropped();
+    while (length > 0) {
+        if(*buf != '\n' || Put_Ring('\r'))
+            Put_Ring(*buf);
+        ++buf;
+        --length;
+    }
+
+    /* an idle transmitter raises no interrupt until it is given work */
+    if(!(s_ier & IER_TX_EMPTY) && s_txTail != s_txHead) {
+        if(In_Byte(COM1_BASE + UART_LSR) & LSR_TX_EMPTY)
+            Fill_FIFO();
+        Set_IER(s_ier | IER_TX_EMPTY);
+    }
+
+    Spin_Unlock(&s_serialLock);
+    End_Int_Atomic(iflag);
+}
+
+/*
+ * Sleep until there is room to queue length bytes of output, newlines
+ * and all, so that a write of that much made next is not dropped.
+ * Call with interrupts enabled and nothing locked.  A full ring means
+ * the transmitter is busy, so its interrupt will come.
+ */
+void Serial_Wait_Room(ulong_t length) {
+    ulong_t need = MIN(2 * length, (ulong_t) SERIAL_RING_SIZE);
+    bool iflag;
+
+    if(!s_serialReady)
+        return;
+
+    KASSERT(Interrupts_Enabled());
+    iflag = Begin_Int_Atomic();
+    Spin_Lock(&s_serialLock);
+    while (Ring_Room() < need) {
+        if(s_roomWanted == 0 || need < s_roomWanted)
+            s_roomWanted = need;
+        /* queue ourselves before the handler can see the room and wake us */
+        Lock_Thread_Queue(&s_roomWaitQueue);
+        Spin_Unlock(&s_serialLock);
+        Locked_Unchecked_Add_To_Back_Of_Thread_Queue(&s_roomWaitQueue,
+                                                     CURRENT_THREAD);
+        Schedule_And_Unlock(&s_roomWaitQueue.lock);
+        Spin_Lock(&s_serialLock);
+    }
+    Spin_Unlock(&s_serialLock);
+    End_Int_Atomic(iflag);
+}
+
+/*
+ * Send everything queued and wait for the line to go idle, as before
+ * a shutdown, which would otherwise cut the output short.  Called on
+ * the way down from a failed assertion too, so if the lock cannot be
+ * had it goes ahead without it.
+ */
+void Serial_Flush(void) {
+    bool iflag, locked = false;
+    int polls;
 
+    if(!s_serialReady)
+        return;
 
-void Init_Serial() {
-    TODO_P(PROJECT_SERIAL, "Initialize a serial port driver");
+    iflag = Begin_Int_Atomic();
+    for(polls = 0; polls < SERIAL_POLL_LIMIT && !locked; ++polls)
+        locked = Try_Spin_Lock(&s_serialLock);
+    while (s_txTail != s_txHead && Wait_TX_Empty())
+        Fill_FIFO();
+    for(polls = 0; polls < SERIAL_POLL_LIMIT; ++polls)
+        if(In_Byte(COM1_BASE + UART_LSR) & LSR_TX_IDLE)
+            break;
+    if(locked)
+        Spin_Unlock(&s_serialLock);
+    End_Int_Atomic(iflag);
 }
@@ -493,6 +493,33 @@ void Init_SMP(void) {
     }
 }
 
+/*
+ * Let memcpy() and friends use what this CPU offers.  Every CPU calls
+ * this before its first string operation: SSE instructions fault
+ * until CR4.OSFXSR is set, and that is per CPU.  The boot CPU also
+ * publishes the features; call it after Init_BSS(), which clears them.
+ * No FPU state is saved on a context switch, so the string routines
+ * save the XMM registers they use themselves.
+ */
+void Init_String_Features(int cpu) {
+    unsigned int features = Detect_String_Features();
+    unsigned long reg;
+
+    if(features & STRING_SSE2) {
+        /* CR0: clear EM and TS, set MP */
+        __asm__ __volatile__("movl %%cr0, %0":"=r"(reg));
+        reg = (reg & ~((1 << 2) | (1 << 3))) | (1 << 1);
+        __asm__ __volatile__("movl %0, %%cr0"::"r"(reg));
+        /* CR4: OSFXSR and OSXMMEXCPT */
+        __asm__ __volatile__("movl %%cr4, %0":"=r"(reg));
+        reg |= (1 << 9) | (1 << 10);
+        __asm__ __volatile__("movl %0, %%cr4"::"r"(reg));
+    }
+
+    if(cpu == 0)
+        Set_String_Features(features);
+}
+
 /*
  * C Entry point for newly booted secondary CPUs
  */
@@ -503,6 +530,7 @@ void Secondary_Start(int stack) {
     (void)stack;                // unused argument.
 
     CPUid = Get_CPU_ID();
+    Init_String_Features(CPUid);
 
     // let boot CPU know we are done!
     CPUs[CPUid].initDone = 1;
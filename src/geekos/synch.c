@@ -22,6 +22,7 @@
 #include <geekos/screen.h>
 #include <geekos/synch.h>
 #include <geekos/smp.h>
+#include <geekos/trace.h>
 
 extern void Schedule_And_Unlock(Spin_Lock_t * unlock_me);
 
@@ -44,8 +45,11 @@ void Mutex_Lock(struct Mutex *mutex) {
                          "=m"(mutex->state)
                          :"i"(MUTEX_LOCKED));
     if(was_held == MUTEX_LOCKED) {
+        TRACE(TRACE_MUTEX_CONTEND, mutex,
+              mutex->owner != NULL ? mutex->owner->pid : 0, 0, 0);
         Add_To_Back_Of_Thread_Queue(&mutex->waitQueue, CURRENT_THREAD);
         Schedule_And_Unlock(&mutex->guard);
+        TRACE(TRACE_MUTEX_ACQUIRE, mutex, 0, 0, 0);
     } else {
         Spin_Unlock(&mutex->guard);
     }
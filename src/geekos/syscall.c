@@ -34,6 +34,10 @@
 #include <geekos/mem.h>
 #include <geekos/smp.h>
 #include <geekos/gfs3.h>
+#include <geekos/poll.h>
+#include <geekos/profile.h>
+#include <geekos/trace.h>
+#include <geekos/futex.h>
 
 extern Spin_Lock_t kthreadLock;
 
@@ -118,8 +122,6 @@ static int Sys_ShutDown(struct Interrupt_State *state) {
     return 0;
 }
 
-static Spin_Lock_t sprintLock;
-
 
 /*
  * Print a string to the console.
@@ -153,13 +155,9 @@ static int Sys_PrintString(struct Interrupt_State *state) {
                      "Attempted to print a null string; this is likely a memory error.");
         }
 
-        TODO_P(PROJECT_SERIAL,
-               "Print to the serial console if appropriate");
-
-        /* Write to console; only one may write. */
-        Spin_Lock(&sprintLock);
-        Put_Buf(buf, length);
-        Spin_Unlock(&sprintLock);
+        /* Queue for the console thread, which also mirrors it to serial;
+           returns without waiting on VGA or the UART. */
+        Put_Buf_Async(buf, length);
 
     }
 
@@ -317,19 +315,144 @@ extern struct All_Thread_List s_allThreadList;
 extern struct Thread_Queue s_runQueue;
 
 
+/* most threads one PS snapshot will copy out */
+#define PS_MAX_THREADS 1024
+
+/* kthreadLock should be held */
+static void Fill_Process_Info(struct Process_Info *info,
+                              struct Kernel_Thread *kthread) {
+    const char *name = kthread->userContext != NULL ?
+        kthread->userContext->name : kthread->threadName;
+    int i;
+
+    memset(info, '\0', sizeof(*info));
+    memcpy(info->name, name, MIN(strlen(name), (size_t) MAX_PROC_NAME_SZB - 1));
+    info->pid = kthread->pid;
+    info->parent_pid = kthread->owner != NULL ? kthread->owner->pid : 0;
+    info->priority = kthread->priority;
+    info->affinity = kthread->affinity;
+    info->totalTime = kthread->totalTime;
+
+    info->currCore = -1;
+    for(i = 0; i < CPU_Count; ++i)
+        if(g_currentThreads[i] == kthread)
+            info->currCore = i;
+
+    if(!kthread->alive)
+        info->status = STATUS_ZOMBIE;
+    else if(info->currCore >= 0 || Is_Thread_On_Run_Queue(kthread))
+        info->status = STATUS_RUNNABLE;
+    else
+        info->status = STATUS_BLOCKED;
+
+    info->lastCore = kthread->stats.lastCore;
+    info->userTicks = kthread->stats.userTicks;
+    info->kernelTicks = kthread->stats.kernelTicks;
+    info->voluntarySwitches = kthread->stats.voluntarySwitches;
+    info->involuntarySwitches =
+        kthread->stats.switches - kthread->stats.voluntarySwitches;
+    info->syscalls = kthread->stats.syscalls;
+    info->pageFaults = kthread->stats.pageFaults;
+    info->blockReads = kthread->stats.blockReads;
+    info->blockWrites = kthread->stats.blockWrites;
+}
+
+/*
+ * Copy every thread's Process_Info into table, all under one hold of
+ * kthreadLock so the entries are a consistent snapshot.  Returns the
+ * number of threads, which may exceed max, in which case nothing
+ * useful was copied.
+ */
+static int PS_Snapshot(struct Process_Info *table, int max) {
+    struct Kernel_Thread *kthread;
+    int count = 0;
+    bool iflag = Begin_Int_Atomic();
+
+    Spin_Lock(&kthreadLock);
+    for(kthread = Get_Front_Of_All_Thread_List(&s_allThreadList);
+        kthread != NULL; kthread = Get_Next_In_All_Thread_List(kthread)) {
+        if(count < max)
+            Fill_Process_Info(&table[count], kthread);
+        ++count;
+    }
+    Spin_Unlock(&kthreadLock);
+    End_Int_Atomic(iflag);
+
+    return count;
+}
+
+static void Fill_CPU_Info(struct PS_CPU_Info *info, int cpu) {
+    memset(info, '\0', sizeof(*info));
+    if(cpu >= (CPU_Count > 0 ? CPU_Count : 1)) {
+        info->cpu = -1;
+        return;
+    }
+    info->cpu = cpu;
+    info->ticks = CPUs[cpu].ticks;
+    info->idleTicks = CPUs[cpu].idleTicks;
+    info->userTicks = CPUs[cpu].userTicks;
+    info->syscallTicks = CPUs[cpu].syscallTicks;
+    info->switches = CPUs[cpu].switches;
+    info->irqs = CPUs[cpu].irqs;
+    info->irqCycles = CPUs[cpu].irqCycles;
+}
+
 /*
  * Get information about the running processes
  * Params:
  *   state->ebx - pointer to user memory containing an array of
  *   Process_Info structs
  *   state->ecx - length of the passed in array in memory
- * Returns: -1 on failure
+ *   state->edx - pointer to user memory for an array of PS_CPU_Info
+ *   structs, or 0
+ *   state->esi - length of that array
+ * Returns: error code (< 0) on failure
  *          0 if size of user memory too small
  *          N the number of entries in the table, on success
  */
 static int Sys_PS(struct Interrupt_State *state) {
-    TODO_P(PROJECT_BACKGROUND_JOBS, "Sys_PS system call");
-    return 0;
+    struct Process_Info *table;
+    struct PS_CPU_Info cpuInfo;
+    int len = (int)state->ecx, numCPUs = (int)state->esi;
+    int capacity = 16, count, i;
+
+    if(len < 0 || numCPUs < 0)
+        return EINVALID;
+
+    /* the thread list can grow while we allocate, so retry until it fits */
+    for(;;) {
+        table = Malloc(sizeof(struct Process_Info) * capacity);
+        if(table == NULL)
+            return ENOMEM;
+        count = PS_Snapshot(table, capacity);
+        if(count <= capacity || count > PS_MAX_THREADS || count > len)
+            break;
+        Free(table);
+        capacity = count + 8;
+    }
+
+    if(count > len || count > capacity) {
+        Free(table);
+        return 0;
+    }
+
+    if(!Copy_To_User(state->ebx, table,
+                     sizeof(struct Process_Info) * count)) {
+        Free(table);
+        return EINVALID;
+    }
+    Free(table);
+
+    if(state->edx != 0) {
+        for(i = 0; i < numCPUs; ++i) {
+            Fill_CPU_Info(&cpuInfo, i);
+            if(!Copy_To_User(state->edx + i * sizeof(struct PS_CPU_Info),
+                             &cpuInfo, sizeof(cpuInfo)))
+                return EINVALID;
+        }
+    }
+
+    return count;
 }
 
 
@@ -1145,36 +1268,84 @@ static int Sys_Limit(struct Interrupt_State *state) {
 /* 
  * Set Processor Affinity
  * Params:
- *   state->ebx - pid
- *   state->ecx - affinity
+ *   state->ebx - pid, or 0 for the calling thread
+ *   state->ecx - affinity: a CPU number, or AFFINITY_ANY_CORE
  * Returns: 0 on success, EINVALID for errors
  */
 static int Sys_Set_Affinity(struct Interrupt_State *state) {
-    return EUNSUPPORTED;
+    struct Kernel_Thread *kthread;
+    int pid = state->ebx, affinity = state->ecx;
+    bool iflag;
+
+    if(affinity != AFFINITY_ANY_CORE &&
+       (affinity < 0 || affinity >= (CPU_Count > 0 ? CPU_Count : 1)))
+        return EINVALID;
+
+    kthread = pid == 0 ? CURRENT_THREAD : Lookup_Thread(pid, true);
+    if(kthread == NULL)
+        return EINVALID;
+
+    iflag = Begin_Int_Atomic();
+    kthread->affinity = affinity;
+    /* move off this CPU on the way back to user mode */
+    if(kthread == get_current_thread(0) &&
+       affinity != AFFINITY_ANY_CORE && affinity != Get_CPU_ID())
+        g_needReschedule[Get_CPU_ID()] = true;
+    End_Int_Atomic(iflag);
+
+    if(pid != 0)
+        Detach_Thread(kthread);
+    return 0;
 }
 
 
 /* 
  * Get Processor Affinity
  * Params:
- *   state->ebx - pid
+ *   state->ebx - pid, or 0 for the calling thread
  * Returns: current affinity on success, EINVALID for errors
  */
 static int Sys_Get_Affinity(struct Interrupt_State *state) {
-    return EUNSUPPORTED;
+    struct Kernel_Thread *kthread;
+    int pid = state->ebx, affinity = EINVALID;
+
+    kthread = pid == 0 ? CURRENT_THREAD : Lookup_Thread(pid, true);
+    if(kthread != NULL)
+        affinity = kthread->affinity;
+    if(pid != 0 && kthread != NULL)
+        Detach_Thread(kthread);
+
+    return affinity;
 }
 
 /*
  * Sys_Clone - create a new LWP, shares text and heap with parent
  *
+ * The new thread shares the caller's whole User_Context: memory,
+ * open files and all.  func must not return; it ends with Exit().
+ *
  * Params:
  *   state->ebx - address of thread function to run 
  *   state->ecx - address of top of child's stack 
  * Returns: pid for child on sucess or EINVALID for error
  */
 static int Sys_Clone(struct Interrupt_State *state) {
-    TODO_P(PROJECT_CLONE, "Clone system call");
-    return EUNSUPPORTED;
+    struct User_Context *userContext = CURRENT_THREAD->userContext;
+    struct Kernel_Thread *child;
+
+    if(userContext == NULL ||
+       !Validate_User_Memory(userContext, state->ebx, 1, VUM_READING) ||
+       state->ecx < sizeof(ulong_t) ||
+       !Validate_User_Memory(userContext, state->ecx - sizeof(ulong_t),
+                             sizeof(ulong_t), VUM_WRITING))
+        return EINVALID;
+
+    child = Clone_User_Thread(state->ebx, state->ecx);
+    if(child == NULL)
+        return ENOMEM;
+
+    /* we hold a reference to the child, so it cannot be reaped yet */
+    return child->pid;
 }
 
 static int Sys_Mmap(struct Interrupt_State *state) {
@@ -1299,7 +1470,12 @@ const Syscall g_syscallTable[] = {
     Sys_Rename,
     Sys_Link,
     Sys_SymLink,
-    Sys_Sbrk
+    Sys_Sbrk,
+    Sys_RouteLookup,
+    Sys_Poll,
+    Sys_Profile,
+    Sys_Trace,
+    Sys_Futex
 };
 
 /*
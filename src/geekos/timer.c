@@ -21,6 +21,7 @@
 #include <geekos/kthread.h>
 #include <geekos/timer.h>
 #include <geekos/smp.h>
+#include <geekos/profile.h>
 
 #define MAX_TIMER_EVENTS	100
 
@@ -88,6 +89,18 @@ void Timer_Interrupt_Handler(struct Interrupt_State *state) {
     ++current->numTicks;
     ++current->totalTime;
     CPUs[id].ticks++;
+    if(Is_User_Interrupt(state)) {
+        ++current->stats.userTicks;
+        ++CPUs[id].userTicks;
+    } else {
+        ++current->stats.kernelTicks;
+        if(current == CPUs[id].idleThread)
+            ++CPUs[id].idleTicks;
+        else if(current->stats.inSyscall)
+            ++CPUs[id].syscallTicks;
+    }
+
+    Profile_Tick(state, id);
 
     /*
      * If thread has been running for an entire quantum,
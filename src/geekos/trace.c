@@ -0,0 +1,111 @@
+/*
+ * Static tracepoints recorded into per-CPU binary trace buffers
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#include <geekos/trace.h>
+#include <geekos/cpuring.h>
+#include <geekos/errno.h>
+#include <geekos/int.h>
+#include <geekos/kthread.h>
+#include <geekos/smp.h>
+#include <geekos/synch.h>
+#include <geekos/timer.h>
+
+/*
+ * A trace site writes a record into its CPU's ring in s_records with
+ * interrupts disabled, so the writer never migrates mid-record; see
+ * cpuring.h.  Readers are serialized by s_traceMutex.
+ */
+
+/* events being traced; read by every trace site */
+volatile unsigned int g_traceMask;
+
+static struct CPU_Rings s_records =
+CPU_RINGS_INITIALIZER(struct Trace_Record, TRACE_RING_SIZE);
+static struct Mutex s_traceMutex = MUTEX_INITIALIZER;
+
+void Trace_Record(int event, unsigned long arg0, unsigned long arg1,
+                  unsigned long arg2, unsigned long arg3) {
+    struct Trace_Record *record;
+    struct Kernel_Thread *current;
+    bool iflag = Begin_Int_Atomic();
+    int cpu = Get_CPU_ID();
+
+    record = CPU_Ring_Reserve(&s_records, cpu);
+    if(record == NULL)
+        goto done;
+
+    current = get_current_thread(0);
+    record->tsc = Read_TSC();
+    record->event = event;
+    record->cpu = cpu;
+    record->pad = 0;
+    record->pid = current != NULL ? current->pid : 0;
+    record->args[0] = arg0;
+    record->args[1] = arg1;
+    record->args[2] = arg2;
+    record->args[3] = arg3;
+
+    CPU_Ring_Commit(&s_records, cpu);
+
+  done:
+    End_Int_Atomic(iflag);
+}
+
+/* s_traceMutex should be held */
+static int Trace_Start(unsigned int mask) {
+    int rc;
+
+    if(mask == 0 || (mask & ~TRACE_ALL_EVENTS) != 0)
+        return EINVALID;
+
+    g_traceMask = 0;
+    rc = CPU_Rings_Start(&s_records);
+    if(rc != 0)
+        return rc;
+    g_traceMask = mask;
+    return 0;
+}
+
+/* s_traceMutex should be held; returns records dropped since the start */
+static int Trace_Stop(void) {
+    g_traceMask = 0;
+    return CPU_Rings_Dropped(&s_records);
+}
+
+/*
+ * Control the tracepoints.
+ * Params:
+ *   state->ebx - TRACE_START, TRACE_STOP or TRACE_READ
+ *   state->ecx - START: mask of events to record; READ: user buffer
+ *   state->edx - READ: buffer size in records
+ * Returns: START: 0; STOP: records dropped because a ring was full;
+ *   READ: records copied, each CPU's in time order; or error code
+ *   (< 0) on error
+ */
+int Sys_Trace(struct Interrupt_State *state) {
+    int rc;
+
+    Mutex_Lock(&s_traceMutex);
+    switch (state->ebx) {
+        case TRACE_START:
+            rc = Trace_Start(state->ecx);
+            break;
+        case TRACE_STOP:
+            rc = Trace_Stop();
+            break;
+        case TRACE_READ:
+            rc = (int)state->edx < 0 ? EINVALID :
+                CPU_Rings_Read(&s_records, state->ecx, (int)state->edx);
+            break;
+        default:
+            rc = EINVALID;
+            break;
+    }
+    Mutex_Unlock(&s_traceMutex);
+
+    return rc;
+}
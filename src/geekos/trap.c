@@ -23,6 +23,7 @@
 #include <geekos/user.h>
 #include <geekos/projects.h>
 #include <geekos/smp.h>
+#include <geekos/trace.h>
 
 /*
  * TODO: need to add handlers for other exceptions (such as bounds
@@ -66,6 +67,7 @@ static void GPF_Handler(struct Interrupt_State *state) {
 static void Syscall_Handler(struct Interrupt_State *state) {
     /* The system call number is specified in the eax register. */
     uint_t syscallNum;
+    struct Kernel_Thread *current;
 
     Enable_Interrupts();
 
@@ -88,7 +90,15 @@ static void Syscall_Handler(struct Interrupt_State *state) {
      * Call the appropriate syscall function.
      * Return code of system call is returned in EAX.
      */
+    current = CURRENT_THREAD;
+    ++current->stats.syscalls;
+    current->stats.inSyscall = true;
+
+    TRACE(TRACE_SYSCALL_ENTER, syscallNum, state->ebx, state->ecx, 0);
     state->eax = g_syscallTable[syscallNum] (state);
+    TRACE(TRACE_SYSCALL_EXIT, syscallNum, state->eax, 0, 0);
+
+    current->stats.inSyscall = false;
 
     Disable_Interrupts();
 }
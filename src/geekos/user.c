@@ -69,6 +69,7 @@ void Detach_User_Context(struct Kernel_Thread *kthread) {
     if(old != 0) {
         --old->refCount;
         if(old->refCount == 0) {
+            Release_Semaphores(old);
             Destroy_User_Context(old);
         }
         KASSERT(old->refCount >= 0);
@@ -22,6 +22,7 @@
 #include <geekos/malloc.h>
 #include <geekos/synch.h>
 #include <geekos/vfs.h>
+#include <geekos/poll.h>
 #include <geekos/projects.h>
 
 /*
@@ -566,6 +567,22 @@ int Seek(struct File *file, ulong_t len) {
         return file->ops->Seek(file, len);
 }
 
+/*
+ * Check whether reading or writing a file would block.
+ * Params:
+ *   file - the File object
+ *   entry - Poll_Entry to register on the file, so a change in its
+ *     readiness wakes the poller; NULL to just check
+ * Returns: POLLIN and/or POLLOUT if that operation would not block,
+ *   plus POLLHUP or POLLERR; files without a Poll operation never block
+ */
+int Poll_File(struct File *file, struct Poll_Entry *entry) {
+    if(file->ops->Poll == 0)
+        return POLLIN | POLLOUT;
+    else
+        return file->ops->Poll(file, entry);
+}
+
 /*
  * Completely read named file into a buffer.
  * Params:
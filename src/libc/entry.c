@@ -10,6 +10,7 @@
 
 #include <geekos/argblock.h>
 #include <signal.h>
+#include <string.h>
 
 int main(int argc, char **argv);
 void Exit(int exitCode);
@@ -23,6 +24,9 @@ void _Entry(void) {
     /* The argument block pointer is in the ESI register. */
     __asm__ __volatile__("movl %%esi, %0":"=r"(argBlock));
 
+    /* rep movsb where it is fast; XMM state is not saved for user code */
+    Set_String_Features(Detect_String_Features() & ~STRING_SSE2);
+
     /* Initialize the signal handling trampoline */
     {
         int ret = Sig_Init();
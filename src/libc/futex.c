@@ -0,0 +1,119 @@
+/*
+ * Futexes, and the user-mode locks built on them
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#include <futex.h>
+#include <geekos/syscall.h>
+
+DEF_SYSCALL(Futex_Wait, SYS_FUTEX, int, (volatile int *word, int value),
+            int arg0 = FUTEX_WAIT;
+            volatile int *arg1 = word;
+            int arg2 = value;
+            , SYSCALL_REGS_3)
+DEF_SYSCALL(Futex_Wake, SYS_FUTEX, int, (volatile int *word, int count),
+            int arg0 = FUTEX_WAKE;
+            volatile int *arg1 = word;
+            int arg2 = count;
+            , SYSCALL_REGS_3)
+
+#define WAKE_ALL 0x7fffffff
+
+/*
+ * The mutex is free (0), held (1), or held with threads that may be
+ * asleep on it (2).  Unlock only enters the kernel from state 2, and a
+ * thread that has slept takes the mutex in state 2, since it cannot
+ * tell whether others are still asleep.
+ */
+void User_Mutex_Init(User_Mutex_t * mutex) {
+    mutex->state = 0;
+}
+
+void User_Mutex_Lock(User_Mutex_t * mutex) {
+    int state = __sync_val_compare_and_swap(&mutex->state, 0, 1);
+
+    while (state != 0) {
+        if(state == 2 ||
+           __sync_val_compare_and_swap(&mutex->state, 1, 2) != 0)
+            Futex_Wait(&mutex->state, 2);
+        state = __sync_val_compare_and_swap(&mutex->state, 0, 2);
+    }
+}
+
+int User_Mutex_Try_Lock(User_Mutex_t * mutex) {
+    return __sync_bool_compare_and_swap(&mutex->state, 0, 1);
+}
+
+void User_Mutex_Unlock(User_Mutex_t * mutex) {
+    if(__sync_fetch_and_sub(&mutex->state, 1) != 1) {
+        mutex->state = 0;
+        Futex_Wake(&mutex->state, 1);
+    }
+}
+
+/*
+ * A waiter reads the sequence before counting itself and releasing
+ * the mutex, and sleeps only while the sequence is unchanged, so a
+ * signal that follows the release is never lost.  Signals only enter
+ * the kernel when someone is waiting.
+ */
+void User_Cond_Init(User_Cond_t * cond) {
+    cond->sequence = 0;
+    cond->waiters = 0;
+}
+
+void User_Cond_Wait(User_Cond_t * cond, User_Mutex_t * mutex) {
+    int sequence = cond->sequence;
+
+    __sync_fetch_and_add(&cond->waiters, 1);
+    User_Mutex_Unlock(mutex);
+    Futex_Wait(&cond->sequence, sequence);
+    __sync_fetch_and_sub(&cond->waiters, 1);
+    User_Mutex_Lock(mutex);
+}
+
+void User_Cond_Signal(User_Cond_t * cond) {
+    __sync_fetch_and_add(&cond->sequence, 1);
+    if(cond->waiters > 0)
+        Futex_Wake(&cond->sequence, 1);
+}
+
+void User_Cond_Broadcast(User_Cond_t * cond) {
+    __sync_fetch_and_add(&cond->sequence, 1);
+    if(cond->waiters > 0)
+        Futex_Wake(&cond->sequence, WAKE_ALL);
+}
+
+/*
+ * P takes a unit with a compare-and-swap while the count is positive,
+ * and otherwise sleeps while it stays at the value it saw; V only
+ * enters the kernel when someone may be asleep.
+ */
+void User_Sema_Init(User_Sema_t * sema, int count) {
+    sema->count = count;
+    sema->waiters = 0;
+}
+
+void User_Sema_P(User_Sema_t * sema) {
+    int count;
+
+    for(;;) {
+        count = sema->count;
+        if(count > 0) {
+            if(__sync_bool_compare_and_swap(&sema->count, count, count - 1))
+                return;
+            continue;
+        }
+        __sync_fetch_and_add(&sema->waiters, 1);
+        Futex_Wait(&sema->count, count);
+        __sync_fetch_and_sub(&sema->waiters, 1);
+    }
+}
+
+void User_Sema_V(User_Sema_t * sema) {
+    __sync_fetch_and_add(&sema->count, 1);
+    if(sema->waiters > 0)
+        Futex_Wake(&sema->count, 1);
+}
@@ -63,6 +63,13 @@ DEF_SYSCALL(Get_Routes, SYS_ROUTEGET, int,
             ulong_t arg1 = count;
             , SYSCALL_REGS_2)
 
+DEF_SYSCALL(Route_Lookup, SYS_ROUTELOOKUP, int,
+                (uchar_t * ipAddress, ulong_t count,
+                 struct IP_Route * route), uchar_t * arg0 = ipAddress;
+            ulong_t arg1 = count;
+            void *arg2 = route;
+            , SYSCALL_REGS_3)
+
 DEF_SYSCALL(Get_IP_Info, SYS_IPGET, int,
                 (struct IP_Device_Info * buffer, ulong_t count,
                  char *interface, ulong_t ifaceLen), void *arg0 = buffer;
@@ -0,0 +1,16 @@
+/*
+ * Readiness multiplexing
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#include <poll.h>
+#include <geekos/syscall.h>
+
+DEF_SYSCALL(Poll, SYS_POLL, int,
+                (struct Poll_Descriptor * fds, int count, int timeout),
+            struct Poll_Descriptor *arg0 = fds;
+            int arg1 = count;
+            int arg2 = timeout;
+            , SYSCALL_REGS_3)
@@ -42,7 +42,17 @@ DEF_SYSCALL(Get_PID, SYS_GETPID, int, (void),, SYSCALL_REGS_0)
     DEF_SYSCALL(PS, SYS_PS, int, (struct Process_Info * ptable, int len),
                 struct Process_Info *arg0 = ptable;
                 int arg1 = len;
-                , SYSCALL_REGS_2)
+                struct PS_CPU_Info *arg2 = 0;
+                int arg3 = 0;
+                , SYSCALL_REGS_4)
+DEF_SYSCALL(PS_With_CPUs, SYS_PS, int,
+                (struct Process_Info * ptable, int len,
+                 struct PS_CPU_Info * cpus, int numCPUs),
+            struct Process_Info *arg0 = ptable;
+            int arg1 = len;
+            struct PS_CPU_Info *arg2 = cpus;
+            int arg3 = numCPUs;
+            , SYSCALL_REGS_4)
 DEF_SYSCALL(WaitNoPID, SYS_WAITNOPID, int, (int *status), int *arg0 =
             status;
             , SYSCALL_REGS_1)
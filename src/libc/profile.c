@@ -0,0 +1,24 @@
+/*
+ * Sampling profiler
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#include <profile.h>
+#include <geekos/syscall.h>
+
+DEF_SYSCALL(Profile_Start, SYS_PROFILE, int, (int period, int flags),
+            int arg0 = PROFILE_START;
+            int arg1 = period;
+            int arg2 = flags;
+            , SYSCALL_REGS_3)
+DEF_SYSCALL(Profile_Stop, SYS_PROFILE, int, (void),
+            int arg0 = PROFILE_STOP;
+            , SYSCALL_REGS_1)
+DEF_SYSCALL(Profile_Read, SYS_PROFILE, int,
+                (struct Profile_Sample * samples, int max),
+            int arg0 = PROFILE_READ;
+            struct Profile_Sample *arg1 = samples;
+            int arg2 = max;
+            , SYSCALL_REGS_3)
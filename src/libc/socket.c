@@ -14,10 +14,18 @@
 uchar_t INADDR_ANY[4] = { 0, 0, 0, 0 };
 uchar_t INADDR_BROADCAST[4] = { 255, 255, 255, 255 };
 
-DEF_SYSCALL(Socket, SYS_SOCKET, int, (uchar_t type, int flags),
-            ulong_t arg0 = type;
+DEF_SYSCALL(Socket_With_Buffers, SYS_SOCKET, int,
+                (uchar_t type, int flags, ulong_t sendBufferSize,
+                 ulong_t receiveBufferSize), ulong_t arg0 = type;
             ulong_t arg1 = flags;
-            , SYSCALL_REGS_2)
+            ulong_t arg2 = sendBufferSize;
+            ulong_t arg3 = receiveBufferSize;
+            , SYSCALL_REGS_4)
+
+int Socket(uchar_t type, int flags) {
+    return Socket_With_Buffers(type, flags, 0, 0);
+}
+
 DEF_SYSCALL(Connect, SYS_CONNECT, int,
                 (ulong_t id, ushort_t port, uchar_t ipAddress[4]),
             ulong_t arg0 = id;
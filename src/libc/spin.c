@@ -20,28 +20,31 @@
  *
  */
 
-#include "geekos/projects.h"
+#include <spin.h>
 
-typedef struct {
-    volatile int lock;
-} User_Spin_Lock_t;
+/*
+ * Test-and-set locks for threads sharing memory through Clone().
+ * Waiters spin on a plain read, so the lock's cache line is only
+ * written when it looks free.  For anything held longer than a few
+ * instructions, User_Mutex_t in futex.h sleeps instead.
+ */
 
 int Is_Locked(User_Spin_Lock_t * lock) {
-    TODO_P(PROJECT_CLONE, "Is_Locked");
-    return 0;
+    return lock->lock != 0;
 }
 
 void Spin_Lock_Init(User_Spin_Lock_t * lock) {
-    TODO_P(PROJECT_CLONE, "Is_Locked");
+    lock->lock = 0;
 }
 
 void Spin_Lock(User_Spin_Lock_t * lock) {
-    TODO_P(PROJECT_CLONE, "Spin_Lock");
-    /* put the address of lock (which is the first field holding the lock) into ebx */
-  asm("mov %0, %%ebx": : "r"(lock):"%ebx");
+    while (__sync_lock_test_and_set(&lock->lock, 1) != 0) {
+        while (lock->lock != 0)
+            __asm__ __volatile__("pause":::"memory");
+    }
 }
 
 int Spin_Unlock(User_Spin_Lock_t * lock) {
-    TODO_P(PROJECT_CLONE, "Spin_Unlock");
+    __sync_lock_release(&lock->lock);
     return 0;
 }
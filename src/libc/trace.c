@@ -0,0 +1,23 @@
+/*
+ * Tracepoints
+ *
+ * This is free software.  You are permitted to use,
+ * redistribute, and modify it as specified in the file "COPYING".
+ */
+
+#include <trace.h>
+#include <geekos/syscall.h>
+
+DEF_SYSCALL(Trace_Start, SYS_TRACE, int, (unsigned int mask),
+            int arg0 = TRACE_START;
+            unsigned int arg1 = mask;
+            , SYSCALL_REGS_2)
+DEF_SYSCALL(Trace_Stop, SYS_TRACE, int, (void),
+            int arg0 = TRACE_STOP;
+            , SYSCALL_REGS_1)
+DEF_SYSCALL(Trace_Read, SYS_TRACE, int,
+                (struct Trace_Record * records, int max),
+            int arg0 = TRACE_READ;
+            struct Trace_Record *arg1 = records;
+            int arg2 = max;
+            , SYSCALL_REGS_3)
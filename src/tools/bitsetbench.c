@@ -0,0 +1,167 @@
+/*
+ * bitsetbench - host-side benchmark for the bit set free-run search
+ *
+ * Usage: bitsetbench [image MB]
+ *
+ * Builds the free-block bitmap a GFS3 volume of the given size
+ * (default 1024 MB, 512-byte blocks) would have after heavy
+ * fragmentation, then times Find_First_N_Free from bitset.c, the
+ * indexed search, and the old bit-at-a-time search for a range of
+ * extent lengths.  Finishes with an allocation run that carves
+ * extents out of the bitmap through the index.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
+
+#include <geekos/bitset.h>
+
+#define BLOCK_SIZE 512
+#define SEARCHES 20
+
+/* bitset.c is kernel code; supply the few kernel services it uses */
+void *Malloc(unsigned long size) {
+    return malloc(size);
+}
+void Free(void *m) {
+    free(m);
+}
+void Print(const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    vprintf(fmt, args);
+    va_end(args);
+}
+
+/* the original search, kept as the baseline */
+static int Slow_Find_First_N_Free(void *bitSet, uint_t runLength,
+                                  ulong_t totalBits) {
+    uint_t i, j;
+
+    for(i = 0; i < totalBits - runLength; i++) {
+        if(!Is_Bit_Set(bitSet, i)) {
+            for(j = 1; j < runLength; j++) {
+                if(Is_Bit_Set(bitSet, i + j)) {
+                    i += j;
+                    break;
+                }
+            }
+            if(j == runLength) {
+                return i;
+            }
+        }
+    }
+    return -1;
+}
+
+static unsigned int s_seed = 412;
+
+static unsigned int Rand(unsigned int limit) {
+    s_seed = s_seed * 1103515245 + 12345;
+    return (s_seed >> 8) % limit;
+}
+
+static double Now_Usec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+/*
+ * Mark the first 90% of the volume as a fragmented mix of used runs
+ * and short holes; leave the rest free, so long extents are only
+ * found after scanning nearly the whole bitmap.
+ */
+static void Fragment(void *bitSet, ulong_t totalBits) {
+    ulong_t pos = 0, end = totalBits / 10 * 9;
+
+    while (pos < end) {
+        ulong_t used = 1 + Rand(256);
+        ulong_t hole = 1 + Rand(48);
+        while (used-- > 0 && pos < end)
+            Set_Bit(bitSet, pos++);
+        pos += hole;
+    }
+}
+
+int main(int argc, char **argv) {
+    static const uint_t runLengths[] = { 1, 8, 64, 512, 4096 };
+    ulong_t megabytes = 1024;
+    ulong_t totalBits;
+    void *bitSet;
+    struct Bit_Set_Index *index;
+    unsigned int r, i;
+    double t0, slow, word, indexed;
+    int expect = -1, got = -1;
+    ulong_t allocated;
+
+    if(argc > 1)
+        megabytes = strtoul(argv[1], 0, 0);
+    if(megabytes == 0) {
+        fprintf(stderr, "usage: %s [image MB]\n", argv[0]);
+        return 1;
+    }
+
+    totalBits = megabytes * 1024 * 1024 / BLOCK_SIZE;
+    bitSet = Create_Bit_Set(totalBits);
+    if(bitSet == 0)
+        return 1;
+    Fragment(bitSet, totalBits);
+    index = Create_Bit_Set_Index(bitSet, totalBits);
+    if(index == 0)
+        return 1;
+
+    printf("%lu MB image: %lu blocks, %lu free\n", megabytes, totalBits,
+           Index_Count_Free(index));
+    printf("%8s %14s %14s %14s\n", "run", "bit (us)", "word (us)",
+           "indexed (us)");
+
+    for(r = 0; r < sizeof(runLengths) / sizeof(runLengths[0]); r++) {
+        uint_t n = runLengths[r];
+
+        t0 = Now_Usec();
+        for(i = 0; i < SEARCHES; i++)
+            expect = Slow_Find_First_N_Free(bitSet, n, totalBits);
+        slow = (Now_Usec() - t0) / SEARCHES;
+
+        t0 = Now_Usec();
+        for(i = 0; i < SEARCHES; i++)
+            got = Find_First_N_Free(bitSet, n, totalBits);
+        word = (Now_Usec() - t0) / SEARCHES;
+        if(got != expect) {
+            printf("mismatch for run %u: %d vs %d\n", n, got, expect);
+            return 1;
+        }
+
+        t0 = Now_Usec();
+        for(i = 0; i < SEARCHES; i++)
+            got = Index_Find_First_N_Free(index, n);
+        indexed = (Now_Usec() - t0) / SEARCHES;
+        if(got != expect) {
+            printf("indexed mismatch for run %u: %d vs %d\n", n, got,
+                   expect);
+            return 1;
+        }
+
+        printf("%8u %14.1f %14.1f %14.1f\n", n, slow, word, indexed);
+    }
+
+    /* carve 256-block extents until the volume is full */
+    t0 = Now_Usec();
+    for(allocated = 0;; allocated++) {
+        got = Index_Find_First_N_Free(index, 256);
+        if(got < 0)
+            break;
+        Index_Set_Bits(index, (uint_t)got, 256);
+    }
+    t0 = Now_Usec() - t0;
+    printf("allocated %lu extents of 256 blocks in %.1f us (%.2f us each)\n",
+           allocated, t0, allocated ? t0 / allocated : 0.0);
+
+    Destroy_Bit_Set_Index(index);
+    Destroy_Bit_Set(bitSet);
+    return 0;
+}
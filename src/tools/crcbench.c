@@ -0,0 +1,144 @@
+/*
+ * crcbench - host-side benchmark for crc32 and the internet checksum
+ *
+ * Usage: crcbench [MB per test]
+ *
+ * Checks the slicing-by-8 crc32() from crc32.c and Checksum_Partial()
+ * from net/checksum.c against the byte-at-a-time versions they
+ * replaced, at every alignment and a spread of lengths, then reports
+ * the throughput of each in MB/s for buffers from a small packet up
+ * to 64 KB.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <geekos/crc32.h>
+#include <geekos/net/checksum.h>
+
+#define MAX_SIZE (64 * 1024)
+
+static unsigned char s_buffer[MAX_SIZE + 16];
+
+/* the original crc32, kept as the baseline */
+static ulong_t s_slowTable[256];
+
+static void Slow_Init_CRC32(void) {
+    unsigned int i, j;
+
+    for(i = 0; i < 256; i++) {
+        ulong_t h = i;
+        for(j = 0; j < 8; j++)
+            h = (h >> 1) ^ ((h & 1) ? 0xedb88320 : 0);
+        s_slowTable[i] = h;
+    }
+}
+
+static ulong_t Slow_CRC32(ulong_t crc, char const *buf, size_t len) {
+    crc ^= 0xffffffff;
+    while (len--)
+        crc = (crc >> 8) ^ s_slowTable[(crc ^ *buf++) & 0xff];
+    return crc ^ 0xffffffff;
+}
+
+/* the checksum loop ip.c and tcp.c each had */
+static ulong_t Slow_Checksum(ulong_t sum, const void *data, ulong_t length) {
+    const uchar_t *bytes = data;
+
+    while (length > 1) {
+        sum += ((ulong_t) bytes[0] << 8) | bytes[1];
+        bytes += 2;
+        length -= 2;
+    }
+    if(length > 0)
+        sum += (ulong_t) bytes[0] << 8;
+    return sum;
+}
+
+static double Now_Usec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int Check(void) {
+    size_t len, off;
+
+    for(len = 0; len < 2048; len += len < 64 ? 1 : 61) {
+        for(off = 0; off < 8; off++) {
+            const char *p = (const char *)s_buffer + off;
+
+            if(crc32(0, p, len) != Slow_CRC32(0, p, len) ||
+               crc32(0x1234, p, len) != Slow_CRC32(0x1234, p, len)) {
+                printf("crc32 mismatch: length %zu offset %zu\n", len, off);
+                return 1;
+            }
+            if(Checksum_Fold(Checksum_Partial(0, p, len)) !=
+               Checksum_Fold(Slow_Checksum(0, p, len))) {
+                printf("checksum mismatch: length %zu offset %zu\n", len,
+                       off);
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    static const size_t sizes[] = { 64, 576, 1500, 4096, MAX_SIZE };
+    unsigned long megabytes = 256;
+    volatile ulong_t sink = 0;
+    double t0, usec[4];
+    unsigned int s, i, reps;
+
+    if(argc > 1)
+        megabytes = strtoul(argv[1], 0, 0);
+    if(megabytes == 0) {
+        fprintf(stderr, "usage: %s [MB per test]\n", argv[0]);
+        return 1;
+    }
+
+    for(i = 0; i < sizeof(s_buffer); i++)
+        s_buffer[i] = rand();
+    Init_CRC32();
+    Slow_Init_CRC32();
+    if(Check() != 0)
+        return 1;
+
+    printf("%8s %12s %12s %12s %12s\n", "bytes", "crc byte", "crc slice8",
+           "csum word16", "csum word32");
+    for(s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        size_t n = sizes[s];
+
+        reps = megabytes * 1024 * 1024 / n;
+
+        t0 = Now_Usec();
+        for(i = 0; i < reps; i++)
+            sink += Slow_CRC32(0, (const char *)s_buffer, n);
+        usec[0] = (Now_Usec() - t0);
+
+        t0 = Now_Usec();
+        for(i = 0; i < reps; i++)
+            sink += crc32(0, (const char *)s_buffer, n);
+        usec[1] = (Now_Usec() - t0);
+
+        t0 = Now_Usec();
+        for(i = 0; i < reps; i++)
+            sink += Slow_Checksum(0, s_buffer, n);
+        usec[2] = (Now_Usec() - t0);
+
+        t0 = Now_Usec();
+        for(i = 0; i < reps; i++)
+            sink += Checksum_Partial(0, s_buffer, n);
+        usec[3] = (Now_Usec() - t0);
+
+        /* bytes per microsecond is MB/s */
+        printf("%8zu", n);
+        for(i = 0; i < 4; i++)
+            printf(" %12.0f", (double)reps * n / usec[i]);
+        printf("\n");
+    }
+    return 0;
+}
@@ -0,0 +1,260 @@
+/*
+ * strbench - host-side benchmark for the block routines in string.c
+ *
+ * Usage: strbench [MB per test]
+ *
+ * Checks memset, memcpy and memmove from src/common against the host
+ * C library, then times them across block sizes with each set of
+ * string features the CPU supports: plain rep stosl/movsl, enhanced
+ * rep movsb (ERMS), and ERMS plus SSE2 non-temporal stores for blocks
+ * of a page or more (the kernel build).  The old C loops and the
+ * host library are timed alongside for comparison.
+ *
+ * Built 32-bit, with the routines renamed so they do not replace the
+ * host's own; see the tools/strbench rule in Makefile.common.
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define STRING_ERMS 0x1
+#define STRING_SSE2 0x2
+
+void *Geek_Memset(void *s, int c, size_t n);
+void *Geek_Memcpy(void *dst, const void *src, size_t n);
+void *Geek_Memmove(void *dst, const void *src, size_t n);
+unsigned int Detect_String_Features(void);
+void Set_String_Features(unsigned int features);
+
+/* string.c links against these; snprintf() is not benchmarked */
+struct Output_Sink;
+
+void *Malloc(size_t size) {
+    return malloc(size);
+}
+
+int Format_Output(struct Output_Sink *q, const char *format, va_list ap) {
+    (void)q;
+    (void)format;
+    (void)ap;
+    return 0;
+}
+
+/* the routines as they were, kept as the baseline */
+static void *Old_Memset(void *s, int c, size_t n) {
+    if((((unsigned long)s) & 0x3) == 0 && ((unsigned long)n & 0x3) == 0) {
+        unsigned int *pi = s;
+        n /= 4;
+        c |= c << 8;
+        c |= c << 16;
+        for(pi = s; n > 0; n--, pi++)
+            *pi = c;
+    } else {
+        unsigned char *p = (unsigned char *)s;
+        while (n > 0) {
+            *p++ = (unsigned char)c;
+            --n;
+        }
+    }
+    return s;
+}
+
+static void *Old_Memcpy(void *dst, const void *src, size_t n) {
+    unsigned char *d = (unsigned char *)dst;
+    const unsigned char *s = (const unsigned char *)src;
+
+    if((((unsigned long)d | (unsigned long)s | n) & 0x3) == 0) {
+        unsigned int *di = (unsigned int *)dst;
+        const unsigned int *si = (const unsigned int *)src;
+        n /= 4;
+        while (n > 0) {
+            *di++ = *si++;
+            --n;
+        }
+    } else {
+        while (n > 0) {
+            *d++ = *s++;
+            --n;
+        }
+    }
+    return dst;
+}
+
+static void *Old_Memmove(void *dest1, const void *source1, size_t length) {
+    char *dest = dest1;
+    const char *source = source1;
+
+    if(source < dest)
+        for(source += length, dest += length; length; --length)
+            *--dest = *--source;
+    else if(source != dest)
+        for(; length; --length)
+            *dest++ = *source++;
+    return dest1;
+}
+
+struct Variant {
+    const char *name;
+    int features;               /* -1: not one of ours */
+    void *(*set) (void *, int, size_t);
+    void *(*copy) (void *, const void *, size_t);
+    void *(*move) (void *, const void *, size_t);
+};
+
+static struct Variant s_variants[] = {
+    {"old C", -1, Old_Memset, Old_Memcpy, Old_Memmove},
+    {"rep", 0, Geek_Memset, Geek_Memcpy, Geek_Memmove},
+    {"erms", STRING_ERMS, Geek_Memset, Geek_Memcpy, Geek_Memmove},
+    {"erms+sse2", STRING_ERMS | STRING_SSE2, Geek_Memset, Geek_Memcpy,
+     Geek_Memmove},
+    {"host", -1, memset, memcpy, memmove},
+};
+
+#define NUM_VARIANTS (sizeof(s_variants) / sizeof(s_variants[0]))
+
+static const size_t s_sizes[] = {
+    16, 64, 256, 1024, 4096, 16384, 65536, 1024 * 1024
+};
+
+#define NUM_SIZES (sizeof(s_sizes) / sizeof(s_sizes[0]))
+#define MAX_SIZE (1024 * 1024)
+
+static unsigned char *s_src, *s_dst, *s_ref;
+
+static double Now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void Fill(unsigned char *buf, size_t n, unsigned int seed) {
+    size_t i;
+
+    for(i = 0; i < n; ++i)
+        buf[i] = (unsigned char)((i + seed) * 2654435761U >> 24);
+}
+
+/* every routine against the host's, over odd sizes and alignments */
+static int Check(struct Variant *v) {
+    size_t n, off, shift;
+
+    for(n = 0; n < 300; n += n < 40 ? 1 : 37) {
+        for(off = 0; off < 8; ++off) {
+            Fill(s_dst, n + 16, 1);
+            memcpy(s_ref, s_dst, n + 16);
+            v->set(s_dst + off, 0xa5, n);
+            memset(s_ref + off, 0xa5, n);
+            if(memcmp(s_dst, s_ref, n + 16) != 0)
+                return printf("%s memset(%zu at +%zu) wrong\n", v->name, n,
+                              off), 1;
+
+            Fill(s_src, n + 16, 2);
+            v->copy(s_dst + off, s_src + 3, n);
+            memcpy(s_ref + off, s_src + 3, n);
+            if(memcmp(s_dst, s_ref, n + 16) != 0)
+                return printf("%s memcpy(%zu at +%zu) wrong\n", v->name, n,
+                              off), 1;
+
+            for(shift = 1; shift < 9; shift += 7) {
+                Fill(s_dst, n + 32, 3);
+                memcpy(s_ref, s_dst, n + 32);
+                v->move(s_dst + off + shift, s_dst + off, n);
+                memmove(s_ref + off + shift, s_ref + off, n);
+                v->move(s_dst + off, s_dst + off + shift, n);
+                memmove(s_ref + off, s_ref + off + shift, n);
+                if(memcmp(s_dst, s_ref, n + 32) != 0)
+                    return printf("%s memmove(%zu at +%zu by %zu) wrong\n",
+                                  v->name, n, off, shift), 1;
+            }
+        }
+    }
+
+    /* a page-aligned block large enough for the non-temporal path */
+    Fill(s_src, MAX_SIZE, 4);
+    v->copy(s_dst, s_src, MAX_SIZE - 24);
+    if(memcmp(s_dst, s_src, MAX_SIZE - 24) != 0)
+        return printf("%s memcpy(%d) wrong\n", v->name, MAX_SIZE - 24), 1;
+    v->set(s_dst, 0, MAX_SIZE - 24);
+    memset(s_ref, 0, MAX_SIZE - 24);
+    if(memcmp(s_dst, s_ref, MAX_SIZE - 24) != 0)
+        return printf("%s memset(%d) wrong\n", v->name, MAX_SIZE - 24), 1;
+    return 0;
+}
+
+/* MB/s over about total bytes */
+static double Rate(struct Variant *v, int op, size_t n, size_t total) {
+    size_t reps = total / n, i;
+    double start = Now();
+
+    for(i = 0; i < reps; ++i) {
+        switch (op) {
+            case 0:
+                v->set(s_dst, (int)i, n);
+                break;
+            case 1:
+                v->copy(s_dst, s_src, n);
+                break;
+            default:
+                v->move(s_dst + 8, s_dst, n);
+                break;
+        }
+        __asm__ __volatile__("":::"memory");
+    }
+    return reps * (double)n / (Now() - start) / 1e6;
+}
+
+int main(int argc, char **argv) {
+    static const char *ops[] = { "memset", "memcpy", "memmove" };
+    unsigned int cpu = Detect_String_Features();
+    size_t total = (argc > 1 ? atoi(argv[1]) : 256) * (size_t) 1024 * 1024;
+    size_t v, s;
+    int op;
+
+    s_src = aligned_alloc(4096, MAX_SIZE + 64);
+    s_dst = aligned_alloc(4096, MAX_SIZE + 64);
+    s_ref = aligned_alloc(4096, MAX_SIZE + 64);
+    if(s_src == NULL || s_dst == NULL || s_ref == NULL || total == 0) {
+        printf("Usage: %s [MB per test]\n", argv[0]);
+        return 1;
+    }
+
+    printf("CPU features:%s%s\n", cpu & STRING_ERMS ? " erms" : "",
+           cpu & STRING_SSE2 ? " sse2" : "");
+
+    for(v = 0; v < NUM_VARIANTS; ++v) {
+        if(s_variants[v].features > 0 &&
+           (s_variants[v].features & (int)cpu) != s_variants[v].features) {
+            s_variants[v].name = NULL;
+            continue;
+        }
+        if(s_variants[v].features >= 0)
+            Set_String_Features(s_variants[v].features);
+        if(Check(&s_variants[v]) != 0)
+            return 1;
+    }
+
+    for(op = 0; op < 3; ++op) {
+        printf("\n%-8s MB/s", ops[op]);
+        for(v = 0; v < NUM_VARIANTS; ++v)
+            if(s_variants[v].name != NULL)
+                printf(" %10s", s_variants[v].name);
+        printf("\n");
+        for(s = 0; s < NUM_SIZES; ++s) {
+            printf("%13zu", s_sizes[s]);
+            for(v = 0; v < NUM_VARIANTS; ++v) {
+                if(s_variants[v].name == NULL)
+                    continue;
+                if(s_variants[v].features >= 0)
+                    Set_String_Features(s_variants[v].features);
+                printf(" %10.0f", Rate(&s_variants[v], op, s_sizes[s],
+                                       total));
+            }
+            printf("\n");
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,39 @@
+/*
+ * conbench - Console output throughput
+ *
+ * Usage: conbench.exe [lines]
+ *
+ * Prints lines lines (default 2000) of 72 characters, scrolling the
+ * whole way, then reports how long the Print() calls took.  With the
+ * console thread drawing queued output, that is the cost to the
+ * printing process, not the cost of drawing.
+ */
+
+#include <conio.h>
+#include <process.h>
+#include <sched.h>
+#include <string.h>
+
+#define DEFAULT_LINES 2000
+
+int main(int argc, char **argv) {
+    int lines = argc > 1 ? atoi(argv[1]) : DEFAULT_LINES;
+    int start, elapsed, i;
+
+    if(lines < 1 || argc > 2) {
+        Print("Usage: %s [lines]\n", argv[0]);
+        return 1;
+    }
+
+    start = Get_Time_Of_Day();
+    for(i = 0; i < lines; ++i)
+        Print("%6d the quick brown fox jumps over the lazy dog %17d\n", i,
+              i * 7);
+    elapsed = Get_Time_Of_Day() - start;
+
+    if(elapsed <= 0)
+        elapsed = 1;
+    Print("%d lines in %d ticks: %d lines/sec\n", lines, elapsed,
+          lines * TICKS_PER_SEC / elapsed);
+    return 0;
+}
@@ -1,13 +1,24 @@
 #include <socket.h>
 #include <conio.h>
 #include <string.h>
+#include <poll.h>
+
+/*
+ * Echo server on port 7.  One process serves every client: Poll()
+ * waits on the listening socket and all open connections at once,
+ * so a slow client never holds up the others.  Each client's first
+ * message is echoed back and the connection closed; a message of
+ * "exit" shuts the server down.
+ */
+
+#define MAX_CLIENTS 256
+
+static struct Poll_Descriptor s_fds[MAX_CLIENTS + 1];
 
 int main() {
-    int rc;
+    int rc, i, count = 1, done = 0;
     char buffer[256];
 
-    memset(buffer, 0, 256);
-
     int fd = Socket(SOCK_STREAM, 0);
     if(fd < 0) {
         Print("Could not create socket\n");
@@ -26,28 +37,59 @@ int main() {
         return 1;
     }
 
-    do {
-
-        int newSocket;
-        uchar_t clientAddress[4];
-        ushort_t clientPort;
+    s_fds[0].fd = fd;
+    s_fds[0].kind = POLL_SOCKET;
+    s_fds[0].events = POLLIN;
 
-        // Accept the connection
-        newSocket = Accept(fd, &clientPort, clientAddress);
-        if(newSocket < 0) {
-            Print("Could not accept the connection\n");
+    while (!done) {
+        rc = Poll(s_fds, count, POLL_INFINITE);
+        if(rc < 0) {
+            Print("Poll failed: %d\n", rc);
             return 1;
         }
 
-        rc = Receive(newSocket, (uchar_t *) buffer, 256);
-        if(rc >= 0) {
-            Print("Echoing data back\n");
-            Send(newSocket, (uchar_t *) buffer, 256);
+        // Serve the connections that have something for us
+        for(i = count - 1; i > 0; --i) {
+            if(s_fds[i].revents == 0)
+                continue;
+
+            memset(buffer, 0, 256);
+            rc = Receive(s_fds[i].fd, (uchar_t *) buffer, 256);
+            if(rc > 0) {
+                Print("Echoing data back\n");
+                Send(s_fds[i].fd, (uchar_t *) buffer, 256);
+                if(strcmp(buffer, "exit") == 0)
+                    done = 1;
+            }
+
+            Close_Socket(s_fds[i].fd);
+            s_fds[i] = s_fds[--count];
         }
 
-        Close_Socket(newSocket);
+        // Accept a new connection
+        if(s_fds[0].revents & POLLIN) {
+            int newSocket;
+            uchar_t clientAddress[4];
+            ushort_t clientPort;
 
-    } while (strcmp(buffer, "exit") != 0);
+            newSocket = Accept(fd, &clientPort, clientAddress);
+            if(newSocket < 0) {
+                Print("Could not accept the connection\n");
+                return 1;
+            }
+            if(count > MAX_CLIENTS) {
+                Close_Socket(newSocket);
+                continue;
+            }
+            s_fds[count].fd = newSocket;
+            s_fds[count].kind = POLL_SOCKET;
+            s_fds[count].events = POLLIN;
+            ++count;
+        }
+    }
 
+    for(i = 1; i < count; ++i)
+        Close_Socket(s_fds[i].fd);
+    Close_Socket(fd);
     return 0;
 }
@@ -15,7 +15,7 @@ int main(int argc, char **argv) {
         char *interface = (argc == 1) ? NULL : argv[1];
         int rc =
             Get_IP_Info(deviceInfo, NUMBER_OF_DEVICES, interface,
-                        strlen(interface));
+                        interface ? strlen(interface) : 0);
         if(rc < 0)
             return rc;
 
@@ -35,12 +35,15 @@ int main(int argc, char **argv) {
                   device->netmask.ptr[0],
                   device->netmask.ptr[1],
                   device->netmask.ptr[2], device->netmask.ptr[3]);
-            Print("          RX packets:%ld  errors:%ld\n",
-                  device->rxPackets, device->rxPacketErrors);
+            Print("          RX packets:%ld  errors:%ld  dropped:%ld\n",
+                  device->rxPackets, device->rxPacketErrors,
+                  device->rxDropped);
             Print("          TX packets:%ld  errors:%ld\n",
                   device->txPackets, device->txPacketErrors);
             Print("          RX bytes:%ld  TX bytes:%ld\n",
                   device->rxBytes, device->txBytes);
+            Print("          RX packets/s:%ld  interrupts/s:%ld\n",
+                  device->rxPacketRate, device->rxInterruptRate);
             Print("          Interrupt: %d  I/O Port: %lx\n",
                   device->interrupt, device->ioport);
             Print("\n\n");
@@ -0,0 +1,178 @@
+/*
+ * prof - Sample where the CPUs spend their time
+ *
+ * Usage: prof.exe run [-p period] [-g] <program> [args...]
+ *        prof.exe start [-p period] [-g]
+ *        prof.exe stop
+ *
+ * "run" profiles the whole system while one command runs; "start"
+ * and "stop" bracket any stretch of activity.  Every period ticks
+ * (default 10, so 100 samples a second per CPU) the kernel records
+ * where each CPU was; -g adds the kernel call stack.  On stop the
+ * samples are counted up and printed as lines of
+ *
+ *     PROF <count> <k|u> <eip> [<return address>...]
+ *
+ * which build/profile_report.rb turns into a symbolized profile
+ * using geekos/kernel.syms.  Samples arriving while a CPU's buffer
+ * is full are dropped and counted; use a longer period if any are.
+ */
+
+#include <conio.h>
+#include <process.h>
+#include <profile.h>
+#include <string.h>
+
+#define DEFAULT_PERIOD 10
+#define DEFAULT_PATH "/c:/a"
+#define MAX_COMMAND 256
+#define MAX_SITES 1024          /* distinct (eip, stack) pairs counted */
+#define READ_BATCH 64
+
+struct Site {
+    int count;
+    struct Profile_Sample sample;
+};
+
+static struct Site s_sites[MAX_SITES];
+static int s_other;             /* samples with no free site to count them */
+static struct Profile_Sample s_batch[READ_BATCH];
+
+static unsigned long Hash_Sample(struct Profile_Sample *sample) {
+    unsigned long hash = sample->eip ^ sample->flags;
+    int i;
+
+    for(i = 0; i < sample->depth; ++i)
+        hash = hash * 31 + sample->stack[i];
+    return hash * 2654435761U;
+}
+
+static int Same_Site(struct Profile_Sample *a, struct Profile_Sample *b) {
+    int i;
+
+    if(a->eip != b->eip || a->flags != b->flags || a->depth != b->depth)
+        return 0;
+    for(i = 0; i < a->depth; ++i)
+        if(a->stack[i] != b->stack[i])
+            return 0;
+    return 1;
+}
+
+static void Count_Sample(struct Profile_Sample *sample) {
+    unsigned long i = Hash_Sample(sample) % MAX_SITES, probes;
+
+    for(probes = 0; probes < MAX_SITES; ++probes) {
+        if(s_sites[i].count == 0) {
+            s_sites[i].sample = *sample;
+            s_sites[i].count = 1;
+            return;
+        }
+        if(Same_Site(&s_sites[i].sample, sample)) {
+            ++s_sites[i].count;
+            return;
+        }
+        i = (i + 1) % MAX_SITES;
+    }
+    ++s_other;
+}
+
+static int Stop_And_Report(void) {
+    int dropped, rc, i, j, total = 0;
+
+    dropped = Profile_Stop();
+    if(dropped < 0) {
+        Print("Could not stop the profiler: %d\n", dropped);
+        return 1;
+    }
+
+    while ((rc = Profile_Read(s_batch, READ_BATCH)) > 0) {
+        for(i = 0; i < rc; ++i)
+            Count_Sample(&s_batch[i]);
+        total += rc;
+    }
+    if(rc < 0) {
+        Print("Could not read samples: %d\n", rc);
+        return 1;
+    }
+
+    for(i = 0; i < MAX_SITES; ++i) {
+        if(s_sites[i].count == 0)
+            continue;
+        Print("PROF %d %c %08lx", s_sites[i].count,
+              (s_sites[i].sample.flags & PROFILE_USER) ? 'u' : 'k',
+              s_sites[i].sample.eip);
+        for(j = 0; j < s_sites[i].sample.depth; ++j)
+            Print(" %08lx", s_sites[i].sample.stack[j]);
+        Print("\n");
+    }
+    Print("PROF total %d dropped %d uncounted %d\n", total, dropped,
+          s_other);
+    return 0;
+}
+
+static int Start(int period, int flags) {
+    int rc = Profile_Start(period, flags);
+
+    if(rc != 0)
+        Print("Could not start the profiler: %d\n", rc);
+    return rc;
+}
+
+static void Usage(const char *name) {
+    Print("Usage: %s run [-p period] [-g] <program> [args...]\n", name);
+    Print("       %s start [-p period] [-g]\n", name);
+    Print("       %s stop\n", name);
+}
+
+int main(int argc, char **argv) {
+    char command[MAX_COMMAND];
+    int period = DEFAULT_PERIOD, flags = 0, i, program, pid;
+
+    if(argc < 2) {
+        Usage(argv[0]);
+        return 1;
+    }
+    if(!strcmp(argv[1], "stop"))
+        return Stop_And_Report();
+
+    for(i = 2; i < argc && argv[i][0] == '-'; ++i) {
+        if(!strcmp(argv[i], "-g"))
+            flags |= PROFILE_STACKS;
+        else if(!strcmp(argv[i], "-p") && i + 1 < argc)
+            period = atoi(argv[++i]);
+        else {
+            Usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if(!strcmp(argv[1], "start") && i == argc)
+        return Start(period, flags) == 0 ? 0 : 1;
+    if(strcmp(argv[1], "run") || i == argc) {
+        Usage(argv[0]);
+        return 1;
+    }
+
+    command[0] = '\0';
+    for(program = i; i < argc; ++i) {
+        if(strlen(command) + strlen(argv[i]) + 2 > MAX_COMMAND) {
+            Print("Command too long\n");
+            return 1;
+        }
+        if(command[0] != '\0')
+            strcat(command, " ");
+        strcat(command, argv[i]);
+    }
+
+    if(Start(period, flags) != 0)
+        return 1;
+    pid = Spawn_With_Path(argv[program], command, DEFAULT_PATH, 0);
+    if(pid < 0) {
+        Profile_Stop();
+        Print("Could not run %s: %d\n", command, pid);
+        return 1;
+    }
+    Wait(pid);
+
+    return Stop_And_Report();
+}
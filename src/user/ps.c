@@ -11,14 +11,207 @@
  * enrolled in similar operating systems courses the University of Maryland's CMSC412 course.
  */
 
+/*
+ * Usage: ps.exe            list every process once
+ *        ps.exe -l         ... with its accounting
+ *        ps.exe -t [ms] [count]
+ *                          top-style: every ms milliseconds (default
+ *                          1000) show each CPU's load and the processes
+ *                          that used the most CPU, count times (default
+ *                          forever)
+ */
+
 #include <conio.h>
 #include <process.h>
+#include <string.h>
+#include <poll.h>
+#include <sched.h>
+
+#define MAX_PROCS 256
+#define MAX_PS_CPUS 16
+#define TOP_LINES 15
+
+struct Snapshot {
+    int count;
+    int numCPUs;
+    struct Process_Info procs[MAX_PROCS];
+    struct PS_CPU_Info cpus[MAX_PS_CPUS];
+};
+
+static struct Snapshot s_snapshots[2];
+
+static int Take_Snapshot(struct Snapshot *snap) {
+    int i;
+
+    snap->count =
+        PS_With_CPUs(snap->procs, MAX_PROCS, snap->cpus, MAX_PS_CPUS);
+    if(snap->count <= 0) {
+        Print(snap->count == 0 ? "Too many processes\n" :
+              "PS failed: %d\n", snap->count);
+        return -1;
+    }
+    for(i = 0; i < MAX_PS_CPUS && snap->cpus[i].cpu >= 0; ++i) ;
+    snap->numCPUs = i;
+    return 0;
+}
+
+static char Status_Char(int status) {
+    switch (status) {
+        case STATUS_RUNNABLE:
+            return 'R';
+        case STATUS_BLOCKED:
+            return 'B';
+        case STATUS_ZOMBIE:
+            return 'Z';
+        default:
+            return '?';
+    }
+}
+
+static char Core_Char(int core) {
+    return core < 0 ? ' ' : core < 10 ? '0' + core : 'A' + core - 10;
+}
+
+static int List(int accounting) {
+    struct Snapshot *snap = &s_snapshots[0];
+    struct Process_Info *p;
+    int i;
+
+    if(Take_Snapshot(snap) != 0)
+        return 1;
 
+    if(accounting)
+        Print("PID  PPID  user kern  vcsw  icsw syscall fault  bread bwrite cpu NAME\n");
+    else
+        Print("PID PPID PRIO STAT AFF TIME COMMAND\n");
+    for(i = 0; i < snap->count; ++i) {
+        p = &snap->procs[i];
+        if(accounting)
+            Print("%3d %4d %5d %4d %5d %5d %7d %5d %6d %6d %3c %s\n",
+                  p->pid, p->parent_pid, p->userTicks, p->kernelTicks,
+                  p->voluntarySwitches, p->involuntarySwitches,
+                  p->syscalls, p->pageFaults, p->blockReads,
+                  p->blockWrites, Core_Char(p->lastCore), p->name);
+        else
+            Print("%3d %4d %4d %2c%2c %3c %4d %s\n", p->pid, p->parent_pid,
+                  p->priority, Status_Char(p->status),
+                  p->currCore >= 0 ? '*' : ' ', Core_Char(p->affinity),
+                  p->totalTime, p->name);
+    }
+    return 0;
+}
+
+static struct Process_Info *Find(struct Snapshot *snap, int pid) {
+    int i;
+
+    for(i = 0; i < snap->count; ++i)
+        if(snap->procs[i].pid == pid)
+            return &snap->procs[i];
+    return 0;
+}
+
+/* ticks a process used between two snapshots */
+static int Used(struct Snapshot *prev, struct Process_Info *p) {
+    struct Process_Info *old = Find(prev, p->pid);
+    int now = p->userTicks + p->kernelTicks;
+
+    return old ? now - old->userTicks - old->kernelTicks : now;
+}
+
+/* elapsed is in ticks, which are milliseconds */
+static void Show_Top(struct Snapshot *prev, struct Snapshot *snap,
+                     int elapsed) {
+    struct PS_CPU_Info *c, *o;
+    struct Process_Info *p, *old;
+    int order[MAX_PROCS];
+    int i, j, t, ticks, used;
+
+    Print("\x1b[2J");
+    Print("CPU  ticks  idle  user  sys  kern  csw/s  irq/s  irq kcycles\n");
+    for(i = 0; i < snap->numCPUs; ++i) {
+        c = &snap->cpus[i];
+        o = &prev->cpus[i];
+        ticks = c->ticks - o->ticks;
+        if(ticks <= 0)
+            ticks = 1;
+        Print("%3d %6d %4d%% %4d%% %3d%% %4d%% %6d %6d %12lu\n", c->cpu,
+              ticks, (c->idleTicks - o->idleTicks) * 100 / ticks,
+              (c->userTicks - o->userTicks) * 100 / ticks,
+              (c->syscallTicks - o->syscallTicks) * 100 / ticks,
+              (ticks - (c->idleTicks - o->idleTicks) -
+               (c->userTicks - o->userTicks) -
+               (c->syscallTicks - o->syscallTicks)) * 100 / ticks,
+              (c->switches - o->switches) * 1000 / elapsed,
+              (c->irqs - o->irqs) * 1000 / elapsed,
+              (unsigned long)((c->irqCycles - o->irqCycles) >> 10));
+    }
+
+    /* sort by ticks used in the interval, busiest first */
+    for(i = 0; i < snap->count; ++i) {
+        order[i] = i;
+        for(j = i; j > 0 && Used(prev, &snap->procs[order[j - 1]]) <
+            Used(prev, &snap->procs[order[j]]); --j) {
+            t = order[j];
+            order[j] = order[j - 1];
+            order[j - 1] = t;
+        }
+    }
+
+    Print("\nPID STAT CPU  %%CPU  usr  sys  vcsw  icsw  sysc  flt  blkio NAME\n");
+    for(i = 0; i < snap->count && i < TOP_LINES; ++i) {
+        p = &snap->procs[order[i]];
+        old = Find(prev, p->pid);
+        used = Used(prev, p);
+        Print("%3d %4c %3c %4d%% %4d %4d %5d %5d %5d %4d %6d %s\n",
+              p->pid, Status_Char(p->status), Core_Char(p->lastCore),
+              used * 100 / elapsed,
+              p->userTicks - (old ? old->userTicks : 0),
+              p->kernelTicks - (old ? old->kernelTicks : 0),
+              p->voluntarySwitches - (old ? old->voluntarySwitches : 0),
+              p->involuntarySwitches - (old ? old->involuntarySwitches : 0),
+              p->syscalls - (old ? old->syscalls : 0),
+              p->pageFaults - (old ? old->pageFaults : 0),
+              p->blockReads + p->blockWrites -
+              (old ? old->blockReads + old->blockWrites : 0), p->name);
+    }
+}
+
+static int Top(int interval, int count) {
+    struct Snapshot *prev = &s_snapshots[0], *snap = &s_snapshots[1], *t;
+    int n, then, now;
+
+    if(Take_Snapshot(prev) != 0)
+        return 1;
+    then = Get_Time_Of_Day();
+    for(n = 0; count <= 0 || n < count; ++n) {
+        /* no descriptors: Poll() just sleeps for the interval */
+        Poll(0, 0, interval);
+        if(Take_Snapshot(snap) != 0)
+            return 1;
+        now = Get_Time_Of_Day();
+        Show_Top(prev, snap, now > then ? now - then : 1);
+        then = now;
+        t = prev;
+        prev = snap;
+        snap = t;
+    }
+    return 0;
+}
 
-int main(int argc __attribute__ ((unused)), char **argv
-         __attribute__ ((unused))) {
+int main(int argc, char **argv) {
+    int interval = 1000;
 
+    if(argc == 1)
+        return List(0);
+    if(argc == 2 && !strcmp(argv[1], "-l"))
+        return List(1);
+    if(argc <= 4 && !strcmp(argv[1], "-t")) {
+        if(argc > 2)
+            interval = atoi(argv[2]);
+        if(interval > 0)
+            return Top(interval, argc > 3 ? atoi(argv[3]) : 0);
+    }
 
-// format string for one process line should be "%3d %4d %4d %2c%2c %3c %4d %s\n"
+    Print("Usage: %s [-l | -t [ms] [count]]\n", argv[0]);
     return 1;
 }
@@ -0,0 +1,134 @@
+/*
+ * psum - Parallel sum over threads sharing one address space
+ *
+ * Usage: psum.exe [-u] [threads]
+ *
+ * Sums an array first with one thread, then with threads threads
+ * (default: one per CPU) started with Clone(), each summing a slice.
+ * Each thread pins itself to a CPU with Set_Affinity() unless -u is
+ * given.  The threads are released together through a User_Cond_t
+ * and add their slices into the total under a User_Mutex_t, so
+ * the only system calls on the way are the ones that must sleep.
+ */
+
+#include <conio.h>
+#include <process.h>
+#include <sched.h>
+#include <string.h>
+#include <futex.h>
+
+#define MAX_THREADS 16
+#define STACK_SIZE 4096
+#define NUM_VALUES (256 * 1024)
+#define PASSES 32
+
+static unsigned int s_values[NUM_VALUES];
+static char s_stacks[MAX_THREADS][STACK_SIZE];
+
+static int s_numThreads;
+static int s_numCPUs;
+static int s_pin = 1;
+static volatile int s_nextThread;
+
+static User_Mutex_t s_lock;
+static User_Cond_t s_startCond;
+static volatile int s_started;
+static volatile unsigned long s_total;
+
+static unsigned long Sum_Slice(int slice, int slices) {
+    int first = NUM_VALUES / slices * slice;
+    int last = slice == slices - 1 ? NUM_VALUES : first + NUM_VALUES / slices;
+    unsigned long sum = 0;
+    int pass, i;
+
+    for(pass = 0; pass < PASSES; ++pass)
+        for(i = first; i < last; ++i)
+            sum += s_values[i];
+    return sum;
+}
+
+static void Worker(void) {
+    int slice = __sync_fetch_and_add(&s_nextThread, 1);
+    unsigned long sum;
+
+    if(s_pin)
+        Set_Affinity(0, slice % s_numCPUs);
+
+    User_Mutex_Lock(&s_lock);
+    while (!s_started)
+        User_Cond_Wait(&s_startCond, &s_lock);
+    User_Mutex_Unlock(&s_lock);
+
+    sum = Sum_Slice(slice, s_numThreads);
+
+    User_Mutex_Lock(&s_lock);
+    s_total += sum;
+    User_Mutex_Unlock(&s_lock);
+
+    Exit(0);
+}
+
+/* the CPUs Set_Affinity() will accept */
+static int Count_CPUs(void) {
+    int n;
+
+    for(n = 0; n < MAX_THREADS && Set_Affinity(0, n) == 0; ++n) ;
+    Set_Affinity(0, AFFINITY_ANY_CORE);
+    return n > 0 ? n : 1;
+}
+
+int main(int argc, char **argv) {
+    int pids[MAX_THREADS];
+    unsigned long expected;
+    int i, start, serial, parallel;
+
+    for(i = 1; i < argc && !strcmp(argv[i], "-u"); ++i)
+        s_pin = 0;
+    s_numCPUs = Count_CPUs();
+    s_numThreads = i < argc ? atoi(argv[i]) : s_numCPUs;
+    if(s_numThreads < 1 || s_numThreads > MAX_THREADS || i + 1 < argc) {
+        Print("Usage: %s [-u] [threads]   (1 to %d threads)\n", argv[0],
+              MAX_THREADS);
+        return 1;
+    }
+
+    for(i = 0; i < NUM_VALUES; ++i)
+        s_values[i] = i * 2654435761U >> 20;
+
+    start = Get_Time_Of_Day();
+    expected = Sum_Slice(0, 1);
+    serial = Get_Time_Of_Day() - start;
+
+    User_Mutex_Init(&s_lock);
+    User_Cond_Init(&s_startCond);
+    for(i = 0; i < s_numThreads; ++i) {
+        pids[i] = Clone(Worker, &s_stacks[i][STACK_SIZE]);
+        if(pids[i] < 0) {
+            Print("Clone failed: %d\n", pids[i]);
+            return 1;
+        }
+    }
+
+    /* release every thread at once, so creation is not timed */
+    User_Mutex_Lock(&s_lock);
+    start = Get_Time_Of_Day();
+    s_started = 1;
+    User_Cond_Broadcast(&s_startCond);
+    User_Mutex_Unlock(&s_lock);
+
+    for(i = 0; i < s_numThreads; ++i)
+        Wait(pids[i]);
+    parallel = Get_Time_Of_Day() - start;
+
+    Print("%d CPUs, %d values x %d passes\n", s_numCPUs, NUM_VALUES, PASSES);
+    Print("1 thread:   %6d ms\n", serial);
+    Print("%d threads: %6d ms%s, speedup %d.%02d\n", s_numThreads, parallel,
+          s_pin ? " pinned" : "",
+          serial * 100 / (parallel > 0 ? parallel : 1) / 100,
+          serial * 100 / (parallel > 0 ? parallel : 1) % 100);
+    if(s_total != expected) {
+        Print("MISMATCH: sum %lu, expected %lu\n", s_total, expected);
+        return 1;
+    }
+    return 0;
+}
@@ -2,17 +2,62 @@
 #include <string.h>
 #include <conio.h>
 #include <ip.h>
+#include <sched.h>
 
 #define NUMBER_OF_ROUTES 25
+#define DEFAULT_LOOKUPS 100000
 
 static char addCommand[] = "add";
 static char delCommand[] = "del";
+static char getCommand[] = "get";
+static char benchCommand[] = "bench";
 
 static char destinationOption[] = "dest";
 static char gatewayOption[] = "gw";
 static char netmaskOption[] = "netmask";
 static char deviceOption[] = "dev";
 
+static void Print_Lookup(const char *what, int lookups, int elapsed) {
+    Print("%-12s %d lookups in %d ticks", what, lookups, elapsed);
+    if(elapsed > 0)
+        Print(": %d lookups/sec", lookups * TICKS_PER_SEC / elapsed);
+    Print("\n");
+}
+
+/*
+ * Time route lookups in the kernel: the same destination over and
+ * over, which the route cache answers, then a sweep of destinations
+ * that each need a walk of the routing trie.
+ */
+static int Route_Bench(int lookups, uchar_t * destination) {
+    struct IP_Route route;
+    int start, i, rc;
+
+    /* also warms the cache for the first run */
+    rc = Route_Lookup(destination, 1, &route);
+    if(rc != 0) {
+        Print("No route to %d.%d.%d.%d\n", destination[0], destination[1],
+              destination[2], destination[3]);
+        return rc;
+    }
+
+    start = Get_Time_Of_Day();
+    for(i = 0; i < lookups; ++i)
+        Route_Lookup(destination, 1, 0);
+    Print_Lookup("cached", lookups, Get_Time_Of_Day() - start);
+
+    start = Get_Time_Of_Day();
+    rc = Route_Lookup(destination, lookups, 0);
+    if(rc != 0) {
+        Print("Sweep from %d.%d.%d.%d failed: %d\n", destination[0],
+              destination[1], destination[2], destination[3], rc);
+        return rc;
+    }
+    Print_Lookup("sweep", lookups, Get_Time_Of_Day() - start);
+
+    return 0;
+}
+
 int main(int argc, char **argv) {
     /* Print out the routing table */
     if(argc == 1) {
@@ -84,6 +129,48 @@ int main(int argc, char **argv) {
     }
 
 
+    /* Show the route a destination would take */
+    else if(argc == 3 && strcmp(argv[1], getCommand) == 0) {
+        uchar_t destination[4];
+        struct IP_Route route;
+        int rc;
+
+        if(!Parse_IP(argv[2], destination)) {
+            Print("IP destination address invalid\n");
+            return 1;
+        }
+
+        rc = Route_Lookup(destination, 1, &route);
+        if(rc != 0) {
+            Print("No route to host\n");
+            return rc;
+        }
+
+        Print("%d.%d.%d.%d/%d.%d.%d.%d ", route.destination.ptr[0],
+              route.destination.ptr[1], route.destination.ptr[2],
+              route.destination.ptr[3], route.netmask.ptr[0],
+              route.netmask.ptr[1], route.netmask.ptr[2],
+              route.netmask.ptr[3]);
+        if(route.fGateway == 1)
+            Print("via %d.%d.%d.%d ", route.gateway.ptr[0],
+                  route.gateway.ptr[1], route.gateway.ptr[2],
+                  route.gateway.ptr[3]);
+        Print("dev %s metric %d\n", route.interface, route.metric);
+        return 0;
+    }
+
+    /* Measure route lookup rate: bench [count] [destination] */
+    else if(argc <= 4 && strcmp(argv[1], benchCommand) == 0) {
+        uchar_t destination[4] = { 10, 0, 0, 1 };
+        int lookups = argc > 2 ? atoi(argv[2]) : DEFAULT_LOOKUPS;
+
+        if(lookups <= 0 || (argc > 3 && !Parse_IP(argv[3], destination))) {
+            Print("Usage: %s bench [count] [destination]\n", argv[0]);
+            return 1;
+        }
+        return Route_Bench(lookups, destination);
+    }
+
     else if(argc > 2) {
         /* Add a route to the table */
         if(strcmp(argv[1], addCommand) == 0 && !(argc & 1)) {
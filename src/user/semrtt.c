@@ -0,0 +1,109 @@
+/*
+ * semrtt - Semaphore ping-pong latency
+ *
+ * Usage: semrtt.exe [-s | -x] [rounds]
+ *
+ * Bounces control between this process and a child it spawns through
+ * a pair of semaphores, rounds times (default 10000), and reports
+ * round trips per second.  -s pins both processes to CPU 0, where V
+ * can switch straight to the woken process; -x pins them to CPUs 0
+ * and 1, so every wakeup crosses CPUs.
+ */
+
+#include <conio.h>
+#include <process.h>
+#include <sched.h>
+#include <sema.h>
+#include <string.h>
+
+#define DEFAULT_ROUNDS 10000
+
+static int Open_Pair(int parent, int *ping, int *pong) {
+    char name[32];
+
+    snprintf(name, sizeof(name), "rtt-ping-%d", parent);
+    *ping = Open_Semaphore(name, 0);
+    snprintf(name, sizeof(name), "rtt-pong-%d", parent);
+    *pong = Open_Semaphore(name, 0);
+    if(*ping < 0 || *pong < 0) {
+        Print("Open_Semaphore failed: %d %d\n", *ping, *pong);
+        return -1;
+    }
+    return 0;
+}
+
+/* the child: answer every ping with a pong */
+static int Pong(int parent, int rounds, int cpu) {
+    int ping, pong, i;
+
+    if(cpu >= 0)
+        Set_Affinity(0, cpu);
+    if(Open_Pair(parent, &ping, &pong) != 0)
+        return 1;
+    for(i = 0; i < rounds; ++i) {
+        P(ping);
+        V(pong);
+    }
+    Close_Semaphore(ping);
+    Close_Semaphore(pong);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    char command[64];
+    int rounds = DEFAULT_ROUNDS, pingCPU = -1, pongCPU = -1;
+    int ping, pong, child, start, elapsed, i, arg = 1;
+
+    if(argc == 5 && !strcmp(argv[1], "-pong"))
+        return Pong(atoi(argv[2]), atoi(argv[3]), atoi(argv[4]));
+
+    if(arg < argc && !strcmp(argv[arg], "-s")) {
+        pingCPU = pongCPU = 0;
+        ++arg;
+    } else if(arg < argc && !strcmp(argv[arg], "-x")) {
+        pingCPU = 0;
+        pongCPU = 1;
+        ++arg;
+    }
+    if(arg < argc)
+        rounds = atoi(argv[arg++]);
+    if(rounds < 2 || arg < argc) {
+        Print("Usage: %s [-s | -x] [rounds]\n", argv[0]);
+        return 1;
+    }
+
+    if(pingCPU >= 0 && Set_Affinity(0, pingCPU) != 0)
+        return 1;
+    if(Open_Pair(Get_PID(), &ping, &pong) != 0)
+        return 1;
+
+    snprintf(command, sizeof(command), "semrtt.exe -pong %d %d %d",
+             Get_PID(), rounds, pongCPU);
+    child = Spawn_Program("/c/semrtt.exe", command, 1);
+    if(child < 0) {
+        Print("Could not spawn the pong process: %d\n", child);
+        return 1;
+    }
+
+    /* one round trip to be sure the child is up before timing */
+    V(ping);
+    P(pong);
+
+    start = Get_Time_Of_Day();
+    for(i = 1; i < rounds; ++i) {
+        V(ping);
+        P(pong);
+    }
+    elapsed = Get_Time_Of_Day() - start;
+    Wait(child);
+
+    Close_Semaphore(ping);
+    Close_Semaphore(pong);
+
+    if(elapsed <= 0)
+        elapsed = 1;
+    Print("%d round trips in %d ms: %d round trips/sec, %d us each\n",
+          rounds - 1, elapsed, (rounds - 1) * 1000 / elapsed,
+          elapsed * 1000 / (rounds - 1));
+    return 0;
+}
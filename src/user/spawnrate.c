@@ -0,0 +1,70 @@
+/*
+ * spawnrate - Measure process spawn/exit throughput
+ *
+ * Usage: spawnrate.exe [count]
+ *
+ * Creates count short-lived processes one after another, waiting for
+ * each to exit, and reports how many were created per second.  Uses
+ * Fork() as in forkexec.c when the kernel supports it, and otherwise
+ * respawns this program with the "child" argument.
+ */
+
+#include <conio.h>
+#include <process.h>
+#include <sched.h>
+#include <string.h>
+#include <geekos/errno.h>
+
+#define DEFAULT_COUNT 200
+
+static int Spawn_One(int useFork) {
+    int pid;
+
+    if(useFork) {
+        pid = Fork();
+        if(pid == 0)
+            Exit(0);
+    } else {
+        pid = Spawn_Program("/c/spawnrate.exe", "spawnrate.exe child", 0);
+    }
+    return pid;
+}
+
+int main(int argc, char **argv) {
+    int count = DEFAULT_COUNT;
+    int useFork = 1;
+    int i, pid, start, elapsed;
+
+    if(argc > 1 && !strcmp(argv[1], "child"))
+        return 0;
+    if(argc > 1)
+        count = atoi(argv[1]);
+    if(count <= 0) {
+        Print("Usage: %s [count]\n", argv[0]);
+        return 1;
+    }
+
+    start = Get_Time_Of_Day();
+    for(i = 0; i < count; i++) {
+        pid = Spawn_One(useFork);
+        if(pid == EUNSUPPORTED && useFork) {
+            useFork = 0;
+            pid = Spawn_One(useFork);
+        }
+        if(pid < 0) {
+            Print("spawn %d failed: %s (%d)\n", i, Get_Error_String(pid),
+                  pid);
+            return 1;
+        }
+        Wait(pid);
+    }
+    elapsed = Get_Time_Of_Day() - start;
+
+    Print("%d processes (%s) in %d ticks", count,
+          useFork ? "Fork" : "Spawn", elapsed);
+    if(elapsed > 0)
+        Print(": %d created/sec", count * TICKS_PER_SEC / elapsed);
+    Print("\n");
+
+    return 0;
+}
@@ -0,0 +1,118 @@
+/*
+ * tcpbench - Measure TCP bulk transfer throughput
+ *
+ * Usage: tcpbench.exe server [port] [receive buffer]
+ *        tcpbench.exe client <ip address> [KB] [port] [send buffer]
+ *
+ * Run the server on one GeekOS instance and the client on another
+ * (build/tcp.sh starts two joined by a QEMU socket netdev).  The
+ * client sends KB kilobytes as fast as the connection takes them and
+ * closes; both sides report what they moved per second.  Buffer sizes
+ * of 0 use the kernel default.
+ */
+
+#include <socket.h>
+#include <conio.h>
+#include <string.h>
+#include <sched.h>
+#include <ip.h>
+
+#define DEFAULT_PORT 5001
+#define DEFAULT_KB 4096
+#define CHUNK_SIZE 8192
+
+static char s_buffer[CHUNK_SIZE];
+
+static void Report(const char *what, int bytes, int elapsed) {
+    Print("%s %d KB in %d ticks", what, bytes / 1024, elapsed);
+    if(elapsed > 0)
+        Print(": %d KB/sec", bytes / 1024 * TICKS_PER_SEC / elapsed);
+    Print("\n");
+}
+
+static int Server(int port, int receiveBuffer) {
+    uchar_t clientAddress[4];
+    ushort_t clientPort;
+    int fd, client, rc, bytes = 0, start;
+
+    fd = Socket_With_Buffers(SOCK_STREAM, 0, 0, receiveBuffer);
+    if(fd < 0) {
+        Print("Could not create socket\n");
+        return fd;
+    }
+    rc = Bind(fd, port, INADDR_ANY);
+    if(rc == 0)
+        rc = Listen(fd, 1);
+    if(rc != 0) {
+        Print("Could not listen on port %d\n", port);
+        return rc;
+    }
+
+    Print("Waiting on port %d\n", port);
+    client = Accept(fd, &clientPort, clientAddress);
+    if(client < 0) {
+        Print("Could not accept the connection\n");
+        return client;
+    }
+    Print("Connection from %d.%d.%d.%d:%d\n", clientAddress[0],
+          clientAddress[1], clientAddress[2], clientAddress[3], clientPort);
+
+    start = Get_Time_Of_Day();
+    while ((rc = Receive(client, s_buffer, CHUNK_SIZE)) > 0)
+        bytes += rc;
+    Report("received", bytes, Get_Time_Of_Day() - start);
+
+    Close_Socket(client);
+    Close_Socket(fd);
+    return rc < 0 ? rc : 0;
+}
+
+static int Client(uchar_t * address, int kilobytes, int port,
+                  int sendBuffer) {
+    int fd, rc, sent, bytes = kilobytes * 1024, start;
+
+    fd = Socket_With_Buffers(SOCK_STREAM, 0, sendBuffer, 0);
+    if(fd < 0) {
+        Print("Could not create socket\n");
+        return fd;
+    }
+    rc = Connect(fd, port, address);
+    if(rc != 0) {
+        Print("Could not connect to %d.%d.%d.%d:%d\n", address[0],
+              address[1], address[2], address[3], port);
+        return rc;
+    }
+
+    memset(s_buffer, 'x', CHUNK_SIZE);
+    start = Get_Time_Of_Day();
+    for(sent = 0; sent < bytes; sent += rc) {
+        rc = Send(fd, s_buffer, MIN(CHUNK_SIZE, bytes - sent));
+        if(rc <= 0) {
+            Print("Send failed after %d bytes: %d\n", sent, rc);
+            break;
+        }
+    }
+    Report("sent", sent, Get_Time_Of_Day() - start);
+
+    Close_Socket(fd);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    uchar_t address[4];
+
+    if(argc > 1 && !strcmp(argv[1], "server"))
+        return Server(argc > 2 ? atoi(argv[2]) : DEFAULT_PORT,
+                      argc > 3 ? atoi(argv[3]) : 0);
+
+    if(argc > 2 && !strcmp(argv[1], "client") &&
+       Parse_IP(argv[2], address))
+        return Client(address, argc > 3 ? atoi(argv[3]) : DEFAULT_KB,
+                      argc > 4 ? atoi(argv[4]) : DEFAULT_PORT,
+                      argc > 5 ? atoi(argv[5]) : 0);
+
+    Print("Usage: %s server [port] [receive buffer]\n", argv[0]);
+    Print("       %s client <ip address> [KB] [port] [send buffer]\n",
+          argv[0]);
+    return 1;
+}
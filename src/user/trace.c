@@ -0,0 +1,145 @@
+/*
+ * trace - Record kernel tracepoints for timeline analysis
+ *
+ * Usage: trace.exe start [sched] [syscall] [block] [irq] [mutex]
+ *        trace.exe stop <file>
+ *        trace.exe print <file>
+ *
+ * "start" begins recording the named groups of events (all of them if
+ * none are named); "stop" ends it and writes every buffered record to
+ * file as an array of struct Trace_Record, one CPU's records after
+ * another, each in time order.  "print" lists such a file as a
+ * timeline, times in units of 1024 TSC cycles since the first record
+ * on the same CPU.
+ */
+
+#include <conio.h>
+#include <fileio.h>
+#include <string.h>
+#include <trace.h>
+
+#define READ_BATCH 128
+
+static struct Trace_Record s_batch[READ_BATCH];
+
+static const struct {
+    const char *name;
+    unsigned int mask;
+} s_groups[] = {
+    {"sched", TRACE_EVENT_BIT(TRACE_SCHED_SWITCH)},
+    {"syscall", TRACE_EVENT_BIT(TRACE_SYSCALL_ENTER) |
+     TRACE_EVENT_BIT(TRACE_SYSCALL_EXIT)},
+    {"block", TRACE_EVENT_BIT(TRACE_BLOCK_POST) |
+     TRACE_EVENT_BIT(TRACE_BLOCK_COMPLETE)},
+    {"irq", TRACE_EVENT_BIT(TRACE_IRQ_ENTER) |
+     TRACE_EVENT_BIT(TRACE_IRQ_EXIT)},
+    {"mutex", TRACE_EVENT_BIT(TRACE_MUTEX_CONTEND) |
+     TRACE_EVENT_BIT(TRACE_MUTEX_ACQUIRE)},
+};
+
+#define NUM_GROUPS (sizeof(s_groups) / sizeof(s_groups[0]))
+
+static const char *s_eventNames[TRACE_NUM_EVENTS] = {
+    "?", "switch", "syscall", "sysret", "blkpost", "blkdone",
+    "irq", "irqret", "contend", "acquire",
+};
+
+static int Start(int argc, char **argv) {
+    unsigned int mask = 0, g;
+    int i, rc;
+
+    for(i = 2; i < argc; ++i) {
+        for(g = 0; g < NUM_GROUPS && strcmp(argv[i], s_groups[g].name);
+            ++g) ;
+        if(g == NUM_GROUPS) {
+            Print("Unknown event group %s\n", argv[i]);
+            return 1;
+        }
+        mask |= s_groups[g].mask;
+    }
+
+    rc = Trace_Start(mask != 0 ? mask : TRACE_ALL_EVENTS);
+    if(rc != 0) {
+        Print("Could not start tracing: %d\n", rc);
+        return 1;
+    }
+    return 0;
+}
+
+static int Stop(const char *path) {
+    int fd, rc, dropped, total = 0;
+
+    dropped = Trace_Stop();
+    if(dropped < 0) {
+        Print("Could not stop tracing: %d\n", dropped);
+        return 1;
+    }
+
+    fd = Open(path, O_CREATE | O_WRITE);
+    if(fd < 0) {
+        Print("Could not open %s: %d\n", path, fd);
+        return 1;
+    }
+    while ((rc = Trace_Read(s_batch, READ_BATCH)) > 0) {
+        if(Write(fd, s_batch, rc * sizeof(struct Trace_Record)) !=
+           (int)(rc * sizeof(struct Trace_Record))) {
+            Print("Could not write %s\n", path);
+            rc = -1;
+            break;
+        }
+        total += rc;
+    }
+    Close(fd);
+    if(rc < 0)
+        return 1;
+
+    Print("%d records written to %s, %d dropped\n", total, path, dropped);
+    return 0;
+}
+
+static int Print_Trace(const char *path) {
+    unsigned long long start[256];
+    unsigned char seen[256];
+    struct Trace_Record *record;
+    int fd, rc, i;
+
+    fd = Open(path, O_READ);
+    if(fd < 0) {
+        Print("Could not open %s: %d\n", path, fd);
+        return 1;
+    }
+
+    memset(seen, 0, sizeof(seen));
+    while ((rc = Read(fd, s_batch, sizeof(s_batch))) > 0) {
+        for(i = 0; i < rc / (int)sizeof(struct Trace_Record); ++i) {
+            record = &s_batch[i];
+            if(!seen[record->cpu]) {
+                seen[record->cpu] = 1;
+                start[record->cpu] = record->tsc;
+            }
+            Print("%10lu cpu %d pid %3d %-8s %lx %lx %lx %lx\n",
+                  (unsigned long)((record->tsc - start[record->cpu]) >> 10),
+                  record->cpu, record->pid,
+                  record->event < TRACE_NUM_EVENTS ?
+                  s_eventNames[record->event] : "?", record->args[0],
+                  record->args[1], record->args[2], record->args[3]);
+        }
+    }
+    Close(fd);
+    return rc < 0 ? 1 : 0;
+}
+
+int main(int argc, char **argv) {
+    if(argc >= 2 && !strcmp(argv[1], "start"))
+        return Start(argc, argv);
+    if(argc == 3 && !strcmp(argv[1], "stop"))
+        return Stop(argv[2]);
+    if(argc == 3 && !strcmp(argv[1], "print"))
+        return Print_Trace(argv[2]);
+
+    Print("Usage: %s start [sched] [syscall] [block] [irq] [mutex]\n",
+          argv[0]);
+    Print("       %s stop <file>\n", argv[0]);
+    Print("       %s print <file>\n", argv[0]);
+    return 1;
+}